@@ -0,0 +1,199 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "ChunkPool.h"
+#include "ChunkQueue.h"
+#include "EncryptionManager.h"
+#include "TcpSocket.h"
+#include "TransferManager.h"
+#include "TransferRequest.h"
+#include "WorkerContext.h"
+#include "crypto.h"
+#include "utils.h"
+
+/*
+Sweeps the chunk size from 8 KiB (the old fixed size) up to MAX_CHUNK_SIZE and
+reports throughput of the sender and receiver pipelines, minus file I/O:
+
+    producer -> encrypt -> send_chunks  ==loopback TCP==>
+        receive_chunks -> decrypt -> consumer
+
+The same amount of data is sent at every size, so the differences come from
+the per-chunk costs (frame header, MAC, queue hops, socket writes). The CPU
+time of both ends is reported per GB, and comparing a run with --zero-copy
+against one without shows what MSG_ZEROCOPY saves on sending.
+
+usage: chunk_size_benchmark [megabytes] [--zero-copy]
+*/
+
+namespace {
+
+struct TransferResult {
+  double seconds;
+  double cpu_seconds;
+  SendStats send_stats;
+};
+
+TransferResult run_transfer(uint16_t port, const crypto::Key &key,
+                            uint64_t transfer_size, uint32_t chunk_size,
+                            bool zero_copy) {
+  const uint32_t num_chunks =
+      static_cast<uint32_t>((transfer_size + chunk_size - 1) / chunk_size);
+  const uint32_t final_chunk_size =
+      static_cast<uint32_t>(transfer_size % chunk_size);
+  const std::size_t queue_capacity = chunk_queue_capacity(chunk_size);
+  const std::size_t pooled_chunks = 2 * queue_capacity + 8;
+
+  crypto::Encryptor encryptor(key);
+  crypto::Decryptor decryptor(key, encryptor.header());
+
+  // The listener is open before connecting, so the connection waits in its
+  // backlog until accepted
+  TcpListener listener(port);
+  TcpSocket receiver_socket;
+  TcpSocket sender_socket;
+  sender_socket.connect("127.0.0.1", port);
+  listener.accept(receiver_socket);
+
+  ChunkPool send_pool(chunk_size + crypto::ENCRYPTION_ADDITIONAL_BYTES,
+                      CHUNK_HEADROOM, CHUNK_TAILROOM, pooled_chunks);
+  ChunkPool receive_pool(chunk_size + crypto::ENCRYPTION_ADDITIONAL_BYTES,
+                         CHUNK_HEADROOM, CHUNK_TAILROOM, pooled_chunks);
+  ChunkQueue plain_queue(queue_capacity);
+  ChunkQueue encrypted_queue(queue_capacity);
+  ChunkQueue received_queue(queue_capacity);
+  ChunkQueue decrypted_queue(queue_capacity);
+
+  WorkerContext ctx;
+  ctx.on_abort([&]() {
+    plain_queue.cancel();
+    encrypted_queue.cancel();
+    received_queue.cancel();
+    decrypted_queue.cancel();
+  });
+
+  EncryptionManager chunk_encryptor(chunk_size, final_chunk_size, num_chunks,
+                                    std::move(encryptor));
+  EncryptionManager chunk_decryptor(chunk_size, final_chunk_size, num_chunks,
+                                    std::move(decryptor));
+  // Every batch is sent with MSG_ZEROCOPY when enabled
+  TransferManager transfer_manager(FrameBatchLimits(), zero_copy ? 1 : 0);
+  std::atomic<uint32_t> chunks_sent(0);
+
+  auto run_stage = [&ctx](auto stage) {
+    return std::thread([&ctx, stage]() {
+      try {
+        stage();
+      } catch (...) {
+        ctx.handle_exception();
+      }
+    });
+  };
+
+  auto start_time = std::chrono::steady_clock::now();
+  const std::clock_t start_cpu_time = std::clock();
+
+  std::thread producer = run_stage([&]() {
+    for (uint32_t i = 1; i <= num_chunks; ++i) {
+      ChunkPtr chunk_ptr = send_pool.acquire(i);
+      chunk_ptr->resize(i == num_chunks && final_chunk_size != 0
+                            ? final_chunk_size
+                            : chunk_size);
+      std::memset(chunk_ptr->data(), static_cast<int>(i), chunk_ptr->size());
+      if (!plain_queue.push(std::move(chunk_ptr))) {
+        return;
+      }
+    }
+    plain_queue.close();
+  });
+  std::thread encryption_thread = run_stage([&]() {
+    chunk_encryptor.encrypt_chunks(ctx, plain_queue, encrypted_queue);
+  });
+  std::thread transmission_thread = run_stage([&]() {
+    transfer_manager.send_chunks(ctx, sender_socket, encrypted_queue,
+                                 chunks_sent);
+  });
+  std::thread receiver_thread = run_stage([&]() {
+    transfer_manager.receive_chunks(ctx, receiver_socket, receive_pool,
+                                    received_queue, num_chunks);
+  });
+  std::thread decryption_thread = run_stage([&]() {
+    chunk_decryptor.decrypt_chunks(ctx, received_queue, decrypted_queue);
+  });
+
+  uint64_t bytes_received = 0;
+  while (auto chunk_ptr_opt = decrypted_queue.pop()) {
+    bytes_received += (*chunk_ptr_opt)->size();
+  }
+
+  producer.join();
+  encryption_thread.join();
+  transmission_thread.join();
+  receiver_thread.join();
+  decryption_thread.join();
+  ctx.rethrow_if_exception();
+
+  auto end_time = std::chrono::steady_clock::now();
+  if (bytes_received != transfer_size) {
+    std::cerr << "Received " << bytes_received << " of " << transfer_size
+              << " bytes" << std::endl;
+    std::exit(1);
+  }
+  return {std::chrono::duration<double>(end_time - start_time).count(),
+          static_cast<double>(std::clock() - start_cpu_time) / CLOCKS_PER_SEC,
+          transfer_manager.send_stats()};
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[]) {
+  uint64_t megabytes = 512;
+  bool zero_copy = false;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--zero-copy") == 0) {
+      zero_copy = true;
+    } else {
+      megabytes = std::stoull(argv[i]);
+    }
+  }
+  const uint64_t transfer_size = megabytes * 1024 * 1024;
+
+  crypto::init_sodium();
+  crypto::Salt salt;
+  crypto::Key key("benchmark", salt);
+
+  uint16_t port = utils::generate_random_port();
+  while (!utils::local_port_available(port)) {
+    port = utils::generate_random_port();
+  }
+
+  std::cout << "Sending " << megabytes << " MiB over loopback per chunk size"
+            << (zero_copy ? " with MSG_ZEROCOPY" : "") << std::endl;
+  for (uint32_t chunk_size = 8 * 1024; chunk_size <= MAX_CHUNK_SIZE;
+       chunk_size *= 2) {
+    TransferResult result =
+        run_transfer(port, key, transfer_size, chunk_size, zero_copy);
+    const double seconds = result.seconds;
+    const SendStats &stats = result.send_stats;
+    const uint64_t num_chunks = (transfer_size + chunk_size - 1) / chunk_size;
+    std::cout << std::setw(6) << chunk_size / 1024 << " KiB  " << std::setw(8)
+              << num_chunks << " chunks  " << std::fixed
+              << std::setprecision(3) << std::setw(8) << seconds << " s  "
+              << std::setprecision(1) << std::setw(9)
+              << transfer_size / 1e6 / seconds << " MB/s  " << std::setw(8)
+              << result.cpu_seconds * 1e3 / (transfer_size / 1e9)
+              << " CPU ms/GB";
+    if (stats.zero_copy_calls > 0) {
+      std::cout << "  (" << stats.zero_copy_copied_calls << "/"
+                << stats.zero_copy_calls << " copied by the kernel)";
+    }
+    std::cout << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,148 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ChunkPool.h"
+#include "ChunkQueue.h"
+#include "EncryptionManager.h"
+#include "TransferManager.h"
+#include "TransferRequest.h"
+#include "WorkerContext.h"
+#include "crypto.h"
+
+/*
+Compares the secretstream path (one encryption and one decryption thread)
+against independently sealed chunks with N encryption and N decryption
+workers. Chunks run through producer -> encrypt -> decrypt -> consumer with
+the same queue capacity as Sender/Receiver, and the consumer checks order and
+contents.
+
+usage: crypto_benchmark [num_chunks] [chunk_size]
+*/
+
+namespace {
+
+double run_pipeline(EncryptionManager &encryptor, EncryptionManager &decryptor,
+                    uint64_t num_chunks, uint32_t chunk_size,
+                    std::size_t num_workers) {
+  const std::size_t queue_capacity = chunk_queue_capacity(chunk_size);
+  ChunkPool chunk_pool(chunk_size + crypto::ENCRYPTION_ADDITIONAL_BYTES,
+                       CHUNK_HEADROOM, CHUNK_TAILROOM,
+                       3 * queue_capacity + 8 + 6 * num_workers);
+  ChunkQueue plain_queue(queue_capacity);
+  ChunkQueue encrypted_queue(queue_capacity);
+  ChunkQueue decrypted_queue(queue_capacity);
+
+  WorkerContext ctx;
+  ctx.on_abort([&]() {
+    plain_queue.cancel();
+    encrypted_queue.cancel();
+    decrypted_queue.cancel();
+  });
+
+  auto start_time = std::chrono::steady_clock::now();
+
+  std::thread producer([&]() {
+    for (uint64_t i = 1; i <= num_chunks; ++i) {
+      ChunkPtr chunk_ptr = chunk_pool.acquire(i);
+      chunk_ptr->resize(chunk_size);
+      std::memset(chunk_ptr->data(), static_cast<int>(i), chunk_size);
+      plain_queue.push(std::move(chunk_ptr));
+    }
+    plain_queue.close();
+  });
+
+  auto run_stage = [&](auto stage) {
+    return std::thread([&ctx, stage]() {
+      try {
+        stage();
+      } catch (...) {
+        ctx.handle_exception();
+      }
+    });
+  };
+  std::thread encryption_thread = run_stage([&]() {
+    encryptor.encrypt_chunks(ctx, plain_queue, encrypted_queue);
+  });
+  std::thread decryption_thread = run_stage([&]() {
+    decryptor.decrypt_chunks(ctx, encrypted_queue, decrypted_queue);
+  });
+
+  uint64_t expected_sequence_num = 1;
+  while (auto chunk_ptr_opt = decrypted_queue.pop()) {
+    const Chunk &chunk = **chunk_ptr_opt;
+    if (chunk.sequence_num() != expected_sequence_num ||
+        chunk.size() != chunk_size ||
+        chunk.data()[chunk_size - 1] !=
+            static_cast<uint8_t>(expected_sequence_num)) {
+      std::cerr << "Chunk " << expected_sequence_num << " came back wrong"
+                << std::endl;
+      std::exit(1);
+    }
+    ++expected_sequence_num;
+  }
+
+  producer.join();
+  encryption_thread.join();
+  decryption_thread.join();
+  ctx.rethrow_if_exception();
+
+  auto end_time = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(end_time - start_time).count();
+}
+
+void report(const std::string &name, uint64_t num_chunks, uint32_t chunk_size,
+            double seconds) {
+  const double megabytes = static_cast<double>(num_chunks) * chunk_size / 1e6;
+  std::cout << std::left << std::setw(22) << name << std::right << std::fixed
+            << std::setprecision(3) << std::setw(9) << seconds << " s  "
+            << std::setprecision(1) << std::setw(9) << megabytes / seconds
+            << " MB/s" << std::endl;
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[]) {
+  uint64_t num_chunks = argc > 1 ? std::stoull(argv[1]) : 4'000;
+  uint32_t chunk_size = argc > 2 ? std::stoul(argv[2]) : MIN_CHUNK_SIZE;
+
+  crypto::init_sodium();
+  crypto::Salt salt;
+  crypto::Key key("benchmark", salt);
+
+  std::cout << "Encrypting and decrypting " << num_chunks << " chunks of "
+            << chunk_size << " bytes" << std::endl;
+
+  {
+    crypto::Encryptor stream_encryptor(key);
+    crypto::Decryptor stream_decryptor(key, stream_encryptor.header());
+    EncryptionManager encryptor(chunk_size, chunk_size, num_chunks,
+                                std::move(stream_encryptor));
+    EncryptionManager decryptor(chunk_size, chunk_size, num_chunks,
+                                std::move(stream_decryptor));
+    report("secretstream", num_chunks, chunk_size,
+           run_pipeline(encryptor, decryptor, num_chunks, chunk_size, 1));
+  }
+
+  const std::size_t max_workers =
+      std::max(1u, std::thread::hardware_concurrency());
+  const auto session_id = crypto::ChunkCipher::generate_session_id();
+  for (std::size_t num_workers = 1; num_workers <= max_workers;
+       num_workers *= 2) {
+    EncryptionManager encryptor(chunk_size, chunk_size, num_chunks,
+                                crypto::ChunkCipher(key, session_id),
+                                num_workers);
+    EncryptionManager decryptor(chunk_size, chunk_size, num_chunks,
+                                crypto::ChunkCipher(key, session_id),
+                                num_workers);
+    report("chunked x" + std::to_string(num_workers), num_chunks, chunk_size,
+           run_pipeline(encryptor, decryptor, num_chunks, chunk_size,
+                        num_workers));
+  }
+  return 0;
+}
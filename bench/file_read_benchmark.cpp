@@ -0,0 +1,212 @@
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "ChunkPool.h"
+#include "ChunkQueue.h"
+#include "FileManager.h"
+#include "TransferRequest.h"
+#include "UringFileIo.h"
+#include "WorkerContext.h"
+
+/*
+Compares the ways FileManager reads files into chunks, std::ifstream reads,
+copies from a MappedFile, drop-behind and O_DIRECT reads by an
+UncachedFileReader and, when built with TRIT_WITH_IO_URING, reads kept in
+flight by UringFileIo, on one large file and on many small files packed
+together into chunks:
+
+    read_files_into_chunks -> consumer
+
+Each is run with the files evicted from the page cache (cold, on Linux, with
+posix_fadvise) and again once they are cached (warm), which is where the
+per-read overhead of the stream shows. The CPU time of the reader is
+reported per GB, along with how much of the files the page cache holds
+after the cold run.
+
+usage: file_read_benchmark [megabytes]
+*/
+
+namespace {
+
+constexpr uint64_t SMALL_FILE_SIZE = 32 * 1024;
+
+struct ReadResult {
+  double seconds;
+  double cpu_seconds;
+};
+
+void write_random_file(const std::filesystem::path &path, uint64_t size) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  std::vector<char> buffer(1024 * 1024);
+  uint32_t state = static_cast<uint32_t>(size) | 1;
+  for (char &byte : buffer) {
+    state = state * 1664525 + 1013904223;
+    byte = static_cast<char>(state >> 24);
+  }
+  while (size > 0) {
+    const uint64_t count = std::min<uint64_t>(size, buffer.size());
+    file.write(buffer.data(), static_cast<std::streamsize>(count));
+    size -= count;
+  }
+}
+
+// Flushes the files and drops them from the page cache. Returns false where
+// the platform cannot
+bool evict_from_page_cache(const TransferRequest &transfer_request) {
+#ifdef __linux__
+  for (const auto &file_info : transfer_request.get_file_infos()) {
+    const int fd = ::open(file_info.relative_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    ::fdatasync(fd);
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+  }
+  return true;
+#else
+  (void)transfer_request;
+  return false;
+#endif
+}
+
+ReadResult run_read(const TransferRequest &transfer_request,
+                    FileReadMode read_mode) {
+  const uint32_t chunk_size = transfer_request.get_chunk_size();
+  const std::size_t queue_capacity = chunk_queue_capacity(chunk_size);
+  ChunkPool chunk_pool(chunk_size, 0, 0, queue_capacity + STAGE_HELD_CHUNKS);
+  ChunkQueue chunk_queue(queue_capacity);
+
+  WorkerContext ctx;
+  ctx.on_abort([&]() { chunk_queue.cancel(); });
+
+  auto start_time = std::chrono::steady_clock::now();
+  const std::clock_t start_cpu_time = std::clock();
+
+  FileManager file_manager;
+  std::thread reader([&]() {
+    try {
+      file_manager.read_files_into_chunks(ctx, transfer_request, chunk_pool,
+                                          chunk_queue, read_mode);
+    } catch (...) {
+      ctx.handle_exception();
+    }
+  });
+
+  uint64_t bytes_read = 0;
+  while (auto chunk_ptr_opt = chunk_queue.pop()) {
+    bytes_read += (*chunk_ptr_opt)->size();
+  }
+  reader.join();
+  ctx.rethrow_if_exception();
+
+  auto end_time = std::chrono::steady_clock::now();
+  if (bytes_read != transfer_request.get_transfer_size()) {
+    std::cerr << "Read " << bytes_read << " of "
+              << transfer_request.get_transfer_size() << " bytes"
+              << std::endl;
+    std::exit(1);
+  }
+  return {std::chrono::duration<double>(end_time - start_time).count(),
+          static_cast<double>(std::clock() - start_cpu_time) / CLOCKS_PER_SEC};
+}
+
+void report(const std::string &label, const TransferRequest &transfer_request,
+            const ReadResult &result, bool footprint = false) {
+  const double transfer_size =
+      static_cast<double>(transfer_request.get_transfer_size());
+  std::cout << "  " << std::left << std::setw(17) << label << std::right
+            << std::fixed << std::setprecision(3) << std::setw(8)
+            << result.seconds << " s  " << std::setprecision(1)
+            << std::setw(9) << transfer_size / 1e6 / result.seconds
+            << " MB/s  " << std::setw(8)
+            << result.cpu_seconds * 1e3 / (transfer_size / 1e9)
+            << " CPU ms/GB";
+  std::optional<uint64_t> cached_bytes;
+  if (footprint) {
+    cached_bytes = FileManager::page_cache_footprint(transfer_request);
+  }
+  if (cached_bytes) {
+    std::cout << "  " << std::setw(5)
+              << static_cast<double>(*cached_bytes) * 100 / transfer_size
+              << "% cached";
+  }
+  std::cout << std::endl;
+}
+
+void compare(const std::string &name,
+             const std::unordered_set<std::filesystem::path> &file_paths) {
+  TransferRequest transfer_request =
+      TransferRequest::from_file_paths(file_paths);
+  std::cout << name << ": " << file_paths.size()
+            << " files, " << transfer_request.get_transfer_size() / 1024 / 1024
+            << " MiB in " << transfer_request.get_chunk_size() / 1024
+            << " KiB chunks" << std::endl;
+
+  std::vector<std::pair<const char *, FileReadMode>> modes = {
+      {"ifstream", FileReadMode::STREAM},
+      {"mmap", FileReadMode::MAPPED},
+      {"drop-behind", FileReadMode::DROP_BEHIND},
+      {"direct", FileReadMode::DIRECT}};
+  if (UringFileIo::supported()) {
+    modes.emplace_back("io_uring", FileReadMode::URING);
+  }
+  for (const auto &[mode_name, read_mode] : modes) {
+    if (evict_from_page_cache(transfer_request)) {
+      report(std::string(mode_name) + " cold", transfer_request,
+             run_read(transfer_request, read_mode), true);
+    }
+    run_read(transfer_request, read_mode);
+    report(std::string(mode_name) + " warm", transfer_request,
+           run_read(transfer_request, read_mode));
+  }
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[]) {
+  const uint64_t megabytes = argc > 1 ? std::stoull(argv[1]) : 1024;
+  const uint64_t size = megabytes * 1024 * 1024;
+
+  const std::filesystem::path directory =
+      std::filesystem::temp_directory_path() / "trit_file_read_benchmark";
+  std::filesystem::remove_all(directory);
+  std::filesystem::create_directories(directory / "small");
+  std::filesystem::current_path(directory);
+
+  std::unordered_set<std::filesystem::path> large_files = {
+      directory / "large.bin"};
+  write_random_file(directory / "large.bin", size);
+
+  // A quarter of the data, in files smaller than a chunk
+  std::unordered_set<std::filesystem::path> small_files;
+  for (uint64_t i = 0; i < size / 4 / SMALL_FILE_SIZE; ++i) {
+    const std::filesystem::path path =
+        directory / "small" / (std::to_string(i) + ".bin");
+    write_random_file(path, SMALL_FILE_SIZE);
+    small_files.insert(path);
+  }
+
+  compare("Large file", large_files);
+  compare("Small files", small_files);
+
+  std::filesystem::current_path(directory.parent_path());
+  std::filesystem::remove_all(directory);
+  return 0;
+}
@@ -0,0 +1,86 @@
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "BoundedThreadSafeQueue.h"
+#include "Chunk.h"
+#include "ChunkPool.h"
+#include "SpscRingQueue.h"
+
+/*
+Compares chunk handoff throughput of BoundedThreadSafeQueue and SpscRingQueue
+on a three stage pipeline shaped like Sender::send_files
+(reader -> encryptor -> transmitter), with the same queue capacity.
+
+usage: queue_benchmark [num_chunks]
+*/
+
+namespace {
+
+constexpr size_t QUEUE_CAPACITY = 50;
+
+template <typename Queue> double run_pipeline(uint64_t num_chunks) {
+  ChunkPool chunk_pool(0, 0, 0, 2 * QUEUE_CAPACITY + 8);
+  Queue first_hop(QUEUE_CAPACITY);
+  Queue second_hop(QUEUE_CAPACITY);
+
+  auto start_time = std::chrono::steady_clock::now();
+
+  std::thread producer([&]() {
+    for (uint64_t i = 1; i <= num_chunks; ++i) {
+      first_hop.push(chunk_pool.acquire(i));
+    }
+    first_hop.close();
+  });
+
+  std::thread relay([&]() {
+    while (auto chunk_ptr_opt = first_hop.pop()) {
+      second_hop.push(std::move(*chunk_ptr_opt));
+    }
+    second_hop.close();
+  });
+
+  uint64_t expected_sequence_num = 1;
+  std::thread consumer([&]() {
+    while (auto chunk_ptr_opt = second_hop.pop()) {
+      if ((*chunk_ptr_opt)->sequence_num() != expected_sequence_num++) {
+        std::cerr << "Chunk received out of order" << std::endl;
+        std::exit(1);
+      }
+    }
+  });
+
+  producer.join();
+  relay.join();
+  consumer.join();
+
+  auto end_time = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(end_time - start_time).count();
+}
+
+void report(const std::string &name, uint64_t num_chunks, double seconds) {
+  std::cout << std::left << std::setw(26) << name << std::right << std::fixed
+            << std::setprecision(3) << std::setw(9) << seconds << " s  "
+            << std::setprecision(0) << std::setw(12) << num_chunks / seconds
+            << " chunks/s  " << std::setprecision(1) << std::setw(8)
+            << seconds * 1e9 / num_chunks << " ns/chunk" << std::endl;
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[]) {
+  uint64_t num_chunks = argc > 1 ? std::stoull(argv[1]) : 2'000'000;
+
+  std::cout << "Handing off " << num_chunks << " chunks across 2 hops (queue "
+            << "capacity " << QUEUE_CAPACITY << ")" << std::endl;
+
+  report("BoundedThreadSafeQueue", num_chunks,
+         run_pipeline<BoundedThreadSafeQueue<ChunkPtr>>(num_chunks));
+  report("SpscRingQueue", num_chunks,
+         run_pipeline<SpscRingQueue<ChunkPtr>>(num_chunks));
+  return 0;
+}
@@ -1,12 +1,17 @@
 #ifndef BOUNDED_THREAD_SAFE_QUEUE_H
 #define BOUNDED_THREAD_SAFE_QUEUE_H
 
+#include <chrono>
 #include <condition_variable>
 #include <mutex>
 #include <optional>
 #include <queue>
 #include <stdexcept>
 
+// Blocking producer-consumer queue with close/cancel semantics. Producers call
+// close() once they have pushed their final element, which lets consumers
+// drain what is left and then observe the end of the stream. cancel() is used
+// on abort to wake every blocked producer and consumer immediately.
 template <typename T> class BoundedThreadSafeQueue {
 public:
   BoundedThreadSafeQueue(size_t capacity) : capacity_(capacity) {
@@ -16,24 +21,65 @@ public:
   }
 
   // Only allowed passing rvalues to force not copying objects, only moving
-  // allowed
-  void push(T &&elem) {
+  // allowed. Blocks while the queue is full, returns false if the queue was
+  // cancelled before the element could be pushed
+  bool push(T &&elem) {
     std::unique_lock<std::mutex> lock(mutex_);
-    not_full_.wait(lock, [this]() { return queue_.size() < capacity_; });
+    not_full_.wait(lock,
+                   [this]() { return cancelled_ || queue_.size() < capacity_; });
+    if (cancelled_) {
+      return false;
+    }
+    if (closed_) {
+      throw std::logic_error("Cannot push to a closed queue");
+    }
     queue_.push(std::move(elem));
     not_empty_.notify_one();
+    return true;
   }
 
-  template <typename... Args> void emplace(Args &&...args) {
+  template <typename... Args> bool emplace(Args &&...args) {
     std::unique_lock<std::mutex> lock(mutex_);
-    not_full_.wait(lock, [this]() { return queue_.size() < capacity_; });
+    not_full_.wait(lock,
+                   [this]() { return cancelled_ || queue_.size() < capacity_; });
+    if (cancelled_) {
+      return false;
+    }
+    if (closed_) {
+      throw std::logic_error("Cannot push to a closed queue");
+    }
     queue_.emplace(std::forward<Args>(args)...);
     not_empty_.notify_one();
+    return true;
+  }
+
+  // Blocks until an element is available. Returns std::nullopt once the queue
+  // has been closed and fully drained, or as soon as it is cancelled
+  std::optional<T> pop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [this]() {
+      return cancelled_ || closed_ || queue_.size() > 0;
+    });
+    if (cancelled_ || queue_.empty()) {
+      return std::nullopt;
+    }
+    T elem = std::move(queue_.front());
+    queue_.pop();
+    not_full_.notify_one();
+    return elem;
   }
 
-  T pop() {
+  // Like pop(), but gives up and returns std::nullopt once the deadline has
+  // passed without an element becoming available
+  std::optional<T>
+  pop_until(const std::chrono::steady_clock::time_point &deadline) {
     std::unique_lock<std::mutex> lock(mutex_);
-    not_empty_.wait(lock, [this]() { return queue_.size() > 0; });
+    not_empty_.wait_until(lock, deadline, [this]() {
+      return cancelled_ || closed_ || queue_.size() > 0;
+    });
+    if (cancelled_ || queue_.empty()) {
+      return std::nullopt;
+    }
     T elem = std::move(queue_.front());
     queue_.pop();
     not_full_.notify_one();
@@ -42,7 +88,7 @@ public:
 
   std::optional<T> try_pop() {
     std::unique_lock<std::mutex> lock(mutex_);
-    if (queue_.empty()) {
+    if (cancelled_ || queue_.empty()) {
       return std::nullopt;
     }
     T elem = std::move(queue_.front());
@@ -51,6 +97,27 @@ public:
     return elem;
   }
 
+  // Marks the end of the stream, consumers may still drain queued elements
+  void close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    not_empty_.notify_all();
+  }
+
+  // Aborts the stream, waking all waiters and discarding queued elements
+  void cancel() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cancelled_ = true;
+    std::queue<T>().swap(queue_);
+    not_empty_.notify_all();
+    not_full_.notify_all();
+  }
+
+  bool closed() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return closed_ || cancelled_;
+  }
+
   bool empty() const {
     std::lock_guard<std::mutex> lock(mutex_);
     return queue_.empty();
@@ -69,9 +136,11 @@ public:
 private:
   const size_t capacity_;
   std::queue<T> queue_;
+  bool closed_ = false;
+  bool cancelled_ = false;
   mutable std::mutex mutex_;
   std::condition_variable not_empty_;
   std::condition_variable not_full_;
 };
 
-#endif
\ No newline at end of file
+#endif
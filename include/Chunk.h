@@ -1,43 +1,93 @@
 #ifndef CHUNK_H
 #define CHUNK_H
 
+#include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <vector>
 
+class Chunk;
+class ChunkPool;
+
+// Returns a chunk to the pool it was borrowed from instead of freeing it
+struct ChunkDeleter {
+  ChunkPool *pool = nullptr;
+  void operator()(Chunk *chunk) const;
+};
+
+using ChunkPtr = std::unique_ptr<Chunk, ChunkDeleter>;
+
+/*
+A chunk owns a buffer that is allocated once and reused for every transfer
+chunk it carries while cycling through a ChunkPool. The payload sits between
+reserved headroom and tailroom so that stages can grow it in place:
+
+    [ headroom | payload ... | tailroom ]
+               ^ data()
+
+Encryption claims the tailroom for the MAC and part of the headroom for the
+stream tag, and the sender then claims the rest of the headroom for the wire
+header, so a frame goes out as one contiguous buffer without copying.
+*/
 class Chunk {
 public:
-  Chunk(uint64_t sequence_num, std::vector<uint8_t> &&data);
+  Chunk(std::size_t capacity, std::size_t headroom, std::size_t tailroom);
 
-  // Constructor for compressed chunks, where data.size != original size
-  Chunk(uint64_t sequence_num, std::vector<uint8_t> &&data,
-        uint16_t original_size_);
-
-  // Chunks should never be copied, only moved
+  // Chunks should never be copied or moved, only passed around by ChunkPtr
   Chunk(const Chunk &) = delete;
   Chunk &operator=(const Chunk &) = delete;
-  Chunk(Chunk &&other) noexcept = default;
-  Chunk &operator=(Chunk &&other) noexcept = default;
+  Chunk(Chunk &&other) = delete;
+  Chunk &operator=(Chunk &&other) = delete;
+
+  // Prepares a recycled chunk to carry a new, empty, uncompressed payload
+  // starting after the full headroom
+  void reset(uint64_t sequence_num);
 
   uint64_t sequence_num();
   const uint64_t sequence_num() const;
 
+  uint8_t *data();
   const uint8_t *data() const;
 
-  uint16_t size() const;
+  uint32_t size() const;
+
+  // Sets the payload size. The payload may grow into the tailroom, but not
+  // past the end of the buffer
+  void resize(std::size_t size);
+
+  // Extends the payload backwards into the headroom by len bytes and returns
+  // the new start of the payload
+  uint8_t *push_front(std::size_t len);
+
+  // Drops len bytes from the front of the payload, returning them to the
+  // headroom
+  void pull_front(std::size_t len);
+
+  // Payload capacity, excluding the reserved headroom and tailroom
+  std::size_t capacity() const;
+
+  std::size_t headroom() const;
+  std::size_t tailroom() const;
 
   bool compressed() const;
 
-  uint16_t original_size() const;
+  // Size of the payload before compression, equal to size() if uncompressed
+  uint32_t original_size() const;
+
+  void set_compressed(bool compressed, uint32_t original_size);
 
 private:
-  const uint64_t sequence_num_;
-  const bool compressed_;
-
-  // original_size_ must be declared before data_ so that it is
-  // initialized with the data.size() argument in the constructor
-  // before data_ is initialized, since data_(std::move(data))
-  uint16_t original_size_;
-  std::vector<uint8_t> data_;
+  uint64_t sequence_num_ = 0;
+  bool compressed_ = false;
+  uint32_t original_size_ = 0;
+
+  const std::size_t reserved_headroom_;
+  const std::size_t reserved_tailroom_;
+
+  // Payload occupies buffer_[offset_, offset_ + size_)
+  std::size_t offset_;
+  std::size_t size_ = 0;
+  std::vector<uint8_t> buffer_;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,67 @@
+#ifndef CHUNK_INDEX_H
+#define CHUNK_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "TransferRequest.h"
+
+/*
+Maps any chunk of a transfer to the pieces of the files it covers, so that
+chunks can be written, or read, in any order.
+
+The files are laid end to end in transfer order, and chunk n covers the
+bytes from (n - 1) * chunk size of that stream. The offsets at which the
+files start, the prefix sums of their sizes, are computed once, and a
+chunk's first file is found by binary search over them. Empty files cover
+no bytes and are in no chunk.
+*/
+class ChunkIndex {
+public:
+  // Part of a chunk's payload that goes to one file
+  struct Piece {
+    std::size_t file_index;
+    uint64_t file_offset;
+    uint32_t chunk_offset;
+    uint32_t size;
+  };
+
+  explicit ChunkIndex(const TransferRequest &transfer_request);
+
+  // The last chunk may be shorter than the others
+  uint32_t payload_size(uint64_t sequence_num) const;
+
+  // Pieces of the chunk, in payload order. Throws if the sequence number is
+  // outside the transfer
+  std::vector<Piece> pieces(uint64_t sequence_num) const;
+
+private:
+  const std::vector<TransferRequest::FileInfo> &file_infos_;
+  const uint32_t chunk_size_;
+  const uint32_t final_chunk_size_;
+  const uint32_t num_chunks_;
+  std::vector<uint64_t> file_starts_;
+};
+
+// Tracks which chunks have been written when they may be written in any
+// order, and how many from the first are written without a gap, which is
+// what a resumable sender is told
+class WrittenChunks {
+public:
+  explicit WrittenChunks(uint32_t num_chunks);
+
+  // Called when a chunk arrives. Throws if it arrived before, the same as
+  // ReorderBuffer
+  void received(uint64_t sequence_num);
+
+  // Returns the number of chunks now written without a gap
+  uint32_t written(uint64_t sequence_num);
+
+private:
+  std::vector<bool> received_;
+  std::vector<bool> written_;
+  uint32_t contiguous_ = 0;
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef CHUNK_POOL_H
+#define CHUNK_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Chunk.h"
+
+// Bounded, thread-safe free list of fixed capacity chunks. Stages borrow a
+// chunk with acquire() and it is returned automatically when its ChunkPtr is
+// destroyed, so once the pipeline is primed the transfer path does no
+// allocation. A miss (empty free list) allocates a new chunk, and chunks
+// released while the free list is full are freed, which bounds the memory
+// held by an idle pool.
+//
+// The pool must outlive every chunk borrowed from it
+class ChunkPool {
+public:
+  // Every chunk is allocated with chunk_capacity payload bytes plus the given
+  // headroom and tailroom (see Chunk)
+  ChunkPool(std::size_t chunk_capacity, std::size_t headroom,
+            std::size_t tailroom, std::size_t max_pooled_chunks);
+
+  ChunkPool(const ChunkPool &) = delete;
+  ChunkPool &operator=(const ChunkPool &) = delete;
+
+  ChunkPtr acquire(uint64_t sequence_num);
+
+  std::size_t chunk_capacity() const;
+  uint64_t hits() const;
+  uint64_t misses() const;
+
+private:
+  friend struct ChunkDeleter;
+  void release(Chunk *chunk);
+
+  const std::size_t chunk_capacity_;
+  const std::size_t headroom_;
+  const std::size_t tailroom_;
+  const std::size_t max_pooled_chunks_;
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<Chunk>> free_chunks_;
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+};
+
+#endif
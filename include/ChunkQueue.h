@@ -0,0 +1,49 @@
+#ifndef CHUNK_QUEUE_H
+#define CHUNK_QUEUE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+
+#include "BoundedThreadSafeQueue.h"
+#include "Chunk.h"
+#include "SpscRingQueue.h"
+
+// Queue type used for the single-producer/single-consumer hops between
+// pipeline stages. The lock-free ring is used by default, configuring with
+// -DTRIT_SPSC_CHUNK_QUEUE=OFF falls back to the mutex-based queue
+#ifdef TRIT_SPSC_CHUNK_QUEUE
+using ChunkQueue = SpscRingQueue<ChunkPtr>;
+#else
+using ChunkQueue = BoundedThreadSafeQueue<ChunkPtr>;
+#endif
+
+// Number of chunks each pipeline queue holds. Large chunks get fewer slots so
+// that a hop buffers about QUEUE_BUFFER_BYTES, but never fewer than
+// MIN_QUEUE_CAPACITY so stages can still overlap
+inline std::size_t chunk_queue_capacity(std::size_t chunk_size) {
+  constexpr std::size_t QUEUE_BUFFER_BYTES = 16 * 1024 * 1024;
+  constexpr std::size_t MIN_QUEUE_CAPACITY = 4;
+  constexpr std::size_t MAX_QUEUE_CAPACITY = 50;
+  return std::clamp(QUEUE_BUFFER_BYTES / std::max<std::size_t>(chunk_size, 1),
+                    MIN_QUEUE_CAPACITY, MAX_QUEUE_CAPACITY);
+}
+
+// Chunks held by the sequential stages themselves, one or two each, on top of
+// those in the queues between them
+constexpr std::size_t STAGE_HELD_CHUNKS = 8;
+
+// Chunks the pipeline shared by the sender and receiver can have in flight:
+// its two queues, or three with compression, the chunks held by the stages,
+// and per parallel worker up to three more (one being processed, two waiting
+// to be reordered) plus the output chunk of a (de)compression worker. The
+// transport and file I/O add their own on top
+inline std::size_t pipeline_chunks(std::size_t chunk_size, bool compressed,
+                                   std::size_t crypto_threads,
+                                   std::size_t compression_threads) {
+  const std::size_t num_queues = compressed ? 3 : 2;
+  return num_queues * chunk_queue_capacity(chunk_size) + STAGE_HELD_CHUNKS +
+         3 * crypto_threads + 4 * compression_threads;
+}
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef COMPRESSION_BYPASS_H
+#define COMPRESSION_BYPASS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "TransferRequest.h"
+
+// Decides which chunks are worth compressing. Keeps a moving average of the
+// compression ratio (compressed / original size) of the file currently being
+// chunked. When it rises above the threshold, the next chunks of that file
+// are sent raw without trying, and the pause doubles each time a probe chunk
+// still does not compress well. Moving on to another file resets the estimate.
+// Thread safe, since parallel compression workers share one instance and see
+// chunks in roughly (not exactly) sequence order
+class CompressionBypass {
+public:
+  CompressionBypass(const TransferRequest &transfer_request);
+
+  // Returns false if the chunk should be sent raw without trying compression
+  bool should_compress(uint64_t sequence_num);
+
+  // Records the outcome of a compression attempt, compressed_size should be
+  // original_size if the data did not shrink
+  void record(uint64_t sequence_num, std::size_t original_size,
+              std::size_t compressed_size);
+
+private:
+  // Chunks that do not save at least 10% are not worth compressing
+  static constexpr double RATIO_THRESHOLD = 0.9;
+  static constexpr double AVERAGE_WEIGHT = 0.25;
+  static constexpr uint32_t INITIAL_BYPASS_CHUNKS = 8;
+  static constexpr uint32_t MAX_BYPASS_CHUNKS = 512;
+
+  const uint32_t chunk_size_;
+
+  // Transfer offset one past the last byte of each file, in chunking order
+  std::vector<uint64_t> file_end_offsets_;
+
+  std::mutex mutex_;
+  std::size_t file_index_ = 0;
+  double average_ratio_ = 0.0;
+  uint32_t num_samples_ = 0;
+  uint32_t bypass_remaining_ = 0;
+  uint32_t bypass_length_ = INITIAL_BYPASS_CHUNKS;
+
+  // Index of the file containing the first byte of the chunk
+  std::size_t file_index_for(uint64_t sequence_num) const;
+};
+
+#endif
@@ -3,38 +3,71 @@
 
 #include <atomic>
 #include <memory>
+#include <string>
 #include <thread>
 #include <vector>
 
-#include "BoundedThreadSafeQueue.h"
 #include "Chunk.h"
+#include "ChunkPool.h"
+#include "ChunkQueue.h"
+#include "CompressionBypass.h"
+#include "TransferRequest.h"
+#include "WorkerContext.h"
 
+// Counters for one compression or decompression stage, reported at the end of
+// a transfer. Sizes are chunk payload bytes
+struct CompressionStats {
+  std::atomic<uint64_t> input_bytes{0};
+  std::atomic<uint64_t> output_bytes{0};
+  // Chunks that went out (or arrived) compressed
+  std::atomic<uint64_t> compressed_chunks{0};
+  // Chunks that were tried but did not shrink
+  std::atomic<uint64_t> incompressible_chunks{0};
+  // Chunks sent raw without trying, see CompressionBypass
+  std::atomic<uint64_t> bypassed_chunks{0};
+  // CPU time summed over the stage's workers
+  std::atomic<uint64_t> cpu_time_ns{0};
+};
+
+// Compresses or decompresses chunks on num_workers threads. Chunks leave the
+// stage in sequence order
 class CompressionManager {
 public:
-  CompressionManager(uint32_t chunk_size, uint32_t last_chunk_size);
-
-  void
-  compress_chunks(BoundedThreadSafeQueue<std::unique_ptr<Chunk>> &input_queue,
-                  std::atomic<bool> &input_done,
-                  BoundedThreadSafeQueue<std::unique_ptr<Chunk>> &output_queue,
-                  std::atomic<bool> &output_done);
-
-  void decompress_chunks(
-      BoundedThreadSafeQueue<std::unique_ptr<Chunk>> &input_queue,
-      std::atomic<bool> &input_done,
-      BoundedThreadSafeQueue<std::unique_ptr<Chunk>> &output_queue,
-      std::atomic<bool> &output_done);
-
-  std::unique_ptr<Chunk> compress_chunk(const Chunk &chunk);
-  std::unique_ptr<Chunk> decompress_chunk(const Chunk &chunk);
-  std::vector<uint8_t> compress_data(const uint8_t *data, uint16_t data_size);
-  std::vector<uint8_t> decompress_data(const uint8_t *compressed_data,
-                                       uint16_t compressed_data_size,
-                                       uint16_t original_size);
+  CompressionManager(const TransferRequest &transfer_request,
+                     ChunkPool &chunk_pool, std::size_t num_workers = 1);
+
+  void compress_chunks(WorkerContext &ctx, ChunkQueue &input_queue,
+                       ChunkQueue &output_queue);
+
+  void decompress_chunks(WorkerContext &ctx, ChunkQueue &input_queue,
+                         ChunkQueue &output_queue);
+
+  const CompressionStats &stats() const;
+
+  // One line summaries of the stats for the end of a transfer
+  std::string compression_summary() const;
+  std::string decompression_summary() const;
+
+  ChunkPtr compress_chunk(const Chunk &chunk);
+  ChunkPtr decompress_chunk(const Chunk &chunk);
+  std::size_t compress_data(const uint8_t *data, uint32_t data_size,
+                            uint8_t *output, std::size_t output_capacity);
+  void decompress_data(const uint8_t *compressed_data,
+                       uint32_t compressed_data_size, uint8_t *output,
+                       uint32_t original_size);
 
 private:
   const uint32_t chunk_size_;
   const uint32_t last_chunk_size_;
+  const std::size_t num_workers_;
+
+  // Output chunks are borrowed from the shared pipeline pool
+  ChunkPool &chunk_pool_;
+
+  CompressionBypass bypass_;
+  CompressionStats stats_;
+
+  ChunkPtr compress_or_bypass(ChunkPtr chunk_ptr);
 };
 
 #endif
\ No newline at end of file
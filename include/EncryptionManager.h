@@ -1,14 +1,13 @@
 #ifndef ENCRYPTION_MANAGER_H
 #define ENCRYPTION_MANAGER_H
 
-#include <atomic>
 #include <memory>
 #include <thread>
 #include <variant>
 #include <vector>
 
-#include "BoundedThreadSafeQueue.h"
 #include "Chunk.h"
+#include "ChunkQueue.h"
 #include "WorkerContext.h"
 #include "crypto.h"
 
@@ -22,32 +21,36 @@ public:
   EncryptionManager(uint32_t chunk_size, uint32_t last_chunk_size,
                     uint64_t num_chunks, crypto::Decryptor decryptor);
 
-  void
-  encrypt_chunks(WorkerContext &ctx,
-                 BoundedThreadSafeQueue<std::unique_ptr<Chunk>> &input_queue,
-                 std::atomic<bool> &input_done,
-                 BoundedThreadSafeQueue<std::unique_ptr<Chunk>> &output_queue,
-                 std::atomic<bool> &output_done);
+  // Independently sealed chunks, encrypted or decrypted on num_workers
+  // threads with chunks leaving the stage in sequence order
+  EncryptionManager(uint32_t chunk_size, uint32_t last_chunk_size,
+                    uint64_t num_chunks, crypto::ChunkCipher chunk_cipher,
+                    std::size_t num_workers);
+
+  void encrypt_chunks(WorkerContext &ctx, ChunkQueue &input_queue,
+                      ChunkQueue &output_queue);
 
-  void
-  decrypt_chunks(WorkerContext &ctx,
-                 BoundedThreadSafeQueue<std::unique_ptr<Chunk>> &input_queue,
-                 std::atomic<bool> &input_done,
-                 BoundedThreadSafeQueue<std::unique_ptr<Chunk>> &output_queue,
-                 std::atomic<bool> &output_done);
+  void decrypt_chunks(WorkerContext &ctx, ChunkQueue &input_queue,
+                      ChunkQueue &output_queue);
 
 private:
   const uint32_t chunk_size_;
   const uint32_t last_chunk_size_;
   const uint64_t num_chunks_;
+  const std::size_t num_workers_;
 
-  // EncryptionManager can be configured for either encryption or decryption
-  std::variant<crypto::Encryptor, crypto::Decryptor> crypto_vnt_;
+  // EncryptionManager can be configured for either stream encryption or
+  // decryption, or for independently sealed chunks in both directions
+  std::variant<crypto::Encryptor, crypto::Decryptor, crypto::ChunkCipher>
+      crypto_vnt_;
 
   crypto::Encryptor &get_encryptor();
   crypto::Decryptor &get_decryptor();
-  std::unique_ptr<Chunk> encrypt_chunk(const Chunk &chunk);
-  std::unique_ptr<Chunk> decrypt_chunk(const Chunk &chunk);
+  void validate_sequence_num(const Chunk &chunk) const;
+  ChunkPtr encrypt_chunk(ChunkPtr chunk_ptr);
+  ChunkPtr decrypt_chunk(ChunkPtr chunk_ptr);
+  ChunkPtr seal_chunk(ChunkPtr chunk_ptr) const;
+  ChunkPtr open_chunk(ChunkPtr chunk_ptr) const;
 };
 
 #endif
\ No newline at end of file
@@ -2,26 +2,105 @@
 #define FILE_MANAGER_H
 
 #include <atomic>
+#include <cstddef>
 #include <filesystem>
+#include <memory>
+#include <optional>
 #include <vector>
 
-#include "BoundedThreadSafeQueue.h"
 #include "Chunk.h"
+#include "ChunkPool.h"
+#include "ChunkQueue.h"
+#include "RateLimiter.h"
+#include "TcpSocket.h"
 #include "TransferRequest.h"
+#include "UringFileIo.h"
 #include "WorkerContext.h"
 #include "utils.h"
 
+// How the sender reads files into chunks. See bench/file_read_benchmark.cpp
+// for a comparison
+enum class FileReadMode {
+  // std::ifstream::read() into the chunk, a single read() per chunk or file
+  STREAM,
+  // Copies from a MappedFile, falling back to STREAM for files that cannot
+  // be mapped
+  MAPPED,
+  // Many reads in flight through UringFileIo, falling back to STREAM where
+  // io_uring is unavailable
+  URING,
+  // Reads through an UncachedFileReader that drops the pages behind it from
+  // the page cache, falling back to STREAM where unsupported
+  DROP_BEHIND,
+  // Reads with O_DIRECT through an UncachedFileReader, bypassing the page
+  // cache, falling back to STREAM where unsupported
+  DIRECT,
+};
+
+// How the receiver writes chunks into files
+enum class FileWriteMode {
+  // pwrite() from the chunk, in any order
+  STREAM,
+  // Many writes in flight through UringFileIo, falling back to STREAM where
+  // io_uring is unavailable
+  URING,
+};
+
 class FileManager {
 public:
-  void read_files_into_chunks(
-      WorkerContext &ctx, const TransferRequest &transfer_request,
-      BoundedThreadSafeQueue<std::unique_ptr<Chunk>> &output_queue,
-      std::atomic<bool> &output_done);
-
-  void write_files_from_chunks(
-      WorkerContext &ctx, const TransferRequest &transfer_request,
-      BoundedThreadSafeQueue<std::unique_ptr<Chunk>> &input_queue,
-      std::atomic<bool> &input_done, std::atomic<uint32_t> &chunks_written);
+  // Sets up io_uring ahead of a URING read or write, so that the chunk pool
+  // can be sized for the file I/O actually used. Returns the chunks it
+  // borrows from the pool, or 0 where io_uring is unavailable and the stream
+  // path is used instead. Called by the first URING read or write otherwise
+  std::size_t prepare_uring();
+
+  // Small files are packed together into chunks, and large files span
+  // several. Throws if a file changed size since the transfer request
+  void read_files_into_chunks(WorkerContext &ctx,
+                              const TransferRequest &transfer_request,
+                              ChunkPool &chunk_pool, ChunkQueue &output_queue,
+                              FileReadMode read_mode = FileReadMode::STREAM);
+
+  // Chunks may arrive in any order, each is written with pwrite() at the
+  // offsets its ChunkIndex pieces give. Counts a chunk in chunks_written
+  // once it and every chunk before it have been handed to the OS
+  void
+  write_files_from_chunks(WorkerContext &ctx,
+                          const TransferRequest &transfer_request,
+                          ChunkQueue &input_queue,
+                          std::atomic<uint32_t> &chunks_written,
+                          FileWriteMode write_mode = FileWriteMode::STREAM);
+
+  // Whether a transfer skips the chunk pipeline and sends the files as one
+  // raw byte stream, which needs an unencrypted, uncompressed transfer over
+  // a single TCP connection
+  static bool can_transfer_zero_copy(const TransferRequest &transfer_request,
+                                     bool encrypted);
+
+  // Bytes of the transfer's files held in the page cache, measured with
+  // mincore(). Returns std::nullopt where it cannot be measured
+  static std::optional<uint64_t>
+  page_cache_footprint(const TransferRequest &transfer_request);
+
+  // Sends the files with sendfile(), so their data goes from the page cache
+  // to the socket without being copied through user space. Each step is
+  // paced by the rate limiter, if one is given
+  void send_files_to_socket(WorkerContext &ctx,
+                            const TransferRequest &transfer_request,
+                            TcpSocket &socket,
+                            std::atomic<uint64_t> &bytes_sent,
+                            RateLimiter *rate_limiter = nullptr);
+
+  // Moves the byte stream from the socket into the files with splice()
+  // through a pipe, the receiving side of send_files_to_socket()
+  void receive_files_from_socket(WorkerContext &ctx,
+                                 const TransferRequest &transfer_request,
+                                 TcpSocket &socket,
+                                 std::atomic<uint64_t> &bytes_written);
+
+private:
+  std::unique_ptr<UringFileIo> uring_file_io_;
+  bool uring_prepared_ = false;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,143 @@
+#ifndef FRAME_HEADER_H
+#define FRAME_HEADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/*
+Header in front of every chunk payload on the wire. The wire form is packed
+and integers are little endian regardless of the host byte order:
+
+sequence number     [8 bytes]
+compressed flag     [1 byte]
+original size       [4 bytes]
+chunk size          [4 bytes]
+
+A header with sequence number 0 and no payload marks the end of the frames
+sent on a connection.
+*/
+struct FrameHeader {
+  static constexpr std::size_t SIZE =
+      sizeof(uint64_t) + sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint32_t);
+
+  uint64_t sequence_num = 0;
+  bool compressed = false;
+  uint32_t original_size = 0;
+  uint32_t chunk_size = 0;
+
+  // Header of the frame that ends a connection's frames
+  static FrameHeader end_of_stream();
+  bool is_end_of_stream() const;
+
+  // Writes the SIZE byte wire form to out
+  void encode(uint8_t *out) const;
+
+  // Parses the SIZE byte wire form at in. Throws if the compressed flag is
+  // anything other than 0 or 1
+  static FrameHeader decode(const uint8_t *in);
+};
+
+/*
+Acknowledgement the receiver of a resumable transfer sends back on the same
+connection, a little endian count of the chunks it has written so far:
+
+chunks written      [4 bytes]
+*/
+struct Acknowledgement {
+  static constexpr std::size_t SIZE = sizeof(uint32_t);
+
+  uint32_t chunks_written = 0;
+
+  void encode(uint8_t *out) const;
+  static Acknowledgement decode(const uint8_t *in);
+};
+
+/*
+Sent by the sender of a resumable transfer in front of its resume token when
+it reconnects, little endian. The receiver answers a valid one with an
+Acknowledgement of the chunks it has written, from which the sender resumes:
+
+attempt             [4 bytes]
+*/
+struct ReconnectRequest {
+  static constexpr std::size_t SIZE = sizeof(uint32_t);
+
+  uint32_t attempt = 0;
+
+  void encode(uint8_t *out) const;
+  static ReconnectRequest decode(const uint8_t *in);
+};
+
+/*
+Datagrams of the UDP transport, see UdpTransferManager. Each starts with a
+type byte, and integers are little endian:
+
+hello               [type][token, crypto::DATAGRAM_TOKEN_SIZE bytes]
+data                [type][DataDatagramHeader][part of a chunk frame]
+acknowledgement     [type][DatagramAcknowledgement]
+finish              [type]
+*/
+enum class DatagramType : uint8_t { HELLO = 1, DATA = 2, ACK = 3, FINISH = 4 };
+
+// Largest datagram sent, which fits the path MTU of practically every
+// network so that no datagram is fragmented by IP
+inline constexpr std::size_t MAX_DATAGRAM_SIZE = 1200;
+
+/*
+Header of a data datagram, which carries the bytes [offset, offset + size)
+of the frame of one chunk, its frame header included:
+
+type                [1 byte]
+packet number       [8 bytes, new for every datagram, resent ones included]
+sequence number     [8 bytes]
+frame size          [4 bytes]
+offset              [4 bytes]
+*/
+struct DataDatagramHeader {
+  static constexpr std::size_t SIZE = sizeof(uint8_t) + sizeof(uint64_t) +
+                                      sizeof(uint64_t) + sizeof(uint32_t) +
+                                      sizeof(uint32_t);
+
+  // Frame bytes carried by every data datagram but the last of a frame
+  static constexpr std::size_t PAYLOAD_SIZE = MAX_DATAGRAM_SIZE - SIZE;
+
+  uint64_t packet_num = 0;
+  uint64_t sequence_num = 0;
+  uint32_t frame_size = 0;
+  uint32_t offset = 0;
+
+  void encode(uint8_t *out) const;
+  static DataDatagramHeader decode(const uint8_t *in);
+};
+
+/*
+Selective acknowledgement of the packet numbers received, newest first:
+
+type                [1 byte]
+next sequence num   [8 bytes, first chunk not yet passed on]
+range count         [1 byte]
+ranges              [range count x (first [8 bytes], last [8 bytes])]
+*/
+struct DatagramAcknowledgement {
+  static constexpr std::size_t MAX_RANGES = 64;
+  static constexpr std::size_t MAX_SIZE =
+      sizeof(uint8_t) + sizeof(uint64_t) + sizeof(uint8_t) +
+      MAX_RANGES * 2 * sizeof(uint64_t);
+  static_assert(MAX_SIZE <= MAX_DATAGRAM_SIZE);
+
+  uint64_t next_sequence_num = 0;
+
+  // Inclusive ranges of packet numbers, in descending order
+  std::vector<std::pair<uint64_t, uint64_t>> ranges;
+
+  // Writes the wire form to out, which must hold MAX_SIZE bytes, and returns
+  // its size
+  std::size_t encode(uint8_t *out) const;
+
+  // Parses the size byte wire form at in. Throws if it is malformed
+  static DatagramAcknowledgement decode(const uint8_t *in, std::size_t size);
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef FRAME_READER_H
+#define FRAME_READER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ChunkPool.h"
+#include "FrameHeader.h"
+#include "TcpSocket.h"
+
+/*
+Parses chunk frames out of a socket with as few read calls as possible.
+
+Reads go into a large receive buffer, and every frame header and payload
+already in it is parsed from there, so a run of small frames costs a single
+read call. When a payload is incomplete, the rest of it is read straight
+into the pooled chunk, where it is later decrypted in place, with the receive
+buffer as a second scatter target to pick up the frames that follow:
+
+    readv([ rest of payload -> chunk | next frames -> receive buffer ])
+
+Only the part of a payload that arrived together with earlier frames is
+copied out of the receive buffer.
+*/
+class FrameReader {
+public:
+  static constexpr std::size_t DEFAULT_BUFFER_SIZE = 256 * 1024;
+
+  FrameReader(TcpSocket &socket,
+              std::size_t buffer_size = DEFAULT_BUFFER_SIZE);
+
+  FrameReader(const FrameReader &) = delete;
+  FrameReader &operator=(const FrameReader &) = delete;
+
+  // Blocks until the next complete frame has been read, and returns its
+  // payload in a chunk borrowed from chunk_pool, or an empty ChunkPtr for the
+  // end of stream frame. Throws if the payload is larger than the pool's
+  // chunks
+  ChunkPtr read_frame(ChunkPool &chunk_pool);
+
+  // Drops any bytes buffered from the socket, e.g. once the connection they
+  // came from has been replaced
+  void discard_buffered();
+
+  uint64_t read_calls() const;
+  uint64_t bytes_read() const;
+
+private:
+  TcpSocket &socket_;
+
+  // Unparsed bytes occupy buffer_[begin_, end_)
+  std::vector<uint8_t> buffer_;
+  std::size_t begin_ = 0;
+  std::size_t end_ = 0;
+
+  uint64_t read_calls_ = 0;
+  uint64_t bytes_read_ = 0;
+
+  std::size_t buffered() const;
+  void fill_header();
+};
+
+#endif
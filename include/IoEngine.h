@@ -0,0 +1,62 @@
+#ifndef IO_ENGINE_H
+#define IO_ENGINE_H
+
+#include <asio.hpp>
+#include <cstddef>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Shared io_context run by a small pool of threads, which completes the
+// asynchronous operations of every TcpSocket and TcpListener created on it.
+// Many sockets are served by the same few threads, and since each socket
+// serializes its handlers on its own strand, it can have a read and a write
+// in flight at the same time.
+//
+// Completion handlers run on the engine threads and must not block on other
+// socket operations, which would starve the pool
+class IoEngine {
+public:
+  explicit IoEngine(std::size_t num_threads);
+  ~IoEngine();
+
+  // non-copyable, non-movable
+  IoEngine(const IoEngine &) = delete;
+  IoEngine &operator=(const IoEngine &) = delete;
+  IoEngine(IoEngine &&) = delete;
+  IoEngine &operator=(IoEngine &&) = delete;
+
+  // Engine used by sockets that are not given one, started on first use
+  static IoEngine &shared();
+
+  asio::io_context &context();
+
+  // Starts an operation on the executor and blocks the calling thread until
+  // its handler has run with (error_code, bytes). Returns the bytes, or
+  // throws the error the operation completed with. Must not be called from
+  // an engine thread
+  template <typename Executor, typename Initiate>
+  static std::size_t wait_for(const Executor &executor, Initiate initiate) {
+    auto done = std::make_shared<std::promise<std::size_t>>();
+    std::future<std::size_t> result = done->get_future();
+    asio::dispatch(executor, [&initiate, done]() {
+      initiate([done](const asio::error_code &ec, std::size_t bytes) {
+        if (ec) {
+          done->set_exception(
+              std::make_exception_ptr(asio::system_error(ec)));
+        } else {
+          done->set_value(bytes);
+        }
+      });
+    });
+    return result.get();
+  }
+
+private:
+  asio::io_context io_context_;
+  asio::executor_work_guard<asio::io_context::executor_type> work_guard_;
+  std::vector<std::thread> threads_;
+};
+
+#endif
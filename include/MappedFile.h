@@ -0,0 +1,55 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+/*
+A file mapped read-only into memory, so the sender copies its data from the
+page cache straight into chunks, without a read() call and an iostream
+buffer for every few KiB.
+
+The mapping is advised as sequential, and the kernel is asked to read ahead
+a window of READAHEAD bytes past what has been copied, so pages are already
+cached when they are reached.
+
+Touching a page of the mapping past the end of the file raises SIGBUS, which
+happens when the file is truncated while it is being sent. copy() catches it
+on the copying thread and throws instead, any other SIGBUS is left to the
+handler installed before.
+*/
+class MappedFile {
+public:
+  // Bytes advised ahead of the last copy
+  static constexpr std::size_t READAHEAD = 8 * 1024 * 1024;
+
+  // Whether the platform can map files, MappedFile throws where it cannot
+  static bool supported();
+
+  // Maps the first size bytes of the file. Throws if it cannot be opened or
+  // mapped, e.g. for special files
+  MappedFile(const std::filesystem::path &path, uint64_t size);
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  uint64_t size() const;
+
+  // Copies len bytes at offset into dest. Throws if the file no longer
+  // holds them
+  void copy(uint64_t offset, uint8_t *dest, std::size_t len);
+
+private:
+  const std::filesystem::path path_;
+  const uint64_t size_;
+  uint8_t *data_ = nullptr;
+
+  // End of the range already advised for readahead
+  uint64_t readahead_end_ = 0;
+
+  void read_ahead(uint64_t offset);
+};
+
+#endif
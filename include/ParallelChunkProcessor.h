@@ -0,0 +1,75 @@
+#ifndef PARALLEL_CHUNK_PROCESSOR_H
+#define PARALLEL_CHUNK_PROCESSOR_H
+
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "Chunk.h"
+#include "ChunkQueue.h"
+#include "ReorderBuffer.h"
+#include "WorkerContext.h"
+
+// Sequence number of the first chunk of every transfer
+inline constexpr uint64_t FIRST_SEQUENCE_NUM = 1;
+
+// Applies transform to every chunk of input_queue on num_workers threads (the
+// calling thread being one of them) and pushes the results to output_queue in
+// sequence order, closing it once the input has been drained. Workers take
+// turns popping the input so the queue still only sees one consumer at a
+// time, and transform must be safe to call concurrently
+template <typename Transform>
+void process_chunks_in_parallel(WorkerContext &ctx, ChunkQueue &input_queue,
+                                ChunkQueue &output_queue,
+                                std::size_t num_workers, Transform transform) {
+  if (num_workers == 0) {
+    throw std::logic_error("Number of workers must be greater than 0");
+  }
+
+  // Chunks are popped in order, so a chunk can be at most num_workers ahead
+  // of the next one to release. The slack lets a fast worker move on to
+  // another chunk instead of waiting for a slower one
+  ReorderBuffer reorder_buffer(FIRST_SEQUENCE_NUM, 2 * num_workers,
+                               output_queue);
+  auto abort_guard = ctx.scoped_on_abort([&]() { reorder_buffer.cancel(); });
+
+  std::mutex input_mutex;
+  auto worker = [&]() {
+    try {
+      while (true) {
+        std::optional<ChunkPtr> chunk_ptr_opt;
+        {
+          std::lock_guard<std::mutex> lock(input_mutex);
+          chunk_ptr_opt = input_queue.pop();
+        }
+        if (!chunk_ptr_opt || ctx.should_abort()) {
+          return;
+        }
+        if (!reorder_buffer.insert(transform(std::move(*chunk_ptr_opt)))) {
+          return;
+        }
+      }
+    } catch (...) {
+      ctx.handle_exception();
+    }
+  };
+
+  std::vector<std::thread> helper_threads;
+  helper_threads.reserve(num_workers - 1);
+  for (std::size_t i = 1; i < num_workers; ++i) {
+    helper_threads.emplace_back(worker);
+  }
+  worker();
+  for (auto &thread : helper_threads) {
+    thread.join();
+  }
+
+  if (!ctx.should_abort()) {
+    output_queue.close();
+  }
+}
+
+#endif
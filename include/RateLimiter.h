@@ -0,0 +1,79 @@
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "WorkerContext.h"
+
+/*
+Token bucket capping the bytes per second a transfer sends, shared by every
+connection of the transfer.
+
+The bucket refills at the rate and holds at most the burst size. Senders take
+tokens in slices of at most the burst size, waiting only as long as the
+missing tokens take to refill, so data goes out in small evenly spaced writes
+instead of a large burst followed by a long sleep.
+
+The limit can be changed while a transfer runs by writing "<rate> [burst]"
+to the control file, e.g. "20M" or "20M 256K", and "0" lifts it. The file is
+checked about once a second, and removing it restores the initial limit.
+*/
+class RateLimiter {
+public:
+  // A rate of 0 is unlimited, a burst of 0 picks one from the rate
+  explicit RateLimiter(uint64_t rate = 0, uint64_t burst = 0,
+                       std::filesystem::path control_file = {});
+
+  RateLimiter(const RateLimiter &) = delete;
+  RateLimiter &operator=(const RateLimiter &) = delete;
+
+  // .trit/rate_limit in the working directory
+  static std::filesystem::path default_control_file();
+
+  void set_rate(uint64_t rate, uint64_t burst = 0);
+
+  // Bytes per second and bucket size, a rate of 0 being unlimited
+  uint64_t rate() const;
+  uint64_t burst() const;
+
+  // Most bytes to take in one acquire(), so a write never outruns the bucket
+  // by more than a burst. Unlimited while the rate is 0
+  std::size_t slice_size() const;
+
+  // Blocks until bytes may be sent, taking them from the bucket. Returns
+  // false if the transfer was aborted while waiting
+  bool acquire(WorkerContext &ctx, std::size_t bytes);
+
+  // One line description of the limit, e.g. for the log
+  std::string describe() const;
+
+private:
+  mutable std::mutex mutex_;
+  const uint64_t initial_rate_;
+  const uint64_t initial_burst_;
+  uint64_t rate_ = 0;
+  uint64_t burst_ = 0;
+
+  // May go negative when a slice larger than the burst is taken
+  double tokens_ = 0;
+  std::chrono::steady_clock::time_point last_refill_;
+
+  const std::filesystem::path control_file_;
+  std::chrono::steady_clock::time_point next_control_check_;
+
+  // Contents of the control file last applied, none while it is absent
+  std::optional<std::string> control_text_;
+
+  void set_rate_locked(uint64_t rate, uint64_t burst);
+  void refill_locked(std::chrono::steady_clock::time_point now);
+  void check_control_file_locked(std::chrono::steady_clock::time_point now);
+  std::string describe_locked() const;
+};
+
+#endif
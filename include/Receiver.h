@@ -1,32 +1,76 @@
 #ifndef RECEIVER_H
 #define RECEIVER_H
 
+#include <array>
+#include <memory>
 #include <optional>
 #include <string>
+#include <variant>
+#include <vector>
 
+#include "SessionTicket.h"
+#include "SocketOptions.h"
 #include "TcpSocket.h"
 #include "TransferRequest.h"
+#include "UdpSocket.h"
 
 #include "crypto.h"
 
 class Receiver {
 public:
-  Receiver(const std::string &ip, uint16_t port, const std::string &password);
+  Receiver(const std::string &ip, uint16_t port, const std::string &password,
+           const SocketOptions &socket_options = SocketOptions());
   void start_session();
 
 private:
   const std::string ip_;
   const uint16_t port_;
   const std::string password_;
+  const SocketOptions socket_options_;
   TcpSocket sender_socket_;
 
+  // Key and handshake header of the current session, which authenticate the
+  // additional connections of a striped transfer
+  std::optional<crypto::Key> session_key_;
+  std::array<uint8_t, crypto::HEADER_SIZE> session_header_;
+
+  // Issues the tickets that let the sender skip the password hash on its
+  // next connection. Unset if the ticket master key is unavailable
+  std::optional<TicketIssuer> ticket_issuer_;
+
+  // Attempt number of the sender's last accepted reconnection, which a new
+  // one must exceed so a recorded reconnection cannot be replayed
+  uint32_t last_resume_attempt_ = 0;
+
+  // Opened once for the whole session, and accepts the sender's connection
+  // on every attempt as well as the additional connections of a striped
+  // transfer
+  std::optional<TcpListener> listener_;
+  std::vector<std::unique_ptr<TcpSocket>> stream_sockets_;
+
+  // Bound for a UDP transfer once it is accepted, on a port the kernel picks
+  UdpSocket udp_socket_;
+
+  // std::monostate for a plaintext session
+  using ChunkDecryption =
+      std::variant<std::monostate, crypto::Decryptor, crypto::ChunkCipher>;
+
   void start_listening_for_connection();
   void wait_for_connection();
-  bool receive_handshake(std::optional<crypto::Decryptor> &decryptor_opt);
-  TransferRequest receive_transfer_request();
-  bool accept_transfer_request(const TransferRequest &transfer_request);
+  bool receive_handshake(std::optional<ChunkDecryption> &chunk_decryption_opt,
+                         crypto::HandshakeKind &kind);
+  std::optional<crypto::Key> receive_credentials(crypto::HandshakeKind &kind);
+  std::optional<TransferRequest> receive_transfer_request();
+  bool accept_transfer_request(const TransferRequest &transfer_request,
+                               bool encrypted);
+  void send_verdict(RequestVerdict verdict,
+                    std::optional<uint16_t> udp_port = std::nullopt);
+  uint16_t open_udp_transport();
+  void accept_streams(uint8_t num_streams);
+  void accept_reconnect(uint64_t chunks_received);
   void receive_files(const TransferRequest &transfer_request,
-                     crypto::Decryptor decryptor);
+                     ChunkDecryption chunk_decryption);
+  void receive_files_zero_copy(const TransferRequest &transfer_request);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,47 @@
+#ifndef REORDER_BUFFER_H
+#define REORDER_BUFFER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "Chunk.h"
+#include "ChunkQueue.h"
+
+// Restores sequence order for chunks that complete out of order, e.g. when
+// they are processed by several workers at once. Chunks are released to the
+// output queue as soon as every chunk before them has been inserted.
+//
+// Only window_size chunks past the next expected one are held at a time, an
+// insert further ahead blocks until the gap has been filled. Chunks are pushed
+// to the output queue by one inserting thread at a time without holding the
+// buffer lock, so a full output queue never blocks cancel()
+class ReorderBuffer {
+public:
+  ReorderBuffer(uint64_t first_sequence_num, std::size_t window_size,
+                ChunkQueue &output_queue);
+
+  // Non-copyable, non-movable since inserting threads wait on it
+  ReorderBuffer(const ReorderBuffer &) = delete;
+  ReorderBuffer &operator=(const ReorderBuffer &) = delete;
+
+  // Returns false if the buffer or the output queue was cancelled
+  bool insert(ChunkPtr chunk_ptr);
+
+  // Wakes every blocked inserter, used on abort
+  void cancel();
+
+  uint64_t next_sequence_num() const;
+
+private:
+  mutable std::mutex mutex_;
+  std::condition_variable window_cv_;
+  std::vector<ChunkPtr> slots_;
+  uint64_t next_sequence_num_;
+  bool releasing_ = false;
+  bool cancelled_ = false;
+  ChunkQueue &output_queue_;
+};
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef RETRANSMIT_WINDOW_H
+#define RETRANSMIT_WINDOW_H
+
+#include <asio.hpp>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "ChunkPool.h"
+
+/*
+Frames sent on a resumable connection that the receiver has not yet
+acknowledged as written.
+
+The transmitter pushes every batch of frames here before writing it, and the
+thread reading the receiver's cumulative acknowledgements releases them. If
+the connection is lost, the frames the receiver did not get are sent again
+from here after reconnecting, so nothing is read, compressed or encrypted a
+second time. The window holds at most max_bytes of frames, which bounds the
+chunks a resumable transfer keeps borrowed from the pool.
+
+Each chunk holds its whole frame, header included, in order of sequence
+number.
+*/
+class RetransmitWindow {
+public:
+  explicit RetransmitWindow(std::size_t max_bytes);
+
+  RetransmitWindow(const RetransmitWindow &) = delete;
+  RetransmitWindow &operator=(const RetransmitWindow &) = delete;
+
+  // Blocks until bytes more fit in the window, or it is empty, so a batch
+  // larger than the window still goes out on its own. Returns false if the
+  // connection failed or the window was cancelled while waiting
+  bool wait_for_space(std::size_t bytes);
+
+  // Blocks until every frame in the window has been acknowledged. Returns
+  // false if the connection failed or the window was cancelled first
+  bool wait_until_acknowledged();
+
+  // Takes the chunks of a batch about to be written
+  void push(std::vector<ChunkPtr> &chunks);
+
+  // Releases the frames of every chunk up to and including sequence number
+  // chunks_written
+  void acknowledge(uint64_t chunks_written);
+
+  // Wakes the waiters to recover the connection, until reset() is called
+  // once it has been recovered
+  void fail();
+  void reset();
+  bool failed() const;
+
+  // Wakes the waiters for good, e.g. on abort
+  void cancel();
+
+  // The frames of every chunk after sequence number chunks_received. Must
+  // only be called while no acknowledgements are being read, as the frames
+  // are released by acknowledge()
+  std::vector<asio::const_buffer> frames_after(uint64_t chunks_received) const;
+
+  uint64_t acknowledged() const;
+
+private:
+  const std::size_t max_bytes_;
+  mutable std::mutex mutex_;
+  std::condition_variable changed_;
+  std::deque<ChunkPtr> chunks_;
+  std::size_t bytes_ = 0;
+  uint64_t acknowledged_ = 0;
+  bool failed_ = false;
+  bool cancelled_ = false;
+};
+
+#endif
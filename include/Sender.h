@@ -1,31 +1,149 @@
 #ifndef SENDER_H
 #define SENDER_H
 
+#include "RateLimiter.h"
+#include "SessionTicket.h"
+#include "SocketOptions.h"
 #include "TcpSocket.h"
+#include "UdpSocket.h"
 #include "crypto.h"
+#include <array>
+#include <memory>
+#include <optional>
 #include <string>
+#include <variant>
+#include <vector>
 
+#include "TransferManager.h"
 #include "TransferRequest.h"
 
+// What reading the files leaves in the sender's page cache
+enum class PageCacheMode {
+  // Files stay cached once read
+  KEEP,
+  // Pages are dropped behind the reads
+  DROP,
+  // Files are read with O_DIRECT, bypassing the cache
+  DIRECT,
+};
+
+// Sender settings chosen on the command line
+struct SendOptions {
+  // More than one thread switches the session to independently sealed
+  // chunks, which the receiver then also decrypts in parallel
+  unsigned int encryption_threads = 1;
+
+  // Compress chunks before encryption, skipping data that does not compress
+  bool compress = false;
+
+  // Number of compression workers when compressing
+  unsigned int compression_threads = 1;
+
+  // Uncompressed chunk size, 0 picks one from the staged file sizes
+  uint32_t chunk_size = 0;
+
+  // How outgoing frames are coalesced into gather writes
+  FrameBatchLimits batch_limits;
+
+  // Batches whose frames average at least this many bytes are sent with
+  // MSG_ZEROCOPY where supported, 0 always copies
+  std::size_t zero_copy_threshold = 0;
+
+  // Number of connections the chunks are striped across
+  unsigned int streams = 1;
+
+  // Applied to every connection
+  SocketOptions socket_options;
+
+  // Cap on the bytes per second sent across all connections, 0 unlimited,
+  // and the burst the pacing allows, 0 picking one from the rate. Either
+  // can be changed during the transfer through the rate limit control file
+  uint64_t rate_limit = 0;
+  uint64_t rate_burst = 0;
+
+  // Bytes of sent frames kept until the receiver acknowledges them, so that
+  // a single connection transfer can reconnect and resume where it stopped.
+  // 0 turns resuming off. Not used by striped, zero-copy or MSG_ZEROCOPY
+  // transfers
+  std::size_t retransmit_window = DEFAULT_RETRANSMIT_WINDOW_BYTES;
+
+  // Carry the chunk frames over UDP with the transport's own congestion
+  // control, for single connection transfers that are not resumed. The
+  // handshake and transfer request still go over TCP
+  bool udp = false;
+
+  // Connect with a session ticket from an earlier transfer to the same
+  // receiver instead of hashing the password, and keep the ticket the
+  // receiver issues
+  bool session_tickets = true;
+
+  // Read files through memory mappings instead of read() calls
+  bool mapped_reads = false;
+
+  // Keep the files out of the page cache while reading them. Not used by
+  // zero-copy transfers, whose data is sent from the cache
+  PageCacheMode page_cache = PageCacheMode::KEEP;
+
+  // Encrypt chunk payloads. Turning it off sends file data in the clear,
+  // and sends uncompressed single connection transfers with sendfile()
+  bool encrypt = true;
+};
+
 class Sender {
 public:
   Sender(const std::string &receiver_ip, const uint16_t receiver_port,
-         const crypto::Key &key, const crypto::Salt &salt);
+         const std::string &password,
+         const SendOptions &options = SendOptions());
   void start_session();
 
 private:
   const std::string receiver_ip_;
   const uint16_t receiver_port_;
-  const crypto::Key key_;
-  const crypto::Salt salt_;
+  const std::string password_;
+  const SendOptions options_;
+  TicketCache ticket_cache_;
   TcpSocket receiver_socket_;
+  RateLimiter rate_limiter_;
+
+  // Key and handshake header of the session, which the tokens of additional
+  // and resumed connections are tied to, and the last reconnection attempt
+  std::optional<crypto::Key> key_;
+  std::array<uint8_t, crypto::HEADER_SIZE> session_header_;
+  uint32_t reconnect_attempt_ = 0;
+
+  // Additional connections of a striped transfer, receiver_socket_ being the
+  // first
+  std::vector<std::unique_ptr<TcpSocket>> stream_sockets_;
+
+  // Socket of a UDP transfer, connected to the port the receiver answered
+  // the transfer request with
+  UdpSocket udp_socket_;
+
+  // std::monostate for a plaintext session
+  using ChunkEncryption =
+      std::variant<std::monostate, crypto::Encryptor, crypto::ChunkCipher>;
 
   void connect_to_receiver();
-  bool send_handshake(const crypto::Encryptor &encryptor);
   TransferRequest create_transfer_request();
-  bool send_transfer_request(const TransferRequest &transfer_request);
+  bool resumable() const;
+  RequestVerdict
+  open_session(const TransferRequest &transfer_request,
+               const SessionTicket *ticket,
+               std::array<uint8_t, crypto::HEADER_SIZE> &header,
+               std::optional<ChunkEncryption> &chunk_encryption_opt);
+  RequestVerdict
+  send_handshake(const std::vector<uint8_t> &credentials,
+                 crypto::CipherMode cipher_mode,
+                 const std::array<uint8_t, crypto::HEADER_SIZE> &header,
+                 const TransferRequest &transfer_request);
+  void receive_ticket(const std::array<uint8_t, crypto::HEADER_SIZE> &header);
+  bool open_udp_transport();
+  void open_streams(uint8_t num_streams,
+                    const std::array<uint8_t, crypto::HEADER_SIZE> &header);
   void send_files(const TransferRequest &transfer_request,
-                  crypto::Encryptor encryptor);
+                  ChunkEncryption chunk_encryption);
+  void send_files_zero_copy(const TransferRequest &transfer_request);
+  uint64_t reconnect_to_receiver();
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,95 @@
+#ifndef SESSION_TICKET_H
+#define SESSION_TICKET_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "crypto.h"
+
+// How long a ticket stays valid after the receiver issues it
+inline constexpr std::chrono::hours TICKET_LIFETIME(24);
+
+// Largest ticket either side accepts, well above the size of those issued
+inline constexpr std::size_t MAX_TICKET_SIZE = 1024;
+
+/*
+A session ticket lets the sender skip the password hash (Argon2) on later
+connections to the same receiver.
+
+After a successful handshake the receiver issues a ticket: a random secret
+and an expiry time, sealed under a ticket key only the receiver knows. The
+sender gets the ticket together with the secret and expiry, sealed under the
+session key, and keeps them in its ticket cache. On its next connection it
+presents the ticket with a fresh session random, and both sides derive the
+session key from the secret and the random. The receiver opens the ticket
+to learn the secret, so it keeps no state per ticket.
+*/
+struct SessionTicket {
+  std::array<uint8_t, crypto::TICKET_SECRET_SIZE> secret{};
+
+  // Unix time in seconds
+  uint64_t expiry = 0;
+
+  // Opaque to the sender
+  std::vector<uint8_t> ticket;
+
+  bool expired() const;
+
+  // Layout: secret, expiry [8 bytes, little endian], ticket
+  std::vector<uint8_t> serialize() const;
+  static std::optional<SessionTicket>
+  deserialize(const std::vector<uint8_t> &buffer);
+};
+
+// Directory of the sender's ticket cache and the receiver's ticket master
+// key, $XDG_STATE_HOME/trit or ~/.local/state/trit. Unlike .trit in the
+// working directory, it outlives the staged files
+std::filesystem::path ticket_directory();
+
+// The sender's tickets, one per receiver IP address. Nothing derived from
+// the password is stored with them, a ticket issued under another password
+// is rejected by the receiver
+class TicketCache {
+public:
+  explicit TicketCache(std::filesystem::path directory = ticket_directory());
+
+  std::optional<SessionTicket> load(const std::string &receiver_ip) const;
+
+  // Throws if the ticket cannot be written
+  void store(const std::string &receiver_ip,
+             const SessionTicket &ticket) const;
+  void remove(const std::string &receiver_ip) const;
+
+private:
+  const std::filesystem::path directory_;
+
+  std::filesystem::path path(const std::string &receiver_ip) const;
+};
+
+// Issues and redeems the receiver's tickets. The ticket key is derived from
+// a master key kept in the ticket directory and from the password, so
+// tickets issued under another password are not redeemed
+class TicketIssuer {
+public:
+  // Creates the master key on first use. Throws if it can be neither read
+  // nor created
+  TicketIssuer(const std::string &password,
+               const std::filesystem::path &directory = ticket_directory());
+
+  SessionTicket issue() const;
+
+  // Returns the secret of a ticket this receiver issued that has not
+  // expired, or std::nullopt
+  std::optional<std::array<uint8_t, crypto::TICKET_SECRET_SIZE>>
+  redeem(const std::vector<uint8_t> &ticket) const;
+
+private:
+  crypto::Key ticket_key_;
+};
+
+#endif
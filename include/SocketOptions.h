@@ -0,0 +1,49 @@
+#ifndef SOCKET_OPTIONS_H
+#define SOCKET_OPTIONS_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+// Settings applied to every connection of a transfer. Unset values keep the
+// system defaults, which for the buffer sizes means the kernel autotunes them
+struct SocketOptions {
+  // Disables Nagle's algorithm (TCP_NODELAY), so the small handshake
+  // messages are not held back waiting for an acknowledgement
+  bool no_delay = true;
+
+  // SO_SNDBUF and SO_RCVBUF in bytes
+  std::optional<std::size_t> send_buffer_size;
+  std::optional<std::size_t> receive_buffer_size;
+
+  // Sizes both buffers from the round trip time the kernel measured during
+  // the handshake and link_rate, instead of fixed sizes
+  bool auto_buffer_size = false;
+
+  // Expected bandwidth of the path in bytes per second, for
+  // auto_buffer_size
+  uint64_t link_rate = 10'000'000'000 / 8;
+
+  // Corks the socket (TCP_CORK) while a batch of frames is written, so no
+  // partial segment goes out between the writes of one batch
+  bool cork_batches = false;
+
+  // Congestion control algorithm (TCP_CONGESTION) such as "bbr", empty keeps
+  // the system default
+  std::string congestion_control;
+
+  // Enables TCP keepalive probes (SO_KEEPALIVE) on idle connections
+  bool keep_alive = false;
+
+  // Share of outgoing UDP transport datagrams dropped on purpose, between 0
+  // and 1, to exercise loss recovery on a lossless path such as loopback
+  double datagram_loss_rate = 0;
+
+  // Buffer size covering the bandwidth-delay product of link_rate over the
+  // given round trip time, with room for the kernel's bookkeeping overhead
+  std::size_t buffer_size_for_rtt(std::chrono::microseconds rtt) const;
+};
+
+#endif
@@ -0,0 +1,262 @@
+#ifndef SPSC_RING_QUEUE_H
+#define SPSC_RING_QUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Lock-free, fixed-capacity ring queue for exactly one producer thread and one
+// consumer thread. Exposes the same push/pop/close/cancel interface as
+// BoundedThreadSafeQueue so it can be used as a drop-in for pipeline hops.
+//
+// Waiting uses a spin-then-park strategy: a blocked side first spins for a
+// short while (cheap when the other stage is about to make progress), then
+// parks on a condition variable so idle stages do not consume CPU. The
+// mutex is only ever touched when one side is parked.
+template <typename T> class SpscRingQueue {
+public:
+  SpscRingQueue(size_t capacity)
+      : capacity_(capacity), mask_(round_up_to_power_of_two(capacity) - 1),
+        slots_(mask_ + 1),
+        spin_limit_(std::thread::hardware_concurrency() > 1 ? SPIN_LIMIT : 0) {
+    static_assert(std::is_default_constructible_v<T>,
+                  "SpscRingQueue elements must be default constructible");
+    if (capacity_ == 0) {
+      throw std::logic_error("Queue capacity must be greater than 0");
+    }
+  }
+
+  // Non-copyable, non-movable since the indices are shared across threads
+  SpscRingQueue(const SpscRingQueue &) = delete;
+  SpscRingQueue &operator=(const SpscRingQueue &) = delete;
+
+  // Producer only. Blocks while the queue is full, returns false if the queue
+  // was cancelled before the element could be pushed
+  bool push(T &&elem) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ >= capacity_) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      if (tail - cached_head_ >= capacity_) {
+        if (!wait_for(producer_parked_, [&]() {
+              cached_head_ = head_.load(std::memory_order_acquire);
+              return tail - cached_head_ < capacity_;
+            })) {
+          return false;
+        }
+      }
+    }
+    if (closed_.load(std::memory_order_relaxed)) {
+      throw std::logic_error("Cannot push to a closed queue");
+    }
+    slots_[tail & mask_] = std::move(elem);
+    tail_.store(tail + 1, std::memory_order_release);
+    wake(consumer_parked_);
+    return true;
+  }
+
+  template <typename... Args> bool emplace(Args &&...args) {
+    return push(T(std::forward<Args>(args)...));
+  }
+
+  // Consumer only. Blocks until an element is available. Returns std::nullopt
+  // once the queue has been closed and fully drained, or when cancelled
+  std::optional<T> pop() {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (cancelled_.load(std::memory_order_acquire)) {
+      return std::nullopt;
+    }
+    if (!readable(head)) {
+      if (!wait_for(consumer_parked_, [&]() {
+            return readable(head) || closed_.load(std::memory_order_acquire);
+          })) {
+        return std::nullopt;
+      }
+      // Re-check after close since the producer may have pushed its final
+      // element right before closing
+      if (!readable(head)) {
+        return std::nullopt;
+      }
+    }
+    return take(head);
+  }
+
+  // Consumer only. Like pop(), but gives up and returns std::nullopt once the
+  // deadline has passed without an element becoming available
+  std::optional<T>
+  pop_until(const std::chrono::steady_clock::time_point &deadline) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (cancelled_.load(std::memory_order_acquire)) {
+      return std::nullopt;
+    }
+    if (!readable(head)) {
+      wait_for(
+          consumer_parked_,
+          [&]() {
+            return readable(head) || closed_.load(std::memory_order_acquire);
+          },
+          deadline);
+      if (cancelled_.load(std::memory_order_acquire) || !readable(head)) {
+        return std::nullopt;
+      }
+    }
+    return take(head);
+  }
+
+  // Consumer only
+  std::optional<T> try_pop() {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (cancelled_.load(std::memory_order_acquire) || !readable(head)) {
+      return std::nullopt;
+    }
+    return take(head);
+  }
+
+  // Producer only. Marks the end of the stream, the consumer may still drain
+  // queued elements
+  void close() {
+    closed_.store(true, std::memory_order_release);
+    wake(consumer_parked_, true);
+  }
+
+  // Any thread. Aborts the stream and wakes both sides. Queued elements are
+  // left in place and destroyed with the queue, since the consumer may still
+  // be touching its slot
+  void cancel() {
+    cancelled_.store(true, std::memory_order_release);
+    wake(consumer_parked_, true);
+    wake(producer_parked_, true);
+  }
+
+  bool closed() const {
+    return closed_.load(std::memory_order_acquire) ||
+           cancelled_.load(std::memory_order_acquire);
+  }
+
+  bool empty() const { return size() == 0; }
+
+  bool full() const { return size() >= capacity_; }
+
+  size_t size() const {
+    return tail_.load(std::memory_order_acquire) -
+           head_.load(std::memory_order_acquire);
+  }
+
+private:
+  static constexpr std::size_t CACHE_LINE_SIZE = 64;
+
+  // Number of polls before a waiting side parks on the condition variable.
+  // Spinning is skipped on single core machines where it only delays the
+  // other side
+  static constexpr int SPIN_LIMIT = 2048;
+
+  // Producer/consumer indices increase monotonically and are masked into the
+  // slot array, so tail - head is always the number of queued elements. Each
+  // index lives on its own cache line alongside the owning side's cached copy
+  // of the opposite index, so the two threads do not false-share
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> head_{0};
+  size_t cached_tail_ = 0;
+
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail_{0};
+  size_t cached_head_ = 0;
+
+  alignas(CACHE_LINE_SIZE) std::atomic<bool> closed_{false};
+  std::atomic<bool> cancelled_{false};
+  std::atomic<bool> consumer_parked_{false};
+  std::atomic<bool> producer_parked_{false};
+  std::mutex park_mutex_;
+  std::condition_variable park_cv_;
+
+  const size_t capacity_;
+  const size_t mask_;
+  std::vector<T> slots_;
+  const int spin_limit_;
+
+  static size_t round_up_to_power_of_two(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+      result <<= 1;
+    }
+    return result;
+  }
+
+  static void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+  }
+
+  bool readable(size_t head) {
+    if (head != cached_tail_) {
+      return true;
+    }
+    cached_tail_ = tail_.load(std::memory_order_acquire);
+    return head != cached_tail_;
+  }
+
+  T take(size_t head) {
+    T elem = std::move(slots_[head & mask_]);
+    head_.store(head + 1, std::memory_order_release);
+    wake(producer_parked_);
+    return elem;
+  }
+
+  // Spins and then parks until ready() holds. Returns false if cancelled, or
+  // if the optional deadline passed first
+  template <typename Ready>
+  bool wait_for(std::atomic<bool> &parked, Ready ready,
+                std::optional<std::chrono::steady_clock::time_point>
+                    deadline = std::nullopt) {
+    for (int i = 0; i < spin_limit_; ++i) {
+      if (cancelled_.load(std::memory_order_acquire)) {
+        return false;
+      }
+      if (ready()) {
+        return true;
+      }
+      if (deadline && std::chrono::steady_clock::now() >= *deadline) {
+        return false;
+      }
+      if (i < spin_limit_ / 2) {
+        cpu_relax();
+      } else {
+        std::this_thread::yield();
+      }
+    }
+
+    std::unique_lock<std::mutex> lock(park_mutex_);
+    parked.store(true, std::memory_order_seq_cst);
+    // Pairs with the fence in wake(): either the other side sees the parked
+    // flag, or this side sees the index it published
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto woken = [&]() {
+      return cancelled_.load(std::memory_order_acquire) || ready();
+    };
+    bool is_ready = true;
+    if (deadline) {
+      is_ready = park_cv_.wait_until(lock, *deadline, woken);
+    } else {
+      park_cv_.wait(lock, woken);
+    }
+    parked.store(false, std::memory_order_relaxed);
+    return is_ready && !cancelled_.load(std::memory_order_acquire);
+  }
+
+  void wake(std::atomic<bool> &parked, bool force = false) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (force || parked.load(std::memory_order_seq_cst)) {
+      std::lock_guard<std::mutex> lock(park_mutex_);
+      park_cv_.notify_all();
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef STRIPED_TRANSFER_MANAGER_H
+#define STRIPED_TRANSFER_MANAGER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ChunkPool.h"
+#include "ChunkQueue.h"
+#include "TcpSocket.h"
+#include "TransferManager.h"
+#include "TransferRequest.h"
+#include "WorkerContext.h"
+
+/*
+Spreads the frames of one transfer over several connections.
+
+Sending: a dispatcher hands each chunk to the connection with the fewest
+chunks queued, so a connection that gets a smaller share of a congested link
+is given fewer chunks. Every connection has its own transmitter thread which
+batches frames like a single connection transfer, and ends with an end of
+stream frame.
+
+Receiving: every connection has its own reader thread, and a bounded reorder
+buffer merges their chunks back into sequence order. Chunks on one connection
+are always in order, so the chunk the buffer waits on is always the next one
+its connection's reader will see.
+*/
+class StripedTransferManager {
+public:
+  StripedTransferManager(
+      std::vector<TcpSocket *> sockets,
+      const FrameBatchLimits &batch_limits = FrameBatchLimits(),
+      std::size_t zero_copy_threshold = 0, RateLimiter *rate_limiter = nullptr);
+
+  // Chunks queued for each connection on the sending side
+  static std::size_t stream_queue_capacity(uint32_t chunk_size,
+                                           std::size_t num_streams);
+
+  // Chunks the receiving side holds to put connections back in order
+  static std::size_t reorder_window(uint32_t chunk_size,
+                                    std::size_t num_streams);
+
+  void send_chunks(WorkerContext &ctx, ChunkQueue &input_queue,
+                   uint32_t chunk_size, std::atomic<uint32_t> &chunks_sent);
+
+  void receive_chunks(WorkerContext &ctx, ChunkPool &chunk_pool,
+                      ChunkQueue &output_queue, uint32_t chunk_size,
+                      uint32_t num_chunks);
+
+  std::size_t num_streams() const;
+
+  // One line per connection with the frames and bytes it carried and its
+  // throughput over the given duration
+  std::string stream_summary(double seconds) const;
+
+  // The socket call summaries of every connection, e.g. for the log
+  std::string send_summary() const;
+  std::string receive_summary() const;
+
+private:
+  std::vector<TcpSocket *> sockets_;
+  std::vector<std::unique_ptr<TransferManager>> streams_;
+
+  void shutdown_sockets();
+};
+
+#endif
@@ -4,12 +4,28 @@
 #include <asio.hpp>
 #include <chrono>
 #include <cstddef>
-#include <system_error>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
 
-// Simple blocking TCP socket wrapper
+#include "IoEngine.h"
+#include "SocketOptions.h"
+
+// TCP socket driven by an IoEngine. Operations are started on the socket's
+// strand and completed by the engine threads, so one thread can be blocked
+// reading while another writes.
+//
+// The asynchronous methods call their handler with (error_code, bytes) on an
+// engine thread. The blocking methods start the same operations and wait for
+// them, which keeps the pipeline stages written as plain blocking loops, and
+// throw asio::system_error on failure. They must not be called from a
+// completion handler
 class TcpSocket {
 public:
-  TcpSocket();
+  TcpSocket(IoEngine &engine = IoEngine::shared());
   ~TcpSocket();
 
   // non-copyable, non-movable
@@ -18,20 +34,163 @@ public:
   TcpSocket(TcpSocket &&) = delete;
   TcpSocket &operator=(TcpSocket &&) = delete;
 
+  // Reads until the buffers are full
+  template <typename MutableBufferSequence, typename Handler>
+  void async_read(const MutableBufferSequence &buffers, Handler handler) {
+    asio::dispatch(strand_, [this, buffers, handler]() mutable {
+      asio::async_read(socket_, buffers, std::move(handler));
+    });
+  }
+
+  // Reads whatever is available, at least one byte
+  template <typename MutableBufferSequence, typename Handler>
+  void async_read_some(const MutableBufferSequence &buffers, Handler handler) {
+    asio::dispatch(strand_, [this, buffers, handler]() mutable {
+      socket_.async_read_some(buffers, std::move(handler));
+    });
+  }
+
+  // Writes the buffers in order with as few writev calls as possible
+  template <typename ConstBufferSequence, typename Handler>
+  void async_write(const ConstBufferSequence &buffers, Handler handler) {
+    async_write(buffers, std::move(handler), nullptr);
+  }
+
   void connect(const std::string &ip, uint16_t port);
-  static void accept(uint16_t port, TcpSocket &client_socket);
+
+  // Same as connect(), but gives up after timeout, closes the socket and
+  // returns false
+  bool connect(const std::string &ip, uint16_t port,
+               std::chrono::steady_clock::duration timeout);
+
   void read(void *buf, std::size_t len);
+
+  // Same as read(), but gives up after timeout, closes the socket and
+  // returns false, e.g. when a peer connects and then sends nothing
+  bool read(void *buf, std::size_t len,
+            std::chrono::steady_clock::duration timeout);
+
+  // Reads whatever is available into the buffer sequence, blocking only
+  // until at least one byte has arrived. Returns the number of bytes read
+  template <typename MutableBufferSequence>
+  std::size_t read_some(const MutableBufferSequence &buffers) {
+    return IoEngine::wait_for(strand_, [&](auto handler) {
+      socket_.async_read_some(buffers, std::move(handler));
+    });
+  }
   void write(const void *buf, std::size_t len);
+
+  // Writes all buffers in order with as few writev calls as possible.
+  // Returns the number of calls made
+  std::size_t write(const std::vector<asio::const_buffer> &buffers);
   void close();
   bool is_open() const;
 
+  // Shuts down both directions so that a read() or write() blocked on
+  // another thread fails instead of waiting for the peer, used on abort
+  void shutdown();
+
+  // Options are applied when the socket connects or is accepted, or right
+  // away if it is already open
+  void set_options(const SocketOptions &options);
+  const SocketOptions &options() const;
+
+  // With auto_buffer_size, sizes both buffers from the round trip time
+  // measured so far. Returns the size chosen, if one was
+  std::optional<std::size_t> tune_buffer_size();
+
+  // Smoothed round trip time measured by the kernel (TCP_INFO), where
+  // available
+  std::optional<std::chrono::microseconds> round_trip_time();
+
+  // Holds back partial segments until uncorked, when cork_batches is set
+  void set_cork(bool corked);
+
+  // Settings in effect as read back from the socket, e.g. for the log
+  std::string describe_options();
+
+  // Descriptor for copies done by the kernel, such as sendfile() and
+  // splice(). The socket is in non-blocking mode, so these fail with EAGAIN
+  // until wait_writable() or wait_readable() returns
+  asio::ip::tcp::socket::native_handle_type native_handle();
+  void wait_writable();
+  void wait_readable();
+
   std::string remote_endpoint_address() const;
   uint16_t remote_endpoint_port() const;
 
 private:
-  asio::io_context io_context_;
+  friend class TcpListener;
+
+  asio::strand<asio::io_context::executor_type> strand_;
   asio::ip::tcp::socket socket_;
   asio::ip::tcp::endpoint endpoint_;
+  SocketOptions options_;
+
+  // Options the platform does not support are left at their defaults,
+  // describe_options() shows what is in effect
+  void apply_options();
+
+  // Sets endpoint_ and opens the socket for it with the options applied
+  void open_for_connect(const std::string &ip, uint16_t port);
+
+  // Same as IoEngine::wait_for() on the strand, but closes the socket once
+  // timeout has passed and then returns false
+  template <typename Initiate>
+  bool wait_for_within(std::chrono::steady_clock::duration timeout,
+                       Initiate initiate);
+
+  // Lets each write_some() of a composed write send the whole remaining
+  // buffer sequence, where ASIO's default caps a call at 64 KiB. It is
+  // consulted once before every call, which is what write_calls counts
+  struct TransferAllCountingCalls {
+    std::size_t *write_calls;
+    std::size_t operator()(const asio::error_code &ec, std::size_t) const {
+      if (ec) {
+        return 0;
+      }
+      if (write_calls) {
+        ++*write_calls;
+      }
+      return std::numeric_limits<std::size_t>::max();
+    }
+  };
+
+  template <typename ConstBufferSequence, typename Handler>
+  void async_write(const ConstBufferSequence &buffers, Handler handler,
+                   std::size_t *write_calls) {
+    asio::dispatch(strand_, [this, buffers, handler, write_calls]() mutable {
+      asio::async_write(socket_, buffers,
+                        TransferAllCountingCalls{write_calls},
+                        std::move(handler));
+    });
+  }
+};
+
+// Listening socket that stays open across any number of accepted
+// connections, e.g. for the whole lifetime of a receiver
+class TcpListener {
+public:
+  TcpListener(uint16_t port, IoEngine &engine = IoEngine::shared());
+  ~TcpListener();
+
+  // non-copyable, non-movable
+  TcpListener(const TcpListener &) = delete;
+  TcpListener &operator=(const TcpListener &) = delete;
+  TcpListener(TcpListener &&) = delete;
+  TcpListener &operator=(TcpListener &&) = delete;
+
+  // Blocks until a connection arrives and hands it to client_socket
+  void accept(TcpSocket &client_socket);
+
+  // Same as accept(), but gives up after timeout and returns false
+  bool accept(TcpSocket &client_socket,
+              std::chrono::steady_clock::duration timeout);
+  void close();
+
+private:
+  asio::strand<asio::io_context::executor_type> strand_;
+  asio::ip::tcp::acceptor acceptor_;
 };
 
 #endif // TCPSOCKET_H
@@ -1,24 +1,199 @@
 #ifndef TRANSFER_H
 #define TRANSFER_H
 
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
 
-#include "BoundedThreadSafeQueue.h"
 #include "Chunk.h"
+#include "ChunkPool.h"
+#include "ChunkQueue.h"
+#include "FrameHeader.h"
+#include "FrameReader.h"
+#include "RateLimiter.h"
+#include "ReorderBuffer.h"
+#include "RetransmitWindow.h"
 #include "TcpSocket.h"
 #include "WorkerContext.h"
+#include "ZeroCopySender.h"
+#include "crypto.h"
+
+// Size of the header preceding each chunk payload on the wire
+inline constexpr std::size_t FRAME_HEADER_SIZE = FrameHeader::SIZE;
+
+// Room reserved around every pooled chunk payload so that it can be encrypted
+// in place and sent with its frame header as one contiguous buffer
+inline constexpr std::size_t CHUNK_HEADROOM =
+    FRAME_HEADER_SIZE + crypto::ENCRYPTION_TAG_BYTES;
+inline constexpr std::size_t CHUNK_TAILROOM = crypto::ENCRYPTION_MAC_BYTES;
+
+// Most frames coalesced into one gather write, matching the number of buffers
+// ASIO hands to a single writev call
+inline constexpr std::size_t MAX_BATCH_FRAMES = 64;
+
+// Limits on how outgoing frames are coalesced. A batch is written once it
+// holds max_bytes, or once its first frame has waited max_hold for more
+// frames to arrive. A max_bytes of 0 writes every frame on its own
+struct FrameBatchLimits {
+  std::size_t max_bytes = 1024 * 1024;
+  std::chrono::microseconds max_hold{500};
+
+  // Most frames of frame_size bytes a batch can hold. A batch is only written
+  // once it reaches max_bytes, so it may overshoot by one frame
+  std::size_t max_frames(std::size_t frame_size) const {
+    const std::size_t frames = max_bytes / std::max<std::size_t>(frame_size, 1);
+    return std::min(frames + 1, MAX_BATCH_FRAMES);
+  }
+};
+
+// Most bytes of zero-copy sends the kernel may still be reading from before
+// the sender waits for completions, which bounds the chunks held for them
+inline constexpr std::size_t MAX_ZERO_COPY_PENDING_BYTES = 8 * 1024 * 1024;
+
+// Frames a resumable transfer keeps for retransmission by default
+inline constexpr std::size_t DEFAULT_RETRANSMIT_WINDOW_BYTES =
+    64 * 1024 * 1024;
+
+// Longest time the receiver of a resumable transfer waits before sending an
+// acknowledgement of newly written chunks
+inline constexpr std::chrono::milliseconds ACKNOWLEDGEMENT_INTERVAL(10);
+
+// How long both sides of a resumable transfer keep trying to replace a lost
+// connection before the transfer fails
+inline constexpr std::chrono::seconds RECONNECT_TIMEOUT(60);
+
+// Counters for the sending side, only updated by the transmission thread
+struct SendStats {
+  uint64_t frames = 0;
+  uint64_t batches = 0;
+  uint64_t bytes = 0;
+  uint64_t write_calls = 0;
+
+  // Connections recovered, and the frames sent again on them
+  uint64_t reconnects = 0;
+  uint64_t retransmitted_frames = 0;
+
+  // Of write_calls, those made with MSG_ZEROCOPY, and those of them the
+  // kernel completed by copying after all
+  uint64_t zero_copy_calls = 0;
+  uint64_t zero_copy_copied_calls = 0;
+};
+
+// Counters for the receiving side, only updated by the receiving thread
+struct ReceiveStats {
+  uint64_t frames = 0;
+  uint64_t bytes = 0;
+  uint64_t read_calls = 0;
+  uint64_t reconnects = 0;
+};
 
 class TransferManager {
 public:
+  // Batches whose frames average at least zero_copy_threshold bytes are sent
+  // with MSG_ZEROCOPY where supported, 0 always copies. Sends are paced by
+  // the rate limiter if one is given, which may be shared between connections
+  TransferManager(const FrameBatchLimits &batch_limits = FrameBatchLimits(),
+                  std::size_t zero_copy_threshold = 0,
+                  RateLimiter *rate_limiter = nullptr);
+
+  // Makes send_chunks() keep up to window_bytes of frames until the receiver
+  // acknowledges them as written, and recover a lost connection with
+  // reconnect. It must connect and authenticate the socket again and return
+  // the number of chunks the receiver has received, or throw to give up.
+  // Sending then resumes after those chunks
+  void enable_send_resume(std::size_t window_bytes,
+                          std::function<uint64_t()> reconnect);
+
+  // Makes receive_chunks() acknowledge chunks_written back to the sender, and
+  // recover a lost connection with accept_reconnect. It is given the number
+  // of chunks received, must accept and authenticate the sender's new
+  // connection on the socket and tell it that number, or throw to give up
+  void enable_receive_resume(const std::atomic<uint32_t> &chunks_written,
+                             std::function<void(uint64_t)> accept_reconnect);
+
   void send_chunks(WorkerContext &ctx, TcpSocket &socket,
-                   BoundedThreadSafeQueue<std::unique_ptr<Chunk>> &input_queue,
-                   std::atomic<bool> &input_done,
+                   ChunkQueue &input_queue, std::atomic<uint32_t> &chunks_sent);
+
+  void receive_chunks(WorkerContext &ctx, TcpSocket &socket,
+                      ChunkPool &chunk_pool, ChunkQueue &output_queue,
+                      uint32_t num_chunks);
+
+  // Receives the frames of one connection of a striped transfer until its
+  // end of stream frame, inserting them into the shared reorder buffer
+  void receive_stream(WorkerContext &ctx, TcpSocket &socket,
+                      ChunkPool &chunk_pool, ReorderBuffer &reorder_buffer,
+                      uint32_t num_chunks);
+
+  const SendStats &send_stats() const;
+
+  const ReceiveStats &receive_stats() const;
+
+  // One line summaries of the socket calls made, e.g. for the log
+  std::string send_summary() const;
+  std::string receive_summary() const;
+
+private:
+  const FrameBatchLimits batch_limits_;
+  const std::size_t zero_copy_threshold_;
+  RateLimiter *const rate_limiter_;
+  SendStats send_stats_;
+  ReceiveStats receive_stats_;
+
+  std::vector<ChunkPtr> batch_chunks_;
+  std::vector<asio::const_buffer> batch_buffers_;
+  std::vector<asio::const_buffer> slice_buffers_;
+  std::size_t batch_bytes_ = 0;
+  std::optional<ZeroCopySender> zero_copy_sender_;
+  std::array<uint8_t, FRAME_HEADER_SIZE> end_frame_;
+  bool end_frame_sent_ = false;
+
+  // Sending side of a resumable transfer, the acknowledgement reader
+  // releasing frames from the window
+  std::optional<RetransmitWindow> retransmit_window_;
+  std::function<uint64_t()> reconnect_;
+  std::thread acknowledgement_reader_;
+
+  // Receiving side of a resumable transfer. The acknowledgement sender only
+  // writes to the socket while holding acknowledgement_mutex_, which the
+  // receiving thread holds while the connection is replaced
+  const std::atomic<uint32_t> *chunks_written_ = nullptr;
+  std::function<void(uint64_t)> accept_reconnect_;
+  std::mutex acknowledgement_mutex_;
+  std::condition_variable acknowledgement_changed_;
+  std::optional<uint32_t> last_acknowledgement_;
+  bool end_received_ = false;
+  bool acknowledgements_stopped_ = false;
+
+  void send_frames(WorkerContext &ctx, TcpSocket &socket,
+                   ChunkQueue &input_queue, std::atomic<uint32_t> &chunks_sent);
+  void add_to_batch(ChunkPtr chunk_ptr);
+  void flush_batch(WorkerContext &ctx, TcpSocket &socket,
                    std::atomic<uint32_t> &chunks_sent);
+  void flush_resumable_batch(WorkerContext &ctx, TcpSocket &socket);
+  std::size_t write_frames(WorkerContext &ctx, TcpSocket &socket,
+                           const std::vector<asio::const_buffer> &buffers);
+  std::size_t write_paced(WorkerContext &ctx, TcpSocket &socket,
+                          const std::vector<asio::const_buffer> &buffers);
+  void wait_for_zero_copy(WorkerContext &ctx, std::size_t max_pending_bytes);
+  void recover_connection(WorkerContext &ctx, TcpSocket &socket);
+  void start_acknowledgement_reader(TcpSocket &socket);
+  void stop_acknowledgement_reader(TcpSocket &socket);
 
-  void
-  receive_chunks(WorkerContext &ctx, TcpSocket &socket,
-                 BoundedThreadSafeQueue<std::unique_ptr<Chunk>> &output_queue,
-                 std::atomic<bool> &output_done, uint32_t num_chunks);
+  void receive_resumable_chunks(WorkerContext &ctx, TcpSocket &socket,
+                                ChunkPool &chunk_pool,
+                                ChunkQueue &output_queue,
+                                uint32_t num_chunks);
+  void send_acknowledgements(TcpSocket &socket, uint32_t num_chunks);
+  ChunkPtr read_frame(FrameReader &frame_reader, ChunkPool &chunk_pool);
 };
 
 #endif
\ No newline at end of file
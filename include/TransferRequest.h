@@ -7,6 +7,26 @@
 #include <unordered_set>
 #include <vector>
 
+// Bounds for the negotiated chunk size. A transfer smaller than
+// MIN_CHUNK_SIZE is sent as a single chunk of its own size
+inline constexpr uint32_t MIN_CHUNK_SIZE = 64 * 1024;
+inline constexpr uint32_t MAX_CHUNK_SIZE = 4 * 1024 * 1024;
+
+// Most connections a transfer can be striped across
+inline constexpr uint8_t MAX_STREAMS = 16;
+
+// Largest sealed transfer request the receiver reads, well above what any
+// staged file list serializes to
+inline constexpr uint64_t MAX_SEALED_REQUEST_SIZE = 64 * 1024 * 1024;
+
+// The receiver's single answer to the handshake and the transfer request
+// sent with it
+enum class RequestVerdict : uint8_t {
+  HANDSHAKE_FAILED = 0,
+  DECLINED = 1,
+  ACCEPTED = 2,
+};
+
 class TransferRequest {
 public:
   // Helper struct to store file path and size pairs to be used in file_infos
@@ -20,14 +40,40 @@ public:
     FileInfo(const std::string &p, uint64_t s) : relative_path(p), size(s) {}
   };
 
+  // A chunk_size of 0 lets choose_chunk_size() pick one
   static TransferRequest
-  from_file_paths(const std::unordered_set<std::filesystem::path> &file_paths);
+  from_file_paths(const std::unordered_set<std::filesystem::path> &file_paths,
+                  bool compression_enabled = false, uint32_t chunk_size = 0,
+                  uint8_t num_streams = 1, bool resumable = false,
+                  bool udp_transport = false);
+
+  // Picks a power of two chunk size between MIN_CHUNK_SIZE and MAX_CHUNK_SIZE
+  // from the total transfer size and the distribution of file sizes
+  static uint32_t choose_chunk_size(const std::vector<FileInfo> &file_infos);
+
   static TransferRequest deserialize(const std::vector<uint8_t> &buffer);
   std::vector<uint8_t> serialize() const;
   std::vector<std::filesystem::path> get_file_paths();
   uint32_t get_chunk_size() const;
   uint32_t get_final_chunk_size() const;
   uint32_t get_num_chunks() const;
+  uint64_t get_transfer_size() const;
+
+  // Whether the sender may compress chunks, in which case the receiver must
+  // run a decompression stage
+  bool compression_enabled() const;
+
+  // Number of connections the chunks are striped across, the first being
+  // the one the request was sent on
+  uint8_t get_num_streams() const;
+
+  // Whether the receiver acknowledges written chunks and both sides
+  // reconnect to resume the transfer when its connection is lost
+  bool resumable() const;
+
+  // Whether the chunk frames are carried over UDP instead of the connection
+  // the request was sent on, see UdpTransferManager
+  bool udp_transport() const;
 
   void print() const;
   const std::vector<TransferRequest::FileInfo> &get_file_infos() const;
@@ -36,13 +82,28 @@ private:
   TransferRequest(uint32_t num_files, uint64_t transfer_size,
                   uint32_t uncompressed_chunk_size,
                   uint32_t uncompressed_last_chunk_size, uint32_t num_chunks,
+                  bool compression_enabled, uint8_t num_streams,
+                  bool resumable, bool udp_transport,
                   std::vector<FileInfo> file_infos);
 
+  // Bits of the flags byte in the serialized request
+  static constexpr uint8_t FLAG_COMPRESSION = 1 << 0;
+  static constexpr uint8_t FLAG_RESUMABLE = 1 << 1;
+  static constexpr uint8_t FLAG_UDP_TRANSPORT = 1 << 2;
+
+  // Throws if the chunk layout or file sizes are inconsistent, since a
+  // deserialized request comes off the wire
+  void validate() const;
+
   uint32_t num_files_;
   uint64_t transfer_size_;
   uint32_t uncompressed_chunk_size_;
   uint32_t uncompressed_final_chunk_size_;
   uint32_t num_chunks_;
+  bool compression_enabled_;
+  uint8_t num_streams_;
+  bool resumable_;
+  bool udp_transport_;
   std::vector<TransferRequest::FileInfo> file_infos_;
 };
 
@@ -0,0 +1,85 @@
+#ifndef UDP_CONGESTION_CONTROL_H
+#define UDP_CONGESTION_CONTROL_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+/*
+Rate-based congestion control of the UDP transport's sender.
+
+Datagrams are paced at a sending rate, and at most window() bytes are in
+flight. The rate is adjusted once per round trip from what the round's
+acknowledgements reported:
+- Starting out, the rate doubles every round until the first congested one.
+- After that it grows by 1/16 per round, and at least one datagram per round
+  trip.
+- A round is congested when over LOSS_TOLERANCE of its datagrams were lost
+  while the round trip time rose well above the lowest seen, or when a large
+  share was lost. The rate then drops by the share lost, between 1/8 and 1/2.
+- The rate is never more than twice what the last round delivered.
+
+Loss without a rising round trip time is taken as noise of the link rather
+than a full queue, so a lossy path does not hold the rate down the way it
+does TCP's congestion window. A retransmission timeout halves the rate.
+*/
+class UdpCongestionControl {
+public:
+  explicit UdpCongestionControl(std::size_t datagram_size);
+
+  // Sending rate in bytes per second, and the bytes allowed in flight
+  uint64_t rate() const;
+  std::size_t window() const;
+
+  std::chrono::microseconds smoothed_rtt() const;
+
+  // Time after which an unacknowledged datagram is taken as lost
+  std::chrono::microseconds retransmission_timeout() const;
+
+  // Time the next datagram may be sent at to keep to the rate
+  std::chrono::steady_clock::time_point next_send_time() const;
+
+  void on_sent(std::size_t bytes, std::chrono::steady_clock::time_point now);
+
+  // rtt is measured from the newest datagram acknowledged, if it was newly
+  // acknowledged
+  void on_acknowledged(std::size_t datagrams, std::size_t bytes,
+                       std::optional<std::chrono::microseconds> rtt,
+                       std::chrono::steady_clock::time_point now);
+  void on_lost(std::size_t datagrams,
+               std::chrono::steady_clock::time_point now);
+
+  // Nothing was acknowledged for a whole retransmission timeout
+  void on_timeout(std::chrono::steady_clock::time_point now);
+
+  // One line description of the state, e.g. for the log
+  std::string describe() const;
+
+private:
+  const std::size_t datagram_size_;
+  double rate_;
+  bool slow_start_ = true;
+
+  // Pacing allows a small burst to make up for the sender oversleeping
+  std::chrono::steady_clock::time_point next_send_time_;
+
+  // Round trip time estimates as in RFC 6298, and the lowest sample
+  std::optional<std::chrono::microseconds> smoothed_rtt_;
+  std::chrono::microseconds rtt_variation_{0};
+  std::optional<std::chrono::microseconds> min_rtt_;
+
+  // What the round in progress has reported, the round trip time being the
+  // lowest sample of the round
+  std::chrono::steady_clock::time_point round_start_;
+  std::size_t round_acknowledged_ = 0;
+  std::size_t round_lost_ = 0;
+  std::size_t round_bytes_ = 0;
+  std::optional<std::chrono::microseconds> round_min_rtt_;
+
+  void end_round_if_due(std::chrono::steady_clock::time_point now);
+  std::chrono::microseconds round_duration() const;
+};
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef UDPSOCKET_H
+#define UDPSOCKET_H
+
+#include <asio.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "IoEngine.h"
+#include "SocketOptions.h"
+
+// UDP socket driven by an IoEngine, for the UDP transport. Datagrams are sent
+// and received without a round trip through the engine whenever the socket
+// is ready, and only waits go through it, so one thread can keep up with a
+// high packet rate.
+//
+// The socket has an in-process loss injector: with a datagram_loss_rate in
+// its options, that share of the datagrams passed to send() is silently
+// dropped instead of sent. Methods throw asio::system_error on failure
+class UdpSocket {
+public:
+  UdpSocket(IoEngine &engine = IoEngine::shared());
+  ~UdpSocket();
+
+  // non-copyable, non-movable
+  UdpSocket(const UdpSocket &) = delete;
+  UdpSocket &operator=(const UdpSocket &) = delete;
+  UdpSocket(UdpSocket &&) = delete;
+  UdpSocket &operator=(UdpSocket &&) = delete;
+
+  // Binds to port on every IPv4 address, 0 picking a free port
+  void bind(uint16_t port);
+  uint16_t local_port() const;
+
+  // Sends to, and only receives from, ip:port from now on
+  void connect(const std::string &ip, uint16_t port);
+
+  // Same as connect(), to the sender of the last datagram received
+  void connect_to_last_sender();
+  std::string last_sender_address() const;
+
+  // Buffer sizes and the loss rate are applied when the socket is bound or
+  // connected, or right away if it is already open
+  void set_options(const SocketOptions &options);
+
+  // Sends the buffers as one datagram, waiting while the send buffer is full
+  void send(const std::vector<asio::const_buffer> &buffers);
+  void send(const void *buf, std::size_t len);
+
+  // Receives one datagram into buf, waiting up to timeout for it to arrive.
+  // Returns its size, or std::nullopt if none arrived in time. A datagram
+  // larger than len is truncated
+  std::optional<std::size_t>
+  receive(void *buf, std::size_t len,
+          std::chrono::steady_clock::duration timeout);
+
+  // Datagrams passed to send() and dropped by the loss injector
+  uint64_t datagrams_dropped() const;
+
+private:
+  asio::strand<asio::io_context::executor_type> strand_;
+  asio::ip::udp::socket socket_;
+  asio::ip::udp::endpoint last_sender_;
+  SocketOptions options_;
+  std::minstd_rand loss_generator_;
+  std::bernoulli_distribution loss_distribution_;
+  uint64_t datagrams_dropped_ = 0;
+
+  void open();
+  void apply_options();
+
+  // Waits for the socket to become readable or writable, returning false
+  // if timeout passed first
+  bool wait(asio::ip::udp::socket::wait_type type,
+            std::chrono::steady_clock::duration timeout);
+};
+
+#endif // UDPSOCKET_H
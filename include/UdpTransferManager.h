@@ -0,0 +1,156 @@
+#ifndef UDP_TRANSFER_MANAGER_H
+#define UDP_TRANSFER_MANAGER_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ChunkPool.h"
+#include "ChunkQueue.h"
+#include "FrameHeader.h"
+#include "RateLimiter.h"
+#include "UdpCongestionControl.h"
+#include "UdpSocket.h"
+#include "WorkerContext.h"
+#include "crypto.h"
+
+// Counters of the UDP transport, for the log
+struct UdpStats {
+  uint64_t datagrams = 0;
+  uint64_t retransmitted = 0;
+  uint64_t lost = 0;
+  uint64_t acknowledgements = 0;
+  uint64_t duplicates = 0;
+  uint64_t bytes = 0;
+};
+
+/*
+Carries the chunk frames of a transfer over UDP instead of TCP, for lossy
+long-haul paths where a lost segment holds up TCP's whole stream and cuts its
+congestion window.
+
+Every frame is split into datagrams of at most MAX_DATAGRAM_SIZE bytes, each
+carrying the chunk's sequence number and the offset of its part of the frame
+(see FrameHeader.h). Each datagram sent gets a new packet number, and the
+receiver selectively acknowledges the packet numbers it got. Only the parts
+of frames whose datagrams were lost are sent again, under new packet
+numbers. The receiver reassembles each chunk from its parts and passes the
+chunks on in sequence order.
+
+The sender paces datagrams with UdpCongestionControl, and the receiver only
+takes chunks within window_chunks() of the first one it has not passed on,
+which bounds the chunks borrowed from the pool on both sides.
+
+The sender opens with a hello datagram carrying a token of the session, and
+the receiver only takes datagrams from the address of a valid hello. A
+finish datagram ends the transfer once every chunk is acknowledged.
+*/
+class UdpTransferManager {
+public:
+  UdpTransferManager(UdpSocket &socket, RateLimiter *rate_limiter = nullptr);
+
+  // Chunks either side holds in flight for a chunk size
+  static std::size_t window_chunks(std::size_t chunk_size);
+
+  // Sends the hello until the receiver answers. Throws if it does not
+  // answer within HANDSHAKE_TIMEOUT
+  void connect(WorkerContext &ctx,
+               const std::array<uint8_t, crypto::DATAGRAM_TOKEN_SIZE> &token);
+
+  // Waits for a hello that verify accepts, and connects the socket to its
+  // sender. Throws if none arrives within HANDSHAKE_TIMEOUT
+  void accept(WorkerContext &ctx,
+              const std::function<bool(
+                  const std::array<uint8_t, crypto::DATAGRAM_TOKEN_SIZE> &)>
+                  &verify);
+
+  // Counts chunks in chunks_sent once the receiver has every part of them
+  void send_chunks(WorkerContext &ctx, ChunkQueue &input_queue,
+                   std::size_t chunk_size,
+                   std::atomic<uint32_t> &chunks_sent);
+  void receive_chunks(WorkerContext &ctx, ChunkPool &chunk_pool,
+                      ChunkQueue &output_queue, std::size_t chunk_size,
+                      uint32_t num_chunks);
+
+  const UdpStats &stats() const;
+  std::string send_summary() const;
+  std::string receive_summary() const;
+
+private:
+  UdpSocket &socket_;
+  RateLimiter *rate_limiter_;
+  UdpStats stats_;
+  std::array<uint8_t, MAX_DATAGRAM_SIZE> datagram_;
+
+  // Sending side. A chunk stays in outstanding_ until every part of its
+  // frame is acknowledged, and every datagram in in_flight_ until it is
+  // acknowledged or taken as lost
+  struct OutstandingChunk {
+    ChunkPtr chunk_ptr;
+    std::vector<bool> acknowledged;
+    std::size_t parts_left = 0;
+  };
+  struct Part {
+    uint64_t sequence_num = 0;
+    uint32_t offset = 0;
+  };
+  struct InFlightDatagram {
+    Part part;
+    uint32_t size = 0;
+    std::chrono::steady_clock::time_point sent;
+  };
+  UdpCongestionControl congestion_control_;
+  std::deque<OutstandingChunk> outstanding_;
+  std::map<uint64_t, InFlightDatagram> in_flight_;
+  std::size_t bytes_in_flight_ = 0;
+  std::deque<Part> lost_parts_;
+  uint64_t next_packet_num_ = 1;
+  uint64_t next_sequence_num_ = 1;
+  uint64_t receiver_next_sequence_num_ = 1;
+  std::chrono::steady_clock::time_point last_acknowledgement_;
+
+  // Next part of the newest chunk to send for the first time
+  Part next_part_{1, 0};
+
+  // Receiving side. Chunks being reassembled from first_missing_ on, and the
+  // ranges of packet numbers received, first to last
+  struct Reassembly {
+    ChunkPtr chunk_ptr;
+    std::array<uint8_t, FrameHeader::SIZE> header;
+    uint32_t frame_size = 0;
+    std::vector<bool> received;
+    std::size_t parts_left = 0;
+  };
+  std::deque<Reassembly> reassemblies_;
+  uint64_t first_missing_ = 1;
+  std::map<uint64_t, uint64_t> received_ranges_;
+  std::size_t unacknowledged_datagrams_ = 0;
+  std::chrono::steady_clock::time_point acknowledgement_due_;
+
+  OutstandingChunk *outstanding_chunk(uint64_t sequence_num);
+  bool next_part_to_send(Part &part, bool &resent);
+  bool has_part_to_send();
+  bool part_acknowledged(const Part &part);
+  bool send_part(WorkerContext &ctx, const Part &part, bool resent,
+                 std::chrono::steady_clock::time_point now);
+  void read_acknowledgements(std::chrono::steady_clock::duration timeout);
+  void handle_acknowledgement(const DatagramAcknowledgement &acknowledgement,
+                              std::chrono::steady_clock::time_point now);
+  void detect_timeouts(std::chrono::steady_clock::time_point now);
+  void send_finish();
+
+  void handle_data(std::size_t size, ChunkPool &chunk_pool,
+                   std::size_t max_frame_size, std::size_t window,
+                   uint32_t num_chunks);
+  void record_received(uint64_t packet_num);
+  void send_acknowledgement();
+};
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef UNCACHED_FILE_READER_H
+#define UNCACHED_FILE_READER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+
+/*
+Reads files front to back without leaving them in the page cache, so that
+sending a dataset far larger than memory does not evict the cache of
+everything else running on the machine.
+
+Drop-behind reads with pread() and tells the kernel with posix_fadvise()
+to read ahead a window of READAHEAD bytes past the cursor, and to drop the
+pages behind it once they are copied. Pages of the file that were cached
+before it was sent are dropped as well.
+
+Direct reads open the file with O_DIRECT, which bypasses the page cache
+altogether. The kernel then transfers whole aligned blocks straight into
+user memory, so reads go through a buffer of DIRECT_BUFFER_SIZE bytes
+aligned to DIRECT_ALIGNMENT, allocated once and reused for every file, and
+are copied from there into chunks. Files on filesystems that refuse
+O_DIRECT, such as tmpfs, are read with drop-behind instead.
+*/
+class UncachedFileReader {
+public:
+  static constexpr std::size_t READAHEAD = 8 * 1024 * 1024;
+  static constexpr std::size_t DIRECT_ALIGNMENT = 4096;
+  static constexpr std::size_t DIRECT_BUFFER_SIZE = 4 * 1024 * 1024;
+
+  // Whether the platform supports either mode, the reader throws where it
+  // does not
+  static bool supported();
+
+  explicit UncachedFileReader(bool direct);
+  ~UncachedFileReader();
+
+  UncachedFileReader(const UncachedFileReader &) = delete;
+  UncachedFileReader &operator=(const UncachedFileReader &) = delete;
+
+  // Closes the previous file, dropping what is left of it from the cache.
+  // Throws if the file cannot be opened
+  void open(const std::filesystem::path &path, uint64_t size);
+
+  // Copies the next len bytes of the file into dest. Throws if the file
+  // ends before them
+  void read(uint8_t *dest, std::size_t len);
+
+  void close();
+
+private:
+  struct AlignedFree {
+    void operator()(uint8_t *buffer) const;
+  };
+
+  const bool direct_;
+  std::unique_ptr<uint8_t, AlignedFree> direct_buffer_;
+
+  std::filesystem::path path_;
+  int fd_ = -1;
+  bool fd_direct_ = false;
+  uint64_t size_ = 0;
+  uint64_t offset_ = 0;
+
+  // Drop-behind: end of the range advised for readahead, and start of the
+  // range not yet dropped
+  uint64_t readahead_end_ = 0;
+  uint64_t dropped_end_ = 0;
+
+  // Direct: file range held in the buffer
+  uint64_t buffer_start_ = 0;
+  uint64_t buffer_end_ = 0;
+
+  void read_cached(uint8_t *dest, std::size_t len);
+  void read_direct(uint8_t *dest, std::size_t len);
+  std::size_t read_at(uint8_t *dest, std::size_t len, uint64_t offset);
+};
+
+#endif
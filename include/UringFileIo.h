@@ -0,0 +1,76 @@
+#ifndef URING_FILE_IO_H
+#define URING_FILE_IO_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "ChunkPool.h"
+#include "ChunkQueue.h"
+#include "TransferRequest.h"
+#include "WorkerContext.h"
+
+/*
+Reads the files of a transfer into chunks and writes chunks back into files
+through io_uring, keeping many requests in flight instead of the single
+blocking read or write of FileManager's stream path, so that devices with
+deep queues such as NVMe drives are kept busy.
+
+Every chunk is mapped to the pieces of the files it covers by a ChunkIndex,
+and each piece is read or written at its offset in its file by requests of
+at most MAX_REQUEST_SIZE bytes. Up to CHUNKS_IN_FLIGHT chunks are worked on
+at once, and their requests may complete in any order. Read chunks are
+still passed on in sequence order. Chunks to write may arrive in any order,
+and are counted as written once every chunk before them is.
+
+Files are opened when their first request is submitted and closed once all
+their bytes are done, so the number of open files stays near QUEUE_DEPTH
+however small the files are. Written files are created and preallocated
+beforehand by WriteBehind::preallocate_files(), and a WriteBehind per file
+follows the writes as they complete.
+
+Only built with TRIT_WITH_IO_URING. FileManager falls back to its stream
+path where it is not built or the kernel refuses to set up a ring.
+*/
+class UringFileIo {
+public:
+  // Requests submitted to the kernel at once
+  static constexpr unsigned QUEUE_DEPTH = 64;
+
+  // Larger pieces are split, so that a large chunk is spread across the
+  // device's queues too
+  static constexpr std::size_t MAX_REQUEST_SIZE = 512 * 1024;
+
+  // Chunks read or written at once, which are borrowed from the chunk pool
+  // on top of those in the pipeline queues
+  static constexpr std::size_t CHUNKS_IN_FLIGHT = 16;
+
+  // Whether trit was built with io_uring support
+  static bool supported();
+
+  // Sets up the ring. Throws if io_uring is not supported or the kernel
+  // refuses it, e.g. before Linux 5.6 or when disabled by a sandbox
+  UringFileIo();
+  ~UringFileIo();
+
+  UringFileIo(const UringFileIo &) = delete;
+  UringFileIo &operator=(const UringFileIo &) = delete;
+
+  // Same contract as FileManager::read_files_into_chunks
+  void read_files_into_chunks(WorkerContext &ctx,
+                              const TransferRequest &transfer_request,
+                              ChunkPool &chunk_pool, ChunkQueue &output_queue);
+
+  // Same contract as FileManager::write_files_from_chunks
+  void write_files_from_chunks(WorkerContext &ctx,
+                               const TransferRequest &transfer_request,
+                               ChunkQueue &input_queue,
+                               std::atomic<uint32_t> &chunks_written);
+
+private:
+  struct Ring;
+  std::unique_ptr<Ring> ring_;
+};
+
+#endif
@@ -2,15 +2,43 @@
 #define WORKER_CONTEXT_H
 
 #include <atomic>
+#include <cstdint>
 #include <exception>
 #include <functional>
+#include <map>
 #include <mutex>
 
 // Context for shared worker synchronization and error handling
 class WorkerContext {
 public:
+  // Unregisters its abort callback when destroyed, for callbacks that
+  // reference state which does not live as long as the context
+  class AbortCallbackGuard {
+  public:
+    AbortCallbackGuard(WorkerContext &ctx, uint64_t id);
+    ~AbortCallbackGuard();
+    AbortCallbackGuard(const AbortCallbackGuard &) = delete;
+    AbortCallbackGuard &operator=(const AbortCallbackGuard &) = delete;
+
+  private:
+    WorkerContext &ctx_;
+    const uint64_t id_;
+  };
+
   bool should_abort() const;
 
+  // Sets the abort flag and runs every registered abort callback once
+  void abort();
+
+  // Registers a callback to run on abort (e.g. cancelling a queue so that
+  // blocked workers wake up). Runs immediately if already aborted
+  void on_abort(std::function<void()> callback);
+
+  // Same as on_abort(), but the callback is unregistered once the returned
+  // guard goes out of scope
+  [[nodiscard]] AbortCallbackGuard
+  scoped_on_abort(std::function<void()> callback);
+
   // Capture the first exception thrown across any worker thread
   void handle_exception();
 
@@ -20,6 +48,11 @@ private:
   std::atomic<bool> abort_flag_{false};
   std::mutex exception_mutex_;
   std::exception_ptr exception_ptr_ = nullptr;
+  std::mutex abort_callbacks_mutex_;
+  std::map<uint64_t, std::function<void()>> abort_callbacks_;
+  uint64_t next_callback_id_ = 0;
+
+  uint64_t add_abort_callback(std::function<void()> callback);
 };
 
-#endif // WORKER_CONTEXT_H
\ No newline at end of file
+#endif // WORKER_CONTEXT_H
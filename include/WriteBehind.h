@@ -0,0 +1,48 @@
+#ifndef WRITE_BEHIND_H
+#define WRITE_BEHIND_H
+
+#include <cstdint>
+
+#include "TransferRequest.h"
+
+/*
+Keeps the receiver's writes flowing to disk at a steady pace, instead of
+letting the kernel collect gigabytes of dirty pages and then flush them in
+stalls of several seconds.
+
+preallocate_files() creates every file of a transfer before any data is
+written and reserves its size on disk with fallocate(), so that a disk
+short of space fails the transfer at once, and each file gets its blocks in
+as few extents as the filesystem manages. The files keep a size of 0 until
+they are written, so an interrupted transfer does not leave files that look
+complete. Writers open them afterwards without truncating.
+
+A WriteBehind then follows the writes to one file. Every WRITEBACK_STEP
+bytes written are handed to the disk with sync_file_range() straight away,
+and waited for once the next step has been written, so that about two steps
+of each file are dirty or under writeback at a time and a writer faster
+than the disk is held to its pace.
+
+Elsewhere the files are only created, and writeback is left to the kernel.
+*/
+class WriteBehind {
+public:
+  static constexpr uint64_t WRITEBACK_STEP = 8 * 1024 * 1024;
+
+  // Throws if a file cannot be created or the disk is short of space.
+  // Filesystems without fallocate() are only checked by the writes
+  static void preallocate_files(const TransferRequest &transfer_request);
+
+  // Records that the file was written up to end. Writes may complete out of
+  // order, writeback covers the range up to the furthest end seen. Throws
+  // if writeback fails
+  void written(int fd, uint64_t end);
+
+private:
+  // Writeback was started up to started_end_ and has completed up to
+  // waited_end_
+  uint64_t started_end_ = 0;
+  uint64_t waited_end_ = 0;
+};
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef ZERO_COPY_SENDER_H
+#define ZERO_COPY_SENDER_H
+
+#include <asio.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "ChunkPool.h"
+#include "TcpSocket.h"
+
+/*
+Sends gather writes with MSG_ZEROCOPY, so the kernel transmits straight out
+of the chunk buffers instead of first copying them into the socket buffer.
+
+The kernel keeps reading the buffers after sendmsg() returns, until it posts
+a completion for that call on the socket's error queue. The chunks of every
+send are therefore held here, and only released back to their pool once
+reap() has seen the completion of the send's last call.
+
+Completions are numbered by the order of the sendmsg() calls on the socket,
+and TCP completes them in that order. The kernel falls back to copying when
+it cannot send from user pages, e.g. over loopback, and flags those
+completions, which copied_calls() counts.
+*/
+class ZeroCopySender {
+public:
+  explicit ZeroCopySender(TcpSocket &socket);
+
+  ZeroCopySender(const ZeroCopySender &) = delete;
+  ZeroCopySender &operator=(const ZeroCopySender &) = delete;
+
+  // Turns on SO_ZEROCOPY for the socket. Returns false where the platform or
+  // kernel does not support it
+  static bool enable(TcpSocket &socket);
+
+  // Sends all buffers, which must point into chunks, and takes ownership of
+  // those chunks until the kernel is done with them. Returns the number of
+  // sendmsg() calls made
+  std::size_t send(const std::vector<asio::const_buffer> &buffers,
+                   std::vector<ChunkPtr> &chunks);
+
+  // Releases the chunks of completed sends, waiting up to timeout for a
+  // completion if none is queued yet
+  void reap(std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+
+  // Bytes sent but not yet completed
+  std::size_t pending_bytes() const;
+  uint64_t completed_calls() const;
+  uint64_t copied_calls() const;
+
+private:
+  struct PendingSend {
+    // Completion number of the last sendmsg() call of the send
+    uint32_t last_call;
+    std::size_t bytes;
+    std::vector<ChunkPtr> chunks;
+  };
+
+  TcpSocket &socket_;
+  std::deque<PendingSend> pending_sends_;
+  std::size_t pending_bytes_ = 0;
+
+  // Completion number of the next sendmsg() call, and of the first call not
+  // yet completed
+  uint32_t next_call_ = 0;
+  uint32_t next_completion_ = 0;
+
+  uint64_t completed_calls_ = 0;
+  uint64_t copied_calls_ = 0;
+
+  bool read_completions();
+  void release_completed();
+};
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <array>
 #include <cstdint>
+#include <optional>
 #include <sodium.h>
 #include <string>
 #include <utility>
@@ -23,11 +24,79 @@ inline constexpr std::size_t HEADER_SIZE =
 inline constexpr std::size_t ENCRYPTION_ADDITIONAL_BYTES =
     crypto_secretstream_xchacha20poly1305_ABYTES;
 
+// Encrypted output is laid out as [tag][ciphertext][MAC], so the extra bytes
+// are split between one byte in front of the data and the MAC behind it
+inline constexpr std::size_t ENCRYPTION_TAG_BYTES = 1;
+inline constexpr std::size_t ENCRYPTION_MAC_BYTES =
+    ENCRYPTION_ADDITIONAL_BYTES - ENCRYPTION_TAG_BYTES;
+
+// Number of extra bytes added when a chunk is sealed on its own by a
+// ChunkCipher, laid out as [ciphertext][MAC]. Fits in the space reserved
+// behind a chunk for the stream MAC, so both modes share chunk layouts
+inline constexpr std::size_t CHUNK_SEAL_ADDITIONAL_BYTES =
+    crypto_aead_xchacha20poly1305_ietf_ABYTES;
+static_assert(CHUNK_SEAL_ADDITIONAL_BYTES <= ENCRYPTION_MAC_BYTES);
+
 inline constexpr char HANDSHAKE_TAG_LITERAL[] = "trit_bonjour";
 inline constexpr std::size_t HANDSHAKE_TAG_SIZE =
     sizeof(HANDSHAKE_TAG_LITERAL) - 1; // exclude null terminator
+
+// The handshake plaintext is the tag followed by the cipher mode byte, so the
+// mode chosen by the sender is authenticated along with the tag
+inline constexpr std::size_t HANDSHAKE_PLAINTEXT_SIZE = HANDSHAKE_TAG_SIZE + 1;
 inline constexpr std::size_t HANDSHAKE_CIPHERTEXT_SIZE =
-    HANDSHAKE_TAG_SIZE + crypto_secretbox_MACBYTES;
+    HANDSHAKE_PLAINTEXT_SIZE + crypto_secretbox_MACBYTES;
+
+// A sealed message, such as the transfer request or a session ticket, is
+// laid out as [nonce][ciphertext][MAC]
+inline constexpr std::size_t MESSAGE_NONCE_SIZE =
+    crypto_aead_xchacha20poly1305_ietf_NPUBBYTES;
+inline constexpr std::size_t MESSAGE_SEAL_ADDITIONAL_BYTES =
+    MESSAGE_NONCE_SIZE + crypto_aead_xchacha20poly1305_ietf_ABYTES;
+
+// A session resumed from a ticket derives its key from the ticket's secret
+// and a random value the sender sends in place of the salt
+inline constexpr std::size_t TICKET_SECRET_SIZE = KEY_SIZE;
+inline constexpr std::size_t SESSION_RANDOM_SIZE = 32;
+inline constexpr char TICKET_SESSION_CONTEXT[] = "trit_ticket_session";
+inline constexpr char TICKET_KEY_CONTEXT[] = "trit_ticket_key";
+
+// Authenticates each additional connection of a striped transfer
+inline constexpr std::size_t STREAM_TOKEN_SIZE = crypto_auth_BYTES;
+inline constexpr char STREAM_TOKEN_CONTEXT[] = "trit_stream";
+
+// Authenticates the sender when it reconnects to resume a transfer
+inline constexpr std::size_t RESUME_TOKEN_SIZE = crypto_auth_BYTES;
+inline constexpr char RESUME_TOKEN_CONTEXT[] = "trit_resume";
+
+// Authenticates the sender's first datagram on the UDP transport
+inline constexpr std::size_t DATAGRAM_TOKEN_SIZE = crypto_auth_BYTES;
+inline constexpr char DATAGRAM_TOKEN_CONTEXT[] = "trit_datagram";
+static_assert(KEY_SIZE == crypto_auth_KEYBYTES);
+
+// How chunk payloads are encrypted for a session
+enum class CipherMode : uint8_t {
+  // One secretstream across all chunks, must be processed in order on a
+  // single thread
+  STREAM = 0,
+  // Every chunk sealed on its own by a ChunkCipher, can be processed by any
+  // number of threads
+  CHUNKED = 1,
+  // Chunk payloads are sent unencrypted and unauthenticated, for trusted
+  // networks only. The key still authenticates the handshake and the
+  // additional connections of a striped transfer
+  PLAINTEXT = 2,
+};
+
+// How the sender proves it knows the password, the first byte of the
+// handshake
+enum class HandshakeKind : uint8_t {
+  // Followed by the salt the key is derived from with the password
+  PASSWORD = 0,
+  // Followed by a session ticket and the session random the key is derived
+  // from with the ticket's secret
+  TICKET = 1,
+};
 
 class Nonce {
 public:
@@ -54,6 +123,9 @@ private:
 class Key {
 public:
   Key(const std::string &password, const Salt &salt);
+
+  // Takes key bytes derived by other means, e.g. from a session ticket
+  explicit Key(const std::array<uint8_t, KEY_SIZE> &bytes);
   const uint8_t *data() const noexcept;
   std::size_t size() const noexcept;
 
@@ -75,7 +147,9 @@ public:
   const std::array<uint8_t, HEADER_SIZE> &header() const noexcept;
 
   // Encrypts a buffer with output size guaranteed to be len +
-  // ENCRYPTION_ADDITIONAL_BYTES
+  // ENCRYPTION_ADDITIONAL_BYTES. Encrypts in place when
+  // output + ENCRYPTION_TAG_BYTES == data, in which case the MAC is written
+  // into the ENCRYPTION_MAC_BYTES following the data
   void encrypt(const uint8_t *data, std::size_t len, uint8_t *output,
                std::size_t *out_len, bool is_final = false);
 
@@ -96,7 +170,8 @@ public:
   Decryptor &operator=(Decryptor &&) = default;
 
   // Decrypts a buffer with output size guaranteed to be len -
-  // ENCRYPTION_ADDITIONAL_BYTES
+  // ENCRYPTION_ADDITIONAL_BYTES. Decrypts in place when
+  // output == input + ENCRYPTION_TAG_BYTES
   void decrypt(const uint8_t *input, std::size_t len, uint8_t *output,
                std::size_t *out_len, bool &is_final);
 
@@ -104,18 +179,126 @@ private:
   crypto_secretstream_xchacha20poly1305_state state_;
 };
 
+// Seals chunks independently with XChaCha20-Poly1305 (IETF) under a subkey
+// derived from the shared key and a random per-session id. The sequence
+// number and final-chunk flag make up the nonce and the associated data, so a
+// chunk that is reordered, replayed into another position or presented as
+// the last one fails authentication. Holds no mutable state, so one instance
+// may be shared by any number of threads
+class ChunkCipher {
+public:
+  ChunkCipher(const Key &key,
+              const std::array<uint8_t, HEADER_SIZE> &session_id);
+
+  // Generates a random session id (must be sent to receiver in place of the
+  // stream header)
+  static std::array<uint8_t, HEADER_SIZE> generate_session_id();
+
+  // Encrypts len bytes at data in place and writes the MAC into the
+  // CHUNK_SEAL_ADDITIONAL_BYTES following them
+  void seal(uint8_t *data, std::size_t len, uint64_t sequence_num,
+            bool is_final) const;
+
+  // Decrypts len bytes of ciphertext and MAC at data in place, returning the
+  // plaintext length. Throws if authentication fails
+  std::size_t open(uint8_t *data, std::size_t len, uint64_t sequence_num,
+                   bool is_final) const;
+
+private:
+  std::array<uint8_t, KEY_SIZE> subkey_;
+};
+
 void init_sodium();
 
-// Creates a nonce and encrypts the handshake tag with the provided key
+// Creates a nonce and encrypts the handshake tag and cipher mode with the
+// provided key
 std::pair<Nonce, std::array<uint8_t, HANDSHAKE_CIPHERTEXT_SIZE>>
-encrypt_handshake_tag(const Key &key);
+encrypt_handshake_tag(const Key &key, CipherMode cipher_mode);
 
 // Attempts to decrypt and verify the provided ciphertext of the handshake tag
-// given a key and nonce
-bool verify_handshake_tag(
+// given a key and nonce. Returns the cipher mode requested by the sender, or
+// std::nullopt if verification failed
+std::optional<CipherMode> verify_handshake_tag(
     const Key &key, const Nonce &nonce,
     const std::array<uint8_t, HANDSHAKE_CIPHERTEXT_SIZE> &ciphertext);
 
+// Encrypts a message with a random nonce, authenticating the associated data
+// along with it
+std::vector<uint8_t> seal_message(const Key &key,
+                                  const std::vector<uint8_t> &message,
+                                  const uint8_t *ad, std::size_t ad_len);
+
+// Decrypts a sealed message, or returns std::nullopt if it fails
+// authentication
+std::optional<std::vector<uint8_t>>
+open_message(const Key &key, const std::vector<uint8_t> &sealed_message,
+             const uint8_t *ad, std::size_t ad_len);
+
+// Encrypts a serialized transfer request with a random nonce, bound to the
+// session identified by its handshake header, so that it can be sent along
+// with the handshake before the receiver has verified the key
+std::vector<uint8_t>
+seal_transfer_request(const Key &key,
+                      const std::array<uint8_t, HEADER_SIZE> &session_header,
+                      const std::vector<uint8_t> &request);
+
+// Decrypts a sealed transfer request, or returns std::nullopt if it fails
+// authentication
+std::optional<std::vector<uint8_t>>
+open_transfer_request(const Key &key,
+                      const std::array<uint8_t, HEADER_SIZE> &session_header,
+                      const std::vector<uint8_t> &sealed_request);
+
+// Derives the key of a session resumed from a ticket. Every session gets a
+// fresh key from its own session random, without hashing the password
+Key derive_ticket_session_key(
+    const std::array<uint8_t, TICKET_SECRET_SIZE> &ticket_secret,
+    const std::array<uint8_t, SESSION_RANDOM_SIZE> &session_random);
+
+// Derives the key the receiver seals its tickets with from its stored
+// master key and the password, so that changing the password invalidates
+// every ticket issued under the old one
+Key derive_ticket_key(const std::array<uint8_t, KEY_SIZE> &master_key,
+                      const std::string &password);
+
+// Computes the token the sender presents on additional connection number
+// stream_index of the session identified by its handshake header
+std::array<uint8_t, STREAM_TOKEN_SIZE>
+make_stream_token(const Key &key,
+                  const std::array<uint8_t, HEADER_SIZE> &session_header,
+                  uint8_t stream_index);
+
+// Checks a token presented for connection stream_index in constant time
+bool verify_stream_token(
+    const Key &key, const std::array<uint8_t, HEADER_SIZE> &session_header,
+    uint8_t stream_index, const std::array<uint8_t, STREAM_TOKEN_SIZE> &token);
+
+// Computes the token the sender presents on its reconnection attempt number
+// attempt to the session identified by its handshake header. The receiver
+// only accepts attempt numbers above the last one it accepted, so a
+// recorded reconnection cannot be replayed
+std::array<uint8_t, RESUME_TOKEN_SIZE>
+make_resume_token(const Key &key,
+                  const std::array<uint8_t, HEADER_SIZE> &session_header,
+                  uint32_t attempt);
+
+// Checks a token presented for reconnection attempt number attempt in
+// constant time
+bool verify_resume_token(
+    const Key &key, const std::array<uint8_t, HEADER_SIZE> &session_header,
+    uint32_t attempt, const std::array<uint8_t, RESUME_TOKEN_SIZE> &token);
+
+// Computes the token the sender presents in its first datagram to the UDP
+// transport of the session identified by its handshake header
+std::array<uint8_t, DATAGRAM_TOKEN_SIZE>
+make_datagram_token(const Key &key,
+                    const std::array<uint8_t, HEADER_SIZE> &session_header);
+
+// Checks a token presented in a first datagram in constant time
+bool verify_datagram_token(
+    const Key &key, const std::array<uint8_t, HEADER_SIZE> &session_header,
+    const std::array<uint8_t, DATAGRAM_TOKEN_SIZE> &token);
+
 } // namespace crypto
 
 #endif
\ No newline at end of file
@@ -2,12 +2,14 @@
 #define UTILS_H
 
 #include <algorithm>
+#include <chrono>
 #include <cstdint>
 #include <cstring>
 #include <filesystem>
 #include <iostream>
 #include <limits>
 #include <optional>
+#include <stdexcept>
 #include <string>
 #include <unordered_set>
 #include <vector>
@@ -18,12 +20,14 @@
 // stateless and no data is shared between them
 namespace utils {
 
-// Shared constants
-constexpr uint32_t MAX_UNCOMPRESSED_CHUNK_SIZE = 8192;
-
 // Non-template function declarations
 bool is_valid_ip_address(const std::string &ip);
 bool is_valid_port(const std::string &port);
+// Parses a plain decimal number, std::nullopt if invalid or out of range
+std::optional<uint64_t> parse_unsigned(const std::string &str);
+// Parses a byte count with an optional binary unit suffix (K, M or G, e.g.
+// "512K" is 524288), std::nullopt if invalid or out of range
+std::optional<uint64_t> parse_data_size(const std::string &str);
 std::optional<std::string> get_local_ipv4_address();
 uint16_t generate_random_port();
 bool local_port_available(uint16_t port);
@@ -33,11 +37,16 @@ std::string format_data_size(uint64_t size_in_bytes);
 // format follows std::put_time format string
 std::string get_timestamp(const std::string &format);
 void log(const std::string &message);
+// CPU time consumed by the calling thread so far
+std::chrono::nanoseconds thread_cpu_time();
 std::filesystem::path relative_to_cwd(const std::filesystem::path &path);
 std::unordered_set<std::filesystem::path>
 relative_to_cwd(const std::unordered_set<std::filesystem::path> &paths);
 std::string str_join(const std::vector<std::string> &strings,
                      const std::string &delimiter);
+// Error for a failed system call, what followed by the description of the
+// errno value, e.g. system_failure("Failed to open file x", errno)
+std::runtime_error system_failure(const std::string &what, int error);
 
 // Template function definitions
 
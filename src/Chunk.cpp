@@ -1,23 +1,88 @@
 
 #include "Chunk.h"
+#include "ChunkPool.h"
 
-Chunk::Chunk(uint64_t sequence_num, std::vector<uint8_t> &&data)
-    : sequence_num_(sequence_num), compressed_(false),
-      original_size_(data.size()), data_(std::move(data)) {};
+#include <stdexcept>
+#include <string>
 
-Chunk::Chunk(uint64_t sequence_num, std::vector<uint8_t> &&data,
-             uint16_t original_size)
-    : sequence_num_(sequence_num), compressed_(true),
-      original_size_(original_size), data_(std::move(data)) {};
+void ChunkDeleter::operator()(Chunk *chunk) const {
+  if (pool) {
+    pool->release(chunk);
+  } else {
+    delete chunk;
+  }
+}
+
+Chunk::Chunk(std::size_t capacity, std::size_t headroom, std::size_t tailroom)
+    : reserved_headroom_(headroom), reserved_tailroom_(tailroom),
+      offset_(headroom), buffer_(headroom + capacity + tailroom) {}
+
+void Chunk::reset(uint64_t sequence_num) {
+  sequence_num_ = sequence_num;
+  compressed_ = false;
+  original_size_ = 0;
+  offset_ = reserved_headroom_;
+  size_ = 0;
+}
 
 uint64_t Chunk::sequence_num() { return sequence_num_; }
 
 const uint64_t Chunk::sequence_num() const { return sequence_num_; }
 
-const uint8_t *Chunk::data() const { return data_.data(); }
+uint8_t *Chunk::data() { return buffer_.data() + offset_; }
+
+const uint8_t *Chunk::data() const { return buffer_.data() + offset_; }
+
+uint32_t Chunk::size() const { return static_cast<uint32_t>(size_); }
+
+void Chunk::resize(std::size_t size) {
+  if (size > buffer_.size() - offset_) {
+    throw std::runtime_error("Chunk size " + std::to_string(size) +
+                             " exceeds buffer capacity of " +
+                             std::to_string(buffer_.size() - offset_) +
+                             " bytes");
+  }
+  size_ = size;
+}
 
-uint16_t Chunk::size() const { return static_cast<uint16_t>(data_.size()); }
+uint8_t *Chunk::push_front(std::size_t len) {
+  if (len > offset_) {
+    throw std::logic_error("Chunk headroom of " + std::to_string(offset_) +
+                           " bytes cannot fit " + std::to_string(len) +
+                           " bytes");
+  }
+  offset_ -= len;
+  size_ += len;
+  return data();
+}
+
+void Chunk::pull_front(std::size_t len) {
+  if (len > size_) {
+    throw std::logic_error("Cannot pull " + std::to_string(len) +
+                           " bytes from a " + std::to_string(size_) +
+                           " byte chunk");
+  }
+  offset_ += len;
+  size_ -= len;
+}
+
+std::size_t Chunk::capacity() const {
+  return buffer_.size() - reserved_headroom_ - reserved_tailroom_;
+}
+
+std::size_t Chunk::headroom() const { return offset_; }
+
+std::size_t Chunk::tailroom() const {
+  return buffer_.size() - offset_ - size_;
+}
 
 bool Chunk::compressed() const { return compressed_; }
 
-uint16_t Chunk::original_size() const { return original_size_; }
\ No newline at end of file
+uint32_t Chunk::original_size() const {
+  return compressed_ ? original_size_ : size();
+}
+
+void Chunk::set_compressed(bool compressed, uint32_t original_size) {
+  compressed_ = compressed;
+  original_size_ = original_size;
+}
@@ -0,0 +1,87 @@
+#include "ChunkIndex.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+ChunkIndex::ChunkIndex(const TransferRequest &transfer_request)
+    : file_infos_(transfer_request.get_file_infos()),
+      chunk_size_(transfer_request.get_chunk_size()),
+      final_chunk_size_(transfer_request.get_final_chunk_size()),
+      num_chunks_(transfer_request.get_num_chunks()) {
+  file_starts_.reserve(file_infos_.size());
+  uint64_t start = 0;
+  for (const auto &file_info : file_infos_) {
+    file_starts_.push_back(start);
+    start += file_info.size;
+  }
+}
+
+// A final chunk size of 0 means the transfer size is a multiple of the chunk
+// size, in which case the last chunk is a full one
+uint32_t ChunkIndex::payload_size(uint64_t sequence_num) const {
+  return sequence_num == num_chunks_ && final_chunk_size_ != 0
+             ? final_chunk_size_
+             : chunk_size_;
+}
+
+std::vector<ChunkIndex::Piece>
+ChunkIndex::pieces(uint64_t sequence_num) const {
+  if (sequence_num == 0 || sequence_num > num_chunks_) {
+    throw std::runtime_error("Chunk #" + std::to_string(sequence_num) +
+                             " is outside the transfer of " +
+                             std::to_string(num_chunks_) + " chunks");
+  }
+  const uint64_t chunk_start = (sequence_num - 1) * chunk_size_;
+  const uint32_t chunk_size = payload_size(sequence_num);
+
+  // The last file starting at or before the chunk holds its first byte, any
+  // others starting at the same offset are empty
+  std::size_t file_index =
+      std::upper_bound(file_starts_.begin(), file_starts_.end(),
+                       chunk_start) -
+      file_starts_.begin() - 1;
+
+  std::vector<Piece> pieces;
+  uint32_t chunk_offset = 0;
+  while (chunk_offset < chunk_size) {
+    if (file_index >= file_infos_.size()) {
+      throw std::runtime_error("Chunk #" + std::to_string(sequence_num) +
+                               " extends past the end of the files");
+    }
+    const uint64_t file_offset =
+        chunk_start + chunk_offset - file_starts_[file_index];
+    const uint64_t file_left = file_infos_[file_index].size - file_offset;
+    if (file_left > 0) {
+      const uint32_t size = static_cast<uint32_t>(
+          std::min<uint64_t>(chunk_size - chunk_offset, file_left));
+      pieces.push_back({file_index, file_offset, chunk_offset, size});
+      chunk_offset += size;
+    }
+    ++file_index;
+  }
+  return pieces;
+}
+
+WrittenChunks::WrittenChunks(uint32_t num_chunks)
+    : received_(num_chunks), written_(num_chunks) {}
+
+void WrittenChunks::received(uint64_t sequence_num) {
+  if (sequence_num == 0 || sequence_num > received_.size()) {
+    throw std::runtime_error("Chunk #" + std::to_string(sequence_num) +
+                             " is outside the transfer");
+  }
+  if (received_[sequence_num - 1]) {
+    throw std::runtime_error("Received chunk #" +
+                             std::to_string(sequence_num) + " twice");
+  }
+  received_[sequence_num - 1] = true;
+}
+
+uint32_t WrittenChunks::written(uint64_t sequence_num) {
+  written_[sequence_num - 1] = true;
+  while (contiguous_ < written_.size() && written_[contiguous_]) {
+    ++contiguous_;
+  }
+  return contiguous_;
+}
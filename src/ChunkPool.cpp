@@ -0,0 +1,48 @@
+#include "ChunkPool.h"
+
+#include <stdexcept>
+
+ChunkPool::ChunkPool(std::size_t chunk_capacity, std::size_t headroom,
+                     std::size_t tailroom, std::size_t max_pooled_chunks)
+    : chunk_capacity_(chunk_capacity), headroom_(headroom),
+      tailroom_(tailroom), max_pooled_chunks_(max_pooled_chunks) {
+  if (max_pooled_chunks_ == 0) {
+    throw std::logic_error("Chunk pool size must be greater than 0");
+  }
+  free_chunks_.reserve(max_pooled_chunks_);
+}
+
+ChunkPtr ChunkPool::acquire(uint64_t sequence_num) {
+  std::unique_ptr<Chunk> chunk;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!free_chunks_.empty()) {
+      chunk = std::move(free_chunks_.back());
+      free_chunks_.pop_back();
+    }
+  }
+
+  if (chunk) {
+    hits_++;
+  } else {
+    misses_++;
+    chunk = std::make_unique<Chunk>(chunk_capacity_, headroom_, tailroom_);
+  }
+
+  chunk->reset(sequence_num);
+  return ChunkPtr(chunk.release(), ChunkDeleter{this});
+}
+
+void ChunkPool::release(Chunk *chunk) {
+  std::unique_ptr<Chunk> owned_chunk(chunk);
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (free_chunks_.size() < max_pooled_chunks_) {
+    free_chunks_.push_back(std::move(owned_chunk));
+  }
+}
+
+std::size_t ChunkPool::chunk_capacity() const { return chunk_capacity_; }
+
+uint64_t ChunkPool::hits() const { return hits_.load(); }
+
+uint64_t ChunkPool::misses() const { return misses_.load(); }
@@ -0,0 +1,68 @@
+#include "CompressionBypass.h"
+
+#include <algorithm>
+
+CompressionBypass::CompressionBypass(const TransferRequest &transfer_request)
+    : chunk_size_(transfer_request.get_chunk_size()) {
+  uint64_t offset = 0;
+  for (const auto &file_info : transfer_request.get_file_infos()) {
+    offset += file_info.size;
+    file_end_offsets_.push_back(offset);
+  }
+}
+
+bool CompressionBypass::should_compress(uint64_t sequence_num) {
+  std::size_t file_index = file_index_for(sequence_num);
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  // A late chunk of an earlier file is always tried, without disturbing the
+  // estimate for the current one
+  if (file_index < file_index_) {
+    return true;
+  }
+  if (file_index > file_index_) {
+    file_index_ = file_index;
+    num_samples_ = 0;
+    bypass_remaining_ = 0;
+    bypass_length_ = INITIAL_BYPASS_CHUNKS;
+  }
+
+  if (bypass_remaining_ > 0) {
+    --bypass_remaining_;
+    return false;
+  }
+  return true;
+}
+
+void CompressionBypass::record(uint64_t sequence_num,
+                               std::size_t original_size,
+                               std::size_t compressed_size) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (original_size == 0 || file_index_for(sequence_num) != file_index_) {
+    return;
+  }
+
+  double ratio = static_cast<double>(compressed_size) / original_size;
+  average_ratio_ =
+      num_samples_ == 0
+          ? ratio
+          : AVERAGE_WEIGHT * ratio + (1 - AVERAGE_WEIGHT) * average_ratio_;
+  ++num_samples_;
+
+  if (average_ratio_ <= RATIO_THRESHOLD) {
+    bypass_length_ = INITIAL_BYPASS_CHUNKS;
+    return;
+  }
+
+  // The first chunk tried after the pause is judged on its own
+  bypass_remaining_ = bypass_length_;
+  bypass_length_ = std::min(bypass_length_ * 2, MAX_BYPASS_CHUNKS);
+  num_samples_ = 0;
+}
+
+std::size_t CompressionBypass::file_index_for(uint64_t sequence_num) const {
+  const uint64_t chunk_offset = (sequence_num - 1) * chunk_size_;
+  return std::upper_bound(file_end_offsets_.begin(), file_end_offsets_.end(),
+                          chunk_offset) -
+         file_end_offsets_.begin();
+}
@@ -1,74 +1,158 @@
 
 #include "CompressionManager.h"
+#include "ParallelChunkProcessor.h"
+#include "utils.h"
 
 #include "zlib.h"
+#include <algorithm>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <stdexcept>
 
-CompressionManager::CompressionManager(uint32_t chunk_size,
-                                       uint32_t last_chunk_size)
-    : chunk_size_(chunk_size), last_chunk_size_(last_chunk_size) {}
-
-void CompressionManager::compress_chunks(
-    BoundedThreadSafeQueue<std::unique_ptr<Chunk>> &input_queue,
-    std::atomic<bool> &input_done,
-    BoundedThreadSafeQueue<std::unique_ptr<Chunk>> &output_queue,
-    std::atomic<bool> &output_done) {
-
-  while (true) {
-    auto chunk_ptr_opt = input_queue.try_pop();
-    if (chunk_ptr_opt) {
-      auto &chunk_ptr = chunk_ptr_opt.value();
-      auto compressed_chunk_ptr = compress_chunk(*chunk_ptr);
-
-      // float percent_reduction = (1 - (compressed_chunk_ptr->size() * 1.0f /
-      // chunk_ptr->size()))*100; std::cout << "Chunk #"<<
-      // chunk_ptr->sequence_num() << " compressed from " << chunk_ptr->size()
-      // << "B to "
-      //       << compressed_chunk_ptr->size() << "B (" << percent_reduction <<
-      //       "% reduction)" << std::endl;
-
-      output_queue.push(compressed_chunk_ptr->size() < chunk_ptr->size()
-                            ? std::move(compressed_chunk_ptr)
-                            : std::move(chunk_ptr));
-    } else if (input_done.load() && input_queue.empty()) {
-      break;
-    }
+namespace {
+
+// Adds the CPU time used by the calling thread while in scope to a counter
+class ThreadCpuTimer {
+public:
+  ThreadCpuTimer(std::atomic<uint64_t> &total_ns)
+      : total_ns_(total_ns), start_(utils::thread_cpu_time()) {}
+  ~ThreadCpuTimer() {
+    total_ns_ += (utils::thread_cpu_time() - start_).count();
+  }
+
+private:
+  std::atomic<uint64_t> &total_ns_;
+  const std::chrono::nanoseconds start_;
+};
+
+} // anonymous namespace
+
+CompressionManager::CompressionManager(const TransferRequest &transfer_request,
+                                       ChunkPool &chunk_pool,
+                                       std::size_t num_workers)
+    : chunk_size_(transfer_request.get_chunk_size()),
+      last_chunk_size_(transfer_request.get_final_chunk_size()),
+      num_workers_(num_workers), chunk_pool_(chunk_pool),
+      bypass_(transfer_request) {
+  if (num_workers_ == 0) {
+    throw std::logic_error("CompressionManager needs at least one worker");
   }
-  output_done.store(true);
 }
 
-void CompressionManager::decompress_chunks(
-    BoundedThreadSafeQueue<std::unique_ptr<Chunk>> &input_queue,
-    std::atomic<bool> &input_done,
-    BoundedThreadSafeQueue<std::unique_ptr<Chunk>> &output_queue,
-    std::atomic<bool> &output_done) {
-
-  while (true) {
-    auto chunk_ptr_opt = input_queue.try_pop();
-    if (chunk_ptr_opt) {
-      auto &chunk_ptr = chunk_ptr_opt.value();
-      output_queue.push(chunk_ptr->compressed()
-                            ? std::move(decompress_chunk(*chunk_ptr))
-                            : std::move(chunk_ptr));
-    } else if (input_done.load() && input_queue.empty()) {
-      break;
-    }
+// Chunks are compressed independently by the workers and put back in sequence
+// order before the encryption stage
+void CompressionManager::compress_chunks(WorkerContext &ctx,
+                                         ChunkQueue &input_queue,
+                                         ChunkQueue &output_queue) {
+  process_chunks_in_parallel(ctx, input_queue, output_queue, num_workers_,
+                             [this](ChunkPtr chunk_ptr) {
+                               ThreadCpuTimer cpu_timer(stats_.cpu_time_ns);
+                               return compress_or_bypass(std::move(chunk_ptr));
+                             });
+}
+
+void CompressionManager::decompress_chunks(WorkerContext &ctx,
+                                           ChunkQueue &input_queue,
+                                           ChunkQueue &output_queue) {
+  process_chunks_in_parallel(
+      ctx, input_queue, output_queue, num_workers_,
+      [this](ChunkPtr chunk_ptr) {
+        ThreadCpuTimer cpu_timer(stats_.cpu_time_ns);
+        stats_.input_bytes += chunk_ptr->size();
+        stats_.output_bytes += chunk_ptr->original_size();
+        if (!chunk_ptr->compressed()) {
+          return chunk_ptr;
+        }
+        ++stats_.compressed_chunks;
+        return decompress_chunk(*chunk_ptr);
+      });
+}
+
+// Returns the compressed chunk, or the input chunk if it is sent raw
+ChunkPtr CompressionManager::compress_or_bypass(ChunkPtr chunk_ptr) {
+  const uint64_t sequence_num = chunk_ptr->sequence_num();
+  stats_.input_bytes += chunk_ptr->size();
+
+  // Data that has not been compressing well is sent raw for a while
+  if (!bypass_.should_compress(sequence_num)) {
+    ++stats_.bypassed_chunks;
+    stats_.output_bytes += chunk_ptr->size();
+    return chunk_ptr;
+  }
+
+  // A null result means the data did not shrink, so the chunk is sent raw
+  ChunkPtr compressed_chunk_ptr = compress_chunk(*chunk_ptr);
+  if (!compressed_chunk_ptr) {
+    bypass_.record(sequence_num, chunk_ptr->size(), chunk_ptr->size());
+    ++stats_.incompressible_chunks;
+    stats_.output_bytes += chunk_ptr->size();
+    return chunk_ptr;
   }
-  output_done.store(true);
+
+  bypass_.record(sequence_num, chunk_ptr->size(),
+                 compressed_chunk_ptr->size());
+  ++stats_.compressed_chunks;
+  stats_.output_bytes += compressed_chunk_ptr->size();
+  return compressed_chunk_ptr;
+}
+
+const CompressionStats &CompressionManager::stats() const { return stats_; }
+
+std::string CompressionManager::compression_summary() const {
+  const uint64_t input_bytes = stats_.input_bytes;
+  const uint64_t output_bytes = stats_.output_bytes;
+  const uint64_t saved_bytes =
+      input_bytes > output_bytes ? input_bytes - output_bytes : 0;
+  const double saved_percent =
+      input_bytes == 0 ? 0.0 : 100.0 * saved_bytes / input_bytes;
+
+  std::ostringstream summary;
+  summary.precision(1);
+  summary << std::fixed << "Compression saved "
+          << utils::format_data_size(saved_bytes) << " of "
+          << utils::format_data_size(input_bytes) << " (" << saved_percent
+          << "%), " << stats_.compressed_chunks << " chunks compressed, "
+          << stats_.incompressible_chunks << " incompressible, "
+          << stats_.bypassed_chunks << " bypassed, " << std::setprecision(3)
+          << stats_.cpu_time_ns / 1e9 << "s CPU";
+  return summary.str();
 }
 
-std::unique_ptr<Chunk> CompressionManager::compress_chunk(const Chunk &chunk) {
+std::string CompressionManager::decompression_summary() const {
+  std::ostringstream summary;
+  summary.precision(3);
+  summary << std::fixed << "Decompressed " << stats_.compressed_chunks
+          << " chunks (" << utils::format_data_size(stats_.input_bytes)
+          << " received for " << utils::format_data_size(stats_.output_bytes)
+          << "), " << stats_.cpu_time_ns / 1e9 << "s CPU";
+  return summary.str();
+}
+
+// Returns nullptr if the compressed data would not be smaller than the input
+ChunkPtr CompressionManager::compress_chunk(const Chunk &chunk) {
   if (chunk.size() > chunk_size_) {
     throw std::runtime_error("Chunk size exceeded expected size of " +
                              std::to_string(chunk_size_) + " bytes");
   }
+  if (chunk.size() == 0) {
+    return nullptr;
+  }
   try {
-    std::vector<uint8_t> compressed_data =
-        compress_data(chunk.data(), chunk.size());
+    ChunkPtr compressed_chunk_ptr = chunk_pool_.acquire(chunk.sequence_num());
+    const std::size_t max_compressed_size = std::min<std::size_t>(
+        chunk.size() - 1, compressed_chunk_ptr->capacity());
+
+    std::size_t compressed_size =
+        compress_data(chunk.data(), chunk.size(), compressed_chunk_ptr->data(),
+                      max_compressed_size);
+    if (compressed_size == 0) {
+      return nullptr;
+    }
 
-    return std::make_unique<Chunk>(chunk.sequence_num(),
-                                   std::move(compressed_data), chunk.size());
+    compressed_chunk_ptr->resize(compressed_size);
+    compressed_chunk_ptr->set_compressed(true, chunk.size());
+    return compressed_chunk_ptr;
   } catch (const std::exception &e) {
     throw std::runtime_error("Error when compressing chunk #" +
                              std::to_string(chunk.sequence_num()) + ": " +
@@ -76,11 +160,20 @@ std::unique_ptr<Chunk> CompressionManager::compress_chunk(const Chunk &chunk) {
   }
 }
 
-std::unique_ptr<Chunk>
-CompressionManager::decompress_chunk(const Chunk &chunk) {
+ChunkPtr CompressionManager::decompress_chunk(const Chunk &chunk) {
+  // The original size comes off the wire, so it is checked before it is used
+  // to size the output chunk
+  if (chunk.original_size() > chunk_size_) {
+    throw std::runtime_error("Chunk #" + std::to_string(chunk.sequence_num()) +
+                             " original size exceeds chunk size of " +
+                             std::to_string(chunk_size_) + " bytes");
+  }
   try {
-    std::vector<uint8_t> decompressed_data =
-        decompress_data(chunk.data(), chunk.size(), chunk.original_size());
+    ChunkPtr decompressed_chunk_ptr =
+        chunk_pool_.acquire(chunk.sequence_num());
+    decompressed_chunk_ptr->resize(chunk.original_size());
+    decompress_data(chunk.data(), chunk.size(), decompressed_chunk_ptr->data(),
+                    chunk.original_size());
 
     // float percent_reduction = (1 - (chunk.size() * 1.0f /
     // decompressed_data.size()))*100; std::cout << "Chunk #"<<
@@ -88,8 +181,7 @@ CompressionManager::decompress_chunk(const Chunk &chunk) {
     //           << decompressed_data.size() << "B (" << percent_reduction << "%
     //           reduction)" << std::endl;
 
-    return std::make_unique<Chunk>(chunk.sequence_num(),
-                                   std::move(decompressed_data));
+    return decompressed_chunk_ptr;
   } catch (const std::exception &e) {
     throw std::runtime_error("Error when decompressing chunk #" +
                              std::to_string(chunk.sequence_num()) + ": " +
@@ -97,35 +189,42 @@ CompressionManager::decompress_chunk(const Chunk &chunk) {
   }
 }
 
-std::vector<uint8_t> CompressionManager::compress_data(const uint8_t *data,
-                                                       uint16_t data_size) {
-  auto compressed_size_bound = compressBound(data_size);
-  std::vector<uint8_t> compressed_data(compressed_size_bound);
-  auto compressed_size = compressed_size_bound;
-  int ret = compress(compressed_data.data(), &compressed_size, data, data_size);
+// Compresses into the caller's buffer, returns 0 if the result does not fit
+std::size_t CompressionManager::compress_data(const uint8_t *data,
+                                              uint32_t data_size,
+                                              uint8_t *output,
+                                              std::size_t output_capacity) {
+  uLongf compressed_size = output_capacity;
+  int ret = compress(output, &compressed_size, data, data_size);
+  if (ret == Z_BUF_ERROR) {
+    return 0;
+  }
   if (ret != Z_OK) {
     throw std::runtime_error("zlib error code: " + std::to_string(ret));
   }
-  compressed_data.resize(compressed_size);
-  return compressed_data;
+  return compressed_size;
 }
 
-std::vector<uint8_t>
-CompressionManager::decompress_data(const uint8_t *compressed_data,
-                                    uint16_t compressed_data_size,
-                                    uint16_t original_size) {
+void CompressionManager::decompress_data(const uint8_t *compressed_data,
+                                         uint32_t compressed_data_size,
+                                         uint8_t *output,
+                                         uint32_t original_size) {
+  // The output may be a pooled buffer already sized to original_size, which
+  // an empty payload would leave holding stale data
   if (compressed_data_size == 0) {
-    return std::vector<uint8_t>();
+    if (original_size != 0) {
+      throw std::runtime_error("empty compressed payload for " +
+                               std::to_string(original_size) + " bytes");
+    }
+    return;
   }
-  std::vector<uint8_t> data(original_size);
-  uLongf data_size = data.size();
-  int ret = uncompress(data.data(), &data_size, compressed_data,
-                       compressed_data_size);
+  uLongf data_size = original_size;
+  int ret =
+      uncompress(output, &data_size, compressed_data, compressed_data_size);
   if (ret != Z_OK) {
     throw std::runtime_error("zlib error code: " + std::to_string(ret));
   }
-  if (data_size > original_size) {
-    throw std::runtime_error("decompression buffer overflow");
+  if (data_size != original_size) {
+    throw std::runtime_error("decompressed size does not match original size");
   }
-  return data;
 }
\ No newline at end of file
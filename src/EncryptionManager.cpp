@@ -1,32 +1,25 @@
 #include "EncryptionManager.h"
+#include "ParallelChunkProcessor.h"
 
 #include <iostream>
 #include <stdexcept>
 
 namespace {
 
+// Blocks on the input queue until the producer closes it, so an idle stage
+// does not consume CPU. A cancelled queue ends the loop early on abort
 template <typename Transform>
-void process_chunks(
-    WorkerContext &ctx,
-    BoundedThreadSafeQueue<std::unique_ptr<Chunk>> &input_queue,
-    std::atomic<bool> &input_done,
-    BoundedThreadSafeQueue<std::unique_ptr<Chunk>> &output_queue,
-    std::atomic<bool> &output_done, Transform &&transform) {
-  while (true) {
+void process_chunks(WorkerContext &ctx, ChunkQueue &input_queue,
+                    ChunkQueue &output_queue, Transform &&transform) {
+  while (auto chunk_ptr_opt = input_queue.pop()) {
     if (ctx.should_abort()) {
-      output_done.store(true);
       return;
     }
-    auto chunk_ptr_opt = input_queue.try_pop();
-    if (chunk_ptr_opt) {
-      auto chunk_ptr = std::move(*chunk_ptr_opt);
-      auto result = transform(*chunk_ptr);
-      output_queue.push(std::move(result));
-    } else if (input_done.load() && input_queue.empty()) {
-      break;
+    if (!output_queue.push(transform(std::move(*chunk_ptr_opt)))) {
+      return;
     }
   }
-  output_done.store(true);
+  output_queue.close();
 }
 
 } // anonymous namespace
@@ -36,14 +29,29 @@ EncryptionManager::EncryptionManager(uint32_t chunk_size,
                                      uint64_t num_chunks,
                                      crypto::Encryptor encryptor)
     : chunk_size_(chunk_size), last_chunk_size_(last_chunk_size),
-      num_chunks_(num_chunks), crypto_vnt_(std::move(encryptor)) {}
+      num_chunks_(num_chunks), num_workers_(1),
+      crypto_vnt_(std::move(encryptor)) {}
 
 EncryptionManager::EncryptionManager(uint32_t chunk_size,
                                      uint32_t last_chunk_size,
                                      uint64_t num_chunks,
                                      crypto::Decryptor decryptor)
     : chunk_size_(chunk_size), last_chunk_size_(last_chunk_size),
-      num_chunks_(num_chunks), crypto_vnt_(std::move(decryptor)) {}
+      num_chunks_(num_chunks), num_workers_(1),
+      crypto_vnt_(std::move(decryptor)) {}
+
+EncryptionManager::EncryptionManager(uint32_t chunk_size,
+                                     uint32_t last_chunk_size,
+                                     uint64_t num_chunks,
+                                     crypto::ChunkCipher chunk_cipher,
+                                     std::size_t num_workers)
+    : chunk_size_(chunk_size), last_chunk_size_(last_chunk_size),
+      num_chunks_(num_chunks), num_workers_(num_workers),
+      crypto_vnt_(std::move(chunk_cipher)) {
+  if (num_workers_ == 0) {
+    throw std::logic_error("EncryptionManager needs at least one worker");
+  }
+}
 
 crypto::Encryptor &EncryptionManager::get_encryptor() {
   if (std::holds_alternative<crypto::Encryptor>(crypto_vnt_)) {
@@ -63,68 +71,93 @@ crypto::Decryptor &EncryptionManager::get_decryptor() {
   }
 }
 
-void EncryptionManager::encrypt_chunks(
-    WorkerContext &ctx,
-    BoundedThreadSafeQueue<std::unique_ptr<Chunk>> &input_queue,
-    std::atomic<bool> &input_done,
-    BoundedThreadSafeQueue<std::unique_ptr<Chunk>> &output_queue,
-    std::atomic<bool> &output_done) {
+void EncryptionManager::encrypt_chunks(WorkerContext &ctx,
+                                       ChunkQueue &input_queue,
+                                       ChunkQueue &output_queue) {
 
-  process_chunks(ctx, input_queue, input_done, output_queue, output_done,
-                 [this](const Chunk &c) { return encrypt_chunk(c); });
+  if (std::holds_alternative<crypto::ChunkCipher>(crypto_vnt_)) {
+    process_chunks_in_parallel(
+        ctx, input_queue, output_queue, num_workers_,
+        [this](ChunkPtr c) { return seal_chunk(std::move(c)); });
+    return;
+  }
+  process_chunks(ctx, input_queue, output_queue,
+                 [this](ChunkPtr c) { return encrypt_chunk(std::move(c)); });
 }
 
-void EncryptionManager::decrypt_chunks(
-    WorkerContext &ctx,
-    BoundedThreadSafeQueue<std::unique_ptr<Chunk>> &input_queue,
-    std::atomic<bool> &input_done,
-    BoundedThreadSafeQueue<std::unique_ptr<Chunk>> &output_queue,
-    std::atomic<bool> &output_done) {
+void EncryptionManager::decrypt_chunks(WorkerContext &ctx,
+                                       ChunkQueue &input_queue,
+                                       ChunkQueue &output_queue) {
 
-  process_chunks(ctx, input_queue, input_done, output_queue, output_done,
-                 [this](const Chunk &c) { return decrypt_chunk(c); });
+  if (std::holds_alternative<crypto::ChunkCipher>(crypto_vnt_)) {
+    process_chunks_in_parallel(
+        ctx, input_queue, output_queue, num_workers_,
+        [this](ChunkPtr c) { return open_chunk(std::move(c)); });
+    return;
+  }
+  process_chunks(ctx, input_queue, output_queue,
+                 [this](ChunkPtr c) { return decrypt_chunk(std::move(c)); });
 }
 
-std::unique_ptr<Chunk> EncryptionManager::encrypt_chunk(const Chunk &chunk) {
+void EncryptionManager::validate_sequence_num(const Chunk &chunk) const {
   if (chunk.sequence_num() == 0 || chunk.sequence_num() > num_chunks_) {
     throw std::runtime_error(
         "EncryptionManager: invalid chunk sequence number: " +
         std::to_string(chunk.sequence_num()));
   }
+}
+
+// Encrypts in place: the stream tag is written into the headroom directly in
+// front of the plaintext and the MAC into the tailroom behind it
+ChunkPtr EncryptionManager::encrypt_chunk(ChunkPtr chunk_ptr) {
+  Chunk &chunk = *chunk_ptr;
+  validate_sequence_num(chunk);
 
   if (chunk.size() > chunk_size_) {
     throw std::runtime_error("Chunk size exceeded expected size of " +
                              std::to_string(chunk_size_) + " bytes");
   }
 
-  std::vector<uint8_t> encrypted_data(chunk.size() +
-                                      crypto::ENCRYPTION_ADDITIONAL_BYTES);
+  if (chunk.headroom() < crypto::ENCRYPTION_TAG_BYTES ||
+      chunk.tailroom() < crypto::ENCRYPTION_MAC_BYTES) {
+    throw std::logic_error(
+        "EncryptionManager: chunk has no room to encrypt in place");
+  }
+
+  const std::size_t plaintext_size = chunk.size();
+  uint8_t *plaintext = chunk.data();
+  uint8_t *ciphertext = chunk.push_front(crypto::ENCRYPTION_TAG_BYTES);
+  chunk.resize(plaintext_size + crypto::ENCRYPTION_ADDITIONAL_BYTES);
+
   std::size_t out_len = 0;
   const bool is_final = chunk.sequence_num() == num_chunks_;
-  get_encryptor().encrypt(chunk.data(), chunk.size(), encrypted_data.data(),
-                          &out_len, is_final);
-  if (out_len != encrypted_data.size()) {
+  get_encryptor().encrypt(plaintext, plaintext_size, ciphertext, &out_len,
+                          is_final);
+  if (out_len != chunk.size()) {
     throw std::runtime_error(
         "EncryptionManager: unexpected encrypted output size");
   }
-  return std::make_unique<Chunk>(chunk.sequence_num(),
-                                 std::move(encrypted_data), chunk.size());
+  return chunk_ptr;
 }
 
-std::unique_ptr<Chunk> EncryptionManager::decrypt_chunk(const Chunk &chunk) {
-  if (chunk.sequence_num() == 0 || chunk.sequence_num() > num_chunks_) {
-    throw std::runtime_error(
-        "EncryptionManager: invalid chunk sequence number: " +
-        std::to_string(chunk.sequence_num()));
+// Decrypts in place, leaving the plaintext where the ciphertext body was
+ChunkPtr EncryptionManager::decrypt_chunk(ChunkPtr chunk_ptr) {
+  Chunk &chunk = *chunk_ptr;
+  validate_sequence_num(chunk);
+
+  if (chunk.size() < crypto::ENCRYPTION_ADDITIONAL_BYTES) {
+    throw std::runtime_error("EncryptionManager: encrypted chunk too small");
   }
 
-  std::vector<uint8_t> decrypted_data(chunk.size() -
-                                      crypto::ENCRYPTION_ADDITIONAL_BYTES);
+  const std::size_t ciphertext_size = chunk.size();
+  const uint8_t *ciphertext = chunk.data();
+  uint8_t *plaintext = chunk.data() + crypto::ENCRYPTION_TAG_BYTES;
+
   std::size_t out_len = 0;
   bool is_final = false;
-  get_decryptor().decrypt(chunk.data(), chunk.size(), decrypted_data.data(),
-                          &out_len, is_final);
-  if (out_len != decrypted_data.size()) {
+  get_decryptor().decrypt(ciphertext, ciphertext_size, plaintext, &out_len,
+                          is_final);
+  if (out_len != ciphertext_size - crypto::ENCRYPTION_ADDITIONAL_BYTES) {
     throw std::runtime_error(
         "EncryptionManager: unexpected decrypted output size");
   }
@@ -133,6 +166,49 @@ std::unique_ptr<Chunk> EncryptionManager::decrypt_chunk(const Chunk &chunk) {
         "EncryptionManager: final chunk decryption mismatch");
   }
 
-  return std::make_unique<Chunk>(chunk.sequence_num(),
-                                 std::move(decrypted_data));
-}
\ No newline at end of file
+  chunk.pull_front(crypto::ENCRYPTION_TAG_BYTES);
+  chunk.resize(out_len);
+  return chunk_ptr;
+}
+
+// Seals in place with the MAC written into the tailroom. Called concurrently
+// from the encryption workers, so only touches the chunk it was given
+ChunkPtr EncryptionManager::seal_chunk(ChunkPtr chunk_ptr) const {
+  Chunk &chunk = *chunk_ptr;
+  validate_sequence_num(chunk);
+
+  if (chunk.size() > chunk_size_) {
+    throw std::runtime_error("Chunk size exceeded expected size of " +
+                             std::to_string(chunk_size_) + " bytes");
+  }
+
+  if (chunk.tailroom() < crypto::CHUNK_SEAL_ADDITIONAL_BYTES) {
+    throw std::logic_error(
+        "EncryptionManager: chunk has no room to encrypt in place");
+  }
+
+  const std::size_t plaintext_size = chunk.size();
+  chunk.resize(plaintext_size + crypto::CHUNK_SEAL_ADDITIONAL_BYTES);
+  std::get<crypto::ChunkCipher>(crypto_vnt_)
+      .seal(chunk.data(), plaintext_size, chunk.sequence_num(),
+            chunk.sequence_num() == num_chunks_);
+  return chunk_ptr;
+}
+
+// Opens in place. Authentication fails unless the chunk was sealed with the
+// same sequence number and final flag it arrived with
+ChunkPtr EncryptionManager::open_chunk(ChunkPtr chunk_ptr) const {
+  Chunk &chunk = *chunk_ptr;
+  validate_sequence_num(chunk);
+
+  if (chunk.size() < crypto::CHUNK_SEAL_ADDITIONAL_BYTES) {
+    throw std::runtime_error("EncryptionManager: encrypted chunk too small");
+  }
+
+  const std::size_t plaintext_size =
+      std::get<crypto::ChunkCipher>(crypto_vnt_)
+          .open(chunk.data(), chunk.size(), chunk.sequence_num(),
+                chunk.sequence_num() == num_chunks_);
+  chunk.resize(plaintext_size);
+  return chunk_ptr;
+}
@@ -1,20 +1,196 @@
 
 #include "FileManager.h"
 
+#include <cerrno>
+#include <cstring>
 #include <fstream>
+#include <memory>
+
+#include "ChunkIndex.h"
+#include "MappedFile.h"
+#include "UncachedFileReader.h"
+#include "UringFileIo.h"
+#include "WriteBehind.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#endif
+
+namespace {
+
+// Largest amount moved by a single sendfile() or splice() call, which is
+// also the pipe size asked for on the receiving side
+constexpr std::size_t ZERO_COPY_STEP = 1024 * 1024;
+
+// Closes the descriptor when it goes out of scope
+class FileDescriptor {
+public:
+  explicit FileDescriptor(int fd) : fd_(fd) {}
+  ~FileDescriptor() {
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+  }
+  FileDescriptor(const FileDescriptor &) = delete;
+  FileDescriptor &operator=(const FileDescriptor &) = delete;
+
+  int get() const { return fd_; }
+
+private:
+  int fd_;
+};
+
+// The files of a transfer, written piece by piece at the offsets the chunk
+// index gives. A file is opened on its first piece and closed once all its
+// bytes are written, which is how its completion is tracked
+class OutputFiles {
+public:
+  explicit OutputFiles(const TransferRequest &transfer_request)
+      : file_infos_(transfer_request.get_file_infos()),
+        files_(file_infos_.size()) {
+    for (std::size_t i = 0; i < file_infos_.size(); ++i) {
+      files_[i].bytes_left = file_infos_[i].size;
+    }
+  }
+
+  ~OutputFiles() {
+    for (const File &file : files_) {
+      if (file.fd >= 0) {
+        ::close(file.fd);
+      }
+    }
+  }
+
+  OutputFiles(const OutputFiles &) = delete;
+  OutputFiles &operator=(const OutputFiles &) = delete;
+
+  void write(const ChunkIndex::Piece &piece, const uint8_t *data) {
+    File &file = files_[piece.file_index];
+    if (file.fd < 0) {
+      // Created by WriteBehind::preallocate_files(), and not truncated,
+      // which would free the reserved space
+      file.fd = ::open(file_infos_[piece.file_index].relative_path.c_str(),
+                       O_WRONLY | O_CLOEXEC);
+      if (file.fd < 0) {
+        throw utils::system_failure(
+            "Failed to open file " + path(piece.file_index), errno);
+      }
+    }
+
+    uint64_t offset = piece.file_offset;
+    std::size_t left = piece.size;
+    while (left > 0) {
+      const ssize_t written =
+          ::pwrite(file.fd, data, left, static_cast<off_t>(offset));
+      if (written < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw utils::system_failure(
+            "Failed to write to file " + path(piece.file_index), errno);
+      }
+      data += written;
+      offset += static_cast<uint64_t>(written);
+      left -= static_cast<std::size_t>(written);
+    }
+    file.write_behind.written(file.fd, offset);
+
+    file.bytes_left -= piece.size;
+    if (file.bytes_left == 0) {
+      ::close(file.fd);
+      file.fd = -1;
+    }
+  }
+
+  // Path of the first file not fully written
+  std::string first_incomplete() const {
+    for (std::size_t i = 0; i < files_.size(); ++i) {
+      if (files_[i].bytes_left > 0) {
+        return path(i);
+      }
+    }
+    return "the end of the transfer";
+  }
+
+private:
+  struct File {
+    int fd = -1;
+    uint64_t bytes_left = 0;
+    WriteBehind write_behind;
+  };
+
+  const std::vector<TransferRequest::FileInfo> &file_infos_;
+  std::vector<File> files_;
+
+  std::string path(std::size_t index) const {
+    return (std::filesystem::current_path() / file_infos_[index].relative_path)
+        .string();
+  }
+};
+
+} // anonymous namespace
+
+std::size_t FileManager::prepare_uring() {
+  if (!uring_prepared_) {
+    uring_prepared_ = true;
+    if (UringFileIo::supported()) {
+      try {
+        uring_file_io_ = std::make_unique<UringFileIo>();
+      } catch (const std::exception &e) {
+        LOG(std::string(e.what()) + ", using stream file I/O instead");
+      }
+    }
+  }
+  return uring_file_io_ ? UringFileIo::CHUNKS_IN_FLIGHT : 0;
+}
 
 void FileManager::read_files_into_chunks(
     WorkerContext &ctx, const TransferRequest &transfer_request,
-    BoundedThreadSafeQueue<std::unique_ptr<Chunk>> &output_queue,
-    std::atomic<bool> &output_done) {
+    ChunkPool &chunk_pool, ChunkQueue &output_queue, FileReadMode read_mode) {
+  if (read_mode == FileReadMode::URING && prepare_uring() > 0) {
+    LOG("reading files through io_uring");
+    uring_file_io_->read_files_into_chunks(ctx, transfer_request, chunk_pool,
+                                           output_queue);
+    return;
+  }
+
+  // Final chunk size should only be used on the last chunk when the
+  // calculated chunk size is not 0. If it is 0, then this may indicate
+  // that the transfer size is perfectly divisble by the chunk size, in
+  // which case the final chunk should be regularily sized, not 0 bytes.
+  auto acquire_chunk = [&](uint32_t sequence_num) {
+    const bool use_final_chunk_size =
+        (sequence_num == transfer_request.get_num_chunks()) &&
+        (transfer_request.get_final_chunk_size() != 0);
+    ChunkPtr chunk_ptr = chunk_pool.acquire(sequence_num);
+    chunk_ptr->resize(use_final_chunk_size
+                          ? transfer_request.get_final_chunk_size()
+                          : transfer_request.get_chunk_size());
+    return chunk_ptr;
+  };
+
+  std::unique_ptr<UncachedFileReader> uncached_reader;
+  if (read_mode == FileReadMode::DROP_BEHIND ||
+      read_mode == FileReadMode::DIRECT) {
+    if (UncachedFileReader::supported()) {
+      uncached_reader = std::make_unique<UncachedFileReader>(
+          read_mode == FileReadMode::DIRECT);
+    } else {
+      LOG("reading around the page cache is not supported, reading files "
+          "with a stream instead");
+    }
+  }
 
   uint32_t sequence_counter = 1;
-  uint32_t remaining_buffer_capacity = transfer_request.get_chunk_size();
-  std::vector<uint8_t> buffer(transfer_request.get_chunk_size());
+  ChunkPtr chunk_ptr = acquire_chunk(sequence_counter);
+  uint32_t remaining_buffer_capacity = chunk_ptr->size();
 
   for (const auto &file_info : transfer_request.get_file_infos()) {
     if (ctx.should_abort()) {
-      output_done.store(true);
       return;
     }
 
@@ -29,27 +205,47 @@ void FileManager::read_files_into_chunks(
     }
 
     uint64_t remaining_file_data = file_size;
-    std::ifstream file(file_path, std::ios::binary);
-    if (!file) {
-      throw std::runtime_error("\nFailed to open file: " + file_path.string());
+    std::unique_ptr<MappedFile> mapped_file;
+    if (read_mode == FileReadMode::MAPPED && MappedFile::supported()) {
+      try {
+        mapped_file = std::make_unique<MappedFile>(file_path, file_size);
+      } catch (const std::exception &e) {
+        LOG(std::string(e.what()) + ", reading it with a stream instead");
+      }
+    }
+    if (uncached_reader) {
+      uncached_reader->open(file_path, file_size);
+    }
+    std::ifstream file;
+    if (!mapped_file && !uncached_reader) {
+      file.open(file_path, std::ios::binary);
+      if (!file) {
+        throw std::runtime_error("\nFailed to open file: " +
+                                 file_path.string());
+      }
     }
 
     // Chunks are a specific size, so multiple smaller files could be contained
     // in one chunk and larger files could be made up of multiple chunks
     while (remaining_file_data > 0) {
       if (ctx.should_abort()) {
-        output_done.store(true);
         return;
       }
 
       const uint64_t bytes_to_read =
           std::min<uint64_t>(remaining_file_data, remaining_buffer_capacity);
-      file.read(
-          reinterpret_cast<char *>(buffer.data() +
-                                   (buffer.size() - remaining_buffer_capacity)),
-          bytes_to_read);
-
-      auto bytes_read = file.gcount();
+      uint8_t *dest =
+          chunk_ptr->data() + (chunk_ptr->size() - remaining_buffer_capacity);
+      uint64_t bytes_read = bytes_to_read;
+      if (mapped_file) {
+        mapped_file->copy(file_size - remaining_file_data, dest,
+                          bytes_to_read);
+      } else if (uncached_reader) {
+        uncached_reader->read(dest, bytes_to_read);
+      } else {
+        file.read(reinterpret_cast<char *>(dest), bytes_to_read);
+        bytes_read = file.gcount();
+      }
       if (bytes_read != bytes_to_read) {
         throw std::runtime_error("\nDid not read expected number of bytes");
       }
@@ -57,91 +253,328 @@ void FileManager::read_files_into_chunks(
       remaining_buffer_capacity -= bytes_read;
       remaining_file_data -= bytes_read;
 
-      // Allocate new chunk buffer if the current one is filled up
+      // Borrow the next chunk from the pool if the current one is filled up
       if (remaining_buffer_capacity == 0) {
-        output_queue.push(
-            std::make_unique<Chunk>(sequence_counter++, std::move(buffer)));
-
-        // Final chunk size should only be used on the last chunk when the
-        // calculated chunk size is not 0. If it is 0, then this may indicate
-        // that the transfer size is perfectly divisble by the chunk size, in
-        // which case the final chunk should be regularily sized, not 0 bytes.
-        const bool use_final_chunk_size =
-            (sequence_counter == transfer_request.get_num_chunks()) &&
-            (transfer_request.get_final_chunk_size() != 0);
-        const uint32_t new_buffer_size =
-            use_final_chunk_size ? transfer_request.get_final_chunk_size()
-                                 : transfer_request.get_chunk_size();
-        buffer.resize(new_buffer_size);
-        remaining_buffer_capacity = new_buffer_size;
+        if (!output_queue.push(std::move(chunk_ptr))) {
+          return;
+        }
+        if (sequence_counter == transfer_request.get_num_chunks()) {
+          break;
+        }
+        chunk_ptr = acquire_chunk(++sequence_counter);
+        remaining_buffer_capacity = chunk_ptr->size();
       }
     }
   }
 
-  output_done.store(true);
+  output_queue.close();
 }
 
 void FileManager::write_files_from_chunks(
     WorkerContext &ctx, const TransferRequest &transfer_request,
-    BoundedThreadSafeQueue<std::unique_ptr<Chunk>> &input_queue,
-    std::atomic<bool> &input_done, std::atomic<uint32_t> &chunks_written) {
+    ChunkQueue &input_queue, std::atomic<uint32_t> &chunks_written,
+    FileWriteMode write_mode) {
+  WriteBehind::preallocate_files(transfer_request);
 
-  uint32_t sequence_counter = 1;
+  if (write_mode == FileWriteMode::URING && prepare_uring() > 0) {
+    LOG("writing files through io_uring");
+    uring_file_io_->write_files_from_chunks(ctx, transfer_request, input_queue,
+                                           chunks_written);
+    return;
+  }
 
-  // Blocking thread until first chunk received
-  std::unique_ptr<Chunk> chunk_ptr = input_queue.pop();
+  const uint32_t num_chunks = transfer_request.get_num_chunks();
+  const ChunkIndex chunk_index(transfer_request);
+  WrittenChunks written_chunks(num_chunks);
+  OutputFiles output_files(transfer_request);
 
-  uint32_t remaining_chunk_data = chunk_ptr->size();
-  size_t chunk_offset = 0;
+  for (uint32_t chunks_received = 0; chunks_received < num_chunks;
+       ++chunks_received) {
+    if (ctx.should_abort()) {
+      return;
+    }
+
+    // Blocks until the next chunk arrives. An empty result means the queue
+    // was cancelled on abort, or closed before all file data was received
+    std::optional<ChunkPtr> chunk_ptr_opt = input_queue.pop();
+    if (!chunk_ptr_opt) {
+      if (ctx.should_abort()) {
+        return;
+      }
+      throw std::runtime_error("Chunk stream ended before " +
+                               output_files.first_incomplete() +
+                               " was fully written");
+    }
+    const ChunkPtr &chunk_ptr = *chunk_ptr_opt;
+    const uint64_t sequence_num = chunk_ptr->sequence_num();
+    if (chunk_ptr->compressed()) {
+      throw std::runtime_error("Received compressed chunk #" +
+                               std::to_string(sequence_num) +
+                               " without a decompression stage");
+    }
+    written_chunks.received(sequence_num);
+    const uint32_t payload_size = chunk_index.payload_size(sequence_num);
+    if (chunk_ptr->size() != payload_size) {
+      throw std::runtime_error("Chunk #" + std::to_string(sequence_num) +
+                               " has " + std::to_string(chunk_ptr->size()) +
+                               " bytes, expected " +
+                               std::to_string(payload_size));
+    }
+
+    for (const ChunkIndex::Piece &piece : chunk_index.pieces(sequence_num)) {
+      output_files.write(piece, chunk_ptr->data() + piece.chunk_offset);
+    }
+
+    // chunks_written is acknowledged to a resumable sender, so it only
+    // counts chunks handed to the OS with every chunk before them
+    chunks_written = written_chunks.written(sequence_num);
+  }
+}
+
+bool FileManager::can_transfer_zero_copy(
+    const TransferRequest &transfer_request, bool encrypted) {
+  return !encrypted && !transfer_request.compression_enabled() &&
+         transfer_request.get_num_streams() == 1 &&
+         !transfer_request.udp_transport();
+}
+
+std::optional<uint64_t>
+FileManager::page_cache_footprint(const TransferRequest &transfer_request) {
+#ifdef __linux__
+  // Files are mapped a window at a time to bound the residency vector.
+  // Mapping does not read anything in, so measuring does not change the
+  // result
+  constexpr uint64_t WINDOW = 1024 * 1024 * 1024;
+  const uint64_t page_size = static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+  std::vector<unsigned char> residency(WINDOW / page_size);
 
+  uint64_t cached_bytes = 0;
   for (const auto &file_info : transfer_request.get_file_infos()) {
-    std::filesystem::path abs_path =
+    FileDescriptor file(
+        ::open(file_info.relative_path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (file.get() < 0) {
+      return std::nullopt;
+    }
+    for (uint64_t offset = 0; offset < file_info.size; offset += WINDOW) {
+      const uint64_t length = std::min(WINDOW, file_info.size - offset);
+      void *mapping = ::mmap(nullptr, length, PROT_READ, MAP_SHARED,
+                             file.get(), static_cast<off_t>(offset));
+      if (mapping == MAP_FAILED) {
+        return std::nullopt;
+      }
+      const int result = ::mincore(mapping, length, residency.data());
+      ::munmap(mapping, length);
+      if (result != 0) {
+        return std::nullopt;
+      }
+      for (uint64_t page = 0; page * page_size < length; ++page) {
+        if (residency[page] & 1) {
+          cached_bytes += std::min(page_size, length - page * page_size);
+        }
+      }
+    }
+  }
+  return cached_bytes;
+#else
+  (void)transfer_request;
+  return std::nullopt;
+#endif
+}
+
+void FileManager::send_files_to_socket(WorkerContext &ctx,
+                                       const TransferRequest &transfer_request,
+                                       TcpSocket &socket,
+                                       std::atomic<uint64_t> &bytes_sent,
+                                       RateLimiter *rate_limiter) {
+  for (const auto &file_info : transfer_request.get_file_infos()) {
+    if (ctx.should_abort()) {
+      return;
+    }
+
+    std::filesystem::path file_path =
         std::filesystem::current_path() / file_info.relative_path;
-    uint64_t remaining_file_data = file_info.size;
-    std::filesystem::path parent_path =
-        std::filesystem::path(file_info.relative_path).parent_path();
-    if (!parent_path.empty()) {
-      std::filesystem::create_directories(parent_path);
+    uint64_t file_size = std::filesystem::file_size(file_path);
+    if (file_size != file_info.size) {
+      throw std::runtime_error(
+          "\nFile size mismatch: expected " + std::to_string(file_info.size) +
+          " bytes, file size is " + std::to_string(file_size) + " bytes");
     }
-    std::ofstream file(file_info.relative_path, std::ios::binary);
-    if (!file) {
-      throw std::runtime_error("Failed to open file: " + abs_path.string());
+
+#ifdef __linux__
+    FileDescriptor file(::open(file_path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (file.get() < 0) {
+      throw utils::system_failure(
+          "\nFailed to open file " + file_path.string(), errno);
     }
 
+    off_t offset = 0;
+    uint64_t remaining_file_data = file_size;
+    while (remaining_file_data > 0) {
+      if (ctx.should_abort()) {
+        return;
+      }
+      std::size_t count =
+          std::min<uint64_t>(remaining_file_data, ZERO_COPY_STEP);
+      if (rate_limiter) {
+        count = std::min(count, rate_limiter->slice_size());
+        if (!rate_limiter->acquire(ctx, count)) {
+          return;
+        }
+      }
+      ssize_t sent =
+          ::sendfile(socket.native_handle(), file.get(), &offset, count);
+      if (sent < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          socket.wait_writable();
+          continue;
+        }
+        if (errno == EINTR) {
+          continue;
+        }
+        throw utils::system_failure(
+            "\nFailed to send file " + file_path.string(), errno);
+      }
+      if (sent == 0) {
+        throw std::runtime_error("\nFile " + file_path.string() +
+                                 " ended before it was fully sent");
+      }
+      remaining_file_data -= sent;
+      bytes_sent += sent;
+    }
+#else
+    std::ifstream file(file_path, std::ios::binary);
+    if (!file) {
+      throw std::runtime_error("\nFailed to open file: " + file_path.string());
+    }
+    std::vector<char> buffer(ZERO_COPY_STEP);
+    uint64_t remaining_file_data = file_size;
     while (remaining_file_data > 0) {
       if (ctx.should_abort()) {
         return;
       }
+      std::size_t count =
+          std::min<uint64_t>(remaining_file_data, buffer.size());
+      if (rate_limiter) {
+        count = std::min(count, rate_limiter->slice_size());
+        if (!rate_limiter->acquire(ctx, count)) {
+          return;
+        }
+      }
+      if (!file.read(buffer.data(), count)) {
+        throw std::runtime_error("\nDid not read expected number of bytes");
+      }
+      socket.write(buffer.data(), count);
+      remaining_file_data -= count;
+      bytes_sent += count;
+    }
+#endif
+  }
+}
 
-      const int64_t bytes_to_write =
-          std::min<uint64_t>(remaining_file_data, remaining_chunk_data);
-      file.write(
-          reinterpret_cast<const char *>(chunk_ptr->data() + chunk_offset),
-          bytes_to_write);
+// Each splice() from the socket is fully drained from the pipe into the file
+// before the next one, so the pipe is always empty when the socket is read
+void FileManager::receive_files_from_socket(
+    WorkerContext &ctx, const TransferRequest &transfer_request,
+    TcpSocket &socket, std::atomic<uint64_t> &bytes_written) {
+  WriteBehind::preallocate_files(transfer_request);
 
-      if (file.fail()) {
-        throw std::runtime_error("Failed to write to file " +
-                                 abs_path.string());
-      }
+#ifdef __linux__
+  int pipe_fds[2];
+  if (::pipe2(pipe_fds, O_CLOEXEC) != 0) {
+    throw utils::system_failure("Failed to create pipe", errno);
+  }
+  FileDescriptor pipe_read_end(pipe_fds[0]);
+  FileDescriptor pipe_write_end(pipe_fds[1]);
 
-      chunk_offset += bytes_to_write;
-      remaining_chunk_data -= bytes_to_write;
-      remaining_file_data -= bytes_to_write;
+  // A larger pipe moves more per call, the default of 64 KiB is kept if the
+  // system limit does not allow it
+  int pipe_size = ::fcntl(pipe_write_end.get(), F_SETPIPE_SZ,
+                          static_cast<int>(ZERO_COPY_STEP));
+  if (pipe_size <= 0) {
+    pipe_size = ::fcntl(pipe_write_end.get(), F_GETPIPE_SZ);
+  }
+#else
+  std::vector<char> buffer(ZERO_COPY_STEP);
+#endif
 
-      // Get next chunk once all data from this one is written
-      if (remaining_chunk_data == 0) {
-        // std::cout << "Wrote chunk (seq#) " << chunk_ptr->sequence_num() << "
-        // (" << chunk_ptr->size() << " B)" << std::endl;
-        chunks_written++;
+  for (const auto &file_info : transfer_request.get_file_infos()) {
+    if (ctx.should_abort()) {
+      return;
+    }
+    std::filesystem::path file_path(file_info.relative_path);
+    std::filesystem::path abs_path =
+        std::filesystem::current_path() / file_info.relative_path;
+    uint64_t remaining_file_data = file_info.size;
 
-        if (input_done.load() && input_queue.empty()) {
-          break;
+#ifdef __linux__
+    FileDescriptor file(::open(file_path.c_str(), O_WRONLY | O_CLOEXEC));
+    if (file.get() < 0) {
+      throw utils::system_failure("Failed to open file " + abs_path.string(),
+                                  errno);
+    }
+    WriteBehind write_behind;
+
+    loff_t offset = 0;
+    while (remaining_file_data > 0) {
+      if (ctx.should_abort()) {
+        return;
+      }
+      const std::size_t count =
+          std::min<uint64_t>(remaining_file_data, pipe_size);
+      ssize_t received =
+          ::splice(socket.native_handle(), nullptr, pipe_write_end.get(),
+                   nullptr, count, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+      if (received < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          socket.wait_readable();
+          continue;
+        }
+        if (errno == EINTR) {
+          continue;
         }
+        throw utils::system_failure("Failed to receive " + abs_path.string(),
+                                    errno);
+      }
+      if (received == 0) {
+        throw std::runtime_error("Connection closed before " +
+                                 abs_path.string() + " was fully received");
+      }
 
-        chunk_ptr = input_queue.pop();
-        remaining_chunk_data = chunk_ptr->size();
-        chunk_offset = 0;
+      while (received > 0) {
+        ssize_t written = ::splice(pipe_read_end.get(), nullptr, file.get(),
+                                   &offset, received, SPLICE_F_MOVE);
+        if (written < 0) {
+          if (errno == EINTR) {
+            continue;
+          }
+          throw utils::system_failure(
+              "Failed to write to file " + abs_path.string(), errno);
+        }
+        received -= written;
+        remaining_file_data -= written;
+        bytes_written += written;
+      }
+      write_behind.written(file.get(), static_cast<uint64_t>(offset));
+    }
+#else
+    std::ofstream file(file_path, std::ios::binary);
+    if (!file) {
+      throw std::runtime_error("Failed to open file: " + abs_path.string());
+    }
+    while (remaining_file_data > 0) {
+      if (ctx.should_abort()) {
+        return;
       }
+      const std::size_t count =
+          std::min<uint64_t>(remaining_file_data, buffer.size());
+      socket.read(buffer.data(), count);
+      if (!file.write(buffer.data(), count)) {
+        throw std::runtime_error("Failed to write to file " +
+                                 abs_path.string());
+      }
+      remaining_file_data -= count;
+      bytes_written += count;
     }
+#endif
   }
-}
\ No newline at end of file
+}
@@ -0,0 +1,132 @@
+#include "FrameHeader.h"
+
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+template <typename T> uint8_t *store_le(uint8_t *out, T value) {
+  for (std::size_t i = 0; i < sizeof(T); ++i) {
+    out[i] = static_cast<uint8_t>(value >> (8 * i));
+  }
+  return out + sizeof(T);
+}
+
+template <typename T> const uint8_t *load_le(const uint8_t *in, T &value) {
+  value = 0;
+  for (std::size_t i = 0; i < sizeof(T); ++i) {
+    value |= static_cast<T>(in[i]) << (8 * i);
+  }
+  return in + sizeof(T);
+}
+
+} // anonymous namespace
+
+FrameHeader FrameHeader::end_of_stream() { return FrameHeader(); }
+
+bool FrameHeader::is_end_of_stream() const { return sequence_num == 0; }
+
+void FrameHeader::encode(uint8_t *out) const {
+  out = store_le(out, sequence_num);
+  out = store_le(out, static_cast<uint8_t>(compressed));
+  out = store_le(out, original_size);
+  store_le(out, chunk_size);
+}
+
+FrameHeader FrameHeader::decode(const uint8_t *in) {
+  FrameHeader header;
+  uint8_t compressed_flag;
+  in = load_le(in, header.sequence_num);
+  in = load_le(in, compressed_flag);
+  in = load_le(in, header.original_size);
+  load_le(in, header.chunk_size);
+
+  if (compressed_flag > 1) {
+    throw std::runtime_error("Invalid compressed flag " +
+                             std::to_string(compressed_flag) +
+                             " in header of chunk #" +
+                             std::to_string(header.sequence_num));
+  }
+  header.compressed = compressed_flag == 1;
+  return header;
+}
+
+void Acknowledgement::encode(uint8_t *out) const {
+  store_le(out, chunks_written);
+}
+
+Acknowledgement Acknowledgement::decode(const uint8_t *in) {
+  Acknowledgement acknowledgement;
+  load_le(in, acknowledgement.chunks_written);
+  return acknowledgement;
+}
+
+void ReconnectRequest::encode(uint8_t *out) const { store_le(out, attempt); }
+
+ReconnectRequest ReconnectRequest::decode(const uint8_t *in) {
+  ReconnectRequest request;
+  load_le(in, request.attempt);
+  return request;
+}
+
+void DataDatagramHeader::encode(uint8_t *out) const {
+  out = store_le(out, static_cast<uint8_t>(DatagramType::DATA));
+  out = store_le(out, packet_num);
+  out = store_le(out, sequence_num);
+  out = store_le(out, frame_size);
+  store_le(out, offset);
+}
+
+DataDatagramHeader DataDatagramHeader::decode(const uint8_t *in) {
+  DataDatagramHeader header;
+  in += sizeof(uint8_t);
+  in = load_le(in, header.packet_num);
+  in = load_le(in, header.sequence_num);
+  in = load_le(in, header.frame_size);
+  load_le(in, header.offset);
+  return header;
+}
+
+std::size_t DatagramAcknowledgement::encode(uint8_t *out) const {
+  if (ranges.size() > MAX_RANGES) {
+    throw std::logic_error("Acknowledgement holds too many ranges");
+  }
+  uint8_t *begin = out;
+  out = store_le(out, static_cast<uint8_t>(DatagramType::ACK));
+  out = store_le(out, next_sequence_num);
+  out = store_le(out, static_cast<uint8_t>(ranges.size()));
+  for (const auto &[first, last] : ranges) {
+    out = store_le(out, first);
+    out = store_le(out, last);
+  }
+  return static_cast<std::size_t>(out - begin);
+}
+
+DatagramAcknowledgement DatagramAcknowledgement::decode(const uint8_t *in,
+                                                        std::size_t size) {
+  constexpr std::size_t FIXED_SIZE =
+      sizeof(uint8_t) + sizeof(uint64_t) + sizeof(uint8_t);
+  if (size < FIXED_SIZE) {
+    throw std::runtime_error("Truncated datagram acknowledgement");
+  }
+  DatagramAcknowledgement acknowledgement;
+  uint8_t range_count;
+  in += sizeof(uint8_t);
+  in = load_le(in, acknowledgement.next_sequence_num);
+  in = load_le(in, range_count);
+  if (range_count > MAX_RANGES ||
+      size != FIXED_SIZE + range_count * 2 * sizeof(uint64_t)) {
+    throw std::runtime_error("Malformed datagram acknowledgement");
+  }
+  for (uint8_t i = 0; i < range_count; ++i) {
+    uint64_t first;
+    uint64_t last;
+    in = load_le(in, first);
+    in = load_le(in, last);
+    if (first > last) {
+      throw std::runtime_error("Malformed datagram acknowledgement");
+    }
+    acknowledgement.ranges.emplace_back(first, last);
+  }
+  return acknowledgement;
+}
@@ -0,0 +1,87 @@
+#include "FrameReader.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+FrameReader::FrameReader(TcpSocket &socket, std::size_t buffer_size)
+    : socket_(socket), buffer_(buffer_size) {
+  if (buffer_size < FrameHeader::SIZE) {
+    throw std::logic_error("FrameReader buffer cannot hold a frame header");
+  }
+}
+
+ChunkPtr FrameReader::read_frame(ChunkPool &chunk_pool) {
+  fill_header();
+  const FrameHeader header = FrameHeader::decode(buffer_.data() + begin_);
+  begin_ += FrameHeader::SIZE;
+
+  if (header.is_end_of_stream()) {
+    if (header.chunk_size != 0) {
+      throw std::runtime_error("End of stream frame carries a payload");
+    }
+    return ChunkPtr();
+  }
+
+  // Payload lands after the chunk headroom so it can be decrypted in place.
+  // The size comes off the wire, resize() rejects anything larger than the
+  // negotiated chunk buffers
+  ChunkPtr chunk_ptr = chunk_pool.acquire(header.sequence_num);
+  chunk_ptr->resize(header.chunk_size);
+  chunk_ptr->set_compressed(header.compressed, header.original_size);
+
+  uint8_t *payload = chunk_ptr->data();
+  std::size_t received = std::min<std::size_t>(buffered(), header.chunk_size);
+  std::memcpy(payload, buffer_.data() + begin_, received);
+  begin_ += received;
+
+  // The receive buffer is empty whenever the payload is still incomplete
+  while (received < header.chunk_size) {
+    begin_ = 0;
+    end_ = 0;
+    const std::array<asio::mutable_buffer, 2> targets = {
+        asio::buffer(payload + received, header.chunk_size - received),
+        asio::buffer(buffer_.data(), buffer_.size())};
+    const std::size_t bytes = socket_.read_some(targets);
+    read_calls_++;
+    bytes_read_ += bytes;
+
+    const std::size_t payload_bytes =
+        std::min<std::size_t>(bytes, header.chunk_size - received);
+    received += payload_bytes;
+    end_ = bytes - payload_bytes;
+  }
+
+  return chunk_ptr;
+}
+
+void FrameReader::discard_buffered() {
+  begin_ = 0;
+  end_ = 0;
+}
+
+uint64_t FrameReader::read_calls() const { return read_calls_; }
+
+uint64_t FrameReader::bytes_read() const { return bytes_read_; }
+
+std::size_t FrameReader::buffered() const { return end_ - begin_; }
+
+// Reads until a whole header is buffered. A partial header left at the end of
+// the buffer is first moved to the front, which is at most a few bytes
+void FrameReader::fill_header() {
+  if (buffered() >= FrameHeader::SIZE) {
+    return;
+  }
+  std::memmove(buffer_.data(), buffer_.data() + begin_, buffered());
+  end_ = buffered();
+  begin_ = 0;
+
+  while (end_ < FrameHeader::SIZE) {
+    const std::size_t bytes = socket_.read_some(
+        asio::buffer(buffer_.data() + end_, buffer_.size() - end_));
+    read_calls_++;
+    bytes_read_ += bytes;
+    end_ += bytes;
+  }
+}
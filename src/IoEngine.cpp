@@ -0,0 +1,33 @@
+#include "IoEngine.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+IoEngine::IoEngine(std::size_t num_threads)
+    : work_guard_(asio::make_work_guard(io_context_)) {
+  if (num_threads == 0) {
+    throw std::logic_error("IoEngine needs at least one thread");
+  }
+  for (std::size_t i = 0; i < num_threads; ++i) {
+    threads_.emplace_back([this]() { io_context_.run(); });
+  }
+}
+
+IoEngine::~IoEngine() {
+  work_guard_.reset();
+  io_context_.stop();
+  for (auto &thread : threads_) {
+    thread.join();
+  }
+}
+
+// The handlers only hand results back to the waiting pipeline threads, so a
+// couple of threads keep up with every socket of a transfer
+IoEngine &IoEngine::shared() {
+  constexpr unsigned int MAX_SHARED_THREADS = 2;
+  static IoEngine engine(
+      std::clamp(std::thread::hardware_concurrency(), 1u, MAX_SHARED_THREADS));
+  return engine;
+}
+
+asio::io_context &IoEngine::context() { return io_context_; }
@@ -0,0 +1,152 @@
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "utils.h"
+
+#ifdef __linux__
+#include <csetjmp>
+#include <csignal>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#ifdef __linux__
+
+// Where a SIGBUS on this thread jumps to, set only while copy() touches the
+// mapping. Volatile so the compiler keeps the stores around the copy
+thread_local sigjmp_buf *volatile fault_jump = nullptr;
+
+struct sigaction previous_sigbus_action;
+
+void handle_sigbus(int signal, siginfo_t *info, void *) {
+  if (sigjmp_buf *jump = fault_jump) {
+    fault_jump = nullptr;
+    siglongjmp(*jump, 1);
+  }
+
+  // Not a fault of a guarded copy. With the previous handler back in place
+  // the faulting access raises the signal again when this returns
+  sigaction(SIGBUS, &previous_sigbus_action, nullptr);
+  if (info->si_code <= 0) {
+    raise(signal);
+  }
+}
+
+void install_sigbus_handler() {
+  static std::once_flag installed;
+  std::call_once(installed, []() {
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_sigaction = handle_sigbus;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGBUS, &action, &previous_sigbus_action) != 0) {
+      throw utils::system_failure("Failed to install the SIGBUS handler",
+                                  errno);
+    }
+  });
+}
+
+uint64_t page_size() {
+  static const uint64_t size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+  return size;
+}
+#endif
+
+} // namespace
+
+bool MappedFile::supported() {
+#ifdef __linux__
+  return true;
+#else
+  return false;
+#endif
+}
+
+#ifdef __linux__
+MappedFile::MappedFile(const std::filesystem::path &path, uint64_t size)
+    : path_(path), size_(size) {
+  install_sigbus_handler();
+  if (size_ == 0) {
+    return;
+  }
+
+  const int fd = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw utils::system_failure("Failed to open " + path_.string(), errno);
+  }
+  void *data = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+  // The mapping keeps the file open
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    throw utils::system_failure("Failed to map " + path_.string(), errno);
+  }
+  data_ = static_cast<uint8_t *>(data);
+
+  // Advice only changes how the kernel reads ahead, so failures are ignored
+  ::madvise(data_, size_, MADV_SEQUENTIAL);
+  read_ahead(0);
+}
+
+MappedFile::~MappedFile() {
+  if (data_) {
+    ::munmap(data_, size_);
+  }
+}
+
+void MappedFile::copy(uint64_t offset, uint8_t *dest, std::size_t len) {
+  if (offset > size_ || len > size_ - offset) {
+    throw std::logic_error("Read past the end of " + path_.string());
+  }
+  if (len == 0) {
+    return;
+  }
+
+  // Advise the next window once half of the current one has been copied
+  if (offset + len + READAHEAD / 2 > readahead_end_) {
+    read_ahead(offset + len);
+  }
+
+  sigjmp_buf jump;
+  if (sigsetjmp(jump, 1) != 0) {
+    throw std::runtime_error("\n" + path_.string() +
+                             " was truncated while being sent");
+  }
+  fault_jump = &jump;
+  std::memcpy(dest, data_ + offset, len);
+  fault_jump = nullptr;
+}
+
+void MappedFile::read_ahead(uint64_t offset) {
+  const uint64_t start = std::max(offset, readahead_end_) & ~(page_size() - 1);
+  const uint64_t end = std::min<uint64_t>(offset + READAHEAD, size_);
+  if (start >= end) {
+    return;
+  }
+  ::madvise(data_ + start, end - start, MADV_WILLNEED);
+  readahead_end_ = end;
+}
+#else
+MappedFile::MappedFile(const std::filesystem::path &path, uint64_t size)
+    : path_(path), size_(size) {
+  throw std::runtime_error("Memory-mapped files are not supported on this "
+                           "platform");
+}
+
+MappedFile::~MappedFile() = default;
+
+void MappedFile::copy(uint64_t, uint8_t *, std::size_t) {}
+
+void MappedFile::read_ahead(uint64_t) {}
+#endif
+
+uint64_t MappedFile::size() const { return size_; }
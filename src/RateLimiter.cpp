@@ -0,0 +1,170 @@
+#include "RateLimiter.h"
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <thread>
+
+#include "utils.h"
+
+namespace {
+
+// The default burst covers this much time at the rate, within the bounds
+// below, so a slice is small enough to keep the pacing even but large enough
+// that a fast limit does not cost a write call per frame
+constexpr std::chrono::milliseconds DEFAULT_BURST_DURATION(20);
+constexpr uint64_t MIN_DEFAULT_BURST = 64 * 1024;
+constexpr uint64_t MAX_DEFAULT_BURST = 4 * 1024 * 1024;
+
+// Longest single sleep, so an abort or a raised limit is noticed promptly
+constexpr std::chrono::milliseconds MAX_WAIT(50);
+
+constexpr std::chrono::seconds CONTROL_CHECK_INTERVAL(1);
+
+} // namespace
+
+RateLimiter::RateLimiter(uint64_t rate, uint64_t burst,
+                         std::filesystem::path control_file)
+    : initial_rate_(rate), initial_burst_(burst),
+      control_file_(std::move(control_file)) {
+  last_refill_ = std::chrono::steady_clock::now();
+  next_control_check_ = last_refill_;
+  set_rate_locked(rate, burst);
+}
+
+std::filesystem::path RateLimiter::default_control_file() {
+  return std::filesystem::current_path() / ".trit" / "rate_limit";
+}
+
+void RateLimiter::set_rate(uint64_t rate, uint64_t burst) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  refill_locked(std::chrono::steady_clock::now());
+  set_rate_locked(rate, burst);
+}
+
+uint64_t RateLimiter::rate() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return rate_;
+}
+
+uint64_t RateLimiter::burst() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return burst_;
+}
+
+std::size_t RateLimiter::slice_size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (rate_ == 0) {
+    return std::numeric_limits<std::size_t>::max();
+  }
+  return static_cast<std::size_t>(burst_);
+}
+
+// A request larger than the burst only needs a full bucket and leaves it in
+// debt, so oversized slices are paced at the rate rather than stalling
+bool RateLimiter::acquire(WorkerContext &ctx, std::size_t bytes) {
+  while (!ctx.should_abort()) {
+    std::chrono::steady_clock::duration wait;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      const auto now = std::chrono::steady_clock::now();
+      check_control_file_locked(now);
+      if (rate_ == 0) {
+        return true;
+      }
+      refill_locked(now);
+
+      const double needed =
+          std::min(static_cast<double>(bytes), static_cast<double>(burst_));
+      if (tokens_ >= needed) {
+        tokens_ -= static_cast<double>(bytes);
+        return true;
+      }
+      wait = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>((needed - tokens_) /
+                                        static_cast<double>(rate_)));
+    }
+    std::this_thread::sleep_for(
+        std::min<std::chrono::steady_clock::duration>(wait, MAX_WAIT));
+  }
+  return false;
+}
+
+std::string RateLimiter::describe() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return describe_locked();
+}
+
+// The bucket starts full, and keeps what it holds up to the new burst
+void RateLimiter::set_rate_locked(uint64_t rate, uint64_t burst) {
+  if (burst == 0) {
+    burst = std::clamp<uint64_t>(rate / 1000 * DEFAULT_BURST_DURATION.count(),
+                                 MIN_DEFAULT_BURST, MAX_DEFAULT_BURST);
+  }
+  const bool was_unlimited = rate_ == 0;
+  rate_ = rate;
+  burst_ = burst;
+  tokens_ = was_unlimited ? static_cast<double>(burst_)
+                          : std::min(tokens_, static_cast<double>(burst_));
+}
+
+void RateLimiter::refill_locked(std::chrono::steady_clock::time_point now) {
+  const double elapsed =
+      std::chrono::duration<double>(now - last_refill_).count();
+  last_refill_ = now;
+  tokens_ = std::min(tokens_ + elapsed * static_cast<double>(rate_),
+                     static_cast<double>(burst_));
+}
+
+// An unreadable or malformed file is logged and ignored, keeping the limit
+// in effect
+void RateLimiter::check_control_file_locked(
+    std::chrono::steady_clock::time_point now) {
+  if (control_file_.empty() || now < next_control_check_) {
+    return;
+  }
+  next_control_check_ = now + CONTROL_CHECK_INTERVAL;
+
+  std::ifstream control_file(control_file_);
+  if (!control_file) {
+    if (control_text_) {
+      control_text_.reset();
+      refill_locked(now);
+      set_rate_locked(initial_rate_, initial_burst_);
+      LOG("rate limit file removed, " + describe_locked());
+    }
+    return;
+  }
+  std::ostringstream contents;
+  contents << control_file.rdbuf();
+  std::string text = contents.str();
+  if (control_text_ == text) {
+    return;
+  }
+  control_text_ = text;
+
+  std::istringstream fields(text);
+  std::string rate_field;
+  std::string burst_field;
+  fields >> rate_field >> burst_field;
+  std::optional<uint64_t> rate_opt = utils::parse_data_size(rate_field);
+  std::optional<uint64_t> burst_opt =
+      burst_field.empty() ? std::optional<uint64_t>(0)
+                          : utils::parse_data_size(burst_field);
+  if (!rate_opt || !burst_opt) {
+    LOG("ignoring malformed rate limit file " + control_file_.string());
+    return;
+  }
+  refill_locked(now);
+  set_rate_locked(*rate_opt, *burst_opt);
+  LOG("rate limit file changed, " + describe_locked());
+}
+
+std::string RateLimiter::describe_locked() const {
+  if (rate_ == 0) {
+    return "rate limit off";
+  }
+  return "rate limit " + utils::format_data_size(rate_) + "/s, burst " +
+         utils::format_data_size(burst_);
+}
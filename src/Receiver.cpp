@@ -1,78 +1,161 @@
+#include <algorithm>
 #include <chrono>
+#include <ctime>
 #include <iostream>
 #include <stdexcept>
 #include <thread>
 
+#include "ChunkPool.h"
 #include "CompressionManager.h"
 #include "EncryptionManager.h"
 #include "FileManager.h"
+#include "FrameHeader.h"
 #include "ProgressTracker.h"
 #include "Receiver.h"
+#include "StripedTransferManager.h"
 #include "TransferManager.h"
+#include "UdpTransferManager.h"
 #include "utils.h"
 
+namespace {
+
+// The sender opens the additional connections of a striped transfer as soon
+// as the transfer is accepted
+constexpr std::chrono::seconds STREAM_ACCEPT_TIMEOUT(10);
+
+} // anonymous namespace
+
 Receiver::Receiver(const std::string &ip, uint16_t port,
-                   const std::string &password)
-    : ip_(ip), port_(port), password_(password) {}
+                   const std::string &password,
+                   const SocketOptions &socket_options)
+    : ip_(ip), port_(port), password_(password),
+      socket_options_(socket_options) {}
 
 void Receiver::start_session() {
   LOG("receiver session started");
+  start_listening_for_connection();
+
+  // Without the master key senders just hash the password every time
+  try {
+    ticket_issuer_.emplace(password_);
+  } catch (const std::exception &e) {
+    LOG(std::string("session tickets disabled: ") + e.what());
+  }
 
   while (true) {
     std::cout << "Waiting for connections..." << std::endl;
     wait_for_connection();
     LOG("connected to sender");
 
-    std::optional<crypto::Decryptor> decryptor_opt;
-    if (!receive_handshake(decryptor_opt)) {
-      std::cout << "Handshake failed. Ensure passwords match." << std::endl;
+    // The transfer request arrives with the handshake, and both are answered
+    // with a single verdict once the user has decided
+    std::optional<ChunkDecryption> chunk_decryption_opt;
+    std::optional<TransferRequest> transfer_request_opt;
+    crypto::HandshakeKind kind = crypto::HandshakeKind::PASSWORD;
+    if (receive_handshake(chunk_decryption_opt, kind)) {
+      transfer_request_opt = receive_transfer_request();
+    }
+    if (!transfer_request_opt) {
+      send_verdict(RequestVerdict::HANDSHAKE_FAILED);
+      if (kind == crypto::HandshakeKind::TICKET) {
+        // The sender retries with the password on a new connection
+        std::cout << "Session ticket not accepted, waiting for the sender to "
+                     "retry with the password"
+                  << std::endl;
+      } else {
+        std::cout << "Handshake failed. Ensure passwords match." << std::endl;
+      }
       continue;
     }
     LOG("handshake successful");
-
-    TransferRequest transfer_request = receive_transfer_request();
+    const TransferRequest &transfer_request = *transfer_request_opt;
     LOG("receieved transfer request");
-    if (!accept_transfer_request(transfer_request)) {
+
+    // The handshake gave the kernel its first round trip time samples
+    if (std::optional<std::size_t> buffer_size =
+            sender_socket_.tune_buffer_size()) {
+      LOG("sized socket buffers to " + std::to_string(*buffer_size) +
+          " bytes from the handshake round trip time");
+    }
+    LOG("socket options: " + sender_socket_.describe_options());
+
+    const bool encrypted =
+        !std::holds_alternative<std::monostate>(*chunk_decryption_opt);
+    if (!accept_transfer_request(transfer_request, encrypted)) {
+      send_verdict(RequestVerdict::DECLINED);
       LOG("transfer request denied by user");
       continue;
     }
     LOG("transfer request accepted by user");
 
+    // The port of a UDP transfer follows the verdict, 0 telling the sender
+    // that none could be bound
+    if (transfer_request.udp_transport()) {
+      const uint16_t udp_port = open_udp_transport();
+      send_verdict(RequestVerdict::ACCEPTED, udp_port);
+      if (udp_port == 0) {
+        continue;
+      }
+    } else {
+      send_verdict(RequestVerdict::ACCEPTED);
+    }
+
+    // A sender whose additional connections never arrive, e.g. blocked by a
+    // firewall, fails only this transfer
+    if (transfer_request.get_num_streams() > 1) {
+      try {
+        accept_streams(transfer_request.get_num_streams());
+      } catch (const std::exception &e) {
+        std::cerr << "Transfer failed: " << e.what() << '\n';
+        stream_sockets_.clear();
+        continue;
+      }
+      LOG("accepted " + std::to_string(transfer_request.get_num_streams()) +
+          " connections");
+    }
+
     LOG("starting transfer receive");
-    receive_files(transfer_request, std::move(*decryptor_opt));
+    if (FileManager::can_transfer_zero_copy(transfer_request, encrypted)) {
+      receive_files_zero_copy(transfer_request);
+    } else {
+      receive_files(transfer_request, std::move(*chunk_decryption_opt));
+    }
     LOG("transfer receieved and completed");
 
     break;
   }
 }
 
-// Waits for a successful connection to be established
-void Receiver::wait_for_connection() {
-  if (sender_socket_.is_open()) {
-    sender_socket_.close();
-  }
+// The listening socket stays open between attempts, so a sender that
+// reconnects after a failed handshake never finds the port closed
+void Receiver::start_listening_for_connection() {
+  listener_.emplace(port_);
   std::cout << "Listening for connection at " << ip_ << " on port " << port_
             << "..." << std::endl;
-  TcpSocket::accept(port_, sender_socket_);
+}
+
+// Waits for a successful connection to be established
+void Receiver::wait_for_connection() {
+  sender_socket_.set_options(socket_options_);
+  listener_->accept(sender_socket_);
   std::cout << "Connected to " << sender_socket_.remote_endpoint_address()
             << " on port " << sender_socket_.remote_endpoint_port()
             << std::endl;
 }
 
-// Handshake format: salt, nonce, cipher, header
+// Handshake format: credentials, nonce, cipher (tag and cipher mode), header.
+// The result is only sent with the verdict on the transfer request that
+// follows
 bool Receiver::receive_handshake(
-    std::optional<crypto::Decryptor> &decryptor_opt) {
+    std::optional<ChunkDecryption> &chunk_decryption_opt,
+    crypto::HandshakeKind &kind) {
   LOG("receiving handshake");
 
-  LOG("receiving salt");
-  std::array<uint8_t, crypto::SALT_SIZE> salt_buffer;
-  sender_socket_.read(salt_buffer.data(), salt_buffer.size());
-  crypto::Salt salt(salt_buffer);
-
-  // LOG("salt=" + utils::buffer_to_hex_string(salt.data(), salt.size()));
-
-  LOG("deriving key");
-  crypto::Key key(password_, salt);
+  std::optional<crypto::Key> key_opt = receive_credentials(kind);
+  if (!key_opt) {
+    return false;
+  }
+  const crypto::Key &key = *key_opt;
 
   // LOG("key=" + utils::buffer_to_hex_string(key.data(), key.size()));
 
@@ -93,27 +176,96 @@ bool Receiver::receive_handshake(
   sender_socket_.read(header.data(), header.size());
   // LOG("header=" + utils::buffer_to_hex_string(header.data(), header.size()));
 
-  bool handshake_success = crypto::verify_handshake_tag(key, nonce, ciphertext);
+  std::optional<crypto::CipherMode> cipher_mode_opt =
+      crypto::verify_handshake_tag(key, nonce, ciphertext);
+  bool handshake_success = cipher_mode_opt.has_value();
+  if (cipher_mode_opt == crypto::CipherMode::CHUNKED) {
+    LOG("sender requested chunked encryption");
+    chunk_decryption_opt.emplace(std::in_place_type<crypto::ChunkCipher>, key,
+                                 header);
+  } else if (cipher_mode_opt == crypto::CipherMode::STREAM) {
+    chunk_decryption_opt.emplace(std::in_place_type<crypto::Decryptor>, key,
+                                 header);
+  } else if (cipher_mode_opt == crypto::CipherMode::PLAINTEXT) {
+    LOG("sender requested an unencrypted transfer");
+    chunk_decryption_opt.emplace(std::monostate());
+  }
   if (handshake_success) {
-    decryptor_opt.emplace(key, header);
+    session_key_.emplace(key);
+    session_header_ = header;
   }
-  uint8_t response_byte = handshake_success ? 1 : 0;
-  sender_socket_.write(&response_byte, sizeof(response_byte));
   return handshake_success;
 }
 
+// Credentials format: handshake kind [1 byte], then the salt for a password
+// handshake, or the ticket size [2 bytes], ticket and session random for a
+// ticket handshake. Returns the key they derive, or std::nullopt for a
+// ticket this receiver does not redeem
+std::optional<crypto::Key>
+Receiver::receive_credentials(crypto::HandshakeKind &kind) {
+  uint8_t kind_byte;
+  sender_socket_.read(&kind_byte, sizeof(kind_byte));
+  kind = static_cast<crypto::HandshakeKind>(kind_byte);
+
+  if (kind == crypto::HandshakeKind::PASSWORD) {
+    LOG("receiving salt");
+    std::array<uint8_t, crypto::SALT_SIZE> salt_buffer;
+    sender_socket_.read(salt_buffer.data(), salt_buffer.size());
+    crypto::Salt salt(salt_buffer);
+
+    // LOG("salt=" + utils::buffer_to_hex_string(salt.data(), salt.size()));
+
+    LOG("deriving key");
+    return crypto::Key(password_, salt);
+  }
+  if (kind != crypto::HandshakeKind::TICKET) {
+    LOG("unknown handshake kind " + std::to_string(kind_byte));
+    return std::nullopt;
+  }
+
+  LOG("receiving session ticket");
+  uint16_t ticket_size;
+  sender_socket_.read(&ticket_size, sizeof(ticket_size));
+  if (ticket_size > MAX_TICKET_SIZE) {
+    LOG("session ticket of " + std::to_string(ticket_size) +
+        " bytes is too large");
+    return std::nullopt;
+  }
+  std::vector<uint8_t> ticket(ticket_size);
+  sender_socket_.read(ticket.data(), ticket.size());
+  std::array<uint8_t, crypto::SESSION_RANDOM_SIZE> session_random;
+  sender_socket_.read(session_random.data(), session_random.size());
+
+  std::optional<std::array<uint8_t, crypto::TICKET_SECRET_SIZE>> secret;
+  if (ticket_issuer_) {
+    secret = ticket_issuer_->redeem(ticket);
+  }
+  if (!secret) {
+    LOG("session ticket rejected");
+    return std::nullopt;
+  }
+  LOG("session ticket redeemed");
+  return crypto::derive_ticket_session_key(*secret, session_random);
+}
+
 /*
-    This function waits for, receives, and deserializes the file transfer
-   request from the sender
+    This function receives, opens, and deserializes the file transfer
+   request sent with the handshake, returning std::nullopt if it fails
+   authentication
     --------------------------
     Transfer request format:
-    transfer reqeust size [8 bytes]
+    sealed transfer request size [8 bytes]
+    nonce [24 bytes]
+
+    Encrypted:
 
     number of files [4 bytes]
     total transfer size [8 bytes]
     uncompressed chunk size [4 bytes]
     uncompressed last chunk size [4 bytes]
     num chunks [4 bytes]
+    flags [1 byte]
+    num streams [1 byte]
     file1 path length [2 bytes]
     file1 path [variable]
     file1 size [8 bytes]
@@ -124,79 +276,363 @@ bool Receiver::receive_handshake(
     fileN path length [2 bytes]
     fileN path [variable]
     fileN size [8 bytes]
+
+    MAC [16 bytes]
 */
-TransferRequest Receiver::receive_transfer_request() {
-  std::cout << "Awaiting file transfer request..." << std::endl;
-  uint64_t transfer_request_buffer_size;
-  sender_socket_.read(&transfer_request_buffer_size,
-                      sizeof(transfer_request_buffer_size));
-  std::vector<uint8_t> transfer_request_buffer(transfer_request_buffer_size);
-  sender_socket_.read(transfer_request_buffer.data(),
-                      transfer_request_buffer.size());
-  return TransferRequest::deserialize(transfer_request_buffer);
+std::optional<TransferRequest> Receiver::receive_transfer_request() {
+  uint64_t sealed_request_size;
+  sender_socket_.read(&sealed_request_size, sizeof(sealed_request_size));
+  if (sealed_request_size > MAX_SEALED_REQUEST_SIZE) {
+    LOG("transfer request of " + std::to_string(sealed_request_size) +
+        " bytes is too large");
+    return std::nullopt;
+  }
+  std::vector<uint8_t> sealed_request(sealed_request_size);
+  sender_socket_.read(sealed_request.data(), sealed_request.size());
+
+  std::optional<std::vector<uint8_t>> transfer_request_buffer =
+      crypto::open_transfer_request(*session_key_, session_header_,
+                                    sealed_request);
+  if (!transfer_request_buffer) {
+    LOG("transfer request failed authentication");
+    return std::nullopt;
+  }
+  return TransferRequest::deserialize(*transfer_request_buffer);
 }
 
 bool Receiver::accept_transfer_request(
-    const TransferRequest &transfer_request) {
+    const TransferRequest &transfer_request, bool encrypted) {
   transfer_request.print();
+  if (!encrypted) {
+    std::cout << "Warning: the sender disabled encryption, file data will "
+                 "not be encrypted or authenticated"
+              << std::endl;
+  }
   char choice =
       utils::input<char>("Accept transfer request? (y/n)", {'y', 'n'});
   bool request_accepted = choice == 'y';
-  uint8_t request_accepted_byte = request_accepted;
-  sender_socket_.write(&request_accepted_byte, sizeof(request_accepted_byte));
   std::cout << ((request_accepted ? "Transfer accepted" : "Transfer denied"))
             << std::endl;
   return request_accepted;
 }
 
+// Once the handshake succeeded, the verdict carries a new session ticket,
+// sealed under the session key: its size [2 bytes], 0 if none is issued, and
+// the sealed ticket. The port of an accepted UDP transfer goes out in the same
+// write
+void Receiver::send_verdict(RequestVerdict verdict,
+                            std::optional<uint16_t> udp_port) {
+  const uint8_t verdict_byte = static_cast<uint8_t>(verdict);
+  std::vector<asio::const_buffer> buffers{
+      asio::buffer(&verdict_byte, sizeof(verdict_byte))};
+
+  std::vector<uint8_t> sealed_ticket;
+  uint16_t sealed_ticket_size = 0;
+  if (verdict != RequestVerdict::HANDSHAKE_FAILED) {
+    if (ticket_issuer_) {
+      sealed_ticket = crypto::seal_message(
+          *session_key_, ticket_issuer_->issue().serialize(),
+          session_header_.data(), session_header_.size());
+      sealed_ticket_size = static_cast<uint16_t>(sealed_ticket.size());
+    }
+    buffers.push_back(
+        asio::buffer(&sealed_ticket_size, sizeof(sealed_ticket_size)));
+    buffers.push_back(asio::buffer(sealed_ticket));
+  }
+  if (udp_port) {
+    buffers.push_back(asio::buffer(&*udp_port, sizeof(*udp_port)));
+  }
+  sender_socket_.write(buffers);
+}
+
+// Returns the bound port, or 0 if none could be bound
+uint16_t Receiver::open_udp_transport() {
+  try {
+    udp_socket_.set_options(socket_options_);
+    udp_socket_.bind(0);
+    const uint16_t udp_port = udp_socket_.local_port();
+    LOG("receiving over UDP on port " + std::to_string(udp_port));
+    return udp_port;
+  } catch (const std::exception &e) {
+    std::cerr << "Failed to open a UDP port: " << e.what() << '\n';
+    return 0;
+  }
+}
+
+// Each additional connection must open with an unused stream index and the
+// matching token for this session. Anything else is some unrelated client of
+// the port and is dropped, and so is one that has not sent its token by the
+// deadline. The transfer fails if the connections are not all there by then
+void Receiver::accept_streams(uint8_t num_streams) {
+  stream_sockets_.clear();
+  stream_sockets_.resize(num_streams - 1);
+  const auto deadline =
+      std::chrono::steady_clock::now() + STREAM_ACCEPT_TIMEOUT;
+  auto time_left = [&]() {
+    return deadline - std::chrono::steady_clock::now();
+  };
+  uint8_t streams_accepted = 1;
+  while (streams_accepted < num_streams) {
+    auto socket = std::make_unique<TcpSocket>();
+    socket->set_options(sender_socket_.options());
+    if (time_left() <= std::chrono::steady_clock::duration::zero() ||
+        !listener_->accept(*socket, time_left())) {
+      throw std::runtime_error(
+          "Sender opened " + std::to_string(streams_accepted) + " of " +
+          std::to_string(num_streams) + " connections within " +
+          std::to_string(STREAM_ACCEPT_TIMEOUT.count()) + " seconds");
+    }
+
+    uint8_t stream_index = 0;
+    std::array<uint8_t, crypto::STREAM_TOKEN_SIZE> token;
+    try {
+      if (!socket->read(&stream_index, sizeof(stream_index), time_left()) ||
+          !socket->read(token.data(), token.size(), time_left())) {
+        LOG("dropped connection that sent no token in time");
+        continue;
+      }
+    } catch (const std::exception &e) {
+      LOG(std::string("dropped connection: ") + e.what());
+      continue;
+    }
+
+    if (stream_index == 0 || stream_index >= num_streams ||
+        stream_sockets_[stream_index - 1] ||
+        !crypto::verify_stream_token(*session_key_, session_header_,
+                                     stream_index, token)) {
+      LOG("dropped unauthenticated connection from " +
+          socket->remote_endpoint_address());
+      continue;
+    }
+    stream_sockets_[stream_index - 1] = std::move(socket);
+    ++streams_accepted;
+  }
+}
+
+// The sender reconnects to a resumable transfer with an attempt number and
+// its token, and is answered with the number of chunks received. Other
+// connections are dropped, as in accept_streams(), and so is one that has
+// not sent its token by the deadline
+void Receiver::accept_reconnect(uint64_t chunks_received) {
+  std::cout << "\nConnection lost, waiting for the sender to reconnect..."
+            << std::endl;
+  const auto deadline = std::chrono::steady_clock::now() + RECONNECT_TIMEOUT;
+  auto time_left = [&]() {
+    return deadline - std::chrono::steady_clock::now();
+  };
+  while (true) {
+    if (time_left() <= std::chrono::steady_clock::duration::zero() ||
+        !listener_->accept(sender_socket_, time_left())) {
+      throw std::runtime_error("Sender did not reconnect within " +
+                               std::to_string(RECONNECT_TIMEOUT.count()) +
+                               " seconds");
+    }
+
+    std::array<uint8_t, ReconnectRequest::SIZE> request;
+    std::array<uint8_t, crypto::RESUME_TOKEN_SIZE> token;
+    try {
+      if (!sender_socket_.read(request.data(), request.size(), time_left()) ||
+          !sender_socket_.read(token.data(), token.size(), time_left())) {
+        LOG("dropped connection that sent no token in time");
+        continue;
+      }
+    } catch (const std::exception &e) {
+      LOG(std::string("dropped connection: ") + e.what());
+      continue;
+    }
+    const uint32_t attempt = ReconnectRequest::decode(request.data()).attempt;
+
+    if (attempt <= last_resume_attempt_ ||
+        !crypto::verify_resume_token(*session_key_, session_header_, attempt,
+                                     token)) {
+      LOG("dropped unauthenticated connection from " +
+          sender_socket_.remote_endpoint_address());
+      continue;
+    }
+    last_resume_attempt_ = attempt;
+
+    const uint32_t resume_point = static_cast<uint32_t>(chunks_received);
+    std::array<uint8_t, Acknowledgement::SIZE> answer;
+    Acknowledgement{resume_point}.encode(answer.data());
+    try {
+      sender_socket_.write(answer.data(), answer.size());
+    } catch (const std::exception &e) {
+      LOG(std::string("lost reconnected sender: ") + e.what());
+      continue;
+    }
+    LOG("sender reconnected, resuming after chunk " +
+        std::to_string(resume_point));
+    std::cout << "Sender reconnected from "
+              << sender_socket_.remote_endpoint_address() << std::endl;
+    return;
+  }
+}
+
 void Receiver::receive_files(const TransferRequest &transfer_request,
-                             crypto::Decryptor decryptor) {
+                             ChunkDecryption chunk_decryption) {
   std::cout << "Receiving files..." << std::endl;
   auto start_time = std::chrono::system_clock::now();
 
   uint32_t num_chunks = transfer_request.get_num_chunks();
 
-  constexpr int QUEUE_CAPACITY = 50;
-  BoundedThreadSafeQueue<std::unique_ptr<Chunk>> received_chunk_queue(
-      QUEUE_CAPACITY);
-  BoundedThreadSafeQueue<std::unique_ptr<Chunk>> decrypted_chunk_queue(
-      QUEUE_CAPACITY);
+  const int queue_capacity = static_cast<int>(
+      chunk_queue_capacity(transfer_request.get_chunk_size()));
+
+  const bool compression_enabled = transfer_request.compression_enabled();
+
+  // Independently sealed chunks are decrypted, and compressed chunks
+  // decompressed, on every available core
+  const unsigned int num_cores =
+      std::max(1u, std::thread::hardware_concurrency());
+  const bool decrypted =
+      !std::holds_alternative<std::monostate>(chunk_decryption);
+  const bool chunked_decryption =
+      std::holds_alternative<crypto::ChunkCipher>(chunk_decryption);
+  const unsigned int decryption_threads = chunked_decryption ? num_cores : 1;
+  const unsigned int decompression_threads =
+      compression_enabled ? num_cores : 0;
+
+  // Chunks in flight are bounded by the pipeline's, plus up to a reorder
+  // window of chunks and one per connection for a striped transfer, and a
+  // window of chunks being reassembled for a UDP transfer. The pool is
+  // declared before the queues so that it outlives any chunk still queued
+  // when they are destroyed
+  const int num_streams = transfer_request.get_num_streams();
+  const int reordered_chunks =
+      num_streams > 1
+          ? static_cast<int>(StripedTransferManager::reorder_window(
+                transfer_request.get_chunk_size(), num_streams)) +
+                num_streams
+          : 0;
+  const int udp_chunks =
+      transfer_request.udp_transport()
+          ? static_cast<int>(UdpTransferManager::window_chunks(
+                transfer_request.get_chunk_size()))
+          : 0;
+  // Only io_uring writes borrow chunks beyond the pipeline's, and only once
+  // the kernel has set up its ring
+  FileManager file_writer;
+  const int file_io_chunks = static_cast<int>(file_writer.prepare_uring());
+  const int POOLED_CHUNKS =
+      static_cast<int>(pipeline_chunks(transfer_request.get_chunk_size(),
+                                       compression_enabled, decryption_threads,
+                                       decompression_threads)) +
+      reordered_chunks + udp_chunks + file_io_chunks;
+  ChunkPool chunk_pool(transfer_request.get_chunk_size() +
+                           crypto::ENCRYPTION_ADDITIONAL_BYTES,
+                       CHUNK_HEADROOM, CHUNK_TAILROOM, POOLED_CHUNKS);
+
+  ChunkQueue received_chunk_queue(queue_capacity);
+  ChunkQueue decrypted_chunk_queue(queue_capacity);
+  ChunkQueue decompressed_chunk_queue(queue_capacity);
+
+  // Without decryption the decompressor reads straight from the receiver,
+  // and without compression the writer reads from whichever stage is last
+  ChunkQueue &decompression_input_queue =
+      decrypted ? decrypted_chunk_queue : received_chunk_queue;
+  ChunkQueue &writer_input_queue = compression_enabled
+                                       ? decompressed_chunk_queue
+                                       : decompression_input_queue;
 
-  std::atomic<bool> chunk_reception_done(false);
-  std::atomic<bool> decryption_done(false);
   std::atomic<uint32_t> chunks_written(0);
 
+  // Cancelling the queues on abort wakes any stage blocked on push or pop
   WorkerContext ctx;
+  ctx.on_abort([&]() {
+    received_chunk_queue.cancel();
+    decrypted_chunk_queue.cancel();
+    decompressed_chunk_queue.cancel();
+  });
 
+  // A striped transfer arrives over every connection, sender_socket_ first
+  std::vector<TcpSocket *> sockets = {&sender_socket_};
+  for (const auto &socket : stream_sockets_) {
+    sockets.push_back(socket.get());
+  }
   TransferManager chunk_receiver;
+  if (transfer_request.resumable()) {
+    chunk_receiver.enable_receive_resume(
+        chunks_written,
+        [this](uint64_t chunks_received) {
+          accept_reconnect(chunks_received);
+        });
+  }
+  StripedTransferManager striped_chunk_receiver(sockets);
+  UdpTransferManager udp_chunk_receiver(udp_socket_);
   std::thread receiver_thread([&]() {
     try {
-      chunk_receiver.receive_chunks(ctx, sender_socket_, received_chunk_queue,
-                                    chunk_reception_done, num_chunks);
+      if (transfer_request.udp_transport()) {
+        udp_chunk_receiver.accept(
+            ctx, [this](const std::array<uint8_t, crypto::DATAGRAM_TOKEN_SIZE>
+                            &token) {
+              return crypto::verify_datagram_token(*session_key_,
+                                                   session_header_, token);
+            });
+        udp_chunk_receiver.receive_chunks(ctx, chunk_pool,
+                                          received_chunk_queue,
+                                          transfer_request.get_chunk_size(),
+                                          num_chunks);
+      } else if (num_streams > 1) {
+        striped_chunk_receiver.receive_chunks(
+            ctx, chunk_pool, received_chunk_queue,
+            transfer_request.get_chunk_size(), num_chunks);
+      } else {
+        chunk_receiver.receive_chunks(ctx, sender_socket_, chunk_pool,
+                                      received_chunk_queue, num_chunks);
+      }
     } catch (...) {
       ctx.handle_exception();
     }
   });
 
-  EncryptionManager chunk_decryptor(transfer_request.get_chunk_size(),
-                                    transfer_request.get_final_chunk_size(),
-                                    num_chunks, std::move(decryptor));
-  std::thread decryption_thread([&]() {
-    try {
-      chunk_decryptor.decrypt_chunks(ctx, received_chunk_queue,
-                                     chunk_reception_done,
-                                     decrypted_chunk_queue, decryption_done);
-    } catch (...) {
-      ctx.handle_exception();
-    }
-  });
+  std::optional<EncryptionManager> chunk_decryptor;
+  if (chunked_decryption) {
+    chunk_decryptor.emplace(
+        transfer_request.get_chunk_size(),
+        transfer_request.get_final_chunk_size(), num_chunks,
+        std::get<crypto::ChunkCipher>(std::move(chunk_decryption)),
+        decryption_threads);
+  } else if (decrypted) {
+    chunk_decryptor.emplace(
+        transfer_request.get_chunk_size(),
+        transfer_request.get_final_chunk_size(), num_chunks,
+        std::get<crypto::Decryptor>(std::move(chunk_decryption)));
+  }
+  std::thread decryption_thread;
+  if (chunk_decryptor) {
+    LOG("decrypting with " + std::to_string(decryption_threads) +
+        (chunked_decryption ? " thread(s), chunked" : " thread, stream"));
+    decryption_thread = std::thread([&]() {
+      try {
+        chunk_decryptor->decrypt_chunks(ctx, received_chunk_queue,
+                                        decrypted_chunk_queue);
+      } catch (...) {
+        ctx.handle_exception();
+      }
+    });
+  } else {
+    LOG("receiving chunks unencrypted");
+  }
+
+  CompressionManager chunk_decompressor(transfer_request, chunk_pool,
+                                        std::max(1u, decompression_threads));
+  std::thread decompression_thread;
+  if (compression_enabled) {
+    decompression_thread = std::thread([&]() {
+      try {
+        chunk_decompressor.decompress_chunks(ctx, decompression_input_queue,
+                                             decompressed_chunk_queue);
+      } catch (...) {
+        ctx.handle_exception();
+      }
+    });
+  }
 
-  FileManager file_writer;
   std::thread writer_thread([&]() {
     try {
       file_writer.write_files_from_chunks(ctx, transfer_request,
-                                          decrypted_chunk_queue,
-                                          decryption_done, chunks_written);
+                                          writer_input_queue, chunks_written,
+                                          FileWriteMode::URING);
     } catch (...) {
       ctx.handle_exception();
     }
@@ -212,7 +648,12 @@ void Receiver::receive_files(const TransferRequest &transfer_request,
   });
 
   receiver_thread.join();
-  decryption_thread.join();
+  if (decryption_thread.joinable()) {
+    decryption_thread.join();
+  }
+  if (decompression_thread.joinable()) {
+    decompression_thread.join();
+  }
   writer_thread.join();
   progress_thread.join();
 
@@ -227,6 +668,83 @@ void Receiver::receive_files(const TransferRequest &transfer_request,
   auto time_elapsed = std::chrono::duration<double>(end_time - start_time);
   auto seconds_elapsed = time_elapsed.count();
 
+  LOG("chunk pool hits=" + std::to_string(chunk_pool.hits()) +
+      " misses=" + std::to_string(chunk_pool.misses()));
+  if (transfer_request.udp_transport()) {
+    LOG("received over UDP, " + udp_chunk_receiver.receive_summary());
+  } else {
+    LOG("received " + (num_streams > 1
+                           ? striped_chunk_receiver.receive_summary()
+                           : chunk_receiver.receive_summary()));
+  }
+
   std::cout << "Files received, transfer complete!" << std::endl;
   std::cout << "Time elapsed: " << seconds_elapsed << "s" << std::endl;
-}
\ No newline at end of file
+  if (compression_enabled) {
+    std::cout << chunk_decompressor.decompression_summary() << std::endl;
+  }
+  if (num_streams > 1) {
+    std::cout << striped_chunk_receiver.stream_summary(seconds_elapsed)
+              << std::endl;
+  }
+}
+// Receives the files as one byte stream moved from the socket into the files
+// by the kernel, the counterpart of Sender::send_files_zero_copy()
+void Receiver::receive_files_zero_copy(
+    const TransferRequest &transfer_request) {
+  std::cout << "Receiving files..." << std::endl;
+  auto start_time = std::chrono::system_clock::now();
+  const std::clock_t start_cpu_time = std::clock();
+
+  std::atomic<uint64_t> bytes_written(0);
+
+  // Shutting the socket down on abort fails a wait for more data
+  WorkerContext ctx;
+  ctx.on_abort([&]() { sender_socket_.shutdown(); });
+
+  FileManager file_writer;
+  std::thread writer_thread([&]() {
+    try {
+      file_writer.receive_files_from_socket(ctx, transfer_request,
+                                            sender_socket_, bytes_written);
+    } catch (...) {
+      ctx.handle_exception();
+    }
+  });
+
+  std::thread progress_thread;
+  if (transfer_request.get_transfer_size() > 0) {
+    progress_thread = std::thread([&]() {
+      try {
+        ProgressTracker<uint64_t> progress_tracker(
+            "Bytes written", transfer_request.get_transfer_size());
+        progress_tracker.start(ctx, bytes_written);
+      } catch (...) {
+        ctx.handle_exception();
+      }
+    });
+  }
+
+  writer_thread.join();
+  if (progress_thread.joinable()) {
+    progress_thread.join();
+  }
+
+  try {
+    ctx.rethrow_if_exception();
+  } catch (const std::exception &e) {
+    std::cerr << "Transfer failed: " << e.what() << '\n';
+    return;
+  }
+
+  auto end_time = std::chrono::system_clock::now();
+  auto time_elapsed = std::chrono::duration<double>(end_time - start_time);
+  const double cpu_seconds =
+      static_cast<double>(std::clock() - start_cpu_time) / CLOCKS_PER_SEC;
+
+  LOG("received " + std::to_string(bytes_written.load()) +
+      " bytes zero-copy, cpu time " + std::to_string(cpu_seconds) + "s");
+
+  std::cout << "Files received, transfer complete!" << std::endl;
+  std::cout << "Time elapsed: " << time_elapsed.count() << "s" << std::endl;
+}
@@ -0,0 +1,75 @@
+#include "ReorderBuffer.h"
+
+#include <stdexcept>
+#include <string>
+
+ReorderBuffer::ReorderBuffer(uint64_t first_sequence_num,
+                             std::size_t window_size, ChunkQueue &output_queue)
+    : slots_(window_size), next_sequence_num_(first_sequence_num),
+      output_queue_(output_queue) {
+  if (window_size == 0) {
+    throw std::logic_error("Reorder window size must be greater than 0");
+  }
+}
+
+bool ReorderBuffer::insert(ChunkPtr chunk_ptr) {
+  const uint64_t sequence_num = chunk_ptr->sequence_num();
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (sequence_num < next_sequence_num_) {
+    throw std::runtime_error("ReorderBuffer: duplicate chunk " +
+                             std::to_string(sequence_num));
+  }
+  window_cv_.wait(lock, [&]() {
+    return cancelled_ || sequence_num < next_sequence_num_ + slots_.size();
+  });
+  if (cancelled_) {
+    return false;
+  }
+
+  ChunkPtr &slot = slots_[sequence_num % slots_.size()];
+  if (slot) {
+    throw std::runtime_error("ReorderBuffer: duplicate chunk " +
+                             std::to_string(sequence_num));
+  }
+  slot = std::move(chunk_ptr);
+
+  // Another thread is already releasing and will pick this chunk up if it is
+  // next in line
+  if (releasing_) {
+    return true;
+  }
+
+  releasing_ = true;
+  while (!cancelled_) {
+    ChunkPtr &next_slot = slots_[next_sequence_num_ % slots_.size()];
+    if (!next_slot) {
+      break;
+    }
+    ChunkPtr ready_chunk_ptr = std::move(next_slot);
+    ++next_sequence_num_;
+    window_cv_.notify_all();
+
+    lock.unlock();
+    const bool pushed = output_queue_.push(std::move(ready_chunk_ptr));
+    lock.lock();
+
+    if (!pushed) {
+      cancelled_ = true;
+      window_cv_.notify_all();
+    }
+  }
+  releasing_ = false;
+  return !cancelled_;
+}
+
+void ReorderBuffer::cancel() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  cancelled_ = true;
+  window_cv_.notify_all();
+}
+
+uint64_t ReorderBuffer::next_sequence_num() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return next_sequence_num_;
+}
@@ -0,0 +1,82 @@
+#include "RetransmitWindow.h"
+
+RetransmitWindow::RetransmitWindow(std::size_t max_bytes)
+    : max_bytes_(max_bytes) {}
+
+bool RetransmitWindow::wait_for_space(std::size_t bytes) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  changed_.wait(lock, [&]() {
+    return failed_ || cancelled_ || chunks_.empty() ||
+           bytes_ + bytes <= max_bytes_;
+  });
+  return !failed_ && !cancelled_;
+}
+
+bool RetransmitWindow::wait_until_acknowledged() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  changed_.wait(lock,
+                [&]() { return failed_ || cancelled_ || chunks_.empty(); });
+  return !failed_ && !cancelled_;
+}
+
+void RetransmitWindow::push(std::vector<ChunkPtr> &chunks) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (ChunkPtr &chunk_ptr : chunks) {
+    bytes_ += chunk_ptr->size();
+    chunks_.push_back(std::move(chunk_ptr));
+  }
+  chunks.clear();
+}
+
+void RetransmitWindow::acknowledge(uint64_t chunks_written) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (chunks_written <= acknowledged_) {
+    return;
+  }
+  acknowledged_ = chunks_written;
+  while (!chunks_.empty() &&
+         chunks_.front()->sequence_num() <= chunks_written) {
+    bytes_ -= chunks_.front()->size();
+    chunks_.pop_front();
+  }
+  changed_.notify_all();
+}
+
+void RetransmitWindow::fail() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  failed_ = true;
+  changed_.notify_all();
+}
+
+void RetransmitWindow::reset() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  failed_ = false;
+}
+
+bool RetransmitWindow::failed() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return failed_;
+}
+
+void RetransmitWindow::cancel() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  cancelled_ = true;
+  changed_.notify_all();
+}
+
+std::vector<asio::const_buffer>
+RetransmitWindow::frames_after(uint64_t chunks_received) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<asio::const_buffer> frames;
+  for (const ChunkPtr &chunk_ptr : chunks_) {
+    if (chunk_ptr->sequence_num() > chunks_received) {
+      frames.emplace_back(chunk_ptr->data(), chunk_ptr->size());
+    }
+  }
+  return frames;
+}
+
+uint64_t RetransmitWindow::acknowledged() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return acknowledged_;
+}
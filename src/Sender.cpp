@@ -1,23 +1,31 @@
 
 #include <algorithm>
 #include <chrono>
+#include <ctime>
 #include <iostream>
+#include <optional>
 #include <thread>
 
+#include "ChunkPool.h"
 #include "CompressionManager.h"
 #include "EncryptionManager.h"
 #include "FileManager.h"
+#include "FrameHeader.h"
 #include "ProgressTracker.h"
 #include "Sender.h"
+#include "StripedTransferManager.h"
 #include "TransferManager.h"
+#include "UdpTransferManager.h"
 #include "WorkerContext.h"
 #include "staging.h"
 #include "utils.h"
 
 Sender::Sender(const std::string &receiver_ip, const uint16_t receiver_port,
-               const crypto::Key &key, const crypto::Salt &salt)
-    : receiver_ip_(receiver_ip), receiver_port_(receiver_port), key_(key),
-      salt_(salt) {}
+               const std::string &password, const SendOptions &options)
+    : receiver_ip_(receiver_ip), receiver_port_(receiver_port),
+      password_(password), options_(options),
+      rate_limiter_(options.rate_limit, options.rate_burst,
+                    RateLimiter::default_control_file()) {}
 
 void Sender::start_session() {
   LOG("sender session started");
@@ -36,138 +44,475 @@ void Sender::start_session() {
 
   LOG("connected to receiver");
 
-  crypto::Encryptor encryptor(key_);
-  if (!send_handshake(encryptor)) {
-    std::cout << "Handshake failed. Ensure passwords match." << std::endl;
-    return;
-  }
-  LOG("handshake successful");
-
   TransferRequest transfer_request = create_transfer_request();
   LOG("transfer request created");
 
-  LOG("sending transfer request");
-  if (!send_transfer_request(transfer_request)) {
+  std::array<uint8_t, crypto::HEADER_SIZE> header;
+  std::optional<ChunkEncryption> chunk_encryption_opt;
+  std::optional<SessionTicket> ticket;
+  if (options_.session_tickets) {
+    ticket = ticket_cache_.load(receiver_ip_);
+  }
+  RequestVerdict verdict =
+      open_session(transfer_request, ticket ? &*ticket : nullptr, header,
+                   chunk_encryption_opt);
+
+  // The receiver may have restarted with another password or lost its
+  // ticket key. It closes the connection after a failed handshake, so the
+  // password handshake goes over a new one
+  if (ticket && verdict == RequestVerdict::HANDSHAKE_FAILED) {
+    LOG("session ticket rejected, falling back to the password");
+    ticket_cache_.remove(receiver_ip_);
+    try {
+      receiver_socket_.close();
+      connect_to_receiver();
+    } catch (const std::exception &e) {
+      std::cerr << "Failed to connect to receiver: " << e.what() << '\n';
+      return;
+    }
+    verdict = open_session(transfer_request, nullptr, header,
+                           chunk_encryption_opt);
+  }
+
+  if (verdict == RequestVerdict::DECLINED) {
     std::cout << "Transfer was declined by the receiver" << std::endl;
     LOG("transfer request denied by receiver");
     return;
   }
-  LOG("transfer request accepted by receiver");
+  if (verdict != RequestVerdict::ACCEPTED) {
+    std::cout << "Handshake failed. Ensure passwords match." << std::endl;
+    return;
+  }
+  LOG("handshake successful, transfer request accepted by receiver");
+  session_header_ = header;
+
+  // The handshake gave the kernel its first round trip time samples
+  if (std::optional<std::size_t> buffer_size =
+          receiver_socket_.tune_buffer_size()) {
+    LOG("sized socket buffers to " + std::to_string(*buffer_size) +
+        " bytes from the handshake round trip time");
+  }
+  LOG("socket options: " + receiver_socket_.describe_options());
+
+  if (transfer_request.udp_transport() && !open_udp_transport()) {
+    std::cout << "Receiver could not open a UDP port for the transfer"
+              << std::endl;
+    return;
+  }
 
-  LOG("starting transfer send");
-  send_files(transfer_request, std::move(encryptor));
+  if (transfer_request.get_num_streams() > 1) {
+    try {
+      open_streams(transfer_request.get_num_streams(), header);
+    } catch (const std::exception &e) {
+      std::cerr << "Failed to open additional connections: " << e.what()
+                << '\n';
+      return;
+    }
+    LOG("opened " + std::to_string(transfer_request.get_num_streams()) +
+        " connections");
+  }
+
+  LOG("starting transfer send, " + rate_limiter_.describe());
+  if (FileManager::can_transfer_zero_copy(transfer_request,
+                                          options_.encrypt)) {
+    send_files_zero_copy(transfer_request);
+  } else {
+    send_files(transfer_request, std::move(*chunk_encryption_opt));
+  }
   LOG("transfer sent and completed");
 }
 
 void Sender::connect_to_receiver() {
+  receiver_socket_.set_options(options_.socket_options);
   receiver_socket_.connect(receiver_ip_, receiver_port_);
   std::cout << "Connected to " << receiver_ip_ << ":" << receiver_port_
             << std::endl;
 }
 
-// Handshake verifies matching keys were derived between sender and receiver
-// (from matching passwords)
+// Derives the session key, from the ticket if there is one and otherwise
+// from the password, and sets up the encryption of the session under it
+RequestVerdict
+Sender::open_session(const TransferRequest &transfer_request,
+                     const SessionTicket *ticket,
+                     std::array<uint8_t, crypto::HEADER_SIZE> &header,
+                     std::optional<ChunkEncryption> &chunk_encryption_opt) {
+  // Credentials format: handshake kind, then the salt for a password
+  // handshake, or the ticket size [2 bytes], ticket and session random for a
+  // ticket handshake
+  std::vector<uint8_t> credentials;
+  if (ticket) {
+    LOG("resuming the session with a ticket");
+    std::array<uint8_t, crypto::SESSION_RANDOM_SIZE> session_random;
+    randombytes_buf(session_random.data(), session_random.size());
+    key_.emplace(
+        crypto::derive_ticket_session_key(ticket->secret, session_random));
+
+    const uint16_t ticket_size = static_cast<uint16_t>(ticket->ticket.size());
+    credentials.push_back(static_cast<uint8_t>(crypto::HandshakeKind::TICKET));
+    credentials.push_back(static_cast<uint8_t>(ticket_size));
+    credentials.push_back(static_cast<uint8_t>(ticket_size >> 8));
+    credentials.insert(credentials.end(), ticket->ticket.begin(),
+                       ticket->ticket.end());
+    credentials.insert(credentials.end(), session_random.begin(),
+                       session_random.end());
+  } else {
+    LOG("deriving key from the password");
+    crypto::Salt salt;
+    key_.emplace(password_, salt);
+    // LOG("salt=" + utils::buffer_to_hex_string(salt.data(), salt.size()));
+
+    credentials.push_back(
+        static_cast<uint8_t>(crypto::HandshakeKind::PASSWORD));
+    credentials.insert(credentials.end(), salt.data(),
+                       salt.data() + salt.size());
+  }
 
-// Handshake format: salt, nonce, cipher, header
-bool Sender::send_handshake(const crypto::Encryptor &encryptor) {
-  LOG("sending handshake");
+  // The stream header and the chunk cipher session id take the same place in
+  // the handshake, the receiver tells them apart by the negotiated mode. A
+  // plaintext session still sends a random session id, which the tokens of
+  // additional connections are tied to
+  const crypto::CipherMode cipher_mode =
+      !options_.encrypt                 ? crypto::CipherMode::PLAINTEXT
+      : options_.encryption_threads > 1 ? crypto::CipherMode::CHUNKED
+                                        : crypto::CipherMode::STREAM;
+  if (cipher_mode == crypto::CipherMode::PLAINTEXT) {
+    header = crypto::ChunkCipher::generate_session_id();
+    chunk_encryption_opt.emplace(std::monostate());
+  } else if (cipher_mode == crypto::CipherMode::CHUNKED) {
+    header = crypto::ChunkCipher::generate_session_id();
+    chunk_encryption_opt.emplace(std::in_place_type<crypto::ChunkCipher>,
+                                 *key_, header);
+  } else {
+    crypto::Encryptor encryptor(*key_);
+    header = encryptor.header();
+    chunk_encryption_opt.emplace(std::move(encryptor));
+  }
 
-  receiver_socket_.write(salt_.data(), salt_.size());
-  LOG("sent salt");
+  return send_handshake(credentials, cipher_mode, header, transfer_request);
+}
 
+// Handshake verifies matching keys were derived between sender and receiver
+// (from matching passwords, or from a ticket the receiver issued). The
+// handshake and the transfer request go out in one write and are answered
+// with a single verdict, so the session takes one round trip before data
+// flows. The request is sealed under the key since it is sent before the
+// receiver has verified it.
+// Handshake format: credentials, nonce, cipher (tag and cipher mode), header,
+// sealed request size, sealed request
+RequestVerdict Sender::send_handshake(
+    const std::vector<uint8_t> &credentials, crypto::CipherMode cipher_mode,
+    const std::array<uint8_t, crypto::HEADER_SIZE> &header,
+    const TransferRequest &transfer_request) {
   LOG("creating handshake nonce and cipher");
-  auto [nonce, cipher] = crypto::encrypt_handshake_tag(key_);
+  auto [nonce, cipher] = crypto::encrypt_handshake_tag(*key_, cipher_mode);
 
   // LOG("nonce=" + utils::buffer_to_hex_string(nonce.data(), nonce.size()));
   // LOG("cipher=" + utils::buffer_to_hex_string(cipher.data(), cipher.size()));
+  // LOG("header=" + utils::buffer_to_hex_string(header.data(), header.size()));
 
-  receiver_socket_.write(nonce.data(), nonce.size());
-  LOG("handshake nonce sent");
+  const std::vector<uint8_t> sealed_request = crypto::seal_transfer_request(
+      *key_, header, transfer_request.serialize());
+  const uint64_t sealed_request_size = sealed_request.size();
+
+  LOG("sending handshake and transfer request");
+  receiver_socket_.write(
+      {asio::buffer(credentials), asio::buffer(nonce.data(), nonce.size()),
+       asio::buffer(cipher),
+       asio::buffer(header),
+       asio::buffer(&sealed_request_size, sizeof(sealed_request_size)),
+       asio::buffer(sealed_request)});
+  std::cout << "Handshake and transfer request sent" << std::endl;
+
+  uint8_t verdict_byte;
+  receiver_socket_.read(&verdict_byte, sizeof(verdict_byte));
+  const RequestVerdict verdict = static_cast<RequestVerdict>(verdict_byte);
+  if (verdict != RequestVerdict::HANDSHAKE_FAILED) {
+    receive_ticket(header);
+  }
+  return verdict;
+}
 
-  receiver_socket_.write(cipher.data(), cipher.size());
-  LOG("handshake cipher sent");
+// A verdict other than a failed handshake is followed by the ticket size
+// [2 bytes], 0 if the receiver issues none, and the ticket sealed under the
+// session key
+void Sender::receive_ticket(
+    const std::array<uint8_t, crypto::HEADER_SIZE> &header) {
+  uint16_t sealed_ticket_size;
+  receiver_socket_.read(&sealed_ticket_size, sizeof(sealed_ticket_size));
+  if (sealed_ticket_size == 0) {
+    LOG("receiver issued no session ticket");
+    return;
+  }
+  std::vector<uint8_t> sealed_ticket(sealed_ticket_size);
+  receiver_socket_.read(sealed_ticket.data(), sealed_ticket.size());
+  if (!options_.session_tickets) {
+    return;
+  }
 
-  LOG("sending encryption header");
-  const auto &header = encryptor.header();
-  receiver_socket_.write(header.data(), header.size());
-  // LOG("header=" + utils::buffer_to_hex_string(header.data(), header.size()));
+  std::optional<std::vector<uint8_t>> ticket_buffer = crypto::open_message(
+      *key_, sealed_ticket, header.data(), header.size());
+  std::optional<SessionTicket> ticket;
+  if (ticket_buffer) {
+    ticket = SessionTicket::deserialize(*ticket_buffer);
+  }
+  if (!ticket) {
+    LOG("session ticket failed authentication");
+    return;
+  }
+  try {
+    ticket_cache_.store(receiver_ip_, *ticket);
+    LOG("stored session ticket");
+  } catch (const std::exception &e) {
+    LOG(std::string("failed to store session ticket: ") + e.what());
+  }
+}
 
-  std::cout << "Handshake sent" << std::endl;
+TransferRequest Sender::create_transfer_request() {
+  return TransferRequest::from_file_paths(
+      staging::get_staged_files(), options_.compress, options_.chunk_size,
+      static_cast<uint8_t>(options_.streams), resumable(), options_.udp);
+}
 
-  // Get success/fail response
-  uint8_t handshake_success_byte;
-  receiver_socket_.read(&handshake_success_byte,
-                        sizeof(handshake_success_byte));
-  return static_cast<bool>(handshake_success_byte);
+// Only a single TCP connection of chunk frames can be resumed. Zero-copy
+// transfers send no frames, and MSG_ZEROCOPY sends hand their chunks to the
+// kernel instead of keeping them for retransmission
+bool Sender::resumable() const {
+  const bool zero_copy_transfer = !options_.encrypt && !options_.compress;
+  return options_.retransmit_window > 0 && options_.streams == 1 &&
+         options_.zero_copy_threshold == 0 && !zero_copy_transfer &&
+         !options_.udp;
 }
 
-TransferRequest Sender::create_transfer_request() {
-  return TransferRequest::from_file_paths(staging::get_staged_files());
+// The receiver follows its acceptance of a UDP transfer with the port it
+// bound for it, 0 if it could not bind one
+bool Sender::open_udp_transport() {
+  uint16_t udp_port;
+  receiver_socket_.read(&udp_port, sizeof(udp_port));
+  if (udp_port == 0) {
+    return false;
+  }
+  udp_socket_.set_options(options_.socket_options);
+  udp_socket_.connect(receiver_ip_, udp_port);
+  LOG("sending over UDP to port " + std::to_string(udp_port));
+  return true;
 }
 
-bool Sender::send_transfer_request(const TransferRequest &transfer_request) {
-  // Serialize and then send transfer request to receiver
-  std::vector<uint8_t> transfer_request_buffer = transfer_request.serialize();
-  uint64_t transfer_request_buffer_size = transfer_request_buffer.size();
-  receiver_socket_.write(&transfer_request_buffer_size,
-                         sizeof(transfer_request_buffer_size));
-  receiver_socket_.write(transfer_request_buffer.data(),
-                         transfer_request_buffer.size());
-  std::cout << "Transfer request sent" << std::endl;
-
-  // Get accept/deny response
-  uint8_t request_accepted_byte;
-  receiver_socket_.read(&request_accepted_byte, sizeof(request_accepted_byte));
-  return static_cast<bool>(request_accepted_byte);
+// Each additional connection opens with its stream index and a token that
+// ties it to this session's handshake, so the receiver can tell it apart
+// from unrelated connections to its port. It takes the options, including
+// any tuned buffer sizes, of the first connection
+void Sender::open_streams(
+    uint8_t num_streams,
+    const std::array<uint8_t, crypto::HEADER_SIZE> &header) {
+  for (uint8_t stream_index = 1; stream_index < num_streams; ++stream_index) {
+    auto socket = std::make_unique<TcpSocket>();
+    socket->set_options(receiver_socket_.options());
+    socket->connect(receiver_ip_, receiver_port_);
+    auto token = crypto::make_stream_token(*key_, header, stream_index);
+    socket->write(&stream_index, sizeof(stream_index));
+    socket->write(token.data(), token.size());
+    stream_sockets_.push_back(std::move(socket));
+  }
 }
 
 void Sender::send_files(const TransferRequest &transfer_request,
-                        crypto::Encryptor encryptor) {
+                        ChunkEncryption chunk_encryption) {
+  // Measured again once sent, to show what reading the files around the page
+  // cache left cached. Kept files are not measured, since it costs a
+  // mincore() walk over every file
+  const std::optional<uint64_t> cached_before =
+      options_.page_cache != PageCacheMode::KEEP
+          ? FileManager::page_cache_footprint(transfer_request)
+          : std::nullopt;
+
   std::cout << "Sending files..." << std::endl;
   auto start_time = std::chrono::system_clock::now();
+  const std::clock_t start_cpu_time = std::clock();
 
   uint32_t num_chunks = transfer_request.get_num_chunks();
 
-  constexpr int QUEUE_CAPACITY = 50;
-  BoundedThreadSafeQueue<std::unique_ptr<Chunk>> file_chunk_queue(
-      QUEUE_CAPACITY);
-  BoundedThreadSafeQueue<std::unique_ptr<Chunk>> encrypted_chunk_queue(
-      QUEUE_CAPACITY);
+  const int queue_capacity = static_cast<int>(
+      chunk_queue_capacity(transfer_request.get_chunk_size()));
+
+  const bool compression_enabled = transfer_request.compression_enabled();
+
+  const bool encrypted =
+      !std::holds_alternative<std::monostate>(chunk_encryption);
+  const bool chunked_encryption =
+      std::holds_alternative<crypto::ChunkCipher>(chunk_encryption);
+  const unsigned int encryption_threads =
+      chunked_encryption ? options_.encryption_threads : 1;
+  const unsigned int compression_threads =
+      compression_enabled ? options_.compression_threads : 0;
+
+  // Chunks in flight are bounded by the pipeline's, the frames kept for
+  // retransmission or awaiting UDP acknowledgement, and the frames queued,
+  // batched and awaiting zero-copy completion per connection.
+  // The pool is declared before the queues so that it outlives any chunk
+  // still queued when they are destroyed
+  const int num_streams = transfer_request.get_num_streams();
+  const std::size_t frame_size = FRAME_HEADER_SIZE +
+                                 transfer_request.get_chunk_size() +
+                                 crypto::ENCRYPTION_ADDITIONAL_BYTES;
+  const int batched_chunks =
+      static_cast<int>(options_.batch_limits.max_frames(frame_size));
+  const int zero_copy_chunks =
+      options_.zero_copy_threshold > 0
+          ? static_cast<int>(MAX_ZERO_COPY_PENDING_BYTES / frame_size) +
+                batched_chunks
+          : 0;
+  const int stream_queued_chunks =
+      num_streams > 1 ? static_cast<int>(
+                            StripedTransferManager::stream_queue_capacity(
+                                transfer_request.get_chunk_size(),
+                                num_streams))
+                      : 0;
+  const int retransmit_chunks =
+      transfer_request.resumable()
+          ? static_cast<int>(options_.retransmit_window / frame_size) + 1
+          : 0;
+  const int udp_chunks =
+      transfer_request.udp_transport()
+          ? static_cast<int>(UdpTransferManager::window_chunks(
+                transfer_request.get_chunk_size()))
+          : 0;
+
+  // Only io_uring reads borrow chunks beyond the pipeline's, and only once
+  // the kernel has set up its ring
+  FileReadMode read_mode = FileReadMode::URING;
+  if (options_.mapped_reads) {
+    read_mode = FileReadMode::MAPPED;
+  } else if (options_.page_cache == PageCacheMode::DROP) {
+    read_mode = FileReadMode::DROP_BEHIND;
+  } else if (options_.page_cache == PageCacheMode::DIRECT) {
+    read_mode = FileReadMode::DIRECT;
+  }
+  FileManager file_chunker;
+  const int file_io_chunks =
+      read_mode == FileReadMode::URING
+          ? static_cast<int>(file_chunker.prepare_uring())
+          : 0;
+
+  const int POOLED_CHUNKS =
+      static_cast<int>(pipeline_chunks(transfer_request.get_chunk_size(),
+                                       compression_enabled, encryption_threads,
+                                       compression_threads)) +
+      retransmit_chunks + udp_chunks + file_io_chunks +
+      num_streams * (batched_chunks + zero_copy_chunks + stream_queued_chunks);
+  ChunkPool chunk_pool(transfer_request.get_chunk_size() +
+                           crypto::ENCRYPTION_ADDITIONAL_BYTES,
+                       CHUNK_HEADROOM, CHUNK_TAILROOM, POOLED_CHUNKS);
+
+  ChunkQueue file_chunk_queue(queue_capacity);
+  ChunkQueue compressed_chunk_queue(queue_capacity);
+  ChunkQueue encrypted_chunk_queue(queue_capacity);
+
+  // Without compression the encryptor reads straight from the file reader,
+  // and without encryption the transmitter takes its input
+  ChunkQueue &encryption_input_queue =
+      compression_enabled ? compressed_chunk_queue : file_chunk_queue;
+  ChunkQueue &transmission_input_queue =
+      encrypted ? encrypted_chunk_queue : encryption_input_queue;
 
-  // Completion flags and progress
-  std::atomic<bool> file_chunking_done(false);
-  std::atomic<bool> encryption_done(false);
   std::atomic<uint32_t> chunks_sent(0);
 
+  // Cancelling the queues on abort wakes any stage blocked on push or pop
   WorkerContext ctx;
+  ctx.on_abort([&]() {
+    file_chunk_queue.cancel();
+    compressed_chunk_queue.cancel();
+    encrypted_chunk_queue.cancel();
+  });
 
-  FileManager file_chunker;
   std::thread chunker_thread([&]() {
     try {
-      file_chunker.read_files_into_chunks(ctx, transfer_request,
-                                          file_chunk_queue, file_chunking_done);
+      file_chunker.read_files_into_chunks(ctx, transfer_request, chunk_pool,
+                                          file_chunk_queue, read_mode);
     } catch (...) {
       ctx.handle_exception();
     }
   });
 
-  EncryptionManager chunk_encryptor(transfer_request.get_chunk_size(),
-                                    transfer_request.get_final_chunk_size(),
-                                    num_chunks, std::move(encryptor));
-  std::thread encryption_thread([&]() {
-    try {
-      chunk_encryptor.encrypt_chunks(ctx, file_chunk_queue, file_chunking_done,
-                                     encrypted_chunk_queue, encryption_done);
-    } catch (...) {
-      ctx.handle_exception();
-    }
-  });
+  CompressionManager chunk_compressor(transfer_request, chunk_pool,
+                                      std::max(1u, compression_threads));
+  std::thread compression_thread;
+  if (compression_enabled) {
+    LOG("compressing with " + std::to_string(compression_threads) +
+        " thread(s)");
+    compression_thread = std::thread([&]() {
+      try {
+        chunk_compressor.compress_chunks(ctx, file_chunk_queue,
+                                         compressed_chunk_queue);
+      } catch (...) {
+        ctx.handle_exception();
+      }
+    });
+  }
 
-  TransferManager chunk_sender;
+  std::optional<EncryptionManager> chunk_encryptor;
+  if (chunked_encryption) {
+    chunk_encryptor.emplace(
+        transfer_request.get_chunk_size(),
+        transfer_request.get_final_chunk_size(), num_chunks,
+        std::get<crypto::ChunkCipher>(std::move(chunk_encryption)),
+        encryption_threads);
+  } else if (encrypted) {
+    chunk_encryptor.emplace(
+        transfer_request.get_chunk_size(),
+        transfer_request.get_final_chunk_size(), num_chunks,
+        std::get<crypto::Encryptor>(std::move(chunk_encryption)));
+  }
+  std::thread encryption_thread;
+  if (chunk_encryptor) {
+    LOG("encrypting with " + std::to_string(encryption_threads) +
+        (chunked_encryption ? " thread(s), chunked" : " thread, stream"));
+    encryption_thread = std::thread([&]() {
+      try {
+        chunk_encryptor->encrypt_chunks(ctx, encryption_input_queue,
+                                        encrypted_chunk_queue);
+      } catch (...) {
+        ctx.handle_exception();
+      }
+    });
+  } else {
+    LOG("sending chunks unencrypted");
+  }
+
+  // A striped transfer sends over every connection, receiver_socket_ first
+  std::vector<TcpSocket *> sockets = {&receiver_socket_};
+  for (const auto &socket : stream_sockets_) {
+    sockets.push_back(socket.get());
+  }
+  TransferManager chunk_sender(options_.batch_limits,
+                               options_.zero_copy_threshold, &rate_limiter_);
+  StripedTransferManager striped_chunk_sender(sockets, options_.batch_limits,
+                                              options_.zero_copy_threshold,
+                                              &rate_limiter_);
+  UdpTransferManager udp_chunk_sender(udp_socket_, &rate_limiter_);
+  if (transfer_request.resumable()) {
+    LOG("keeping up to " +
+        utils::format_data_size(options_.retransmit_window) +
+        " of frames to resume after a lost connection");
+    chunk_sender.enable_send_resume(
+        options_.retransmit_window,
+        [this]() { return reconnect_to_receiver(); });
+  }
   std::thread transmission_thread([&]() {
     try {
-      chunk_sender.send_chunks(ctx, receiver_socket_, encrypted_chunk_queue,
-                               encryption_done, chunks_sent);
+      if (transfer_request.udp_transport()) {
+        udp_chunk_sender.connect(
+            ctx, crypto::make_datagram_token(*key_, session_header_));
+        udp_chunk_sender.send_chunks(ctx, transmission_input_queue,
+                                     transfer_request.get_chunk_size(),
+                                     chunks_sent);
+      } else if (num_streams > 1) {
+        striped_chunk_sender.send_chunks(ctx, transmission_input_queue,
+                                         transfer_request.get_chunk_size(),
+                                         chunks_sent);
+      } else {
+        chunk_sender.send_chunks(ctx, receiver_socket_,
+                                 transmission_input_queue, chunks_sent);
+      }
     } catch (...) {
       ctx.handle_exception();
     }
@@ -183,7 +528,12 @@ void Sender::send_files(const TransferRequest &transfer_request,
   });
 
   chunker_thread.join();
-  encryption_thread.join();
+  if (compression_thread.joinable()) {
+    compression_thread.join();
+  }
+  if (encryption_thread.joinable()) {
+    encryption_thread.join();
+  }
   transmission_thread.join();
   progress_thread.join();
 
@@ -199,7 +549,152 @@ void Sender::send_files(const TransferRequest &transfer_request,
   auto time_elapsed = std::chrono::duration<double>(end_time - start_time);
   auto seconds_elapsed = time_elapsed.count();
 
+  // CPU time of the whole process, since socket writes complete on the I/O
+  // engine threads rather than the transmission thread
+  const double cpu_seconds =
+      static_cast<double>(std::clock() - start_cpu_time) / CLOCKS_PER_SEC;
+  const double gigabytes =
+      static_cast<double>(transfer_request.get_transfer_size()) / 1e9;
+
+  LOG("chunk pool hits=" + std::to_string(chunk_pool.hits()) +
+      " misses=" + std::to_string(chunk_pool.misses()));
+  LOG("cpu time " + std::to_string(cpu_seconds) + "s (" +
+      std::to_string(gigabytes > 0 ? cpu_seconds * 1e3 / gigabytes : 0) +
+      " ms/GB)");
+  if (transfer_request.udp_transport()) {
+    LOG("sent over UDP, " + udp_chunk_sender.send_summary());
+  } else {
+    LOG("sent " + (num_streams > 1 ? striped_chunk_sender.send_summary()
+                                    : chunk_sender.send_summary()));
+  }
+
   std::cout << "Files sent, transfer complete!" << std::endl;
   std::cout << "Time elapsed: " << seconds_elapsed << "s" << std::endl;
+  if (compression_enabled) {
+    std::cout << chunk_compressor.compression_summary() << std::endl;
+  }
+  if (num_streams > 1) {
+    std::cout << striped_chunk_sender.stream_summary(seconds_elapsed)
+              << std::endl;
+  }
+
+  const std::optional<uint64_t> cached_after =
+      cached_before ? FileManager::page_cache_footprint(transfer_request)
+                    : std::nullopt;
+  if (cached_before && cached_after) {
+    std::cout << "Page cache held " << utils::format_data_size(*cached_before)
+              << " of the files before the transfer and "
+              << utils::format_data_size(*cached_after) << " after"
+              << std::endl;
+  }
+  staging::clear(); // Clear staged files after successful transfer
+}
+
+// Sends the staged files as one byte stream straight from the page cache,
+// without chunking, framing or encryption
+void Sender::send_files_zero_copy(const TransferRequest &transfer_request) {
+  std::cout << "Sending files..." << std::endl;
+  auto start_time = std::chrono::system_clock::now();
+  const std::clock_t start_cpu_time = std::clock();
+
+  std::atomic<uint64_t> bytes_sent(0);
+
+  // Shutting the socket down on abort fails a send blocked on a full socket
+  WorkerContext ctx;
+  ctx.on_abort([&]() { receiver_socket_.shutdown(); });
+
+  FileManager file_sender;
+  std::thread transmission_thread([&]() {
+    try {
+      file_sender.send_files_to_socket(ctx, transfer_request,
+                                       receiver_socket_, bytes_sent,
+                                       &rate_limiter_);
+    } catch (...) {
+      ctx.handle_exception();
+    }
+  });
+
+  std::thread progress_thread;
+  if (transfer_request.get_transfer_size() > 0) {
+    progress_thread = std::thread([&]() {
+      try {
+        ProgressTracker<uint64_t> progress_tracker(
+            "Bytes sent", transfer_request.get_transfer_size());
+        progress_tracker.start(ctx, bytes_sent);
+      } catch (...) {
+        ctx.handle_exception();
+      }
+    });
+  }
+
+  transmission_thread.join();
+  if (progress_thread.joinable()) {
+    progress_thread.join();
+  }
+
+  try {
+    ctx.rethrow_if_exception();
+  } catch (const std::exception &e) {
+    std::cerr << "Transfer failed: " << e.what() << '\n';
+    return;
+  }
+
+  auto end_time = std::chrono::system_clock::now();
+  auto time_elapsed = std::chrono::duration<double>(end_time - start_time);
+  const double cpu_seconds =
+      static_cast<double>(std::clock() - start_cpu_time) / CLOCKS_PER_SEC;
+
+  LOG("sent " + std::to_string(bytes_sent.load()) +
+      " bytes zero-copy, cpu time " + std::to_string(cpu_seconds) + "s");
+
+  std::cout << "Files sent, transfer complete!" << std::endl;
+  std::cout << "Time elapsed: " << time_elapsed.count() << "s" << std::endl;
   staging::clear(); // Clear staged files after successful transfer
 }
+
+// Every attempt presents a new attempt number and its token, and is answered
+// with the number of chunks the receiver got. Attempts are repeated until
+// RECONNECT_TIMEOUT, e.g. while the network is down, which also bounds
+// connecting and waiting for the answer
+uint64_t Sender::reconnect_to_receiver() {
+  constexpr std::chrono::seconds RETRY_INTERVAL(1);
+  const auto deadline = std::chrono::steady_clock::now() + RECONNECT_TIMEOUT;
+  auto time_left = [&]() {
+    return deadline - std::chrono::steady_clock::now();
+  };
+  while (true) {
+    const uint32_t attempt = ++reconnect_attempt_;
+    try {
+      receiver_socket_.close();
+      if (!receiver_socket_.connect(receiver_ip_, receiver_port_,
+                                    time_left())) {
+        throw std::runtime_error("timed out connecting");
+      }
+      std::array<uint8_t, ReconnectRequest::SIZE> request;
+      ReconnectRequest{attempt}.encode(request.data());
+      auto token = crypto::make_resume_token(*key_, session_header_, attempt);
+      receiver_socket_.write(request.data(), request.size());
+      receiver_socket_.write(token.data(), token.size());
+
+      std::array<uint8_t, Acknowledgement::SIZE> answer;
+      if (!receiver_socket_.read(answer.data(), answer.size(), time_left())) {
+        throw std::runtime_error("timed out waiting for the receiver");
+      }
+      const uint32_t chunks_received =
+          Acknowledgement::decode(answer.data()).chunks_written;
+      std::cout << "\nReconnected to " << receiver_ip_ << ":"
+                << receiver_port_ << std::endl;
+      return chunks_received;
+    } catch (const std::exception &e) {
+      LOG("reconnection attempt " + std::to_string(attempt) +
+          " failed: " + e.what());
+    }
+    if (std::chrono::steady_clock::now() + RETRY_INTERVAL > deadline) {
+      throw std::runtime_error("Lost the connection to the receiver and "
+                               "could not reconnect within " +
+                               std::to_string(RECONNECT_TIMEOUT.count()) +
+                               " seconds");
+    }
+    std::this_thread::sleep_for(RETRY_INTERVAL);
+  }
+}
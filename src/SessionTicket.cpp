@@ -0,0 +1,188 @@
+#include "SessionTicket.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include <sodium.h>
+
+#include "utils.h"
+
+namespace {
+
+constexpr char MASTER_KEY_FILE[] = "ticket_key";
+constexpr char TICKETS_DIRECTORY[] = "tickets";
+
+// [secret][expiry, little endian]
+constexpr std::size_t TICKET_PLAINTEXT_SIZE = crypto::TICKET_SECRET_SIZE + 8;
+
+uint64_t now_seconds() {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::seconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count());
+}
+
+void append_u64(std::vector<uint8_t> &buffer, uint64_t value) {
+  for (int shift = 0; shift < 64; shift += 8) {
+    buffer.push_back(static_cast<uint8_t>(value >> shift));
+  }
+}
+
+uint64_t read_u64(const uint8_t *data) {
+  uint64_t value = 0;
+  for (int i = 7; i >= 0; --i) {
+    value = (value << 8) | data[i];
+  }
+  return value;
+}
+
+std::vector<uint8_t> read_file(const std::filesystem::path &path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return {};
+  }
+  return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), {});
+}
+
+// The file is made private to the user before anything is written to it
+void write_private_file(const std::filesystem::path &path,
+                        const std::vector<uint8_t> &contents) {
+  std::filesystem::create_directories(path.parent_path());
+  std::filesystem::permissions(path.parent_path(),
+                               std::filesystem::perms::owner_all);
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file) {
+    throw std::runtime_error("Failed to create " + path.string());
+  }
+  std::filesystem::permissions(path, std::filesystem::perms::owner_read |
+                                         std::filesystem::perms::owner_write);
+  file.write(reinterpret_cast<const char *>(contents.data()),
+             static_cast<std::streamsize>(contents.size()));
+  if (!file) {
+    throw std::runtime_error("Failed to write " + path.string());
+  }
+}
+
+std::array<uint8_t, crypto::KEY_SIZE>
+load_master_key(const std::filesystem::path &directory) {
+  const std::filesystem::path path = directory / MASTER_KEY_FILE;
+  std::array<uint8_t, crypto::KEY_SIZE> master_key;
+  std::vector<uint8_t> contents = read_file(path);
+  if (contents.size() == master_key.size()) {
+    std::copy(contents.begin(), contents.end(), master_key.begin());
+    return master_key;
+  }
+
+  LOG("creating ticket master key at " + path.string());
+  randombytes_buf(master_key.data(), master_key.size());
+  write_private_file(path, std::vector<uint8_t>(master_key.begin(),
+                                                master_key.end()));
+  return master_key;
+}
+
+} // namespace
+
+bool SessionTicket::expired() const { return now_seconds() >= expiry; }
+
+std::vector<uint8_t> SessionTicket::serialize() const {
+  std::vector<uint8_t> buffer(secret.begin(), secret.end());
+  append_u64(buffer, expiry);
+  buffer.insert(buffer.end(), ticket.begin(), ticket.end());
+  return buffer;
+}
+
+std::optional<SessionTicket>
+SessionTicket::deserialize(const std::vector<uint8_t> &buffer) {
+  if (buffer.size() <= TICKET_PLAINTEXT_SIZE ||
+      buffer.size() > TICKET_PLAINTEXT_SIZE + MAX_TICKET_SIZE) {
+    return std::nullopt;
+  }
+  SessionTicket session_ticket;
+  std::copy(buffer.begin(), buffer.begin() + crypto::TICKET_SECRET_SIZE,
+            session_ticket.secret.begin());
+  session_ticket.expiry = read_u64(buffer.data() + crypto::TICKET_SECRET_SIZE);
+  session_ticket.ticket.assign(buffer.begin() + TICKET_PLAINTEXT_SIZE,
+                               buffer.end());
+  return session_ticket;
+}
+
+std::filesystem::path ticket_directory() {
+  if (const char *state_home = std::getenv("XDG_STATE_HOME");
+      state_home && *state_home) {
+    return std::filesystem::path(state_home) / "trit";
+  }
+  if (const char *home = std::getenv("HOME"); home && *home) {
+    return std::filesystem::path(home) / ".local" / "state" / "trit";
+  }
+  return std::filesystem::temp_directory_path() / "trit" / "state";
+}
+
+TicketCache::TicketCache(std::filesystem::path directory)
+    : directory_(std::move(directory)) {}
+
+// The file holds the serialized ticket
+std::optional<SessionTicket>
+TicketCache::load(const std::string &receiver_ip) const {
+  std::optional<SessionTicket> session_ticket =
+      SessionTicket::deserialize(read_file(path(receiver_ip)));
+  if (!session_ticket || session_ticket->expired()) {
+    return std::nullopt;
+  }
+  return session_ticket;
+}
+
+void TicketCache::store(const std::string &receiver_ip,
+                        const SessionTicket &ticket) const {
+  write_private_file(path(receiver_ip), ticket.serialize());
+}
+
+void TicketCache::remove(const std::string &receiver_ip) const {
+  std::error_code ec;
+  std::filesystem::remove(path(receiver_ip), ec);
+}
+
+// Receiver addresses are validated IPv4 addresses, so they are safe file
+// names
+std::filesystem::path
+TicketCache::path(const std::string &receiver_ip) const {
+  return directory_ / TICKETS_DIRECTORY / receiver_ip;
+}
+
+TicketIssuer::TicketIssuer(const std::string &password,
+                           const std::filesystem::path &directory)
+    : ticket_key_(
+          crypto::derive_ticket_key(load_master_key(directory), password)) {}
+
+SessionTicket TicketIssuer::issue() const {
+  SessionTicket session_ticket;
+  randombytes_buf(session_ticket.secret.data(), session_ticket.secret.size());
+  session_ticket.expiry =
+      now_seconds() +
+      std::chrono::duration_cast<std::chrono::seconds>(TICKET_LIFETIME)
+          .count();
+
+  std::vector<uint8_t> plaintext(session_ticket.secret.begin(),
+                                 session_ticket.secret.end());
+  append_u64(plaintext, session_ticket.expiry);
+  session_ticket.ticket =
+      crypto::seal_message(ticket_key_, plaintext, nullptr, 0);
+  return session_ticket;
+}
+
+std::optional<std::array<uint8_t, crypto::TICKET_SECRET_SIZE>>
+TicketIssuer::redeem(const std::vector<uint8_t> &ticket) const {
+  std::optional<std::vector<uint8_t>> plaintext =
+      crypto::open_message(ticket_key_, ticket, nullptr, 0);
+  if (!plaintext || plaintext->size() != TICKET_PLAINTEXT_SIZE ||
+      read_u64(plaintext->data() + crypto::TICKET_SECRET_SIZE) <=
+          now_seconds()) {
+    return std::nullopt;
+  }
+  std::array<uint8_t, crypto::TICKET_SECRET_SIZE> secret;
+  std::copy(plaintext->begin(), plaintext->begin() + secret.size(),
+            secret.begin());
+  return secret;
+}
@@ -0,0 +1,20 @@
+#include "SocketOptions.h"
+
+#include <algorithm>
+
+// Linux counts its own overhead against the buffer sizes, so twice the
+// bandwidth-delay product is asked for. Even a short path keeps a buffer
+// large enough for a batch of frames, and a long fast path is capped, as the
+// kernel clamps the size to net.core.wmem_max/rmem_max anyway
+std::size_t
+SocketOptions::buffer_size_for_rtt(std::chrono::microseconds rtt) const {
+  constexpr std::size_t MIN_BUFFER_SIZE = 256 * 1024;
+  constexpr std::size_t MAX_BUFFER_SIZE = 256 * 1024 * 1024;
+
+  const double bandwidth_delay_product = static_cast<double>(link_rate) *
+                                         static_cast<double>(rtt.count()) /
+                                         1e6;
+  const double buffer_size = std::min(2 * bandwidth_delay_product,
+                                      static_cast<double>(MAX_BUFFER_SIZE));
+  return std::max(MIN_BUFFER_SIZE, static_cast<std::size_t>(buffer_size));
+}
@@ -0,0 +1,192 @@
+#include "StripedTransferManager.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include "ParallelChunkProcessor.h"
+#include "ReorderBuffer.h"
+
+StripedTransferManager::StripedTransferManager(
+    std::vector<TcpSocket *> sockets, const FrameBatchLimits &batch_limits,
+    std::size_t zero_copy_threshold, RateLimiter *rate_limiter)
+    : sockets_(std::move(sockets)) {
+  if (sockets_.empty() || sockets_.size() > MAX_STREAMS) {
+    throw std::logic_error("A striped transfer needs between 1 and " +
+                           std::to_string(MAX_STREAMS) + " connections");
+  }
+  for (std::size_t i = 0; i < sockets_.size(); ++i) {
+    streams_.push_back(std::make_unique<TransferManager>(
+        batch_limits, zero_copy_threshold, rate_limiter));
+  }
+}
+
+std::size_t
+StripedTransferManager::stream_queue_capacity(uint32_t chunk_size,
+                                              std::size_t num_streams) {
+  constexpr std::size_t MIN_STREAM_QUEUE_CAPACITY = 2;
+  return std::max(MIN_STREAM_QUEUE_CAPACITY,
+                  chunk_queue_capacity(chunk_size) / num_streams);
+}
+
+// Covers every chunk the sender can have queued or batched across all
+// connections, so a connection that falls behind does not stall the rest
+std::size_t StripedTransferManager::reorder_window(uint32_t chunk_size,
+                                                   std::size_t num_streams) {
+  return std::max(chunk_queue_capacity(chunk_size) * num_streams,
+                  MAX_BATCH_FRAMES);
+}
+
+void StripedTransferManager::send_chunks(WorkerContext &ctx,
+                                         ChunkQueue &input_queue,
+                                         uint32_t chunk_size,
+                                         std::atomic<uint32_t> &chunks_sent) {
+  const std::size_t capacity =
+      stream_queue_capacity(chunk_size, sockets_.size());
+  std::vector<std::unique_ptr<ChunkQueue>> stream_queues;
+  for (std::size_t i = 0; i < sockets_.size(); ++i) {
+    stream_queues.push_back(std::make_unique<ChunkQueue>(capacity));
+  }
+  auto abort_guard = ctx.scoped_on_abort([&]() {
+    for (auto &queue : stream_queues) {
+      queue->cancel();
+    }
+    shutdown_sockets();
+  });
+
+  std::vector<std::thread> transmitter_threads;
+  for (std::size_t i = 0; i < sockets_.size(); ++i) {
+    transmitter_threads.emplace_back([&, i]() {
+      try {
+        streams_[i]->send_chunks(ctx, *sockets_[i], *stream_queues[i],
+                                 chunks_sent);
+      } catch (...) {
+        ctx.handle_exception();
+      }
+    });
+  }
+
+  // Only this thread pushes to the stream queues, so each still has a single
+  // producer. The scan for the least loaded queue starts after the one last
+  // picked, so equally loaded connections take turns
+  const std::size_t num_streams = stream_queues.size();
+  std::size_t next_stream = 0;
+  try {
+    while (auto chunk_ptr_opt = input_queue.pop()) {
+      if (ctx.should_abort()) {
+        break;
+      }
+      std::size_t target = next_stream;
+      for (std::size_t i = 1; i < num_streams; ++i) {
+        const std::size_t candidate = (next_stream + i) % num_streams;
+        if (stream_queues[candidate]->size() < stream_queues[target]->size()) {
+          target = candidate;
+        }
+      }
+      next_stream = (target + 1) % num_streams;
+      if (!stream_queues[target]->push(std::move(*chunk_ptr_opt))) {
+        break;
+      }
+    }
+    if (!ctx.should_abort()) {
+      for (auto &queue : stream_queues) {
+        queue->close();
+      }
+    }
+  } catch (...) {
+    ctx.handle_exception();
+  }
+
+  for (auto &thread : transmitter_threads) {
+    thread.join();
+  }
+}
+
+void StripedTransferManager::receive_chunks(WorkerContext &ctx,
+                                            ChunkPool &chunk_pool,
+                                            ChunkQueue &output_queue,
+                                            uint32_t chunk_size,
+                                            uint32_t num_chunks) {
+  ReorderBuffer reorder_buffer(FIRST_SEQUENCE_NUM,
+                               reorder_window(chunk_size, sockets_.size()),
+                               output_queue);
+  auto abort_guard = ctx.scoped_on_abort([&]() {
+    reorder_buffer.cancel();
+    shutdown_sockets();
+  });
+
+  std::vector<std::thread> reader_threads;
+  for (std::size_t i = 0; i < sockets_.size(); ++i) {
+    reader_threads.emplace_back([&, i]() {
+      try {
+        streams_[i]->receive_stream(ctx, *sockets_[i], chunk_pool,
+                                    reorder_buffer, num_chunks);
+      } catch (...) {
+        ctx.handle_exception();
+      }
+    });
+  }
+  for (auto &thread : reader_threads) {
+    thread.join();
+  }
+
+  if (ctx.should_abort()) {
+    return;
+  }
+  const uint64_t chunks_received =
+      reorder_buffer.next_sequence_num() - FIRST_SEQUENCE_NUM;
+  if (chunks_received != num_chunks) {
+    throw std::runtime_error("Connections ended after " +
+                             std::to_string(chunks_received) + " of " +
+                             std::to_string(num_chunks) + " chunks");
+  }
+  output_queue.close();
+}
+
+std::size_t StripedTransferManager::num_streams() const {
+  return sockets_.size();
+}
+
+std::string StripedTransferManager::stream_summary(double seconds) const {
+  std::ostringstream summary;
+  summary << std::fixed << std::setprecision(1);
+  for (std::size_t i = 0; i < streams_.size(); ++i) {
+    const SendStats &sent = streams_[i]->send_stats();
+    const ReceiveStats &received = streams_[i]->receive_stats();
+    const uint64_t frames = sent.frames + received.frames;
+    const uint64_t bytes = sent.bytes + received.bytes;
+    if (i > 0) {
+      summary << '\n';
+    }
+    summary << "Stream " << i << ": " << frames << " chunks, "
+            << bytes / 1e6 << " MB, "
+            << (seconds > 0 ? bytes / 1e6 / seconds : 0.0) << " MB/s";
+  }
+  return summary.str();
+}
+
+std::string StripedTransferManager::send_summary() const {
+  std::string summary;
+  for (std::size_t i = 0; i < streams_.size(); ++i) {
+    summary += (i > 0 ? "; stream " : "stream ") + std::to_string(i) + ": " +
+               streams_[i]->send_summary();
+  }
+  return summary;
+}
+
+std::string StripedTransferManager::receive_summary() const {
+  std::string summary;
+  for (std::size_t i = 0; i < streams_.size(); ++i) {
+    summary += (i > 0 ? "; stream " : "stream ") + std::to_string(i) + ": " +
+               streams_[i]->receive_summary();
+  }
+  return summary;
+}
+
+void StripedTransferManager::shutdown_sockets() {
+  for (TcpSocket *socket : sockets_) {
+    socket->shutdown();
+  }
+}
@@ -1,38 +1,278 @@
-
 #include "TcpSocket.h"
 
-TcpSocket::TcpSocket() : socket_(io_context_) {}
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <sstream>
 
-TcpSocket::~TcpSocket() { socket_.close(); }
+#ifdef __linux__
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
 
-void TcpSocket::connect(const std::string &ip, uint16_t port) {
+TcpSocket::TcpSocket(IoEngine &engine)
+    : strand_(asio::make_strand(engine.context())), socket_(strand_) {}
+
+TcpSocket::~TcpSocket() {
+  asio::error_code ec;
+  socket_.close(ec);
+}
+
+// The timer closes the socket, which cancels the operation. Its state is
+// shared with the handlers, since the timer may expire while the completed
+// operation's handler is still queued, which must then win
+template <typename Initiate>
+bool TcpSocket::wait_for_within(std::chrono::steady_clock::duration timeout,
+                                Initiate initiate) {
+  auto timer = std::make_shared<asio::steady_timer>(strand_);
+  auto completed = std::make_shared<bool>(false);
+  auto timed_out = std::make_shared<bool>(false);
+  try {
+    IoEngine::wait_for(strand_, [&](auto handler) {
+      timer->expires_after(timeout);
+      timer->async_wait(
+          [this, completed, timed_out](const asio::error_code &ec) {
+            if (!ec && !*completed) {
+              *timed_out = true;
+              asio::error_code close_ec;
+              socket_.close(close_ec);
+            }
+          });
+      initiate([handler, timer, completed](const asio::error_code &ec,
+                                           std::size_t bytes) {
+        *completed = true;
+        timer->cancel();
+        handler(ec, bytes);
+      });
+    });
+  } catch (const asio::system_error &) {
+    if (*timed_out) {
+      return false;
+    }
+    throw;
+  }
+  return true;
+}
+
+// Buffer sizes are set before connecting, since the receive buffer size
+// decides the window scale offered in the SYN
+void TcpSocket::open_for_connect(const std::string &ip, uint16_t port) {
   endpoint_ = asio::ip::tcp::endpoint(asio::ip::make_address(ip), port);
-  socket_.connect(endpoint_);
+  if (!socket_.is_open()) {
+    socket_.open(endpoint_.protocol());
+  }
+  apply_options();
+}
+
+void TcpSocket::connect(const std::string &ip, uint16_t port) {
+  open_for_connect(ip, port);
+  IoEngine::wait_for(strand_, [this](auto handler) {
+    socket_.async_connect(endpoint_, [handler](const asio::error_code &ec) {
+      handler(ec, 0);
+    });
+  });
 }
 
-void TcpSocket::accept(uint16_t port, TcpSocket &client_socket) {
-  asio::ip::tcp::acceptor acceptor(
-      client_socket.io_context_,
-      asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port));
-  acceptor.accept(client_socket.socket_);
-  acceptor.close();
+bool TcpSocket::connect(const std::string &ip, uint16_t port,
+                        std::chrono::steady_clock::duration timeout) {
+  open_for_connect(ip, port);
+  return wait_for_within(timeout, [this](auto handler) {
+    socket_.async_connect(endpoint_, [handler](const asio::error_code &ec) {
+      handler(ec, 0);
+    });
+  });
 }
 
 void TcpSocket::read(void *buf, std::size_t len) {
-  asio::read(socket_, asio::buffer(buf, len));
+  IoEngine::wait_for(strand_, [&](auto handler) {
+    asio::async_read(socket_, asio::buffer(buf, len), std::move(handler));
+  });
+}
+
+bool TcpSocket::read(void *buf, std::size_t len,
+                     std::chrono::steady_clock::duration timeout) {
+  return wait_for_within(timeout, [&](auto handler) {
+    asio::async_read(socket_, asio::buffer(buf, len), std::move(handler));
+  });
 }
 
 void TcpSocket::write(const void *buf, std::size_t len) {
-  asio::write(socket_, asio::buffer(buf, len));
+  IoEngine::wait_for(strand_, [&](auto handler) {
+    asio::async_write(socket_, asio::buffer(buf, len), std::move(handler));
+  });
+}
+
+std::size_t
+TcpSocket::write(const std::vector<asio::const_buffer> &buffers) {
+  // The composed write resumes a short write where the kernel stopped
+  std::size_t write_calls = 0;
+  IoEngine::wait_for(strand_, [&](auto handler) {
+    asio::async_write(socket_, buffers,
+                      TransferAllCountingCalls{&write_calls},
+                      std::move(handler));
+  });
+  return write_calls;
 }
 
 void TcpSocket::close() {
+  IoEngine::wait_for(strand_, [this](auto handler) {
+    asio::error_code ec;
+    if (socket_.is_open()) {
+      socket_.close(ec);
+    }
+    handler(ec, 0);
+  });
+}
+
+bool TcpSocket::is_open() const { return socket_.is_open(); }
+
+// Runs on the strand, so it is ordered with the handlers of a read or write
+// that is in flight on another thread, which then completes with an error
+void TcpSocket::shutdown() {
+  IoEngine::wait_for(strand_, [this](auto handler) {
+    asio::error_code ec;
+    socket_.shutdown(asio::ip::tcp::socket::shutdown_both, ec);
+    handler(asio::error_code(), 0);
+  });
+}
+
+void TcpSocket::set_options(const SocketOptions &options) {
+  options_ = options;
   if (socket_.is_open()) {
-    socket_.close();
+    apply_options();
   }
 }
 
-bool TcpSocket::is_open() const { return socket_.is_open(); }
+const SocketOptions &TcpSocket::options() const { return options_; }
+
+void TcpSocket::apply_options() {
+  // The kernel takes int sized buffer sizes
+  auto buffer_size = [](std::size_t size) {
+    return static_cast<int>(std::min<std::size_t>(
+        size, static_cast<std::size_t>(std::numeric_limits<int>::max())));
+  };
+
+  asio::error_code ec;
+  socket_.set_option(asio::ip::tcp::no_delay(options_.no_delay), ec);
+  if (options_.send_buffer_size) {
+    socket_.set_option(asio::socket_base::send_buffer_size(
+                           buffer_size(*options_.send_buffer_size)),
+                       ec);
+  }
+  if (options_.receive_buffer_size) {
+    socket_.set_option(asio::socket_base::receive_buffer_size(
+                           buffer_size(*options_.receive_buffer_size)),
+                       ec);
+  }
+  socket_.set_option(asio::socket_base::keep_alive(options_.keep_alive), ec);
+#if defined(__linux__) && defined(TCP_CONGESTION)
+  if (!options_.congestion_control.empty()) {
+    ::setsockopt(socket_.native_handle(), IPPROTO_TCP, TCP_CONGESTION,
+                 options_.congestion_control.data(),
+                 static_cast<socklen_t>(options_.congestion_control.size()));
+  }
+#endif
+}
+
+std::optional<std::size_t> TcpSocket::tune_buffer_size() {
+  if (!options_.auto_buffer_size) {
+    return std::nullopt;
+  }
+  std::optional<std::chrono::microseconds> rtt = round_trip_time();
+  if (!rtt) {
+    return std::nullopt;
+  }
+  const std::size_t size = options_.buffer_size_for_rtt(*rtt);
+  options_.send_buffer_size = size;
+  options_.receive_buffer_size = size;
+  apply_options();
+  return size;
+}
+
+std::optional<std::chrono::microseconds> TcpSocket::round_trip_time() {
+#ifdef __linux__
+  tcp_info info{};
+  socklen_t length = sizeof(info);
+  if (::getsockopt(socket_.native_handle(), IPPROTO_TCP, TCP_INFO, &info,
+                   &length) != 0 ||
+      info.tcpi_rtt == 0) {
+    return std::nullopt;
+  }
+  return std::chrono::microseconds(info.tcpi_rtt);
+#else
+  return std::nullopt;
+#endif
+}
+
+void TcpSocket::set_cork(bool corked) {
+#if defined(__linux__) && defined(TCP_CORK)
+  if (options_.cork_batches) {
+    int value = corked ? 1 : 0;
+    ::setsockopt(socket_.native_handle(), IPPROTO_TCP, TCP_CORK, &value,
+                 sizeof(value));
+  }
+#else
+  (void)corked;
+#endif
+}
+
+std::string TcpSocket::describe_options() {
+  asio::error_code ec;
+  asio::ip::tcp::no_delay no_delay;
+  asio::socket_base::send_buffer_size send_buffer_size;
+  asio::socket_base::receive_buffer_size receive_buffer_size;
+  asio::socket_base::keep_alive keep_alive;
+  socket_.get_option(no_delay, ec);
+  socket_.get_option(send_buffer_size, ec);
+  socket_.get_option(receive_buffer_size, ec);
+  socket_.get_option(keep_alive, ec);
+
+  std::ostringstream description;
+  description << "nodelay=" << (no_delay.value() ? "on" : "off")
+              << " sndbuf=" << send_buffer_size.value()
+              << " rcvbuf=" << receive_buffer_size.value()
+              << " keepalive=" << (keep_alive.value() ? "on" : "off")
+              << " cork=" << (options_.cork_batches ? "batches" : "off");
+#if defined(__linux__) && defined(TCP_CONGESTION)
+  char congestion_control[16] = {};
+  socklen_t length = sizeof(congestion_control) - 1;
+  if (::getsockopt(socket_.native_handle(), IPPROTO_TCP, TCP_CONGESTION,
+                   congestion_control, &length) == 0) {
+    description << " congestion=" << congestion_control;
+    if (!options_.congestion_control.empty() &&
+        options_.congestion_control != congestion_control) {
+      description << " (" << options_.congestion_control << " unavailable)";
+    }
+  }
+#endif
+  if (std::optional<std::chrono::microseconds> rtt = round_trip_time()) {
+    description << " rtt=" << rtt->count() << "us";
+  }
+  return description.str();
+}
+
+asio::ip::tcp::socket::native_handle_type TcpSocket::native_handle() {
+  return socket_.native_handle();
+}
+
+void TcpSocket::wait_writable() {
+  IoEngine::wait_for(strand_, [this](auto handler) {
+    socket_.async_wait(asio::ip::tcp::socket::wait_write,
+                       [handler](const asio::error_code &ec) {
+                         handler(ec, 0);
+                       });
+  });
+}
+
+void TcpSocket::wait_readable() {
+  IoEngine::wait_for(strand_, [this](auto handler) {
+    socket_.async_wait(asio::ip::tcp::socket::wait_read,
+                       [handler](const asio::error_code &ec) {
+                         handler(ec, 0);
+                       });
+  });
+}
 
 std::string TcpSocket::remote_endpoint_address() const {
   return socket_.remote_endpoint().address().to_string();
@@ -40,4 +280,74 @@ std::string TcpSocket::remote_endpoint_address() const {
 
 uint16_t TcpSocket::remote_endpoint_port() const {
   return socket_.remote_endpoint().port();
-}
\ No newline at end of file
+}
+
+TcpListener::TcpListener(uint16_t port, IoEngine &engine)
+    : strand_(asio::make_strand(engine.context())),
+      acceptor_(strand_, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port)) {}
+
+TcpListener::~TcpListener() {
+  asio::error_code ec;
+  acceptor_.close(ec);
+}
+
+// Accepts into a socket that may already have served an earlier connection
+void TcpListener::accept(TcpSocket &client_socket) {
+  IoEngine::wait_for(strand_, [&](auto handler) {
+    asio::error_code ec;
+    if (client_socket.socket_.is_open()) {
+      client_socket.socket_.close(ec);
+    }
+    acceptor_.async_accept(client_socket.socket_,
+                           [handler](const asio::error_code &ec) {
+                             handler(ec, 0);
+                           });
+  });
+  client_socket.apply_options();
+}
+
+// The timer cancels the accept, and its state is shared with the handler,
+// which may still be queued when the accept completes first
+bool TcpListener::accept(TcpSocket &client_socket,
+                         std::chrono::steady_clock::duration timeout) {
+  auto timer = std::make_shared<asio::steady_timer>(strand_);
+  auto timed_out = std::make_shared<bool>(false);
+  try {
+    IoEngine::wait_for(strand_, [&](auto handler) {
+      asio::error_code ec;
+      if (client_socket.socket_.is_open()) {
+        client_socket.socket_.close(ec);
+      }
+      timer->expires_after(timeout);
+      timer->async_wait([this, timed_out](const asio::error_code &ec) {
+        if (!ec) {
+          *timed_out = true;
+          asio::error_code cancel_ec;
+          acceptor_.cancel(cancel_ec);
+        }
+      });
+      acceptor_.async_accept(client_socket.socket_,
+                             [handler, timer](const asio::error_code &ec) {
+                               timer->cancel();
+                               handler(ec, 0);
+                             });
+    });
+  } catch (const asio::system_error &) {
+    if (*timed_out) {
+      return false;
+    }
+    throw;
+  }
+  client_socket.apply_options();
+  return true;
+}
+
+void TcpListener::close() {
+  IoEngine::wait_for(strand_, [this](auto handler) {
+    asio::error_code ec;
+    if (acceptor_.is_open()) {
+      acceptor_.close(ec);
+    }
+    handler(ec, 0);
+  });
+}
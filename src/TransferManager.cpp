@@ -1,87 +1,604 @@
 
+#include <array>
+#include <cstring>
+#include <iomanip>
 #include <iostream>
+#include <optional>
+#include <sstream>
 #include <stdexcept>
 
+#include "FrameReader.h"
 #include "TransferManager.h"
 #include "utils.h"
 
 /*
 Chunk transfer protocol:
-sequence number     [8 bytes]
-compressed flag     [1 byte]
-original size       [2 bytes]
-chunk size          [2 bytes]
-chunk data          [<= 65535 bytes]
+frame header        [FrameHeader::SIZE bytes, see FrameHeader.h]
+chunk data          [<= MAX_CHUNK_SIZE + encryption overhead]
+...
+end of stream       [FrameHeader::SIZE bytes, sequence number 0]
+
+On a resumable transfer the receiver sends acknowledgements (see
+FrameHeader.h) the other way on the same connection, and the sender closes
+the connection once the last chunk is acknowledged. A lost connection is
+replaced by a new one, on which the sender resumes with the chunks after the
+last one received and, if it had been sent before, the end of stream frame.
 */
 
-void TransferManager::send_chunks(
-    WorkerContext &ctx, TcpSocket &socket,
-    BoundedThreadSafeQueue<std::unique_ptr<Chunk>> &input_queue,
-    std::atomic<bool> &input_done, std::atomic<uint32_t> &chunks_sent) {
+TransferManager::TransferManager(const FrameBatchLimits &batch_limits,
+                                 std::size_t zero_copy_threshold,
+                                 RateLimiter *rate_limiter)
+    : batch_limits_(batch_limits), zero_copy_threshold_(zero_copy_threshold),
+      rate_limiter_(rate_limiter) {
+  batch_chunks_.reserve(MAX_BATCH_FRAMES);
+  batch_buffers_.reserve(MAX_BATCH_FRAMES);
+  FrameHeader::end_of_stream().encode(end_frame_.data());
+}
+
+void TransferManager::enable_send_resume(std::size_t window_bytes,
+                                         std::function<uint64_t()> reconnect) {
+  retransmit_window_.emplace(window_bytes);
+  reconnect_ = std::move(reconnect);
+}
+
+void TransferManager::enable_receive_resume(
+    const std::atomic<uint32_t> &chunks_written,
+    std::function<void(uint64_t)> accept_reconnect) {
+  chunks_written_ = &chunks_written;
+  accept_reconnect_ = std::move(accept_reconnect);
+}
+
+// A resumable transfer reads acknowledgements for as long as it sends, and
+// shuts the socket down on abort so that neither side stays blocked on it
+void TransferManager::send_chunks(WorkerContext &ctx, TcpSocket &socket,
+                                  ChunkQueue &input_queue,
+                                  std::atomic<uint32_t> &chunks_sent) {
+  if (!retransmit_window_) {
+    send_frames(ctx, socket, input_queue, chunks_sent);
+    return;
+  }
+
+  auto abort_guard = ctx.scoped_on_abort([&]() {
+    retransmit_window_->cancel();
+    socket.shutdown();
+  });
+  start_acknowledgement_reader(socket);
+  try {
+    send_frames(ctx, socket, input_queue, chunks_sent);
+  } catch (...) {
+    stop_acknowledgement_reader(socket);
+    throw;
+  }
+  stop_acknowledgement_reader(socket);
+}
+
+// Frames are coalesced into batches that go out with one gather write. The
+// first frame of a batch is waited for indefinitely, further frames only until
+// the hold deadline, so a slow upstream stage never stalls a partial batch
+void TransferManager::send_frames(WorkerContext &ctx, TcpSocket &socket,
+                                  ChunkQueue &input_queue,
+                                  std::atomic<uint32_t> &chunks_sent) {
+  // Zero-copy sends hand their chunks to the kernel, while a resumable
+  // transfer keeps them for retransmission
+  if (zero_copy_threshold_ > 0 && !retransmit_window_) {
+    if (ZeroCopySender::enable(socket)) {
+      zero_copy_sender_.emplace(socket);
+    } else {
+      LOG("MSG_ZEROCOPY is not available, sending with copies");
+    }
+  }
+
+  std::chrono::steady_clock::time_point flush_deadline;
 
   while (true) {
+    std::optional<ChunkPtr> chunk_ptr_opt =
+        batch_chunks_.empty() ? input_queue.pop()
+                              : input_queue.pop_until(flush_deadline);
     if (ctx.should_abort()) {
       return;
     }
-    auto chunk_ptr_opt = input_queue.try_pop();
-    if (chunk_ptr_opt) {
-      const Chunk &chunk = *chunk_ptr_opt.value();
-      if (chunk.size() > UINT16_MAX) {
-        throw std::runtime_error("Chunk exceeded maximum size of " +
-                                 std::to_string(UINT16_MAX) + " bytes");
+
+    // Timed out, or the queue was closed: send what is held. The blocking
+    // pop() on the next pass tells the two apart
+    if (!chunk_ptr_opt) {
+      if (batch_chunks_.empty()) {
+        break;
       }
+      flush_batch(ctx, socket, chunks_sent);
+      continue;
+    }
 
-      uint64_t sequence_num = chunk.sequence_num();
-      socket.write(&sequence_num, sizeof(sequence_num));
+    if (batch_chunks_.empty()) {
+      flush_deadline =
+          std::chrono::steady_clock::now() + batch_limits_.max_hold;
+    }
+    add_to_batch(std::move(*chunk_ptr_opt));
+    if (batch_bytes_ >= batch_limits_.max_bytes ||
+        batch_chunks_.size() == MAX_BATCH_FRAMES) {
+      flush_batch(ctx, socket, chunks_sent);
+    }
+  }
+  if (ctx.should_abort()) {
+    return;
+  }
 
-      uint8_t compressed_flag = static_cast<uint8_t>(chunk.compressed());
-      socket.write(&compressed_flag, sizeof(compressed_flag));
+  // Tells the receiver no more frames follow on this connection
+  end_frame_sent_ = true;
+  if (!retransmit_window_) {
+    socket.write(end_frame_.data(), end_frame_.size());
+    send_stats_.write_calls++;
 
-      uint16_t original_size = chunk.original_size();
-      socket.write(&original_size, sizeof(original_size));
+    // Chunks of zero-copy sends are only released once the kernel is done
+    // reading them
+    wait_for_zero_copy(ctx, 0);
+    return;
+  }
 
-      uint16_t chunk_size = chunk.size();
-      socket.write(&chunk_size, sizeof(chunk_size));
-      socket.write(chunk.data(), chunk_size);
+  try {
+    socket.write(end_frame_.data(), end_frame_.size());
+    send_stats_.write_calls++;
+  } catch (const asio::system_error &) {
+    if (ctx.should_abort()) {
+      throw;
+    }
+    recover_connection(ctx, socket);
+  }
 
-      // std::cout << "Sent chunk (seq#) " << chunk_ptr->sequence_num() << " ("
-      // << chunk_ptr->size() << " B)" << std::endl;
-      chunks_sent++;
-    } else if (input_done.load() && input_queue.empty()) {
+  // The transfer is only complete once every chunk is written on the other
+  // side, so the connection is recovered for as long as that takes
+  while (!retransmit_window_->wait_until_acknowledged()) {
+    if (ctx.should_abort()) {
+      return;
+    }
+    recover_connection(ctx, socket);
+  }
+}
+
+// Writes the frame header into the chunk headroom so that header, payload and
+// MAC form one buffer of the batch
+void TransferManager::add_to_batch(ChunkPtr chunk_ptr) {
+  Chunk &chunk = *chunk_ptr;
+
+  // Header fields are captured before the payload is extended backwards
+  // into the headroom where the header is written
+  FrameHeader header;
+  header.sequence_num = chunk.sequence_num();
+  header.compressed = chunk.compressed();
+  header.original_size = chunk.original_size();
+  header.chunk_size = chunk.size();
+
+  uint8_t *frame = chunk.push_front(FRAME_HEADER_SIZE);
+  header.encode(frame);
+
+  const std::size_t frame_size = FRAME_HEADER_SIZE + header.chunk_size;
+  batch_buffers_.emplace_back(frame, frame_size);
+  batch_bytes_ += frame_size;
+  batch_chunks_.push_back(std::move(chunk_ptr));
+}
+
+// Chunks are held until the write returns, since the buffers point into them.
+// A zero-copy send holds them on until the kernel reports it complete, and
+// takes the whole batch from the rate limiter at once. The socket is corked
+// around the batch if its options ask for it
+void TransferManager::flush_batch(WorkerContext &ctx, TcpSocket &socket,
+                                  std::atomic<uint32_t> &chunks_sent) {
+  const std::size_t frames = batch_chunks_.size();
+  if (retransmit_window_) {
+    flush_resumable_batch(ctx, socket);
+  } else if (zero_copy_sender_ &&
+             batch_bytes_ / frames >= zero_copy_threshold_) {
+    socket.set_cork(true);
+    if (rate_limiter_ && !rate_limiter_->acquire(ctx, batch_bytes_)) {
+      return;
+    }
+    const std::size_t calls =
+        zero_copy_sender_->send(batch_buffers_, batch_chunks_);
+    send_stats_.write_calls += calls;
+    send_stats_.zero_copy_calls += calls;
+    wait_for_zero_copy(ctx, MAX_ZERO_COPY_PENDING_BYTES);
+    socket.set_cork(false);
+  } else {
+    socket.set_cork(true);
+    send_stats_.write_calls += write_frames(ctx, socket, batch_buffers_);
+    socket.set_cork(false);
+  }
+  send_stats_.frames += frames;
+  send_stats_.bytes += batch_bytes_;
+  send_stats_.batches++;
+
+  chunks_sent += static_cast<uint32_t>(frames);
+  batch_chunks_.clear();
+  batch_buffers_.clear();
+  batch_bytes_ = 0;
+}
+
+// The frames go into the retransmit window before they are written, so a
+// write that fails part way is completed by the retransmission once the
+// connection is recovered
+void TransferManager::flush_resumable_batch(WorkerContext &ctx,
+                                            TcpSocket &socket) {
+  while (!retransmit_window_->wait_for_space(batch_bytes_)) {
+    if (ctx.should_abort()) {
+      return;
+    }
+    recover_connection(ctx, socket);
+  }
+  retransmit_window_->push(batch_chunks_);
+  try {
+    socket.set_cork(true);
+    send_stats_.write_calls += write_frames(ctx, socket, batch_buffers_);
+    socket.set_cork(false);
+  } catch (const asio::system_error &) {
+    if (ctx.should_abort()) {
+      throw;
+    }
+    recover_connection(ctx, socket);
+  }
+}
+
+// Returns the write calls made
+std::size_t
+TransferManager::write_frames(WorkerContext &ctx, TcpSocket &socket,
+                              const std::vector<asio::const_buffer> &buffers) {
+  if (rate_limiter_) {
+    return write_paced(ctx, socket, buffers);
+  }
+  return socket.write(buffers);
+}
+
+// Writes the buffers in slices of at most the rate limiter's slice size, each
+// waiting for its share of the rate, so a large batch goes out as evenly
+// spaced writes. Slices may end inside a frame
+std::size_t
+TransferManager::write_paced(WorkerContext &ctx, TcpSocket &socket,
+                             const std::vector<asio::const_buffer> &buffers) {
+  std::size_t write_calls = 0;
+  auto next_buffer = buffers.begin();
+  std::size_t offset = 0;
+  while (next_buffer != buffers.end()) {
+    const std::size_t slice_size = rate_limiter_->slice_size();
+    std::size_t slice_bytes = 0;
+    slice_buffers_.clear();
+    while (next_buffer != buffers.end() && slice_bytes < slice_size) {
+      const std::size_t size =
+          std::min(next_buffer->size() - offset, slice_size - slice_bytes);
+      slice_buffers_.emplace_back(
+          static_cast<const uint8_t *>(next_buffer->data()) + offset, size);
+      slice_bytes += size;
+      offset += size;
+      if (offset == next_buffer->size()) {
+        ++next_buffer;
+        offset = 0;
+      }
+    }
+    if (!rate_limiter_->acquire(ctx, slice_bytes)) {
       break;
     }
+    write_calls += socket.write(slice_buffers_);
   }
+  return write_calls;
 }
 
-void TransferManager::receive_chunks(
-    WorkerContext &ctx, TcpSocket &socket,
-    BoundedThreadSafeQueue<std::unique_ptr<Chunk>> &output_queue,
-    std::atomic<bool> &output_done, uint32_t num_chunks) {
+// Releases the chunks of completed zero-copy sends, and blocks while more
+// than max_pending_bytes are still being read by the kernel
+void TransferManager::wait_for_zero_copy(WorkerContext &ctx,
+                                         std::size_t max_pending_bytes) {
+  if (!zero_copy_sender_) {
+    return;
+  }
+  zero_copy_sender_->reap();
+  while (zero_copy_sender_->pending_bytes() > max_pending_bytes &&
+         !ctx.should_abort()) {
+    zero_copy_sender_->reap(std::chrono::milliseconds(10));
+  }
+  send_stats_.zero_copy_copied_calls = zero_copy_sender_->copied_calls();
+}
 
+// Reconnects after the connection was lost, and sends again every frame the
+// receiver had not received, followed by the end of stream frame if it had
+// already been sent. Acknowledgements are only read again afterwards, as they
+// release the frames being sent. Gives up by letting reconnect_ throw
+void TransferManager::recover_connection(WorkerContext &ctx,
+                                         TcpSocket &socket) {
+  while (true) {
+    stop_acknowledgement_reader(socket);
+    LOG("connection lost after " +
+        std::to_string(retransmit_window_->acknowledged()) +
+        " acknowledged chunks, reconnecting");
+    const uint64_t chunks_received = reconnect_();
+    send_stats_.reconnects++;
+    retransmit_window_->reset();
+
+    try {
+      std::vector<asio::const_buffer> frames =
+          retransmit_window_->frames_after(chunks_received);
+      LOG("reconnected, resending " + std::to_string(frames.size()) +
+          " frames after chunk #" + std::to_string(chunks_received));
+      send_stats_.retransmitted_frames += frames.size();
+      if (end_frame_sent_) {
+        frames.emplace_back(end_frame_.data(), end_frame_.size());
+      }
+      send_stats_.write_calls += write_frames(ctx, socket, frames);
+      start_acknowledgement_reader(socket);
+      return;
+    } catch (const asio::system_error &) {
+      if (ctx.should_abort()) {
+        throw;
+      }
+    }
+  }
+}
+
+// Reads acknowledgements until the connection fails or is shut down, which
+// wakes the transmitter to recover it or finish
+void TransferManager::start_acknowledgement_reader(TcpSocket &socket) {
+  acknowledgement_reader_ = std::thread([this, &socket]() {
+    try {
+      std::array<uint8_t, Acknowledgement::SIZE> buffer;
+      while (true) {
+        socket.read(buffer.data(), buffer.size());
+        retransmit_window_->acknowledge(
+            Acknowledgement::decode(buffer.data()).chunks_written);
+      }
+    } catch (const std::exception &) {
+      retransmit_window_->fail();
+    }
+  });
+}
+
+void TransferManager::stop_acknowledgement_reader(TcpSocket &socket) {
+  if (acknowledgement_reader_.joinable()) {
+    socket.shutdown();
+    acknowledgement_reader_.join();
+  }
+}
+
+const SendStats &TransferManager::send_stats() const { return send_stats_; }
+
+const ReceiveStats &TransferManager::receive_stats() const {
+  return receive_stats_;
+}
+
+std::string TransferManager::send_summary() const {
+  const SendStats &stats = send_stats_;
+  if (stats.batches == 0) {
+    return "no frames sent";
+  }
+  const double gigabytes = static_cast<double>(stats.bytes) / 1e9;
+  std::ostringstream summary;
+  summary << std::fixed << std::setprecision(1) << stats.frames
+          << " frames in " << stats.batches << " batches, "
+          << stats.write_calls << " write calls ("
+          << static_cast<double>(stats.frames) / stats.batches
+          << " frames/batch, " << stats.write_calls / gigabytes
+          << " syscalls/GB)";
+  if (stats.zero_copy_calls > 0) {
+    summary << ", " << stats.zero_copy_calls << " MSG_ZEROCOPY calls ("
+            << stats.zero_copy_copied_calls << " copied by the kernel)";
+  }
+  if (stats.reconnects > 0) {
+    summary << ", " << stats.reconnects << " reconnects ("
+            << stats.retransmitted_frames << " frames sent again)";
+  }
+  return summary.str();
+}
+
+std::string TransferManager::receive_summary() const {
+  const ReceiveStats &stats = receive_stats_;
+  if (stats.frames == 0) {
+    return "no frames received";
+  }
+  const double gigabytes = static_cast<double>(stats.bytes) / 1e9;
+  std::ostringstream summary;
+  summary << std::fixed << std::setprecision(1) << stats.frames
+          << " frames with " << stats.read_calls << " read calls ("
+          << static_cast<double>(stats.frames) / stats.read_calls
+          << " frames/read, " << stats.read_calls / gigabytes
+          << " syscalls/GB)";
+  if (stats.reconnects > 0) {
+    summary << ", " << stats.reconnects << " reconnects";
+  }
+  return summary.str();
+}
+
+void TransferManager::receive_chunks(WorkerContext &ctx, TcpSocket &socket,
+                                     ChunkPool &chunk_pool,
+                                     ChunkQueue &output_queue,
+                                     uint32_t num_chunks) {
+  if (accept_reconnect_) {
+    receive_resumable_chunks(ctx, socket, chunk_pool, output_queue,
+                             num_chunks);
+    return;
+  }
+
+  FrameReader frame_reader(socket);
   for (uint32_t i = 0; i < num_chunks; ++i) {
     if (ctx.should_abort()) {
       return;
     }
-    uint64_t sequence_num;
-    socket.read(&sequence_num, sizeof(sequence_num));
+    ChunkPtr chunk_ptr = read_frame(frame_reader, chunk_pool);
+    if (!chunk_ptr) {
+      throw std::runtime_error("Connection ended after " + std::to_string(i) +
+                               " of " + std::to_string(num_chunks) +
+                               " chunks");
+    }
+    if (!output_queue.push(std::move(chunk_ptr))) {
+      return;
+    }
+  }
 
-    uint8_t compressed_flag;
-    socket.read(&compressed_flag, sizeof(compressed_flag));
-    bool compressed = static_cast<bool>(compressed_flag);
+  if (read_frame(frame_reader, chunk_pool)) {
+    throw std::runtime_error("Received more than the " +
+                             std::to_string(num_chunks) +
+                             " chunks in the transfer");
+  }
+  output_queue.close();
+}
 
-    uint16_t original_size;
-    socket.read(&original_size, sizeof(original_size));
+// Chunks must arrive in sequence, so that after a reconnection the sender's
+// frames continue exactly where the lost connection stopped. Once the last
+// acknowledgement is sent, the connection ending is the end of the transfer,
+// as the sender only closes it after receiving that acknowledgement
+void TransferManager::receive_resumable_chunks(WorkerContext &ctx,
+                                               TcpSocket &socket,
+                                               ChunkPool &chunk_pool,
+                                               ChunkQueue &output_queue,
+                                               uint32_t num_chunks) {
+  auto abort_guard = ctx.scoped_on_abort([&]() { socket.shutdown(); });
+  std::thread acknowledgement_thread(
+      [&]() { send_acknowledgements(socket, num_chunks); });
+  auto stop_acknowledgements = [&]() {
+    {
+      std::lock_guard<std::mutex> lock(acknowledgement_mutex_);
+      acknowledgements_stopped_ = true;
+    }
+    acknowledgement_changed_.notify_all();
+    acknowledgement_thread.join();
+  };
 
-    uint16_t chunk_size;
-    socket.read(&chunk_size, sizeof(chunk_size));
-    std::vector<uint8_t> buffer(chunk_size);
-    socket.read(buffer.data(), chunk_size);
+  FrameReader frame_reader(socket);
+  uint32_t chunks_received = 0;
+  bool end_received = false;
+  try {
+    while (true) {
+      try {
+        while (chunks_received < num_chunks) {
+          if (ctx.should_abort()) {
+            stop_acknowledgements();
+            return;
+          }
+          ChunkPtr chunk_ptr = read_frame(frame_reader, chunk_pool);
+          if (!chunk_ptr) {
+            throw std::runtime_error("Connection ended after " +
+                                     std::to_string(chunks_received) + " of " +
+                                     std::to_string(num_chunks) + " chunks");
+          }
+          if (chunk_ptr->sequence_num() != chunks_received + 1ull) {
+            throw std::runtime_error(
+                "Received chunk #" + std::to_string(chunk_ptr->sequence_num()) +
+                " where #" + std::to_string(chunks_received + 1) +
+                " was expected");
+          }
+          if (!output_queue.push(std::move(chunk_ptr))) {
+            stop_acknowledgements();
+            return;
+          }
+          ++chunks_received;
+        }
 
-    output_queue.push(
-        compressed ? std::make_unique<Chunk>(sequence_num, std::move(buffer),
-                                             original_size)
-                   : std::make_unique<Chunk>(sequence_num, std::move(buffer)));
+        if (!end_received) {
+          if (read_frame(frame_reader, chunk_pool)) {
+            throw std::runtime_error("Received more than the " +
+                                     std::to_string(num_chunks) +
+                                     " chunks in the transfer");
+          }
+          end_received = true;
+          {
+            std::lock_guard<std::mutex> lock(acknowledgement_mutex_);
+            end_received_ = true;
+          }
+          output_queue.close();
+        } else if (read_frame(frame_reader, chunk_pool)) {
+          throw std::runtime_error("Received a chunk after the end of stream");
+        }
+
+        // Nothing follows the end of stream frame, so this read only ends
+        // with the connection
+        uint8_t byte;
+        socket.read(&byte, sizeof(byte));
+        throw std::runtime_error("Received data after the end of stream");
+      } catch (const asio::system_error &e) {
+        if (ctx.should_abort()) {
+          throw;
+        }
+        {
+          std::lock_guard<std::mutex> lock(acknowledgement_mutex_);
+          if (end_received && last_acknowledgement_ == num_chunks) {
+            break;
+          }
+        }
+        LOG("connection lost after " + std::to_string(chunks_received) +
+            " chunks: " + e.what());
+
+        // Fails an acknowledgement write that is blocked on the lost
+        // connection, so that the lock is free
+        socket.shutdown();
+        std::lock_guard<std::mutex> lock(acknowledgement_mutex_);
+        accept_reconnect_(chunks_received);
+        last_acknowledgement_.reset();
+        receive_stats_.reconnects++;
+        frame_reader.discard_buffered();
+      }
+    }
+  } catch (...) {
+    stop_acknowledgements();
+    throw;
   }
+  stop_acknowledgements();
+}
 
-  output_done.store(true);
+// Sends the number of chunks written whenever it has changed, waiting up to
+// ACKNOWLEDGEMENT_INTERVAL in between. The last chunk is only acknowledged
+// once the end of stream frame has arrived too, since the sender stops
+// recovering the connection after that. A failed write is left to the
+// receiving thread, which replaces the connection and has the count sent
+// again
+void TransferManager::send_acknowledgements(TcpSocket &socket,
+                                            uint32_t num_chunks) {
+  std::unique_lock<std::mutex> lock(acknowledgement_mutex_);
+  while (!acknowledgements_stopped_) {
+    acknowledgement_changed_.wait_for(lock, ACKNOWLEDGEMENT_INTERVAL);
+    uint32_t chunks_written = chunks_written_->load();
+    if (num_chunks > 0 && chunks_written == num_chunks &&
+        !end_received_) {
+      --chunks_written;
+    }
+    if (acknowledgements_stopped_ || last_acknowledgement_ == chunks_written) {
+      continue;
+    }
+    Acknowledgement acknowledgement;
+    acknowledgement.chunks_written = chunks_written;
+    std::array<uint8_t, Acknowledgement::SIZE> buffer;
+    acknowledgement.encode(buffer.data());
+    try {
+      socket.write(buffer.data(), buffer.size());
+      last_acknowledgement_ = chunks_written;
+    } catch (const asio::system_error &) {
+      // Retried on the next pass, on the replacement connection if need be
+    }
+  }
+}
+
+void TransferManager::receive_stream(WorkerContext &ctx, TcpSocket &socket,
+                                     ChunkPool &chunk_pool,
+                                     ReorderBuffer &reorder_buffer,
+                                     uint32_t num_chunks) {
+
+  FrameReader frame_reader(socket);
+  while (!ctx.should_abort()) {
+    ChunkPtr chunk_ptr = read_frame(frame_reader, chunk_pool);
+    if (!chunk_ptr) {
+      return;
+    }
+    // A sequence number past the end would block the reorder buffer forever
+    if (chunk_ptr->sequence_num() > num_chunks) {
+      throw std::runtime_error(
+          "Received chunk #" + std::to_string(chunk_ptr->sequence_num()) +
+          " of a transfer with " + std::to_string(num_chunks) + " chunks");
+    }
+    if (!reorder_buffer.insert(std::move(chunk_ptr))) {
+      return;
+    }
+  }
+}
+
+ChunkPtr TransferManager::read_frame(FrameReader &frame_reader,
+                                     ChunkPool &chunk_pool) {
+  ChunkPtr chunk_ptr = frame_reader.read_frame(chunk_pool);
+  if (chunk_ptr) {
+    receive_stats_.frames++;
+  }
+  receive_stats_.read_calls = frame_reader.read_calls();
+  receive_stats_.bytes = frame_reader.bytes_read();
+  return chunk_ptr;
 }
\ No newline at end of file
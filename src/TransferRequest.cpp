@@ -2,18 +2,26 @@
 #include "TransferRequest.h"
 #include "utils.h"
 
+#include <algorithm>
+
 TransferRequest::TransferRequest(uint32_t num_files, uint64_t transfer_size,
                                  uint32_t uncompressed_chunk_size,
                                  uint32_t uncompressed_final_chunk_size,
-                                 uint32_t num_chunks,
+                                 uint32_t num_chunks, bool compression_enabled,
+                                 uint8_t num_streams, bool resumable,
+                                 bool udp_transport,
                                  std::vector<FileInfo> file_infos)
     : num_files_(num_files), transfer_size_(transfer_size),
       uncompressed_chunk_size_(uncompressed_chunk_size),
       uncompressed_final_chunk_size_(uncompressed_final_chunk_size),
-      num_chunks_(num_chunks), file_infos_(file_infos) {};
+      num_chunks_(num_chunks), compression_enabled_(compression_enabled),
+      num_streams_(num_streams), resumable_(resumable),
+      udp_transport_(udp_transport), file_infos_(file_infos) {};
 
 TransferRequest TransferRequest::from_file_paths(
-    const std::unordered_set<std::filesystem::path> &file_paths) {
+    const std::unordered_set<std::filesystem::path> &file_paths,
+    bool compression_enabled, uint32_t chunk_size, uint8_t num_streams,
+    bool resumable, bool udp_transport) {
 
   const uint32_t num_files = file_paths.size();
 
@@ -42,11 +50,19 @@ TransferRequest TransferRequest::from_file_paths(
                              "transfer would be 0 bytes");
   }
 
-  // If total size is less than the max chunk size, use the total transfer size
-  // so that the transfer is exactly one chunk Otherwise, use the max chunk
-  // size, and the transfer will be divided into multiple chunks
-  uint32_t uncompressed_chunk_size = std::min(
-      transfer_size, static_cast<uint64_t>(utils::MAX_UNCOMPRESSED_CHUNK_SIZE));
+  if (chunk_size == 0) {
+    chunk_size = choose_chunk_size(file_infos);
+  } else if (chunk_size < MIN_CHUNK_SIZE || chunk_size > MAX_CHUNK_SIZE) {
+    throw std::runtime_error(
+        "Chunk size must be between " + std::to_string(MIN_CHUNK_SIZE) +
+        " and " + std::to_string(MAX_CHUNK_SIZE) + " bytes");
+  }
+
+  // If total size is less than the chunk size, use the total transfer size
+  // so that the transfer is exactly one chunk. Otherwise, the transfer will
+  // be divided into multiple chunks
+  uint32_t uncompressed_chunk_size =
+      std::min(transfer_size, static_cast<uint64_t>(chunk_size));
 
   // Last chunk contains remaining data, which is variable
   uint32_t uncompressed_last_chunk_size =
@@ -58,7 +74,94 @@ TransferRequest TransferRequest::from_file_paths(
       (transfer_size + (uncompressed_chunk_size - 1)) / uncompressed_chunk_size;
 
   return TransferRequest(num_files, transfer_size, uncompressed_chunk_size,
-                         uncompressed_last_chunk_size, num_chunks, file_infos);
+                         uncompressed_last_chunk_size, num_chunks,
+                         compression_enabled, num_streams, resumable,
+                         udp_transport, file_infos);
+}
+
+/*
+    Larger chunks cut the per-chunk cost (frame header, MAC, queue hops) but
+    the transfer should still be split into enough chunks to keep every
+    pipeline stage and worker busy. Chunks also should not be much larger
+    than the files holding most of the data, otherwise each chunk mixes many
+    files, which blurs the per-file compression bypass
+*/
+uint32_t
+TransferRequest::choose_chunk_size(const std::vector<FileInfo> &file_infos) {
+  constexpr uint64_t TARGET_NUM_CHUNKS = 256;
+  constexpr uint64_t TARGET_CHUNKS_PER_FILE = 4;
+
+  std::vector<uint64_t> file_sizes;
+  uint64_t transfer_size = 0;
+  for (const auto &file_info : file_infos) {
+    file_sizes.push_back(file_info.size);
+    transfer_size += file_info.size;
+  }
+
+  // Byte weighted median: half of the data is in files at least this large
+  std::sort(file_sizes.begin(), file_sizes.end());
+  uint64_t typical_file_size = 0;
+  uint64_t bytes_seen = 0;
+  for (uint64_t file_size : file_sizes) {
+    bytes_seen += file_size;
+    if (bytes_seen * 2 >= transfer_size) {
+      typical_file_size = file_size;
+      break;
+    }
+  }
+
+  const uint64_t target_size =
+      std::min(transfer_size / TARGET_NUM_CHUNKS,
+               typical_file_size / TARGET_CHUNKS_PER_FILE);
+
+  uint64_t chunk_size = MIN_CHUNK_SIZE;
+  while (chunk_size * 2 <= target_size && chunk_size < MAX_CHUNK_SIZE) {
+    chunk_size *= 2;
+  }
+  return static_cast<uint32_t>(chunk_size);
+}
+
+void TransferRequest::validate() const {
+  if (num_streams_ == 0 || num_streams_ > MAX_STREAMS) {
+    throw std::runtime_error("Transfer request has invalid stream count of " +
+                             std::to_string(num_streams_));
+  }
+
+  // Only a single connection's frames can be resumed from one position
+  if (resumable_ && num_streams_ > 1) {
+    throw std::runtime_error(
+        "Transfer request asks to resume a striped transfer");
+  }
+
+  // The UDP transport replaces the connections, and recovers lost datagrams
+  // on its own
+  if (udp_transport_ && (num_streams_ > 1 || resumable_)) {
+    throw std::runtime_error("Transfer request asks for UDP transport of a "
+                             "striped or resumable transfer");
+  }
+
+  if (uncompressed_chunk_size_ == 0 ||
+      uncompressed_chunk_size_ > MAX_CHUNK_SIZE) {
+    throw std::runtime_error("Transfer request has invalid chunk size of " +
+                             std::to_string(uncompressed_chunk_size_) +
+                             " bytes");
+  }
+
+  uint64_t file_sizes_total = 0;
+  for (const auto &file_info : file_infos_) {
+    file_sizes_total += file_info.size;
+  }
+  const uint64_t expected_num_chunks =
+      (transfer_size_ + (uncompressed_chunk_size_ - 1)) /
+      uncompressed_chunk_size_;
+
+  if (file_infos_.size() != num_files_ || file_sizes_total != transfer_size_ ||
+      num_chunks_ != expected_num_chunks ||
+      uncompressed_final_chunk_size_ !=
+          transfer_size_ % uncompressed_chunk_size_) {
+    throw std::runtime_error("Transfer request chunk layout does not match "
+                             "its file sizes");
+  }
 }
 
 /*
@@ -70,6 +173,8 @@ TransferRequest TransferRequest::from_file_paths(
     uncompressed chunk size [4 bytes]
     uncompressed last chunk size [4 bytes]
     num chunks [4 bytes]
+    flags [1 byte]
+    num streams [1 byte]
     file1 path length [2 bytes]
     file1 path [variable]
     file1 size [8 bytes]
@@ -102,6 +207,12 @@ TransferRequest::deserialize(const std::vector<uint8_t> &buffer) {
   uint32_t num_chunks;
   it = utils::deserialize(it, end, num_chunks);
 
+  uint8_t flags;
+  it = utils::deserialize(it, end, flags);
+
+  uint8_t num_streams;
+  it = utils::deserialize(it, end, num_streams);
+
   // Serialize file size and generic path strings
   std::vector<FileInfo> file_infos;
   for (uint32_t i = 0; i < num_files; ++i) {
@@ -117,8 +228,14 @@ TransferRequest::deserialize(const std::vector<uint8_t> &buffer) {
     file_infos.emplace_back(path, size);
   }
 
-  return TransferRequest(num_files, transfer_size, uncompressed_chunk_size,
-                         uncompressed_last_chunk_size, num_chunks, file_infos);
+  TransferRequest transfer_request(
+      num_files, transfer_size, uncompressed_chunk_size,
+      uncompressed_last_chunk_size, num_chunks,
+      (flags & FLAG_COMPRESSION) != 0, num_streams,
+      (flags & FLAG_RESUMABLE) != 0, (flags & FLAG_UDP_TRANSPORT) != 0,
+      file_infos);
+  transfer_request.validate();
+  return transfer_request;
 }
 
 /*
@@ -130,6 +247,8 @@ TransferRequest::deserialize(const std::vector<uint8_t> &buffer) {
     [4 bytes] uncompressed chunk size
     [4 bytes] uncompressed last chunk size
     [4 bytes] num chunks
+    [1 byte] flags
+    [1 byte] num streams
     [2 bytes] file1 path length
     [variable] file1 path
     [8 bytes] file1 size
@@ -152,6 +271,12 @@ std::vector<uint8_t> TransferRequest::serialize() const {
   utils::serialize(uncompressed_final_chunk_size_, transfer_request_buffer);
   utils::serialize(num_chunks_, transfer_request_buffer);
 
+  uint8_t flags = (compression_enabled_ ? FLAG_COMPRESSION : 0) |
+                  (resumable_ ? FLAG_RESUMABLE : 0) |
+                  (udp_transport_ ? FLAG_UDP_TRANSPORT : 0);
+  utils::serialize(flags, transfer_request_buffer);
+  utils::serialize(num_streams_, transfer_request_buffer);
+
   // Serialize file size and generic path strings
   for (const auto &file_info : file_infos_) {
     if (file_info.relative_path.size() >
@@ -197,6 +322,12 @@ void TransferRequest::print() const {
   std::cout << "Uncompressed last chunk size: "
             << uncompressed_final_chunk_size_ << " bytes\n";
   std::cout << "Number of chunks: " << num_chunks_ << "\n";
+  std::cout << "Compression: " << (compression_enabled_ ? "on" : "off")
+            << "\n";
+  std::cout << "Connections: " << static_cast<int>(num_streams_) << "\n";
+  std::cout << "Resume on connection loss: " << (resumable_ ? "on" : "off")
+            << "\n";
+  std::cout << "Transport: " << (udp_transport_ ? "UDP" : "TCP") << "\n";
 
   for (const auto &file_info : file_infos_) {
     std::cout << "\t" << file_info.relative_path << " ("
@@ -216,4 +347,16 @@ uint32_t TransferRequest::get_final_chunk_size() const {
   return uncompressed_final_chunk_size_;
 }
 
-uint32_t TransferRequest::get_num_chunks() const { return num_chunks_; }
\ No newline at end of file
+uint32_t TransferRequest::get_num_chunks() const { return num_chunks_; }
+
+uint64_t TransferRequest::get_transfer_size() const { return transfer_size_; }
+
+bool TransferRequest::compression_enabled() const {
+  return compression_enabled_;
+}
+
+uint8_t TransferRequest::get_num_streams() const { return num_streams_; }
+
+bool TransferRequest::resumable() const { return resumable_; }
+
+bool TransferRequest::udp_transport() const { return udp_transport_; }
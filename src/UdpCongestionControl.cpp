@@ -0,0 +1,192 @@
+#include "UdpCongestionControl.h"
+
+#include <algorithm>
+#include <sstream>
+
+#include "utils.h"
+
+namespace {
+
+constexpr double INITIAL_RATE = 1024 * 1024;
+constexpr double MIN_RATE = 64 * 1024;
+constexpr double MAX_RATE = 10e9;
+
+// Share of a round's datagrams that may be lost without it counting as
+// congested while the round trip time has not risen, and the share that
+// counts as congested regardless
+constexpr double LOSS_TOLERANCE = 0.02;
+constexpr double HEAVY_LOSS = 0.2;
+
+// A round trip time this much above the lowest seen means a queue is
+// building up on the path. Smaller rises are taken as the receiver's delayed
+// acknowledgements and scheduling noise, which on a path of a few
+// microseconds such as loopback are many times the round trip time itself
+constexpr double RTT_INFLATION = 1.25;
+constexpr std::chrono::microseconds MIN_QUEUE_DELAY(2'000);
+
+constexpr double GROWTH = 1.0 / 16;
+constexpr double MIN_DECREASE = 1.0 / 8;
+constexpr double MAX_DECREASE = 1.0 / 2;
+
+// Bytes in flight are allowed to cover this many round trips at the rate,
+// but never fewer than MIN_WINDOW_DATAGRAMS
+constexpr double WINDOW_ROUND_TRIPS = 2;
+constexpr std::size_t MIN_WINDOW_DATAGRAMS = 32;
+constexpr std::size_t PACING_BURST_DATAGRAMS = 16;
+
+// Bounds of rounds and timeouts, so that a loopback round trip time of a
+// few microseconds does not turn every acknowledgement into a round
+constexpr std::chrono::microseconds INITIAL_RTT(100'000);
+constexpr std::chrono::microseconds MIN_ROUND(1'000);
+constexpr std::chrono::microseconds MIN_TIMEOUT(20'000);
+
+// A round also waits for this many datagrams to be reported, so that the
+// share lost is not just the noise of a handful of them
+constexpr std::size_t MIN_ROUND_DATAGRAMS = 64;
+constexpr std::chrono::microseconds MAX_TIMEOUT(2'000'000);
+
+} // namespace
+
+UdpCongestionControl::UdpCongestionControl(std::size_t datagram_size)
+    : datagram_size_(datagram_size), rate_(INITIAL_RATE) {
+  next_send_time_ = std::chrono::steady_clock::now();
+  round_start_ = next_send_time_;
+}
+
+uint64_t UdpCongestionControl::rate() const {
+  return static_cast<uint64_t>(rate_);
+}
+
+std::size_t UdpCongestionControl::window() const {
+  const double round_trip =
+      std::chrono::duration<double>(round_duration()).count();
+  return std::max(static_cast<std::size_t>(WINDOW_ROUND_TRIPS * rate_ *
+                                           round_trip),
+                  MIN_WINDOW_DATAGRAMS * datagram_size_);
+}
+
+std::chrono::microseconds UdpCongestionControl::smoothed_rtt() const {
+  return smoothed_rtt_.value_or(INITIAL_RTT);
+}
+
+std::chrono::microseconds
+UdpCongestionControl::retransmission_timeout() const {
+  if (!smoothed_rtt_) {
+    return std::clamp(3 * INITIAL_RTT, MIN_TIMEOUT, MAX_TIMEOUT);
+  }
+  return std::clamp(*smoothed_rtt_ + 4 * rtt_variation_ + MIN_ROUND,
+                    MIN_TIMEOUT, MAX_TIMEOUT);
+}
+
+std::chrono::steady_clock::time_point
+UdpCongestionControl::next_send_time() const {
+  return next_send_time_;
+}
+
+void UdpCongestionControl::on_sent(std::size_t bytes,
+                                   std::chrono::steady_clock::time_point now) {
+  const auto burst = std::chrono::duration_cast<
+      std::chrono::steady_clock::duration>(std::chrono::duration<double>(
+      static_cast<double>(PACING_BURST_DATAGRAMS * datagram_size_) / rate_));
+  const auto interval =
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(static_cast<double>(bytes) / rate_));
+  next_send_time_ = std::max(next_send_time_, now - burst) + interval;
+}
+
+void UdpCongestionControl::on_acknowledged(
+    std::size_t datagrams, std::size_t bytes,
+    std::optional<std::chrono::microseconds> rtt,
+    std::chrono::steady_clock::time_point now) {
+  if (rtt) {
+    if (!smoothed_rtt_) {
+      smoothed_rtt_ = *rtt;
+      rtt_variation_ = *rtt / 2;
+    } else {
+      const auto deviation = *smoothed_rtt_ > *rtt ? *smoothed_rtt_ - *rtt
+                                                   : *rtt - *smoothed_rtt_;
+      rtt_variation_ = (3 * rtt_variation_ + deviation) / 4;
+      smoothed_rtt_ = (7 * *smoothed_rtt_ + *rtt) / 8;
+    }
+    min_rtt_ = std::min(min_rtt_.value_or(*rtt), *rtt);
+    round_min_rtt_ = std::min(round_min_rtt_.value_or(*rtt), *rtt);
+  }
+  round_acknowledged_ += datagrams;
+  round_bytes_ += bytes;
+  end_round_if_due(now);
+}
+
+void UdpCongestionControl::on_lost(std::size_t datagrams,
+                                   std::chrono::steady_clock::time_point now) {
+  round_lost_ += datagrams;
+  end_round_if_due(now);
+}
+
+void UdpCongestionControl::on_timeout(
+    std::chrono::steady_clock::time_point now) {
+  rate_ = std::max(MIN_RATE, rate_ / 2);
+  slow_start_ = false;
+  round_start_ = now;
+  round_acknowledged_ = 0;
+  round_lost_ = 0;
+  round_bytes_ = 0;
+  round_min_rtt_.reset();
+}
+
+std::string UdpCongestionControl::describe() const {
+  std::ostringstream description;
+  description << "rate " << utils::format_data_size(rate()) << "/s, window "
+              << utils::format_data_size(window()) << ", srtt "
+              << smoothed_rtt().count() << "us";
+  if (min_rtt_) {
+    description << ", min rtt " << min_rtt_->count() << "us";
+  }
+  return description.str();
+}
+
+void UdpCongestionControl::end_round_if_due(
+    std::chrono::steady_clock::time_point now) {
+  const auto elapsed = now - round_start_;
+  const std::size_t reported = round_acknowledged_ + round_lost_;
+  if (elapsed < round_duration() || reported < MIN_ROUND_DATAGRAMS) {
+    return;
+  }
+
+  const double loss = static_cast<double>(round_lost_) / reported;
+  const bool rtt_inflated =
+      round_min_rtt_ && min_rtt_ &&
+      *round_min_rtt_ > *min_rtt_ + MIN_QUEUE_DELAY &&
+      static_cast<double>(round_min_rtt_->count()) >
+          RTT_INFLATION * static_cast<double>(min_rtt_->count());
+  const bool congested =
+      loss > HEAVY_LOSS || (loss > LOSS_TOLERANCE && rtt_inflated);
+
+  if (congested) {
+    rate_ *= 1 - std::clamp(loss, MIN_DECREASE, MAX_DECREASE);
+    slow_start_ = false;
+  } else if (slow_start_) {
+    rate_ *= 2;
+  } else {
+    const double round_trip =
+        std::chrono::duration<double>(round_duration()).count();
+    rate_ += std::max(rate_ * GROWTH,
+                      static_cast<double>(datagram_size_) / round_trip);
+  }
+
+  // The rate may only run ahead of what the path delivers by so much
+  const double delivered =
+      static_cast<double>(round_bytes_) /
+      std::chrono::duration<double>(elapsed).count();
+  rate_ = std::clamp(std::min(rate_, std::max(2 * delivered, MIN_RATE)),
+                     MIN_RATE, MAX_RATE);
+
+  round_start_ = now;
+  round_acknowledged_ = 0;
+  round_lost_ = 0;
+  round_bytes_ = 0;
+  round_min_rtt_.reset();
+}
+
+std::chrono::microseconds UdpCongestionControl::round_duration() const {
+  return std::max(smoothed_rtt(), MIN_ROUND);
+}
@@ -0,0 +1,169 @@
+#include "UdpSocket.h"
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+
+namespace {
+
+// Buffer sizes asked for unless the options set them. The kernel defaults
+// of a few hundred KiB overflow at the packet rates of a fast link
+constexpr std::size_t DEFAULT_BUFFER_SIZE = 4 * 1024 * 1024;
+
+// Longest wait for room in the send buffer before giving up on a datagram
+constexpr std::chrono::seconds SEND_TIMEOUT(5);
+
+} // namespace
+
+UdpSocket::UdpSocket(IoEngine &engine)
+    : strand_(asio::make_strand(engine.context())), socket_(strand_),
+      loss_generator_(std::random_device{}()) {}
+
+UdpSocket::~UdpSocket() {
+  asio::error_code ec;
+  socket_.close(ec);
+}
+
+void UdpSocket::bind(uint16_t port) {
+  open();
+  socket_.bind(asio::ip::udp::endpoint(asio::ip::udp::v4(), port));
+}
+
+uint16_t UdpSocket::local_port() const {
+  return socket_.local_endpoint().port();
+}
+
+void UdpSocket::connect(const std::string &ip, uint16_t port) {
+  open();
+  socket_.connect(asio::ip::udp::endpoint(asio::ip::make_address(ip), port));
+}
+
+void UdpSocket::connect_to_last_sender() { socket_.connect(last_sender_); }
+
+std::string UdpSocket::last_sender_address() const {
+  return last_sender_.address().to_string();
+}
+
+void UdpSocket::set_options(const SocketOptions &options) {
+  options_ = options;
+  loss_distribution_ = std::bernoulli_distribution(
+      std::clamp(options_.datagram_loss_rate, 0.0, 1.0));
+  if (socket_.is_open()) {
+    apply_options();
+  }
+}
+
+void UdpSocket::send(const std::vector<asio::const_buffer> &buffers) {
+  if (options_.datagram_loss_rate > 0 &&
+      loss_distribution_(loss_generator_)) {
+    ++datagrams_dropped_;
+    return;
+  }
+  while (true) {
+    asio::error_code ec;
+    socket_.send(buffers, 0, ec);
+    if (ec == asio::error::would_block || ec == asio::error::try_again) {
+      if (!wait(asio::ip::udp::socket::wait_write, SEND_TIMEOUT)) {
+        throw asio::system_error(asio::error::timed_out);
+      }
+      continue;
+    }
+    // An earlier datagram was refused by the peer's host. Delivery is up to
+    // the transport, which notices when the peer stays silent
+    if (ec && ec != asio::error::connection_refused) {
+      throw asio::system_error(ec);
+    }
+    return;
+  }
+}
+
+void UdpSocket::send(const void *buf, std::size_t len) {
+  send(std::vector<asio::const_buffer>{asio::buffer(buf, len)});
+}
+
+std::optional<std::size_t>
+UdpSocket::receive(void *buf, std::size_t len,
+                   std::chrono::steady_clock::duration timeout) {
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (true) {
+    asio::error_code ec;
+    const std::size_t size =
+        socket_.receive_from(asio::buffer(buf, len), last_sender_, 0, ec);
+    if (!ec || ec == asio::error::message_size) {
+      return std::min(size, len);
+    }
+    if (ec != asio::error::would_block && ec != asio::error::try_again &&
+        ec != asio::error::connection_refused) {
+      throw asio::system_error(ec);
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    if (now >= deadline ||
+        !wait(asio::ip::udp::socket::wait_read, deadline - now)) {
+      return std::nullopt;
+    }
+  }
+}
+
+uint64_t UdpSocket::datagrams_dropped() const { return datagrams_dropped_; }
+
+// Non-blocking, so that send() and receive() only go through the engine to
+// wait
+void UdpSocket::open() {
+  if (!socket_.is_open()) {
+    socket_.open(asio::ip::udp::v4());
+    socket_.non_blocking(true);
+    apply_options();
+  }
+}
+
+void UdpSocket::apply_options() {
+  auto buffer_size = [](std::optional<std::size_t> size) {
+    return static_cast<int>(std::min<std::size_t>(
+        size.value_or(DEFAULT_BUFFER_SIZE),
+        static_cast<std::size_t>(std::numeric_limits<int>::max())));
+  };
+
+  asio::error_code ec;
+  socket_.set_option(asio::socket_base::send_buffer_size(
+                         buffer_size(options_.send_buffer_size)),
+                     ec);
+  socket_.set_option(asio::socket_base::receive_buffer_size(
+                         buffer_size(options_.receive_buffer_size)),
+                     ec);
+}
+
+// The timer cancels the wait, and its state is shared with the handler,
+// which may still be queued when the wait completes first. A timer that
+// expired just as the wait completed must not cancel the next wait, which
+// is why the handler marks the wait done
+bool UdpSocket::wait(asio::ip::udp::socket::wait_type type,
+                     std::chrono::steady_clock::duration timeout) {
+  auto timer = std::make_shared<asio::steady_timer>(strand_);
+  auto timed_out = std::make_shared<bool>(false);
+  auto done = std::make_shared<bool>(false);
+  try {
+    IoEngine::wait_for(strand_, [&](auto handler) {
+      timer->expires_after(timeout);
+      timer->async_wait([this, timed_out, done](const asio::error_code &ec) {
+        if (!ec && !*done) {
+          *timed_out = true;
+          asio::error_code cancel_ec;
+          socket_.cancel(cancel_ec);
+        }
+      });
+      socket_.async_wait(
+          type, [handler, timer, done](const asio::error_code &ec) {
+            *done = true;
+            timer->cancel();
+            handler(ec, 0);
+          });
+    });
+  } catch (const asio::system_error &) {
+    if (*timed_out) {
+      return false;
+    }
+    throw;
+  }
+  return true;
+}
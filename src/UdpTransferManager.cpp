@@ -0,0 +1,677 @@
+#include "UdpTransferManager.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+
+#include "utils.h"
+
+namespace {
+
+constexpr std::chrono::seconds HANDSHAKE_TIMEOUT(10);
+constexpr std::chrono::milliseconds HELLO_INTERVAL(200);
+
+// A peer silent for this long is taken as gone
+constexpr std::chrono::seconds IDLE_TIMEOUT(30);
+
+// Once every chunk has been passed on, the receiver keeps acknowledging
+// resent datagrams until the finish datagram or this much silence
+constexpr std::chrono::seconds LINGER_TIMEOUT(2);
+constexpr int FINISH_REPEATS = 3;
+
+// Frame bytes both sides hold in flight, in whole chunks
+constexpr std::size_t WINDOW_BYTES = 64 * 1024 * 1024;
+constexpr std::size_t MIN_WINDOW_CHUNKS = 4;
+constexpr std::size_t MAX_WINDOW_CHUNKS = 1024;
+
+// A datagram is taken as lost once this many later ones were acknowledged,
+// which tolerates a little reordering on the path
+constexpr uint64_t REORDER_THRESHOLD = 3;
+
+// The receiver acknowledges every ACK_EVERY datagrams, and no later than
+// ACK_DELAY after the first one not yet acknowledged
+constexpr std::size_t ACK_EVERY = 16;
+constexpr std::chrono::microseconds ACK_DELAY(1'000);
+
+// Ranges of packet numbers the receiver remembers, the newest of which go
+// into each acknowledgement
+constexpr std::size_t TRACKED_RANGES = 1024;
+
+// Longest the sender waits for acknowledgements while it has nothing to
+// send, which is also how often it looks for new chunks
+constexpr std::chrono::milliseconds SEND_POLL_INTERVAL(1);
+constexpr std::chrono::milliseconds RECEIVE_POLL_INTERVAL(50);
+
+std::size_t parts_in_frame(std::size_t frame_size) {
+  return (frame_size + DataDatagramHeader::PAYLOAD_SIZE - 1) /
+         DataDatagramHeader::PAYLOAD_SIZE;
+}
+
+} // namespace
+
+UdpTransferManager::UdpTransferManager(UdpSocket &socket,
+                                       RateLimiter *rate_limiter)
+    : socket_(socket), rate_limiter_(rate_limiter),
+      congestion_control_(MAX_DATAGRAM_SIZE) {}
+
+std::size_t UdpTransferManager::window_chunks(std::size_t chunk_size) {
+  return std::clamp(WINDOW_BYTES / std::max<std::size_t>(chunk_size, 1),
+                    MIN_WINDOW_CHUNKS, MAX_WINDOW_CHUNKS);
+}
+
+void UdpTransferManager::connect(
+    WorkerContext &ctx,
+    const std::array<uint8_t, crypto::DATAGRAM_TOKEN_SIZE> &token) {
+  std::array<uint8_t, 1 + crypto::DATAGRAM_TOKEN_SIZE> hello;
+  hello[0] = static_cast<uint8_t>(DatagramType::HELLO);
+  std::copy(token.begin(), token.end(), hello.begin() + 1);
+
+  const auto deadline = std::chrono::steady_clock::now() + HANDSHAKE_TIMEOUT;
+  while (!ctx.should_abort() && std::chrono::steady_clock::now() < deadline) {
+    socket_.send(hello.data(), hello.size());
+    std::optional<std::size_t> size =
+        socket_.receive(datagram_.data(), datagram_.size(), HELLO_INTERVAL);
+    if (size && *size > 0 &&
+        datagram_[0] == static_cast<uint8_t>(DatagramType::ACK)) {
+      return;
+    }
+  }
+  if (!ctx.should_abort()) {
+    throw std::runtime_error("Receiver did not answer over UDP within " +
+                             std::to_string(HANDSHAKE_TIMEOUT.count()) +
+                             " seconds");
+  }
+}
+
+void UdpTransferManager::accept(
+    WorkerContext &ctx,
+    const std::function<
+        bool(const std::array<uint8_t, crypto::DATAGRAM_TOKEN_SIZE> &)>
+        &verify) {
+  const auto deadline = std::chrono::steady_clock::now() + HANDSHAKE_TIMEOUT;
+  while (!ctx.should_abort()) {
+    const auto now = std::chrono::steady_clock::now();
+    if (now >= deadline) {
+      throw std::runtime_error("Sender did not open the UDP transport within " +
+                               std::to_string(HANDSHAKE_TIMEOUT.count()) +
+                               " seconds");
+    }
+    std::optional<std::size_t> size = socket_.receive(
+        datagram_.data(), datagram_.size(),
+        std::min<std::chrono::steady_clock::duration>(deadline - now,
+                                                      RECEIVE_POLL_INTERVAL));
+    if (!size) {
+      continue;
+    }
+
+    std::array<uint8_t, crypto::DATAGRAM_TOKEN_SIZE> token;
+    if (*size != 1 + token.size() ||
+        datagram_[0] != static_cast<uint8_t>(DatagramType::HELLO)) {
+      LOG("dropped datagram from " + socket_.last_sender_address());
+      continue;
+    }
+    std::copy(datagram_.begin() + 1, datagram_.begin() + 1 + token.size(),
+              token.begin());
+    if (!verify(token)) {
+      LOG("dropped unauthenticated datagram from " +
+          socket_.last_sender_address());
+      continue;
+    }
+    socket_.connect_to_last_sender();
+    send_acknowledgement();
+    LOG("UDP transport opened by " + socket_.last_sender_address());
+    return;
+  }
+}
+
+// Runs as one loop that reads acknowledgements, takes new chunks while the
+// receiver's window has room, and sends parts of frames as fast as the
+// congestion window and pacing allow, lost parts first
+void UdpTransferManager::send_chunks(WorkerContext &ctx,
+                                     ChunkQueue &input_queue,
+                                     std::size_t chunk_size,
+                                     std::atomic<uint32_t> &chunks_sent) {
+  const std::size_t window = window_chunks(chunk_size);
+  bool input_closed = false;
+  last_acknowledgement_ = std::chrono::steady_clock::now();
+
+  while (!ctx.should_abort()) {
+    while (!input_closed &&
+           next_sequence_num_ < receiver_next_sequence_num_ + window) {
+      std::optional<ChunkPtr> chunk_ptr_opt = input_queue.try_pop();
+      if (!chunk_ptr_opt && input_queue.closed()) {
+        // The final chunk may have been pushed right before closing
+        chunk_ptr_opt = input_queue.try_pop();
+        input_closed = !chunk_ptr_opt;
+      }
+      if (!chunk_ptr_opt) {
+        break;
+      }
+      ChunkPtr chunk_ptr = std::move(*chunk_ptr_opt);
+      if (chunk_ptr->sequence_num() != next_sequence_num_) {
+        throw std::logic_error("UDP transport got chunk #" +
+                               std::to_string(chunk_ptr->sequence_num()) +
+                               " out of order");
+      }
+
+      FrameHeader header;
+      header.sequence_num = chunk_ptr->sequence_num();
+      header.compressed = chunk_ptr->compressed();
+      header.original_size = chunk_ptr->original_size();
+      header.chunk_size = chunk_ptr->size();
+      header.encode(chunk_ptr->push_front(FrameHeader::SIZE));
+
+      OutstandingChunk outstanding;
+      outstanding.parts_left = parts_in_frame(chunk_ptr->size());
+      outstanding.acknowledged.assign(outstanding.parts_left, false);
+      outstanding.chunk_ptr = std::move(chunk_ptr);
+      outstanding_.push_back(std::move(outstanding));
+      ++next_sequence_num_;
+    }
+
+    // Chunks the receiver has passed on need no acknowledgement of their
+    // parts, which may have been lost along with the acknowledgements
+    while (!outstanding_.empty() &&
+           (outstanding_.front().parts_left == 0 ||
+            outstanding_.front().chunk_ptr->sequence_num() <
+                receiver_next_sequence_num_)) {
+      outstanding_.pop_front();
+      chunks_sent++;
+    }
+    if (input_closed && outstanding_.empty()) {
+      break;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    detect_timeouts(now);
+    if (!in_flight_.empty() && now - last_acknowledgement_ > IDLE_TIMEOUT) {
+      throw std::runtime_error("Receiver stopped acknowledging datagrams for " +
+                               std::to_string(IDLE_TIMEOUT.count()) +
+                               " seconds");
+    }
+
+    auto window_open = [&]() {
+      return bytes_in_flight_ + MAX_DATAGRAM_SIZE <=
+             congestion_control_.window();
+    };
+    Part part;
+    bool resent = false;
+    while (window_open() && congestion_control_.next_send_time() <= now &&
+           next_part_to_send(part, resent)) {
+      if (!send_part(ctx, part, resent, now)) {
+        return;
+      }
+      now = std::chrono::steady_clock::now();
+    }
+
+    // Only pacing holds back a part that is ready, so the wait ends when it
+    // allows the next one
+    std::chrono::steady_clock::duration timeout = SEND_POLL_INTERVAL;
+    if (window_open() && has_part_to_send()) {
+      timeout = std::clamp<std::chrono::steady_clock::duration>(
+          congestion_control_.next_send_time() - now,
+          std::chrono::steady_clock::duration::zero(), SEND_POLL_INTERVAL);
+    }
+    read_acknowledgements(timeout);
+  }
+
+  if (!ctx.should_abort()) {
+    send_finish();
+  }
+}
+
+void UdpTransferManager::receive_chunks(WorkerContext &ctx,
+                                        ChunkPool &chunk_pool,
+                                        ChunkQueue &output_queue,
+                                        std::size_t chunk_size,
+                                        uint32_t num_chunks) {
+  const std::size_t window = window_chunks(chunk_size);
+  const std::size_t max_frame_size =
+      FrameHeader::SIZE + chunk_size + crypto::ENCRYPTION_ADDITIONAL_BYTES;
+  auto last_datagram = std::chrono::steady_clock::now();
+  bool all_passed_on = false;
+  bool finished = false;
+
+  while (!ctx.should_abort()) {
+    // Reassembled chunks wait here while the next stage is behind, rather
+    // than blocking the acknowledgements
+    while (!reassemblies_.empty() && reassemblies_.front().chunk_ptr &&
+           reassemblies_.front().parts_left == 0 && !output_queue.full()) {
+      if (!output_queue.push(std::move(reassemblies_.front().chunk_ptr))) {
+        return;
+      }
+      reassemblies_.pop_front();
+      ++first_missing_;
+    }
+    if (!all_passed_on && first_missing_ > num_chunks) {
+      output_queue.close();
+      all_passed_on = true;
+      send_acknowledgement();
+    }
+    if (all_passed_on && finished) {
+      break;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    if (unacknowledged_datagrams_ >= ACK_EVERY ||
+        (unacknowledged_datagrams_ > 0 && now >= acknowledgement_due_)) {
+      send_acknowledgement();
+    }
+
+    std::chrono::steady_clock::duration timeout = RECEIVE_POLL_INTERVAL;
+    if (unacknowledged_datagrams_ > 0) {
+      timeout = std::max<std::chrono::steady_clock::duration>(
+          acknowledgement_due_ - now,
+          std::chrono::steady_clock::duration::zero());
+    } else if (!reassemblies_.empty() && reassemblies_.front().chunk_ptr &&
+               reassemblies_.front().parts_left == 0) {
+      timeout = SEND_POLL_INTERVAL;
+    }
+    std::optional<std::size_t> size =
+        socket_.receive(datagram_.data(), datagram_.size(), timeout);
+    if (!size) {
+      const auto silence = std::chrono::steady_clock::now() - last_datagram;
+      if (all_passed_on && silence > LINGER_TIMEOUT) {
+        break;
+      }
+      if (silence > IDLE_TIMEOUT) {
+        throw std::runtime_error("Sender stopped sending datagrams for " +
+                                 std::to_string(IDLE_TIMEOUT.count()) +
+                                 " seconds");
+      }
+      continue;
+    }
+    last_datagram = std::chrono::steady_clock::now();
+
+    if (*size == 0) {
+      continue;
+    }
+    switch (static_cast<DatagramType>(datagram_[0])) {
+    case DatagramType::DATA:
+      handle_data(*size, chunk_pool, max_frame_size, window, num_chunks);
+      break;
+    case DatagramType::HELLO:
+      // The answer to the hello was lost
+      send_acknowledgement();
+      break;
+    case DatagramType::FINISH:
+      finished = true;
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+const UdpStats &UdpTransferManager::stats() const { return stats_; }
+
+std::string UdpTransferManager::send_summary() const {
+  std::ostringstream summary;
+  summary << stats_.datagrams << " datagrams, "
+          << utils::format_data_size(stats_.bytes) << " ("
+          << stats_.retransmitted << " resent, " << stats_.lost
+          << " taken as lost), " << stats_.acknowledgements
+          << " acknowledgements, " << congestion_control_.describe();
+  if (socket_.datagrams_dropped() > 0) {
+    summary << ", " << socket_.datagrams_dropped()
+            << " dropped by the loss injector";
+  }
+  return summary.str();
+}
+
+std::string UdpTransferManager::receive_summary() const {
+  std::ostringstream summary;
+  summary << stats_.datagrams << " datagrams, "
+          << utils::format_data_size(stats_.bytes) << " ("
+          << stats_.duplicates << " duplicates), " << stats_.acknowledgements
+          << " acknowledgements sent";
+  if (socket_.datagrams_dropped() > 0) {
+    summary << ", " << socket_.datagrams_dropped()
+            << " dropped by the loss injector";
+  }
+  return summary.str();
+}
+
+UdpTransferManager::OutstandingChunk *
+UdpTransferManager::outstanding_chunk(uint64_t sequence_num) {
+  if (outstanding_.empty()) {
+    return nullptr;
+  }
+  const uint64_t first = outstanding_.front().chunk_ptr->sequence_num();
+  if (sequence_num < first || sequence_num - first >= outstanding_.size()) {
+    return nullptr;
+  }
+  return &outstanding_[sequence_num - first];
+}
+
+// Lost parts go first, skipping those acknowledged after all, then the next
+// part of the outstanding chunks not yet sent at all
+bool UdpTransferManager::next_part_to_send(Part &part, bool &resent) {
+  while (!lost_parts_.empty()) {
+    part = lost_parts_.front();
+    lost_parts_.pop_front();
+    if (!part_acknowledged(part)) {
+      resent = true;
+      return true;
+    }
+  }
+
+  OutstandingChunk *chunk = outstanding_chunk(next_part_.sequence_num);
+  if (!chunk) {
+    return false;
+  }
+  resent = false;
+  part = next_part_;
+  next_part_.offset += DataDatagramHeader::PAYLOAD_SIZE;
+  if (next_part_.offset >= chunk->chunk_ptr->size()) {
+    ++next_part_.sequence_num;
+    next_part_.offset = 0;
+  }
+  return true;
+}
+
+bool UdpTransferManager::has_part_to_send() {
+  return !lost_parts_.empty() || outstanding_chunk(next_part_.sequence_num);
+}
+
+// A part of a chunk no longer outstanding was acknowledged with it
+bool UdpTransferManager::part_acknowledged(const Part &part) {
+  OutstandingChunk *chunk = outstanding_chunk(part.sequence_num);
+  return !chunk ||
+         chunk->acknowledged[part.offset / DataDatagramHeader::PAYLOAD_SIZE];
+}
+
+// Returns false if the transfer was aborted while waiting for the rate
+// limiter
+bool UdpTransferManager::send_part(WorkerContext &ctx, const Part &part,
+                                   bool resent,
+                                   std::chrono::steady_clock::time_point now) {
+  OutstandingChunk &chunk = *outstanding_chunk(part.sequence_num);
+  const uint32_t frame_size = chunk.chunk_ptr->size();
+  const uint32_t size = std::min<uint32_t>(DataDatagramHeader::PAYLOAD_SIZE,
+                                           frame_size - part.offset);
+  const std::size_t datagram_size = DataDatagramHeader::SIZE + size;
+  if (rate_limiter_ && !rate_limiter_->acquire(ctx, datagram_size)) {
+    return false;
+  }
+
+  DataDatagramHeader header;
+  header.packet_num = next_packet_num_++;
+  header.sequence_num = part.sequence_num;
+  header.frame_size = frame_size;
+  header.offset = part.offset;
+  std::array<uint8_t, DataDatagramHeader::SIZE> header_bytes;
+  header.encode(header_bytes.data());
+  socket_.send({asio::buffer(header_bytes),
+                asio::buffer(chunk.chunk_ptr->data() + part.offset, size)});
+
+  in_flight_[header.packet_num] = {part, static_cast<uint32_t>(datagram_size),
+                                   now};
+  bytes_in_flight_ += datagram_size;
+  congestion_control_.on_sent(datagram_size, now);
+  stats_.datagrams++;
+  stats_.bytes += datagram_size;
+  if (resent) {
+    stats_.retransmitted++;
+  }
+  return true;
+}
+
+// Waits up to timeout for the first datagram, then takes whatever else has
+// already arrived
+void UdpTransferManager::read_acknowledgements(
+    std::chrono::steady_clock::duration timeout) {
+  std::optional<std::size_t> size =
+      socket_.receive(datagram_.data(), datagram_.size(), timeout);
+  while (size) {
+    if (*size > 0 &&
+        datagram_[0] == static_cast<uint8_t>(DatagramType::ACK)) {
+      handle_acknowledgement(
+          DatagramAcknowledgement::decode(datagram_.data(), *size),
+          std::chrono::steady_clock::now());
+    }
+    size = socket_.receive(datagram_.data(), datagram_.size(),
+                           std::chrono::steady_clock::duration::zero());
+  }
+}
+
+// Datagrams in the acknowledged ranges are done with. Those left between
+// the lowest and the highest range, REORDER_THRESHOLD below the highest, are
+// taken as lost
+void UdpTransferManager::handle_acknowledgement(
+    const DatagramAcknowledgement &acknowledgement,
+    std::chrono::steady_clock::time_point now) {
+  stats_.acknowledgements++;
+  last_acknowledgement_ = now;
+  receiver_next_sequence_num_ =
+      std::max(receiver_next_sequence_num_, acknowledgement.next_sequence_num);
+  if (acknowledgement.ranges.empty()) {
+    return;
+  }
+
+  const uint64_t largest = acknowledgement.ranges.front().second;
+  std::size_t acknowledged = 0;
+  std::size_t acknowledged_bytes = 0;
+  std::optional<std::chrono::microseconds> rtt;
+  for (const auto &[first, last] : acknowledgement.ranges) {
+    auto it = in_flight_.lower_bound(first);
+    while (it != in_flight_.end() && it->first <= last) {
+      const InFlightDatagram &datagram = it->second;
+      if (it->first == largest) {
+        rtt = std::chrono::duration_cast<std::chrono::microseconds>(
+            now - datagram.sent);
+      }
+      if (OutstandingChunk *chunk =
+              outstanding_chunk(datagram.part.sequence_num)) {
+        const std::size_t index =
+            datagram.part.offset / DataDatagramHeader::PAYLOAD_SIZE;
+        if (!chunk->acknowledged[index]) {
+          chunk->acknowledged[index] = true;
+          chunk->parts_left--;
+        }
+      }
+      ++acknowledged;
+      acknowledged_bytes += datagram.size;
+      bytes_in_flight_ -= datagram.size;
+      it = in_flight_.erase(it);
+    }
+  }
+
+  std::size_t lost = 0;
+  auto it = in_flight_.lower_bound(acknowledgement.ranges.back().first);
+  while (it != in_flight_.end() && it->first + REORDER_THRESHOLD <= largest) {
+    if (!part_acknowledged(it->second.part)) {
+      lost_parts_.push_back(it->second.part);
+      ++lost;
+    }
+    bytes_in_flight_ -= it->second.size;
+    it = in_flight_.erase(it);
+  }
+
+  if (acknowledged > 0) {
+    congestion_control_.on_acknowledged(acknowledged, acknowledged_bytes, rtt,
+                                        now);
+  }
+  if (lost > 0) {
+    stats_.lost += lost;
+    congestion_control_.on_lost(lost, now);
+  }
+}
+
+// Datagrams unacknowledged for a retransmission timeout are taken as lost,
+// unless their part was acknowledged by an earlier copy. With no
+// acknowledgement at all for that long, the path is taken as congested
+void UdpTransferManager::detect_timeouts(
+    std::chrono::steady_clock::time_point now) {
+  const auto timeout = congestion_control_.retransmission_timeout();
+  std::size_t lost = 0;
+  auto it = in_flight_.begin();
+  while (it != in_flight_.end() && now - it->second.sent > timeout) {
+    const Part &part = it->second.part;
+    if (!part_acknowledged(part)) {
+      lost_parts_.push_back(part);
+      ++lost;
+    }
+    bytes_in_flight_ -= it->second.size;
+    it = in_flight_.erase(it);
+  }
+  if (lost == 0) {
+    return;
+  }
+  stats_.lost += lost;
+  if (now - last_acknowledgement_ > timeout) {
+    congestion_control_.on_timeout(now);
+  } else {
+    congestion_control_.on_lost(lost, now);
+  }
+}
+
+// Repeated, since the receiver otherwise waits out LINGER_TIMEOUT
+void UdpTransferManager::send_finish() {
+  const uint8_t finish = static_cast<uint8_t>(DatagramType::FINISH);
+  for (int i = 0; i < FINISH_REPEATS; ++i) {
+    socket_.send(&finish, sizeof(finish));
+  }
+  LOG("UDP transport finished, " + congestion_control_.describe());
+}
+
+// Datagrams for chunks past the window are dropped without being
+// acknowledged, so the sender sends them again once the window has moved
+void UdpTransferManager::handle_data(std::size_t size, ChunkPool &chunk_pool,
+                                     std::size_t max_frame_size,
+                                     std::size_t window, uint32_t num_chunks) {
+  if (size < DataDatagramHeader::SIZE) {
+    throw std::runtime_error("Received a truncated data datagram");
+  }
+  const DataDatagramHeader header =
+      DataDatagramHeader::decode(datagram_.data());
+  const uint8_t *payload = datagram_.data() + DataDatagramHeader::SIZE;
+  const std::size_t payload_size = size - DataDatagramHeader::SIZE;
+
+  if (header.sequence_num == 0 || header.sequence_num > num_chunks) {
+    throw std::runtime_error("Received a datagram of chunk #" +
+                             std::to_string(header.sequence_num) + " of " +
+                             std::to_string(num_chunks));
+  }
+  const bool valid_part =
+      header.offset % DataDatagramHeader::PAYLOAD_SIZE == 0 &&
+      header.offset < header.frame_size &&
+      payload_size == std::min<std::size_t>(DataDatagramHeader::PAYLOAD_SIZE,
+                                            header.frame_size - header.offset);
+  if (header.frame_size <= FrameHeader::SIZE ||
+      header.frame_size > max_frame_size || !valid_part) {
+    throw std::runtime_error("Received a malformed datagram of chunk #" +
+                             std::to_string(header.sequence_num));
+  }
+  if (header.sequence_num >= first_missing_ + window) {
+    return;
+  }
+
+  stats_.datagrams++;
+  stats_.bytes += size;
+  record_received(header.packet_num);
+  if (unacknowledged_datagrams_++ == 0) {
+    acknowledgement_due_ = std::chrono::steady_clock::now() + ACK_DELAY;
+  }
+  if (header.sequence_num < first_missing_) {
+    stats_.duplicates++;
+    return;
+  }
+
+  const std::size_t slot = header.sequence_num - first_missing_;
+  if (reassemblies_.size() <= slot) {
+    reassemblies_.resize(slot + 1);
+  }
+  Reassembly &reassembly = reassemblies_[slot];
+  if (!reassembly.chunk_ptr) {
+    reassembly.chunk_ptr = chunk_pool.acquire(header.sequence_num);
+    reassembly.chunk_ptr->resize(header.frame_size - FrameHeader::SIZE);
+    reassembly.frame_size = header.frame_size;
+    reassembly.parts_left = parts_in_frame(header.frame_size);
+    reassembly.received.assign(reassembly.parts_left, false);
+  } else if (reassembly.frame_size != header.frame_size) {
+    throw std::runtime_error(
+        "Received datagrams of different sizes of chunk #" +
+        std::to_string(header.sequence_num));
+  }
+
+  const std::size_t index = header.offset / DataDatagramHeader::PAYLOAD_SIZE;
+  if (reassembly.received[index]) {
+    stats_.duplicates++;
+    return;
+  }
+
+  // The first part also carries the frame header, which is kept aside so
+  // that the payload lands after the chunk headroom
+  std::size_t offset = header.offset;
+  std::size_t copied = 0;
+  if (offset < FrameHeader::SIZE) {
+    copied = std::min(payload_size, FrameHeader::SIZE - offset);
+    std::memcpy(reassembly.header.data() + offset, payload, copied);
+    offset += copied;
+  }
+  std::memcpy(reassembly.chunk_ptr->data() + (offset - FrameHeader::SIZE),
+              payload + copied, payload_size - copied);
+  reassembly.received[index] = true;
+  if (--reassembly.parts_left > 0) {
+    return;
+  }
+
+  const FrameHeader frame_header =
+      FrameHeader::decode(reassembly.header.data());
+  if (frame_header.sequence_num != header.sequence_num ||
+      frame_header.chunk_size != header.frame_size - FrameHeader::SIZE) {
+    throw std::runtime_error("Frame header of chunk #" +
+                             std::to_string(header.sequence_num) +
+                             " does not match its datagrams");
+  }
+  reassembly.chunk_ptr->set_compressed(frame_header.compressed,
+                                       frame_header.original_size);
+}
+
+// Adjacent ranges are merged, and the oldest forgotten beyond
+// TRACKED_RANGES
+void UdpTransferManager::record_received(uint64_t packet_num) {
+  auto next = received_ranges_.upper_bound(packet_num);
+  if (next != received_ranges_.begin()) {
+    auto previous = std::prev(next);
+    if (previous->second >= packet_num) {
+      return;
+    }
+    if (previous->second + 1 == packet_num) {
+      previous->second = packet_num;
+      if (next != received_ranges_.end() && next->first == packet_num + 1) {
+        previous->second = next->second;
+        received_ranges_.erase(next);
+      }
+      return;
+    }
+  }
+  if (next != received_ranges_.end() && next->first == packet_num + 1) {
+    const uint64_t last = next->second;
+    received_ranges_.erase(next);
+    received_ranges_.emplace(packet_num, last);
+  } else {
+    received_ranges_.emplace(packet_num, packet_num);
+  }
+  if (received_ranges_.size() > TRACKED_RANGES) {
+    received_ranges_.erase(received_ranges_.begin());
+  }
+}
+
+void UdpTransferManager::send_acknowledgement() {
+  DatagramAcknowledgement acknowledgement;
+  acknowledgement.next_sequence_num = first_missing_;
+  for (auto it = received_ranges_.rbegin();
+       it != received_ranges_.rend() &&
+       acknowledgement.ranges.size() < DatagramAcknowledgement::MAX_RANGES;
+       ++it) {
+    acknowledgement.ranges.emplace_back(it->first, it->second);
+  }
+  std::array<uint8_t, DatagramAcknowledgement::MAX_SIZE> buffer;
+  socket_.send(buffer.data(), acknowledgement.encode(buffer.data()));
+  unacknowledged_datagrams_ = 0;
+  stats_.acknowledgements++;
+}
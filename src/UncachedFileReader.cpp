@@ -0,0 +1,216 @@
+#include "UncachedFileReader.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "utils.h"
+
+namespace {
+
+// Pages are dropped in steps of this many bytes rather than after every read
+constexpr uint64_t DROP_STEP = 4 * 1024 * 1024;
+
+uint64_t align_down(uint64_t value, uint64_t alignment) {
+  return value / alignment * alignment;
+}
+
+} // namespace
+
+void UncachedFileReader::AlignedFree::operator()(uint8_t *buffer) const {
+  std::free(buffer);
+}
+
+bool UncachedFileReader::supported() {
+#ifdef __linux__
+  return true;
+#else
+  return false;
+#endif
+}
+
+UncachedFileReader::UncachedFileReader(bool direct) : direct_(direct) {
+  if (!supported()) {
+    throw std::runtime_error("Reading around the page cache is not "
+                             "supported on this platform");
+  }
+  if (direct_) {
+    direct_buffer_.reset(static_cast<uint8_t *>(
+        std::aligned_alloc(DIRECT_ALIGNMENT, DIRECT_BUFFER_SIZE)));
+    if (!direct_buffer_) {
+      throw std::bad_alloc();
+    }
+  }
+}
+
+UncachedFileReader::~UncachedFileReader() { close(); }
+
+#ifdef __linux__
+void UncachedFileReader::open(const std::filesystem::path &path,
+                              uint64_t size) {
+  close();
+  path_ = path;
+  size_ = size;
+  offset_ = 0;
+  readahead_end_ = 0;
+  dropped_end_ = 0;
+  buffer_start_ = 0;
+  buffer_end_ = 0;
+
+  fd_direct_ = false;
+  if (direct_) {
+    fd_ = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT);
+    fd_direct_ = fd_ >= 0;
+    if (fd_ < 0 && errno != EINVAL) {
+      throw utils::system_failure("\nFailed to open file " + path_.string(),
+                                  errno);
+    }
+    if (fd_ < 0) {
+      LOG(path_.string() + " cannot be read with O_DIRECT, dropping its "
+                           "pages behind the reads instead");
+    }
+  }
+  if (fd_ < 0) {
+    fd_ = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) {
+      throw utils::system_failure("\nFailed to open file " + path_.string(),
+                                  errno);
+    }
+    // Advice only changes what the kernel caches, so failures are ignored
+    ::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+  }
+}
+
+void UncachedFileReader::read(uint8_t *dest, std::size_t len) {
+  if (offset_ + len > size_) {
+    throw std::logic_error("Read past the end of " + path_.string());
+  }
+  if (fd_direct_) {
+    read_direct(dest, len);
+  } else {
+    read_cached(dest, len);
+  }
+  offset_ += len;
+}
+
+void UncachedFileReader::close() {
+  if (fd_ < 0) {
+    return;
+  }
+  if (!fd_direct_) {
+    ::posix_fadvise(fd_, dropped_end_, 0, POSIX_FADV_DONTNEED);
+  }
+  ::close(fd_);
+  fd_ = -1;
+}
+
+void UncachedFileReader::read_cached(uint8_t *dest, std::size_t len) {
+  const uint64_t end = offset_ + len;
+
+  // Advise the next window once half of the current one has been read
+  if (end + READAHEAD / 2 > readahead_end_) {
+    const uint64_t readahead_end = std::min<uint64_t>(end + READAHEAD, size_);
+    const uint64_t start = std::max(offset_, readahead_end_);
+    if (readahead_end > start) {
+      ::posix_fadvise(fd_, start, readahead_end - start, POSIX_FADV_WILLNEED);
+      readahead_end_ = readahead_end;
+    }
+  }
+
+  if (read_at(dest, len, offset_) != len) {
+    throw std::runtime_error("\n" + path_.string() +
+                             " was truncated while being sent");
+  }
+
+  // The kernel only drops whole pages, so the page the cursor is in stays
+  // until the next step
+  const uint64_t drop_end = align_down(end, DIRECT_ALIGNMENT);
+  if (drop_end >= dropped_end_ + DROP_STEP) {
+    ::posix_fadvise(fd_, dropped_end_, drop_end - dropped_end_,
+                    POSIX_FADV_DONTNEED);
+    dropped_end_ = drop_end;
+  }
+}
+
+void UncachedFileReader::read_direct(uint8_t *dest, std::size_t len) {
+  uint64_t offset = offset_;
+  while (len > 0) {
+    if (offset < buffer_start_ || offset >= buffer_end_) {
+      // Reads are sequential, so every refill starts at an aligned offset,
+      // and no more than the rest of the file is asked for, which makes a
+      // difference to the kernel's cost for small files
+      buffer_start_ = align_down(offset, DIRECT_ALIGNMENT);
+      const uint64_t request_size =
+          align_down(size_ - buffer_start_ + DIRECT_ALIGNMENT - 1,
+                     DIRECT_ALIGNMENT);
+      const std::size_t bytes_read = read_at(
+          direct_buffer_.get(),
+          static_cast<std::size_t>(
+              std::min<uint64_t>(request_size, DIRECT_BUFFER_SIZE)),
+          buffer_start_);
+      buffer_end_ = buffer_start_ + bytes_read;
+      if (buffer_end_ <= offset) {
+        throw std::runtime_error("\n" + path_.string() +
+                                 " was truncated while being sent");
+      }
+    }
+    const std::size_t count =
+        static_cast<std::size_t>(std::min<uint64_t>(len, buffer_end_ - offset));
+    std::memcpy(dest, direct_buffer_.get() + (offset - buffer_start_), count);
+    dest += count;
+    offset += count;
+    len -= count;
+  }
+}
+
+// Reads until len bytes are read or the file ends, returning the bytes read
+std::size_t UncachedFileReader::read_at(uint8_t *dest, std::size_t len,
+                                        uint64_t offset) {
+  std::size_t total = 0;
+  while (total < len) {
+    const ssize_t count =
+        ::pread(fd_, dest + total, len - total, static_cast<off_t>(offset));
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw utils::system_failure("\nFailed to read file " + path_.string(),
+                                  errno);
+    }
+    if (count == 0) {
+      break;
+    }
+    total += static_cast<std::size_t>(count);
+    offset += static_cast<uint64_t>(count);
+
+    // A short direct read ends at the end of the file, and the next one
+    // would not be aligned
+    if (fd_direct_) {
+      break;
+    }
+  }
+  return total;
+}
+#else
+void UncachedFileReader::open(const std::filesystem::path &, uint64_t) {}
+
+void UncachedFileReader::read(uint8_t *, std::size_t) {}
+
+void UncachedFileReader::close() {}
+
+void UncachedFileReader::read_cached(uint8_t *, std::size_t) {}
+
+void UncachedFileReader::read_direct(uint8_t *, std::size_t) {}
+
+std::size_t UncachedFileReader::read_at(uint8_t *, std::size_t, uint64_t) {
+  return 0;
+}
+#endif
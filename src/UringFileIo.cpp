@@ -0,0 +1,421 @@
+#include "UringFileIo.h"
+#include "ChunkIndex.h"
+#include "WriteBehind.h"
+
+#include <stdexcept>
+
+#ifdef TRIT_WITH_IO_URING
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <liburing.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "utils.h"
+#endif
+
+struct UringFileIo::Ring {
+#ifdef TRIT_WITH_IO_URING
+  io_uring ring;
+#endif
+};
+
+bool UringFileIo::supported() {
+#ifdef TRIT_WITH_IO_URING
+  return true;
+#else
+  return false;
+#endif
+}
+
+#ifdef TRIT_WITH_IO_URING
+namespace {
+
+struct InFlightChunk;
+
+// A read or write of part of a chunk at an offset in one of the files
+struct Request {
+  InFlightChunk *chunk = nullptr;
+  std::size_t file_index = 0;
+  uint64_t file_offset = 0;
+  uint8_t *data = nullptr;
+  uint32_t size = 0;
+};
+
+// Requests are never added once the chunk is queued, so pointers to them
+// stay valid while they are in flight
+struct InFlightChunk {
+  ChunkPtr chunk_ptr;
+  std::vector<Request> requests;
+  std::size_t requests_left = 0;
+};
+
+// Splits the chunk's pieces of the files into requests, so that a large
+// piece is spread across the device's queues too
+void map_chunk(const ChunkIndex &chunk_index, InFlightChunk &in_flight) {
+  Chunk &chunk = *in_flight.chunk_ptr;
+  for (const ChunkIndex::Piece &piece :
+       chunk_index.pieces(chunk.sequence_num())) {
+    for (uint32_t offset = 0; offset < piece.size;) {
+      const uint32_t size = static_cast<uint32_t>(std::min<uint64_t>(
+          piece.size - offset, UringFileIo::MAX_REQUEST_SIZE));
+      in_flight.requests.push_back({&in_flight, piece.file_index,
+                                    piece.file_offset + offset,
+                                    chunk.data() + piece.chunk_offset + offset,
+                                    size});
+      offset += size;
+    }
+  }
+  in_flight.requests_left = in_flight.requests.size();
+}
+
+// Submits the requests of the chunks in flight and handles their completions.
+// Waits for every submitted request before it is destroyed, since the kernel
+// may still be reading or writing the chunk buffers
+class RequestQueue {
+public:
+  RequestQueue(io_uring &ring, const TransferRequest &transfer_request,
+               bool writing)
+      : ring_(ring), file_infos_(transfer_request.get_file_infos()),
+        writing_(writing), fds_(file_infos_.size(), -1),
+        bytes_left_(file_infos_.size()),
+        write_behind_(writing ? file_infos_.size() : 0) {
+    for (std::size_t i = 0; i < file_infos_.size(); ++i) {
+      bytes_left_[i] = file_infos_[i].size;
+    }
+  }
+
+  // Requests prepared when a file failed to open are submitted too, so that
+  // every buffer the kernel may still use is waited for
+  ~RequestQueue() {
+    submit_prepared();
+    while (in_flight_ > 0) {
+      io_uring_cqe *cqe;
+      const int result = io_uring_wait_cqe(&ring_, &cqe);
+      if (result == -EINTR) {
+        continue;
+      }
+      if (result < 0) {
+        break;
+      }
+      io_uring_cqe_seen(&ring_, cqe);
+      --in_flight_;
+    }
+    for (int fd : fds_) {
+      if (fd >= 0) {
+        ::close(fd);
+      }
+    }
+  }
+
+  RequestQueue(const RequestQueue &) = delete;
+  RequestQueue &operator=(const RequestQueue &) = delete;
+
+  void add(InFlightChunk &in_flight) {
+    for (Request &request : in_flight.requests) {
+      pending_.push_back(&request);
+    }
+  }
+
+  // Submits pending requests until QUEUE_DEPTH are in flight. The file is
+  // opened before a request takes a submission queue entry, since opening
+  // can throw
+  void submit() {
+    while (!pending_.empty() &&
+           in_flight_ + prepared_ < UringFileIo::QUEUE_DEPTH) {
+      Request *request = pending_.front();
+      const int fd = file(request->file_index);
+      io_uring_sqe *sqe = io_uring_get_sqe(&ring_);
+      if (!sqe) {
+        break;
+      }
+      if (writing_) {
+        io_uring_prep_write(sqe, fd, request->data, request->size,
+                            request->file_offset);
+      } else {
+        io_uring_prep_read(sqe, fd, request->data, request->size,
+                           request->file_offset);
+      }
+      io_uring_sqe_set_data(sqe, request);
+      pending_.pop_front();
+      ++prepared_;
+    }
+    const int result = submit_prepared();
+    if (result < 0) {
+      throw utils::system_failure("Failed to submit file I/O", -result);
+    }
+    // Nothing would ever complete for wait()
+    if (in_flight_ == 0 && prepared_ > 0) {
+      throw utils::system_failure("Failed to submit file I/O", EAGAIN);
+    }
+  }
+
+  // Waits for a request to complete, then handles every completion that is
+  // ready. Must only be called with requests in flight
+  void wait() {
+    io_uring_cqe *cqe;
+    int result;
+    do {
+      result = io_uring_wait_cqe(&ring_, &cqe);
+    } while (result == -EINTR);
+    if (result < 0) {
+      throw utils::system_failure("Failed to wait for file I/O", -result);
+    }
+    do {
+      Request *request = static_cast<Request *>(io_uring_cqe_get_data(cqe));
+      const int request_result = cqe->res;
+      io_uring_cqe_seen(&ring_, cqe);
+      --in_flight_;
+      complete(*request, request_result);
+    } while (io_uring_peek_cqe(&ring_, &cqe) == 0);
+  }
+
+private:
+  io_uring &ring_;
+  const std::vector<TransferRequest::FileInfo> &file_infos_;
+  const bool writing_;
+  std::vector<int> fds_;
+  std::vector<uint64_t> bytes_left_;
+  std::vector<WriteBehind> write_behind_;
+  std::deque<Request *> pending_;
+
+  // Requests are prepared in submission queue entries, and only counted in
+  // flight once the kernel has taken them
+  unsigned prepared_ = 0;
+  unsigned in_flight_ = 0;
+
+  // Returns 0, or the negative error of io_uring_submit()
+  int submit_prepared() {
+    if (prepared_ == 0) {
+      return 0;
+    }
+    const int result = io_uring_submit(&ring_);
+    if (result < 0) {
+      return result;
+    }
+    prepared_ -= static_cast<unsigned>(result);
+    in_flight_ += static_cast<unsigned>(result);
+    return 0;
+  }
+
+  // Opens the file on its first request. The sender checks that it still
+  // has the size the transfer request declared, like the stream path
+  int file(std::size_t index) {
+    if (fds_[index] >= 0) {
+      return fds_[index];
+    }
+    const TransferRequest::FileInfo &file_info = file_infos_[index];
+    const std::filesystem::path path =
+        std::filesystem::current_path() / file_info.relative_path;
+    if (writing_) {
+      // Created by WriteBehind::preallocate_files(), and not truncated
+      fds_[index] =
+          ::open(file_info.relative_path.c_str(), O_WRONLY | O_CLOEXEC);
+      if (fds_[index] < 0) {
+        throw utils::system_failure("Failed to open file " + path.string(),
+                                    errno);
+      }
+      return fds_[index];
+    }
+
+    fds_[index] = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fds_[index] < 0) {
+      throw utils::system_failure("\nFailed to open file " + path.string(),
+                                  errno);
+    }
+    struct stat file_stat;
+    if (::fstat(fds_[index], &file_stat) != 0) {
+      throw utils::system_failure("\nFailed to stat file " + path.string(),
+                                  errno);
+    }
+    if (static_cast<uint64_t>(file_stat.st_size) != file_info.size) {
+      throw std::runtime_error("\nFile size mismatch: expected " +
+                               std::to_string(file_info.size) +
+                               " bytes, file size is " +
+                               std::to_string(file_stat.st_size) + " bytes");
+    }
+    return fds_[index];
+  }
+
+  // A short read or write is submitted again for the rest of its bytes
+  void complete(Request &request, int result) {
+    if (result == -EINTR || result == -EAGAIN) {
+      pending_.push_front(&request);
+      return;
+    }
+    const std::size_t index = request.file_index;
+    const std::filesystem::path path =
+        std::filesystem::current_path() / file_infos_[index].relative_path;
+    if (result < 0) {
+      throw utils::system_failure(
+          writing_ ? "Failed to write to file " + path.string()
+                   : "\nFailed to read file " + path.string(),
+          -result);
+    }
+    if (result == 0) {
+      throw std::runtime_error(
+          writing_ ? "Failed to write to file " + path.string()
+                   : "\n" + path.string() + " was truncated while being sent");
+    }
+
+    request.data += result;
+    request.file_offset += result;
+    request.size -= result;
+    bytes_left_[index] -= result;
+    if (writing_) {
+      write_behind_[index].written(fds_[index], request.file_offset);
+    }
+    if (bytes_left_[index] == 0) {
+      ::close(fds_[index]);
+      fds_[index] = -1;
+    }
+    if (request.size > 0) {
+      pending_.push_front(&request);
+    } else {
+      --request.chunk->requests_left;
+    }
+  }
+};
+
+} // namespace
+
+UringFileIo::UringFileIo() : ring_(std::make_unique<Ring>()) {
+  const int result = io_uring_queue_init(QUEUE_DEPTH, &ring_->ring, 0);
+  if (result < 0) {
+    throw utils::system_failure("Failed to set up io_uring", -result);
+  }
+}
+
+UringFileIo::~UringFileIo() { io_uring_queue_exit(&ring_->ring); }
+
+void UringFileIo::read_files_into_chunks(
+    WorkerContext &ctx, const TransferRequest &transfer_request,
+    ChunkPool &chunk_pool, ChunkQueue &output_queue) {
+  const uint32_t num_chunks = transfer_request.get_num_chunks();
+
+  // Declared before the request queue, which waits for the kernel to be
+  // done with the chunks before they are released
+  std::deque<InFlightChunk> chunks;
+  RequestQueue requests(ring_->ring, transfer_request, false);
+  const ChunkIndex chunk_index(transfer_request);
+
+  uint32_t next_sequence_num = 1;
+  while (next_sequence_num <= num_chunks || !chunks.empty()) {
+    if (ctx.should_abort()) {
+      return;
+    }
+
+    while (next_sequence_num <= num_chunks &&
+           chunks.size() < CHUNKS_IN_FLIGHT) {
+      ChunkPtr chunk_ptr = chunk_pool.acquire(next_sequence_num);
+      chunk_ptr->resize(chunk_index.payload_size(next_sequence_num));
+      chunks.emplace_back();
+      chunks.back().chunk_ptr = std::move(chunk_ptr);
+      map_chunk(chunk_index, chunks.back());
+      requests.add(chunks.back());
+      ++next_sequence_num;
+    }
+    requests.submit();
+
+    // Chunks complete in any order but are passed on in sequence order
+    while (!chunks.empty() && chunks.front().requests_left == 0) {
+      if (!output_queue.push(std::move(chunks.front().chunk_ptr))) {
+        return;
+      }
+      chunks.pop_front();
+    }
+    if (!chunks.empty()) {
+      requests.wait();
+    }
+  }
+
+  output_queue.close();
+}
+
+void UringFileIo::write_files_from_chunks(
+    WorkerContext &ctx, const TransferRequest &transfer_request,
+    ChunkQueue &input_queue, std::atomic<uint32_t> &chunks_written) {
+  const uint32_t num_chunks = transfer_request.get_num_chunks();
+  std::deque<InFlightChunk> chunks;
+  RequestQueue requests(ring_->ring, transfer_request, true);
+  const ChunkIndex chunk_index(transfer_request);
+  WrittenChunks written_chunks(num_chunks);
+
+  uint32_t chunks_received = 0;
+  while (chunks_received < num_chunks || !chunks.empty()) {
+    if (ctx.should_abort()) {
+      return;
+    }
+
+    // Only blocks for the next chunk when no writes are left to wait for.
+    // An empty result then means the queue was cancelled on abort, or closed
+    // before all file data was received
+    while (chunks_received < num_chunks && chunks.size() < CHUNKS_IN_FLIGHT) {
+      std::optional<ChunkPtr> chunk_ptr_opt =
+          chunks.empty() ? input_queue.pop() : input_queue.try_pop();
+      if (!chunk_ptr_opt) {
+        if (!chunks.empty() || ctx.should_abort()) {
+          break;
+        }
+        throw std::runtime_error(
+            "Chunk stream ended before all files were fully written");
+      }
+      const uint64_t sequence_num = (*chunk_ptr_opt)->sequence_num();
+      if ((*chunk_ptr_opt)->compressed()) {
+        throw std::runtime_error("Received compressed chunk #" +
+                                 std::to_string(sequence_num) +
+                                 " without a decompression stage");
+      }
+      written_chunks.received(sequence_num);
+      const uint32_t payload_size = chunk_index.payload_size(sequence_num);
+      if ((*chunk_ptr_opt)->size() != payload_size) {
+        throw std::runtime_error(
+            "Chunk #" + std::to_string(sequence_num) + " has " +
+            std::to_string((*chunk_ptr_opt)->size()) + " bytes, expected " +
+            std::to_string(payload_size));
+      }
+      chunks.emplace_back();
+      chunks.back().chunk_ptr = std::move(*chunk_ptr_opt);
+      map_chunk(chunk_index, chunks.back());
+      requests.add(chunks.back());
+      ++chunks_received;
+    }
+    requests.submit();
+
+    // Chunks may arrive in any order. chunks_written is acknowledged to a
+    // resumable sender, so a chunk is only counted once it and every chunk
+    // before it are with the OS
+    while (!chunks.empty() && chunks.front().requests_left == 0) {
+      chunks_written =
+          written_chunks.written(chunks.front().chunk_ptr->sequence_num());
+      chunks.pop_front();
+    }
+    if (!chunks.empty()) {
+      requests.wait();
+    }
+  }
+}
+#else
+UringFileIo::UringFileIo() {
+  throw std::runtime_error("trit was built without io_uring support");
+}
+
+UringFileIo::~UringFileIo() = default;
+
+void UringFileIo::read_files_into_chunks(WorkerContext &,
+                                         const TransferRequest &, ChunkPool &,
+                                         ChunkQueue &) {}
+
+void UringFileIo::write_files_from_chunks(WorkerContext &,
+                                          const TransferRequest &,
+                                          ChunkQueue &,
+                                          std::atomic<uint32_t> &) {}
+#endif
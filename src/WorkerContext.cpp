@@ -1,14 +1,53 @@
-
 #include "WorkerContext.h"
 
+WorkerContext::AbortCallbackGuard::AbortCallbackGuard(WorkerContext &ctx,
+                                                      uint64_t id)
+    : ctx_(ctx), id_(id) {}
+
+WorkerContext::AbortCallbackGuard::~AbortCallbackGuard() {
+  std::lock_guard<std::mutex> lock(ctx_.abort_callbacks_mutex_);
+  ctx_.abort_callbacks_.erase(id_);
+}
+
 bool WorkerContext::should_abort() const { return abort_flag_.load(); }
 
+void WorkerContext::abort() {
+  std::lock_guard<std::mutex> lock(abort_callbacks_mutex_);
+  if (abort_flag_.exchange(true)) {
+    return;
+  }
+  for (auto &[id, callback] : abort_callbacks_) {
+    callback();
+  }
+}
+
+void WorkerContext::on_abort(std::function<void()> callback) {
+  add_abort_callback(std::move(callback));
+}
+
+WorkerContext::AbortCallbackGuard
+WorkerContext::scoped_on_abort(std::function<void()> callback) {
+  return AbortCallbackGuard(*this, add_abort_callback(std::move(callback)));
+}
+
+uint64_t WorkerContext::add_abort_callback(std::function<void()> callback) {
+  std::lock_guard<std::mutex> lock(abort_callbacks_mutex_);
+  if (abort_flag_.load()) {
+    callback();
+  }
+  uint64_t id = next_callback_id_++;
+  abort_callbacks_.emplace(id, std::move(callback));
+  return id;
+}
+
 void WorkerContext::handle_exception() {
-  abort_flag_ = true;
-  std::lock_guard<std::mutex> lock(exception_mutex_);
-  if (!exception_ptr_) {
-    exception_ptr_ = std::current_exception();
+  {
+    std::lock_guard<std::mutex> lock(exception_mutex_);
+    if (!exception_ptr_) {
+      exception_ptr_ = std::current_exception();
+    }
   }
+  abort();
 }
 
 void WorkerContext::rethrow_if_exception() {
@@ -0,0 +1,75 @@
+#include "WriteBehind.h"
+
+#include <cerrno>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "utils.h"
+
+void WriteBehind::preallocate_files(const TransferRequest &transfer_request) {
+  for (const auto &file_info : transfer_request.get_file_infos()) {
+    std::filesystem::path parent_path =
+        std::filesystem::path(file_info.relative_path).parent_path();
+    if (!parent_path.empty()) {
+      std::filesystem::create_directories(parent_path);
+    }
+    const std::filesystem::path abs_path =
+        std::filesystem::current_path() / file_info.relative_path;
+
+    const int fd = ::open(file_info.relative_path.c_str(),
+                          O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0) {
+      throw utils::system_failure("Failed to open file " + abs_path.string(),
+                                  errno);
+    }
+#ifdef __linux__
+    // Filesystems that cannot reserve space, e.g. EOPNOTSUPP, are skipped
+    if (file_info.size > 0 &&
+        ::fallocate(fd, FALLOC_FL_KEEP_SIZE, 0,
+                    static_cast<off_t>(file_info.size)) != 0 &&
+        (errno == ENOSPC || errno == EDQUOT)) {
+      const int error = errno;
+      ::close(fd);
+      throw utils::system_failure(
+          "Not enough disk space for " + abs_path.string() + " (" +
+              utils::format_data_size(file_info.size) + ")",
+          error);
+    }
+#endif
+    ::close(fd);
+  }
+}
+
+void WriteBehind::written(int fd, uint64_t end) {
+#ifdef __linux__
+  if (end < started_end_ + WRITEBACK_STEP) {
+    return;
+  }
+
+  // Waiting for the previous step holds the writer to the disk's pace
+  if (started_end_ > waited_end_ &&
+      ::sync_file_range(fd, static_cast<off_t>(waited_end_),
+                        static_cast<off_t>(started_end_ - waited_end_),
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                            SYNC_FILE_RANGE_WAIT_AFTER) != 0 &&
+      errno == EIO) {
+    throw utils::system_failure("Failed to write back file data", errno);
+  }
+  waited_end_ = started_end_;
+
+  if (::sync_file_range(fd, static_cast<off_t>(started_end_),
+                        static_cast<off_t>(end - started_end_),
+                        SYNC_FILE_RANGE_WRITE) != 0 &&
+      errno == EIO) {
+    throw utils::system_failure("Failed to write back file data", errno);
+  }
+  started_end_ = end;
+#else
+  (void)fd;
+  (void)end;
+#endif
+}
@@ -0,0 +1,186 @@
+#include "ZeroCopySender.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#ifdef __linux__
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+
+#include "utils.h"
+
+#if defined(__linux__) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+#define TRIT_HAS_MSG_ZEROCOPY
+#endif
+
+ZeroCopySender::ZeroCopySender(TcpSocket &socket) : socket_(socket) {}
+
+bool ZeroCopySender::enable(TcpSocket &socket) {
+#ifdef TRIT_HAS_MSG_ZEROCOPY
+  int one = 1;
+  return ::setsockopt(socket.native_handle(), SOL_SOCKET, SO_ZEROCOPY, &one,
+                      sizeof(one)) == 0;
+#else
+  (void)socket;
+  return false;
+#endif
+}
+
+std::size_t
+ZeroCopySender::send(const std::vector<asio::const_buffer> &buffers,
+                     std::vector<ChunkPtr> &chunks) {
+#ifdef TRIT_HAS_MSG_ZEROCOPY
+  std::vector<iovec> iov;
+  iov.reserve(buffers.size());
+  std::size_t bytes = 0;
+  for (const auto &buffer : buffers) {
+    iov.push_back({const_cast<void *>(buffer.data()), buffer.size()});
+    bytes += buffer.size();
+  }
+
+  std::size_t calls = 0;
+  std::size_t first = 0;
+  while (first < iov.size()) {
+    msghdr msg{};
+    msg.msg_iov = iov.data() + first;
+    msg.msg_iovlen = iov.size() - first;
+    ssize_t sent = ::sendmsg(socket_.native_handle(), &msg,
+                             MSG_ZEROCOPY | MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        socket_.wait_writable();
+        continue;
+      }
+      // The memory the kernel may pin for zero-copy sends is exhausted. It
+      // frees up as earlier calls complete, and if none are in flight the
+      // rest is sent with an ordinary copying write
+      if (errno == ENOBUFS) {
+        if (next_completion_ != next_call_) {
+          reap(std::chrono::milliseconds(10));
+          continue;
+        }
+        std::vector<asio::const_buffer> rest;
+        for (std::size_t i = first; i < iov.size(); ++i) {
+          rest.emplace_back(iov[i].iov_base, iov[i].iov_len);
+        }
+        calls += socket_.write(rest);
+        break;
+      }
+      throw utils::system_failure("Zero-copy send failed", errno);
+    }
+    ++next_call_;
+    ++calls;
+
+    // A short send resumes from the first buffer that was not fully sent
+    std::size_t remaining = static_cast<std::size_t>(sent);
+    while (first < iov.size() && remaining >= iov[first].iov_len) {
+      remaining -= iov[first].iov_len;
+      ++first;
+    }
+    if (first < iov.size()) {
+      iov[first].iov_base = static_cast<uint8_t *>(iov[first].iov_base) +
+                            remaining;
+      iov[first].iov_len -= remaining;
+    }
+  }
+
+  pending_bytes_ += bytes;
+  pending_sends_.push_back({next_call_ - 1, bytes, std::move(chunks)});
+  chunks.clear();
+  return calls;
+#else
+  (void)buffers;
+  (void)chunks;
+  throw std::logic_error("MSG_ZEROCOPY is not supported on this platform");
+#endif
+}
+
+void ZeroCopySender::reap(std::chrono::milliseconds timeout) {
+#ifdef TRIT_HAS_MSG_ZEROCOPY
+  // The error queue being non-empty is reported as POLLERR
+  if (!read_completions() && timeout.count() > 0 && !pending_sends_.empty()) {
+    pollfd poll_fd{socket_.native_handle(), 0, 0};
+    if (::poll(&poll_fd, 1, static_cast<int>(timeout.count())) > 0) {
+      read_completions();
+    }
+  }
+  release_completed();
+#else
+  (void)timeout;
+#endif
+}
+
+std::size_t ZeroCopySender::pending_bytes() const { return pending_bytes_; }
+
+uint64_t ZeroCopySender::completed_calls() const { return completed_calls_; }
+
+uint64_t ZeroCopySender::copied_calls() const { return copied_calls_; }
+
+// Drains the error queue without blocking. Returns whether any completion
+// was read
+bool ZeroCopySender::read_completions() {
+  bool completed = false;
+#ifdef TRIT_HAS_MSG_ZEROCOPY
+  while (true) {
+    alignas(cmsghdr) char control[128];
+    msghdr msg{};
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (::recvmsg(socket_.native_handle(), &msg,
+                  MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return completed;
+      }
+      throw utils::system_failure("Failed to read zero-copy completions",
+                                  errno);
+    }
+
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      const bool is_error =
+          (cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+          (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR);
+      if (!is_error) {
+        continue;
+      }
+      sock_extended_err err;
+      std::memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+      if (err.ee_origin != SO_EE_ORIGIN_ZEROCOPY || err.ee_errno != 0) {
+        continue;
+      }
+
+      // The notification covers calls ee_info through ee_data inclusive
+      const uint32_t calls = err.ee_data - err.ee_info + 1;
+      completed_calls_ += calls;
+      if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+        copied_calls_ += calls;
+      }
+      next_completion_ = err.ee_data + 1;
+      completed = true;
+    }
+  }
+#endif
+  return completed;
+}
+
+// Completion numbers wrap around, so they are compared by their difference
+void ZeroCopySender::release_completed() {
+  while (!pending_sends_.empty() &&
+         static_cast<int32_t>(pending_sends_.front().last_call -
+                              next_completion_) < 0) {
+    pending_bytes_ -= pending_sends_.front().bytes;
+    pending_sends_.pop_front();
+  }
+}
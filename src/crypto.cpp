@@ -32,6 +32,36 @@ derive_key_bytes(const std::string &password, const crypto::Salt &salt) {
   return key;
 }
 
+// Keyed BLAKE2b, as ChunkCipher derives its subkey
+std::array<uint8_t, crypto::KEY_SIZE>
+keyed_hash(const std::array<uint8_t, crypto::KEY_SIZE> &key,
+           const std::vector<uint8_t> &message) {
+  std::array<uint8_t, crypto::KEY_SIZE> hash{};
+  if (crypto_generichash(hash.data(), hash.size(), message.data(),
+                         message.size(), key.data(), key.size()) != 0) {
+    throw std::runtime_error("Key derivation failed");
+  }
+  return hash;
+}
+
+using ChunkNonce =
+    std::array<uint8_t, crypto_aead_xchacha20poly1305_ietf_NPUBBYTES>;
+
+// [sequence number (8 bytes, little endian)][final flag (1 byte)][zeros]
+// Unique per chunk since every session uses a freshly derived subkey
+ChunkNonce make_chunk_nonce(uint64_t sequence_num, bool is_final) {
+  ChunkNonce nonce{};
+  for (std::size_t i = 0; i < sizeof(sequence_num); ++i) {
+    nonce[i] = static_cast<uint8_t>(sequence_num >> (8 * i));
+  }
+  nonce[sizeof(sequence_num)] = is_final ? 1 : 0;
+  return nonce;
+}
+
+// The associated data repeats the sequence number and final flag, which are
+// the leading bytes of the nonce
+constexpr std::size_t CHUNK_AD_SIZE = sizeof(uint64_t) + 1;
+
 } // anonymous namespace
 
 namespace crypto {
@@ -63,6 +93,8 @@ std::size_t Salt::size() const noexcept { return data_.size(); }
 Key::Key(const std::string &password, const Salt &salt)
     : data_(derive_key_bytes(password, salt)) {}
 
+Key::Key(const std::array<uint8_t, KEY_SIZE> &bytes) : data_(bytes) {}
+
 const uint8_t *Key::data() const noexcept { return data_.data(); }
 
 std::size_t Key::size() const noexcept { return data_.size(); }
@@ -141,6 +173,64 @@ void Decryptor::decrypt(const uint8_t *input, std::size_t len, uint8_t *output,
   }
 }
 
+// ChunkCipher class
+
+ChunkCipher::ChunkCipher(const Key &key,
+                         const std::array<uint8_t, HEADER_SIZE> &session_id) {
+  // Keyed BLAKE2b of the session id
+  if (crypto_generichash(subkey_.data(), subkey_.size(), session_id.data(),
+                         session_id.size(), key.data(), key.size()) != 0) {
+    throw std::runtime_error("ChunkCipher: Failed to derive session key");
+  }
+}
+
+std::array<uint8_t, HEADER_SIZE> ChunkCipher::generate_session_id() {
+  std::array<uint8_t, HEADER_SIZE> session_id{};
+  randombytes_buf(session_id.data(), session_id.size());
+  return session_id;
+}
+
+void ChunkCipher::seal(uint8_t *data, std::size_t len, uint64_t sequence_num,
+                       bool is_final) const {
+  const ChunkNonce nonce = make_chunk_nonce(sequence_num, is_final);
+  unsigned long long out_len_raw = 0;
+
+  if (crypto_aead_xchacha20poly1305_ietf_encrypt(
+          data, &out_len_raw, data, static_cast<unsigned long long>(len),
+          nonce.data(), CHUNK_AD_SIZE, nullptr, nonce.data(),
+          subkey_.data()) != 0) {
+    throw std::runtime_error("ChunkCipher: Encryption failed");
+  }
+
+  if (out_len_raw != (len + CHUNK_SEAL_ADDITIONAL_BYTES)) {
+    throw std::runtime_error("Encryption output bad length");
+  }
+}
+
+std::size_t ChunkCipher::open(uint8_t *data, std::size_t len,
+                              uint64_t sequence_num, bool is_final) const {
+  if (len < CHUNK_SEAL_ADDITIONAL_BYTES) {
+    throw std::invalid_argument("ChunkCipher: Ciphertext chunk too small");
+  }
+
+  const ChunkNonce nonce = make_chunk_nonce(sequence_num, is_final);
+  unsigned long long out_len_raw = 0;
+
+  if (crypto_aead_xchacha20poly1305_ietf_decrypt(
+          data, &out_len_raw, nullptr, data,
+          static_cast<unsigned long long>(len), nonce.data(), CHUNK_AD_SIZE,
+          nonce.data(), subkey_.data()) != 0) {
+    throw std::runtime_error(
+        "ChunkCipher: Authentication failed or corrupt chunk");
+  }
+
+  if (out_len_raw != (len - CHUNK_SEAL_ADDITIONAL_BYTES)) {
+    throw std::runtime_error("Decryption output bad length");
+  }
+
+  return static_cast<std::size_t>(out_len_raw);
+}
+
 // public crypto functions
 
 void init_sodium() {
@@ -150,37 +240,225 @@ void init_sodium() {
 }
 
 std::pair<Nonce, std::array<uint8_t, HANDSHAKE_CIPHERTEXT_SIZE>>
-encrypt_handshake_tag(const Key &key) {
+encrypt_handshake_tag(const Key &key, CipherMode cipher_mode) {
   Nonce nonce;
 
+  std::array<uint8_t, HANDSHAKE_PLAINTEXT_SIZE> plaintext;
+  std::memcpy(plaintext.data(), HANDSHAKE_TAG_LITERAL, HANDSHAKE_TAG_SIZE);
+  plaintext[HANDSHAKE_TAG_SIZE] = static_cast<uint8_t>(cipher_mode);
+
   // ciphertext length is the size of the handshake + the libsodium MAC tag
   std::array<uint8_t, HANDSHAKE_CIPHERTEXT_SIZE> ciphertext;
 
-  if (crypto_secretbox_easy(
-          ciphertext.data(),
-          reinterpret_cast<const uint8_t *>(HANDSHAKE_TAG_LITERAL),
-          HANDSHAKE_TAG_SIZE, nonce.data(), key.data()) != 0) {
+  if (crypto_secretbox_easy(ciphertext.data(), plaintext.data(),
+                            plaintext.size(), nonce.data(),
+                            key.data()) != 0) {
     throw std::runtime_error("Failed to encrypt handshake tag");
   }
 
   return {std::move(nonce), std::move(ciphertext)};
 }
 
-bool verify_handshake_tag(
+std::optional<CipherMode> verify_handshake_tag(
     const Key &key, const Nonce &nonce,
     const std::array<uint8_t, HANDSHAKE_CIPHERTEXT_SIZE> &ciphertext) {
 
-  std::array<uint8_t, HANDSHAKE_TAG_SIZE> decrypted;
+  std::array<uint8_t, HANDSHAKE_PLAINTEXT_SIZE> decrypted;
 
   if (crypto_secretbox_open_easy(decrypted.data(), ciphertext.data(),
                                  ciphertext.size(), nonce.data(),
                                  key.data()) != 0) {
-    return false; // authentication failed (tampered or wrong key)
+    return std::nullopt; // authentication failed (tampered or wrong key)
   }
 
   // Compare decrypted value with expected tag
-  return std::memcmp(decrypted.data(), HANDSHAKE_TAG_LITERAL,
-                     HANDSHAKE_TAG_SIZE) == 0;
+  if (std::memcmp(decrypted.data(), HANDSHAKE_TAG_LITERAL,
+                  HANDSHAKE_TAG_SIZE) != 0) {
+    return std::nullopt;
+  }
+
+  // Only accept modes this build knows how to decrypt
+  uint8_t mode_byte = decrypted[HANDSHAKE_TAG_SIZE];
+  switch (static_cast<CipherMode>(mode_byte)) {
+  case CipherMode::STREAM:
+  case CipherMode::CHUNKED:
+  case CipherMode::PLAINTEXT:
+    return static_cast<CipherMode>(mode_byte);
+  }
+  return std::nullopt;
+}
+
+std::vector<uint8_t> seal_message(const Key &key,
+                                  const std::vector<uint8_t> &message,
+                                  const uint8_t *ad, std::size_t ad_len) {
+  std::vector<uint8_t> sealed(message.size() + MESSAGE_SEAL_ADDITIONAL_BYTES);
+  randombytes_buf(sealed.data(), MESSAGE_NONCE_SIZE);
+  unsigned long long sealed_len = 0;
+  if (crypto_aead_xchacha20poly1305_ietf_encrypt(
+          sealed.data() + MESSAGE_NONCE_SIZE, &sealed_len, message.data(),
+          message.size(), ad, ad_len, nullptr, sealed.data(),
+          key.data()) != 0) {
+    throw std::runtime_error("Failed to encrypt message");
+  }
+  return sealed;
+}
+
+std::optional<std::vector<uint8_t>>
+open_message(const Key &key, const std::vector<uint8_t> &sealed_message,
+             const uint8_t *ad, std::size_t ad_len) {
+  if (sealed_message.size() < MESSAGE_SEAL_ADDITIONAL_BYTES) {
+    return std::nullopt;
+  }
+  std::vector<uint8_t> message(sealed_message.size() -
+                               MESSAGE_SEAL_ADDITIONAL_BYTES);
+  unsigned long long message_len = 0;
+  if (crypto_aead_xchacha20poly1305_ietf_decrypt(
+          message.data(), &message_len, nullptr,
+          sealed_message.data() + MESSAGE_NONCE_SIZE,
+          sealed_message.size() - MESSAGE_NONCE_SIZE, ad, ad_len,
+          sealed_message.data(), key.data()) != 0) {
+    return std::nullopt;
+  }
+  return message;
+}
+
+std::vector<uint8_t>
+seal_transfer_request(const Key &key,
+                      const std::array<uint8_t, HEADER_SIZE> &session_header,
+                      const std::vector<uint8_t> &request) {
+  return seal_message(key, request, session_header.data(),
+                      session_header.size());
+}
+
+std::optional<std::vector<uint8_t>>
+open_transfer_request(const Key &key,
+                      const std::array<uint8_t, HEADER_SIZE> &session_header,
+                      const std::vector<uint8_t> &sealed_request) {
+  return open_message(key, sealed_request, session_header.data(),
+                      session_header.size());
+}
+
+Key derive_ticket_session_key(
+    const std::array<uint8_t, TICKET_SECRET_SIZE> &ticket_secret,
+    const std::array<uint8_t, SESSION_RANDOM_SIZE> &session_random) {
+  std::vector<uint8_t> message(TICKET_SESSION_CONTEXT,
+                               TICKET_SESSION_CONTEXT +
+                                   sizeof(TICKET_SESSION_CONTEXT) - 1);
+  message.insert(message.end(), session_random.begin(), session_random.end());
+  return Key(keyed_hash(ticket_secret, message));
+}
+
+Key derive_ticket_key(const std::array<uint8_t, KEY_SIZE> &master_key,
+                      const std::string &password) {
+  std::vector<uint8_t> message(TICKET_KEY_CONTEXT,
+                               TICKET_KEY_CONTEXT +
+                                   sizeof(TICKET_KEY_CONTEXT) - 1);
+  message.insert(message.end(), password.begin(), password.end());
+  return Key(keyed_hash(master_key, message));
+}
+
+namespace {
+
+// [context][session header][stream index]
+std::vector<uint8_t>
+stream_token_message(const std::array<uint8_t, HEADER_SIZE> &session_header,
+                     uint8_t stream_index) {
+  std::vector<uint8_t> message(STREAM_TOKEN_CONTEXT,
+                               STREAM_TOKEN_CONTEXT +
+                                   sizeof(STREAM_TOKEN_CONTEXT) - 1);
+  message.insert(message.end(), session_header.begin(), session_header.end());
+  message.push_back(stream_index);
+  return message;
+}
+
+// [context][session header][attempt, little endian]
+std::vector<uint8_t>
+resume_token_message(const std::array<uint8_t, HEADER_SIZE> &session_header,
+                     uint32_t attempt) {
+  std::vector<uint8_t> message(RESUME_TOKEN_CONTEXT,
+                               RESUME_TOKEN_CONTEXT +
+                                   sizeof(RESUME_TOKEN_CONTEXT) - 1);
+  message.insert(message.end(), session_header.begin(), session_header.end());
+  for (int shift = 0; shift < 32; shift += 8) {
+    message.push_back(static_cast<uint8_t>(attempt >> shift));
+  }
+  return message;
+}
+
+// [context][session header]
+std::vector<uint8_t> datagram_token_message(
+    const std::array<uint8_t, HEADER_SIZE> &session_header) {
+  std::vector<uint8_t> message(DATAGRAM_TOKEN_CONTEXT,
+                               DATAGRAM_TOKEN_CONTEXT +
+                                   sizeof(DATAGRAM_TOKEN_CONTEXT) - 1);
+  message.insert(message.end(), session_header.begin(), session_header.end());
+  return message;
+}
+
+} // anonymous namespace
+
+std::array<uint8_t, STREAM_TOKEN_SIZE>
+make_stream_token(const Key &key,
+                  const std::array<uint8_t, HEADER_SIZE> &session_header,
+                  uint8_t stream_index) {
+  std::vector<uint8_t> message =
+      stream_token_message(session_header, stream_index);
+  std::array<uint8_t, STREAM_TOKEN_SIZE> token;
+  if (crypto_auth(token.data(), message.data(), message.size(), key.data()) !=
+      0) {
+    throw std::runtime_error("Failed to create stream token");
+  }
+  return token;
+}
+
+bool verify_stream_token(
+    const Key &key, const std::array<uint8_t, HEADER_SIZE> &session_header,
+    uint8_t stream_index, const std::array<uint8_t, STREAM_TOKEN_SIZE> &token) {
+  std::vector<uint8_t> message =
+      stream_token_message(session_header, stream_index);
+  return crypto_auth_verify(token.data(), message.data(), message.size(),
+                            key.data()) == 0;
+}
+
+std::array<uint8_t, RESUME_TOKEN_SIZE>
+make_resume_token(const Key &key,
+                  const std::array<uint8_t, HEADER_SIZE> &session_header,
+                  uint32_t attempt) {
+  std::vector<uint8_t> message = resume_token_message(session_header, attempt);
+  std::array<uint8_t, RESUME_TOKEN_SIZE> token;
+  if (crypto_auth(token.data(), message.data(), message.size(), key.data()) !=
+      0) {
+    throw std::runtime_error("Failed to create resume token");
+  }
+  return token;
+}
+
+bool verify_resume_token(
+    const Key &key, const std::array<uint8_t, HEADER_SIZE> &session_header,
+    uint32_t attempt, const std::array<uint8_t, RESUME_TOKEN_SIZE> &token) {
+  std::vector<uint8_t> message = resume_token_message(session_header, attempt);
+  return crypto_auth_verify(token.data(), message.data(), message.size(),
+                            key.data()) == 0;
+}
+
+std::array<uint8_t, DATAGRAM_TOKEN_SIZE>
+make_datagram_token(const Key &key,
+                    const std::array<uint8_t, HEADER_SIZE> &session_header) {
+  std::vector<uint8_t> message = datagram_token_message(session_header);
+  std::array<uint8_t, DATAGRAM_TOKEN_SIZE> token;
+  if (crypto_auth(token.data(), message.data(), message.size(), key.data()) !=
+      0) {
+    throw std::runtime_error("Failed to create datagram token");
+  }
+  return token;
+}
+
+bool verify_datagram_token(
+    const Key &key, const std::array<uint8_t, HEADER_SIZE> &session_header,
+    const std::array<uint8_t, DATAGRAM_TOKEN_SIZE> &token) {
+  std::vector<uint8_t> message = datagram_token_message(session_header);
+  return crypto_auth_verify(token.data(), message.data(), message.size(),
+                            key.data()) == 0;
 }
 
 } // namespace crypto
@@ -1,14 +1,251 @@
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <optional>
 #include <string>
 #include <vector>
 
 #include "Receiver.h"
 #include "Sender.h"
+#include "TransferRequest.h"
 #include "crypto.h"
 #include "staging.h"
 #include "utils.h"
 
+// Removes "--name value" from args and returns the value, if the option was
+// passed. Exits if the option is missing its value
+std::optional<std::string> take_option(std::vector<std::string> &args,
+                                       const std::string &name) {
+  auto it = std::find(args.begin(), args.end(), name);
+  if (it == args.end()) {
+    return std::nullopt;
+  }
+  if (std::next(it) == args.end()) {
+    std::cerr << "trit: option '" << name << "' requires a value.\n";
+    exit(1);
+  }
+  std::string value = *std::next(it);
+  args.erase(it, std::next(it, 2));
+  return value;
+}
+
+// Removes the flag "--name" from args and returns whether it was passed
+bool take_flag(std::vector<std::string> &args, const std::string &name) {
+  auto it = std::find(args.begin(), args.end(), name);
+  if (it == args.end()) {
+    return false;
+  }
+  args.erase(it);
+  return true;
+}
+
+// Exits if any unrecognized option is left in args
+void reject_unknown_options(const std::vector<std::string> &args) {
+  for (const auto &arg : args) {
+    if (arg.rfind("--", 0) == 0) {
+      std::cerr << "trit: unknown option '" << arg << "'\n";
+      exit(1);
+    }
+  }
+}
+
+// Removes "--name <n>" from args and returns n. Exits unless 1 <= n <= max
+std::optional<unsigned int> take_thread_count(std::vector<std::string> &args,
+                                              const std::string &name,
+                                              uint64_t max) {
+  std::optional<std::string> value_opt = take_option(args, name);
+  if (!value_opt) {
+    return std::nullopt;
+  }
+  std::optional<uint64_t> threads_opt = utils::parse_unsigned(*value_opt);
+  if (!threads_opt || *threads_opt == 0 || *threads_opt > max) {
+    std::cerr << "trit: " << name << " must be between 1 and " << max << "\n";
+    exit(1);
+  }
+  return static_cast<unsigned int>(*threads_opt);
+}
+
+// Socket options are accepted by both send and receive
+SocketOptions take_socket_options(std::vector<std::string> &args) {
+  SocketOptions options;
+
+  if (auto value_opt = take_option(args, "--socket-buffer")) {
+    if (*value_opt == "auto") {
+      options.auto_buffer_size = true;
+    } else {
+      constexpr uint64_t MIN_SOCKET_BUFFER = 4 * 1024;
+      constexpr uint64_t MAX_SOCKET_BUFFER = 1024 * 1024 * 1024;
+      std::optional<uint64_t> size_opt = utils::parse_data_size(*value_opt);
+      if (!size_opt || *size_opt < MIN_SOCKET_BUFFER ||
+          *size_opt > MAX_SOCKET_BUFFER) {
+        std::cerr << "trit: --socket-buffer must be 'auto' or between "
+                  << MIN_SOCKET_BUFFER / 1024 << "K and "
+                  << MAX_SOCKET_BUFFER / (1024 * 1024) << "M\n";
+        exit(1);
+      }
+      options.send_buffer_size = static_cast<std::size_t>(*size_opt);
+      options.receive_buffer_size = static_cast<std::size_t>(*size_opt);
+    }
+  }
+
+  if (auto value_opt = take_option(args, "--link-rate")) {
+    constexpr uint64_t MAX_LINK_RATE_MBITS = 10'000'000;
+    std::optional<uint64_t> rate_opt = utils::parse_unsigned(*value_opt);
+    if (!rate_opt || *rate_opt == 0 || *rate_opt > MAX_LINK_RATE_MBITS) {
+      std::cerr << "trit: --link-rate must be between 1 and "
+                << MAX_LINK_RATE_MBITS << " Mbit/s\n";
+      exit(1);
+    }
+    options.link_rate = *rate_opt * 1'000'000 / 8;
+  }
+
+  if (auto value_opt = take_option(args, "--congestion")) {
+    // Longest algorithm name the kernel accepts, TCP_CA_NAME_MAX - 1
+    constexpr std::size_t MAX_CONGESTION_NAME = 15;
+    if (value_opt->empty() || value_opt->size() > MAX_CONGESTION_NAME) {
+      std::cerr << "trit: --congestion must name an algorithm such as bbr\n";
+      exit(1);
+    }
+    options.congestion_control = *value_opt;
+  }
+
+  if (auto value_opt = take_option(args, "--inject-loss")) {
+    constexpr uint64_t MAX_LOSS_PERCENT = 100;
+    std::optional<uint64_t> percent_opt = utils::parse_unsigned(*value_opt);
+    if (!percent_opt || *percent_opt > MAX_LOSS_PERCENT) {
+      std::cerr << "trit: --inject-loss must be between 0 and "
+                << MAX_LOSS_PERCENT << " percent\n";
+      exit(1);
+    }
+    options.datagram_loss_rate = static_cast<double>(*percent_opt) / 100;
+  }
+
+  options.no_delay = !take_flag(args, "--no-nodelay");
+  options.keep_alive = take_flag(args, "--keepalive");
+  options.cork_batches = take_flag(args, "--cork");
+  return options;
+}
+
+SendOptions take_send_options(std::vector<std::string> &args) {
+  constexpr uint64_t MAX_THREADS = 256;
+  SendOptions options;
+  options.socket_options = take_socket_options(args);
+
+  options.encryption_threads =
+      take_thread_count(args, "--encryption-threads", MAX_THREADS)
+          .value_or(options.encryption_threads);
+  options.compression_threads =
+      take_thread_count(args, "--compression-threads", MAX_THREADS)
+          .value_or(options.compression_threads);
+
+  options.streams = take_thread_count(args, "--streams", MAX_STREAMS)
+                        .value_or(options.streams);
+
+  options.compress = take_flag(args, "--compress");
+  options.encrypt = !take_flag(args, "--no-encrypt");
+  options.session_tickets = !take_flag(args, "--no-ticket");
+  options.mapped_reads = take_flag(args, "--mmap");
+  if (auto value_opt = take_option(args, "--page-cache")) {
+    if (*value_opt == "drop") {
+      options.page_cache = PageCacheMode::DROP;
+    } else if (*value_opt == "direct") {
+      options.page_cache = PageCacheMode::DIRECT;
+    } else if (*value_opt != "keep") {
+      std::cerr << "trit: --page-cache must be keep, drop or direct\n";
+      exit(1);
+    }
+    if (options.mapped_reads && options.page_cache != PageCacheMode::KEEP) {
+      std::cerr << "trit: --mmap reads through the page cache, without "
+                   "--page-cache drop or direct\n";
+      exit(1);
+    }
+  }
+  options.udp = take_flag(args, "--udp");
+  if (options.udp && options.streams > 1) {
+    std::cerr << "trit: --udp sends over a single connection, without "
+                 "--streams\n";
+    exit(1);
+  }
+
+  if (auto value_opt = take_option(args, "--chunk-size")) {
+    std::optional<uint64_t> size_opt = utils::parse_data_size(*value_opt);
+    if (!size_opt || *size_opt < MIN_CHUNK_SIZE || *size_opt > MAX_CHUNK_SIZE) {
+      std::cerr << "trit: --chunk-size must be between "
+                << MIN_CHUNK_SIZE / 1024 << "K and "
+                << MAX_CHUNK_SIZE / (1024 * 1024) << "M\n";
+      exit(1);
+    }
+    options.chunk_size = static_cast<uint32_t>(*size_opt);
+  }
+
+  if (auto value_opt = take_option(args, "--batch-size")) {
+    constexpr uint64_t MAX_BATCH_SIZE = 64 * 1024 * 1024;
+    std::optional<uint64_t> size_opt = utils::parse_data_size(*value_opt);
+    if (!size_opt || *size_opt > MAX_BATCH_SIZE) {
+      std::cerr << "trit: --batch-size must be between 0 and "
+                << MAX_BATCH_SIZE / (1024 * 1024) << "M\n";
+      exit(1);
+    }
+    options.batch_limits.max_bytes = static_cast<std::size_t>(*size_opt);
+  }
+
+  if (auto value_opt = take_option(args, "--batch-hold")) {
+    constexpr uint64_t MAX_BATCH_HOLD_US = 1'000'000;
+    std::optional<uint64_t> hold_opt = utils::parse_unsigned(*value_opt);
+    if (!hold_opt || *hold_opt > MAX_BATCH_HOLD_US) {
+      std::cerr << "trit: --batch-hold must be between 0 and "
+                << MAX_BATCH_HOLD_US << " microseconds\n";
+      exit(1);
+    }
+    options.batch_limits.max_hold = std::chrono::microseconds(*hold_opt);
+  }
+
+  if (auto value_opt = take_option(args, "--zero-copy")) {
+    std::optional<uint64_t> size_opt = utils::parse_data_size(*value_opt);
+    if (!size_opt || *size_opt > MAX_CHUNK_SIZE) {
+      std::cerr << "trit: --zero-copy must be between 0 and "
+                << MAX_CHUNK_SIZE / (1024 * 1024) << "M\n";
+      exit(1);
+    }
+    options.zero_copy_threshold = static_cast<std::size_t>(*size_opt);
+  }
+
+  if (auto value_opt = take_option(args, "--rate-limit")) {
+    std::optional<uint64_t> rate_opt = utils::parse_data_size(*value_opt);
+    if (!rate_opt) {
+      std::cerr << "trit: --rate-limit must be a size per second, e.g. 20M\n";
+      exit(1);
+    }
+    options.rate_limit = *rate_opt;
+  }
+
+  if (auto value_opt = take_option(args, "--rate-burst")) {
+    constexpr uint64_t MIN_RATE_BURST = 4 * 1024;
+    std::optional<uint64_t> burst_opt = utils::parse_data_size(*value_opt);
+    if (!burst_opt || *burst_opt < MIN_RATE_BURST) {
+      std::cerr << "trit: --rate-burst must be at least "
+                << MIN_RATE_BURST / 1024 << "K\n";
+      exit(1);
+    }
+    options.rate_burst = *burst_opt;
+  }
+
+  if (auto value_opt = take_option(args, "--retransmit-window")) {
+    constexpr uint64_t MAX_RETRANSMIT_WINDOW = 1024 * 1024 * 1024;
+    std::optional<uint64_t> size_opt = utils::parse_data_size(*value_opt);
+    if (!size_opt || *size_opt > MAX_RETRANSMIT_WINDOW) {
+      std::cerr << "trit: --retransmit-window must be between 0 and "
+                << MAX_RETRANSMIT_WINDOW / (1024 * 1024 * 1024) << "G\n";
+      exit(1);
+    }
+    options.retransmit_window = static_cast<std::size_t>(*size_opt);
+  }
+
+  reject_unknown_options(args);
+  return options;
+}
+
 void handle_add(const std::vector<std::string> &args) {
   if (args.size() < 1) {
     std::cerr << "trit: 'add' requires at least one file pattern.\n";
@@ -46,13 +283,23 @@ void handle_help(const std::vector<std::string> &args) {
   staging::help();
 }
 
-void handle_send(const std::vector<std::string> &args) {
+void handle_send(const std::vector<std::string> &command_args) {
   LOG("handling send command");
 
+  std::vector<std::string> args = command_args;
+  SendOptions options = take_send_options(args);
+
   if (args.size() != 2 && args.size() != 3) {
     std::cerr
         << "trit: 'send' requires an ip, port, and optionally a password.\n";
-    std::cout << "usage: trit send <ip> <port> [password]\n";
+    std::cout << "usage: trit send <ip> <port> [password] [--compress] "
+                 "[--compression-threads <n>] [--encryption-threads <n>] "
+                 "[--chunk-size <size>] [--batch-size <size>] "
+                 "[--batch-hold <us>] [--streams <n>] [--mmap] "
+                 "[--page-cache <keep|drop|direct>] [--no-encrypt] "
+                 "[--no-ticket] [--zero-copy <size>] [--rate-limit <size>] "
+                 "[--rate-burst <size>] [--retransmit-window <size>] "
+                 "[--udp] [socket options]\n";
     exit(1);
   }
 
@@ -76,21 +323,20 @@ void handle_send(const std::vector<std::string> &args) {
   crypto::init_sodium();
   LOG("initialized sodium");
 
-  crypto::Salt salt;
-  crypto::Key key(password, salt);
-
   // LOG("password=" + password);
-  // LOG("salt=" + utils::buffer_to_hex_string(salt.data(), salt.size()));
-  // LOG("key=" + utils::buffer_to_hex_string(key.data(), key.size()));
 
   LOG(std::string("sending to ") + ip + ":" + port_str);
-  Sender sender(ip, port, key, salt);
+  Sender sender(ip, port, password, options);
   sender.start_session();
 }
 
-void handle_receive(const std::vector<std::string> &args) {
+void handle_receive(const std::vector<std::string> &command_args) {
   LOG("handling receive command");
 
+  std::vector<std::string> args = command_args;
+  SocketOptions socket_options = take_socket_options(args);
+  reject_unknown_options(args);
+
   /*
       Tried to pick a port number that was unreserved, unlikely to be used by
      other applications, and easy to type. Found an interesting website to
@@ -109,7 +355,7 @@ void handle_receive(const std::vector<std::string> &args) {
 
   if (args.size() > 1) {
     std::cerr << "trit: 'receive' only optionally takes a password.\n";
-    std::cout << "usage: trit receive [password]\n";
+    std::cout << "usage: trit receive [password] [socket options]\n";
     exit(1);
   }
 
@@ -133,7 +379,7 @@ void handle_receive(const std::vector<std::string> &args) {
   LOG("initialized sodium");
 
   LOG(std::string("receiving on port ") + std::to_string(port));
-  Receiver receiver(*local_ip, port, password);
+  Receiver receiver(*local_ip, port, password, socket_options);
   receiver.start_session();
 }
 
@@ -355,8 +355,85 @@ void help() {
                "request to a receiver\n";
   std::cout << "  trit receive [password]             Start listening for "
                "incoming file transfers\n\n";
-  std::cout
-      << "  trit help                           Display this help message\n";
+  std::cout << "  trit help                           Display this help "
+               "message\n\n";
+
+  std::cout << "Send options:\n";
+  std::cout << "  --batch-hold <us>         Longest wait for more chunks "
+               "before a partial\n"
+               "                            batch is sent (default: 500)\n";
+  std::cout << "  --batch-size <size>       Bytes of chunks coalesced into one "
+               "socket write\n"
+               "                            (default: 1M, 0 sends chunks one "
+               "by one)\n";
+  std::cout << "  --compress                Compress chunks before encryption, "
+               "skipping data\n"
+               "                            that does not compress well\n";
+  std::cout << "  --compression-threads <n> Compress chunks on n threads "
+               "(with --compress)\n";
+  std::cout << "  --chunk-size <size>       Chunk size from 64K to 4M "
+               "(default: chosen from\n"
+               "                            the staged file sizes)\n";
+  std::cout << "  --encryption-threads <n>  Encrypt chunks on n threads "
+               "(chunks are sealed\n"
+               "                            independently when n > 1)\n";
+  std::cout << "  --mmap                    Read files through memory mappings "
+               "instead of read()\n";
+  std::cout << "  --no-encrypt              Send file data unencrypted, for "
+               "trusted networks only\n"
+               "                            (uncompressed transfers over one "
+               "connection use\n"
+               "                            sendfile/splice)\n";
+  std::cout << "  --page-cache <mode>       keep, drop (drop pages behind the "
+               "reads) or direct\n"
+               "                            (read with O_DIRECT) "
+               "(default: keep)\n";
+  std::cout << "  --no-ticket               Hash the password instead of using "
+               "the session ticket\n"
+               "                            of an earlier transfer, and keep "
+               "no new one\n";
+  std::cout << "  --rate-burst <size>       Bytes the rate limit lets out at "
+               "once (default:\n"
+               "                            20 ms worth of the rate)\n";
+  std::cout << "  --rate-limit <size>       Cap the bytes sent per second, "
+               "adjustable during\n"
+               "                            the transfer in .trit/rate_limit "
+               "(default: none)\n";
+  std::cout << "  --retransmit-window <size> Keep size bytes of sent chunks to "
+               "resume after a lost\n"
+               "                            connection (default: 64M, 0 "
+               "turns resuming off)\n";
+  std::cout << "  --streams <n>             Stripe chunks across n connections "
+               "(default: 1)\n";
+  std::cout << "  --udp                     Send chunks over UDP with its own "
+               "congestion control\n"
+               "                            and selective retransmission "
+               "(one connection,\n"
+               "                            not resumable)\n";
+  std::cout << "  --zero-copy <size>        Send batches of chunks of at least "
+               "size bytes with\n"
+               "                            MSG_ZEROCOPY (default: 0, "
+               "always copy)\n\n";
+
+  std::cout << "Socket options (send and receive):\n";
+  std::cout << "  --congestion <name>       TCP congestion control algorithm, "
+               "e.g. bbr\n";
+  std::cout << "  --cork                    Cork the socket while a batch of "
+               "chunks is written\n";
+  std::cout << "  --inject-loss <percent>   Drop this share of outgoing UDP "
+               "datagrams, for\n"
+               "                            testing --udp (default: 0)\n";
+  std::cout << "  --keepalive               Send TCP keepalive probes on idle "
+               "connections\n";
+  std::cout << "  --link-rate <Mbit/s>      Path bandwidth for "
+               "--socket-buffer auto\n"
+               "                            (default: 10000)\n";
+  std::cout << "  --no-nodelay              Leave Nagle's algorithm on\n";
+  std::cout << "  --socket-buffer <size>    Send and receive buffer size, or "
+               "'auto' to size\n"
+               "                            them to the bandwidth-delay "
+               "product (default:\n"
+               "                            kernel autotuning)\n\n";
 
   std::cout << "File pattern syntax:\n";
   std::cout << "  *.ext           Matches all files with the given extension "
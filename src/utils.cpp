@@ -1,7 +1,10 @@
 
 #include <asio.hpp>
+#include <cctype>
 #include <chrono>
 #include <cmath>
+#include <cstring>
+#include <ctime>
 #include <filesystem>
 #include <fstream>
 #include <iomanip>
@@ -44,6 +47,45 @@ bool is_valid_port(const std::string &port_str) {
   return (port_ul >= 49152) && (port_ul <= 65535);
 }
 
+std::optional<uint64_t> parse_unsigned(const std::string &str) {
+  if (str.empty() || !std::all_of(str.begin(), str.end(), ::isdigit)) {
+    return std::nullopt;
+  }
+
+  // Catch if stoull throws error from value being too large
+  try {
+    return std::stoull(str);
+  } catch (const std::exception &) {
+    return std::nullopt;
+  }
+}
+
+std::optional<uint64_t> parse_data_size(const std::string &str) {
+  if (str.empty()) {
+    return std::nullopt;
+  }
+
+  int shift = 0;
+  switch (std::toupper(static_cast<unsigned char>(str.back()))) {
+  case 'K':
+    shift = 10;
+    break;
+  case 'M':
+    shift = 20;
+    break;
+  case 'G':
+    shift = 30;
+    break;
+  }
+
+  std::optional<uint64_t> value_opt =
+      parse_unsigned(shift == 0 ? str : str.substr(0, str.size() - 1));
+  if (!value_opt || *value_opt > (UINT64_MAX >> shift)) {
+    return std::nullopt;
+  }
+  return *value_opt << shift;
+}
+
 // Trick to get local IP address by creating a UDP socket and connecting to a
 // remote endpoint (Google DNS)
 std::optional<std::string> get_local_ipv4_address() {
@@ -254,6 +296,14 @@ void log(const std::string &message) {
   ofs.flush(); // forces write in case of crash
 }
 
+std::chrono::nanoseconds thread_cpu_time() {
+  timespec ts{};
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+    return std::chrono::nanoseconds(0);
+  }
+  return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+}
+
 std::filesystem::path relative_to_cwd(const std::filesystem::path &path) {
   static auto cwd = std::filesystem::current_path();
   return std::filesystem::relative(path, cwd);
@@ -281,4 +331,8 @@ std::string str_join(const std::vector<std::string> &strings,
   return oss.str();
 }
 
+std::runtime_error system_failure(const std::string &what, int error) {
+  return std::runtime_error(what + ": " + std::strerror(error));
+}
+
 } // namespace utils
\ No newline at end of file